@@ -17,20 +17,6 @@
 
 #include "AudioFileStream.h"
 
-// only one of these can actively read/decode a file, so it's fine
-// if we have these variables shared between instances
-char Mp3FileStream::fileReadBuffer_[Mp3FileStream::fileReadBufferSize_];
-char* Mp3FileStream::fileReadBufferTailPtr_;
-int Mp3FileStream::fileReadBufferNumBytesLeft_;
-MP3FrameInfo Mp3FileStream::mp3FrameInfo_;
-HMP3Decoder Mp3FileStream::mp3Decoder_;
-int16_t Mp3FileStream::audioBuffer_[Mp3FileStream::audioBufferSize_];
-int Mp3FileStream::audioBufferTail_;
-int Mp3FileStream::currentSampleRate_;
-int Mp3FileStream::numSamplesPlayed_;
-FixedSizeStr<128> Mp3FileStream::artist_;
-FixedSizeStr<128> Mp3FileStream::title_;
-
 /*
  * Taken from
  * http://www.mikrocontroller.net/topic/252319
@@ -38,9 +24,11 @@ FixedSizeStr<128> Mp3FileStream::title_;
 int Mp3FileStream::mp3ReadId3V2Text(File& file, uint32_t unDataLen, char* pszBuffer, uint32_t unBufferSize)
 {
     uint32_t unRead = 0;
-    char byEncoding = 0;
-    if (file.tryRead(&byEncoding, 1, unRead) && (unRead == 1))
+    // File::tryRead() adds a terminating zero
+    char encoding[1 + 1];
+    if (file.tryRead(encoding, 1, unRead) && (unRead == 1))
     {
+        const char byEncoding = encoding[0];
         unDataLen--;
         if (unDataLen <= (unBufferSize - 1))
         {
@@ -57,7 +45,7 @@ int Mp3FileStream::mp3ReadId3V2Text(File& file, uint32_t unDataLen, char* pszBuf
                     // UTF16LE unicode
                     uint32_t r = 0;
                     uint32_t w = 0;
-                    if ((unDataLen > 2) && (pszBuffer[0] == 0xFF) && (pszBuffer[1] == 0xFE))
+                    if ((unDataLen > 2) && (uint8_t(pszBuffer[0]) == 0xFF) && (uint8_t(pszBuffer[1]) == 0xFE))
                     {
                         // ignore BOM, assume LE
                         r = 2;
@@ -98,7 +86,8 @@ int Mp3FileStream::mp3ReadId3V2Tag(File& file, char* pszArtist, uint32_t unArtis
     pszArtist[0] = 0;
     pszTitle[0] = 0;
 
-    char id3hd[10];
+    // File::tryRead() adds a terminating zero
+    char id3hd[10 + 1];
     uint32_t unRead = 0;
     if (!file.tryRead(id3hd, 10, unRead) || (unRead != 10))
         return 1;
@@ -115,7 +104,7 @@ int Mp3FileStream::mp3ReadId3V2Tag(File& file, char* pszArtist, uint32_t unArtis
             uint8_t unVersion = id3hd[3];
             if (id3hd[5] & 0x40)
             {
-                char exhd[4];
+                char exhd[4 + 1];
                 file.tryRead(exhd, 4, unRead);
                 size_t unExHdrSkip = ((exhd[0] & 0x7f) << 21) | ((exhd[1] & 0x7f) << 14) | ((exhd[2] & 0x7f) << 7) | (exhd[3] & 0x7f);
                 unExHdrSkip -= 4;
@@ -125,7 +114,7 @@ int Mp3FileStream::mp3ReadId3V2Tag(File& file, char* pszArtist, uint32_t unArtis
             uint32_t nFramesToRead = 2;
             while (nFramesToRead > 0)
             {
-                char frhd[10];
+                char frhd[10 + 1];
                 if (!file.tryRead(frhd, 10, unRead) || (unRead != 10))
                     return 1;
                 if ((frhd[0] == 0) || (strncmp(frhd, "3DI", 3) == 0))
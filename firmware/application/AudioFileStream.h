@@ -19,6 +19,11 @@
 
 #include "AudioStreamPlayer.h"
 #include "File.h"
+#include "FileReadAheadBuffer.h"
+#include "GaplessTrimmer.h"
+#include "Mp3FrameHeader.h"
+#include "Mp3SeekIndex.h"
+#include "Profiler.h"
 
 extern "C"
 {
@@ -26,12 +31,36 @@ extern "C"
 #include "string.h"
 }
 
+/**
+ *  @brief  Decodes an mp3 file. Each instance has its own decoder state, so that
+ *          the next file can be opened and primed while the current one is still
+ *          playing. The encoder delay and padding from a LAME/Xing header are
+ *          removed so that consecutive files play back without a gap.
+ */
 class Mp3FileStream : public StereoAudioSampleStream
 {
 public:
     Mp3FileStream() :
+        mp3Decoder_(nullptr),
+        audioBufferTail_(0),
+        audioBufferEnd_(0),
+        currentSampleRate_(0),
+        numSamplesPlayed_(0),
+        numSampleFramesToSkip_(0),
+        numSampleFramesToPlay_(0),
+        nextFrameIndex_(0),
+        firstFrameToPlay_(0),
+        isFrameIndexExact_(true),
+        isResyncing_(false),
+        numSamplesPlayedAtSeek_(0),
+        isScanningFrames_(false),
+        scanFrameIndex_(0),
+        scanPosition_(0),
+        lastCountedFrameIndex_(0),
+        lastCountedFramePosition_(0),
         isStreamInUse_(false)
     {
+        memset(&mp3FrameInfo_, 0, sizeof(mp3FrameInfo_));
     }
 
     Mp3FileStream(const Mp3FileStream&) = delete;
@@ -40,12 +69,86 @@ public:
         tearDownStream();
     }
 
+    /** Returns the position of the playback. After a seek to an estimated position,
+     *  this is the time that was sought to, until the frame headers were counted
+     *  up to the position (see scanFrameHeaders()). */
     float getNumSecondsPlayed() const
     {
         if (currentSampleRate_ <= 0)
             return 0.0f;
 
-        return float(numSamplesPlayed_) / float(currentSampleRate_);
+        // two interleaved samples per sample frame
+        const int numSamplesPlayed = isFrameIndexExact_ ? numSamplesPlayed_ : numSamplesPlayedAtSeek_;
+        return float(numSamplesPlayed / 2) / float(currentSampleRate_);
+    }
+
+    /** Continues playback at `seconds` into the file. The position of the frame is
+     *  taken from the Mp3SeekIndex, so this doesn't read the file (apart from the sector
+     *  at the new position) and returns well within the period of a DMA block. The
+     *  frames are read and decoded by the following calls to fillBuffer(). If the
+     *  position is an estimate, the following calls also count the frame headers from
+     *  the last exactly known frame until they reach the position.
+     *  Returns false if the stream isn't playing or `seconds` is past its end. */
+    bool seekToSeconds(float seconds)
+    {
+        if (!isStreamInUse_ || (firstFrameHeader_.sampleRate <= 0) || (seconds < 0.0f))
+            return false;
+
+        // the sample frame to continue with, counted from the first one that's played
+        // and counted in the output of the decoder
+        const uint32_t sampleFrame = uint32_t(seconds * float(firstFrameHeader_.sampleRate));
+        if ((numSampleFramesToPlay_ > 0) && (sampleFrame >= numSampleFramesToPlay_))
+            return false;
+        const uint32_t decodedSampleFrame = sampleFrame + numSampleFramesToSkip_;
+        const uint32_t samplesPerFrame = uint32_t(firstFrameHeader_.samplesPerFrame);
+        const uint32_t targetFrame = decodedSampleFrame / samplesPerFrame;
+
+        // Decoding starts a few frames early: the main data of a frame can start in the
+        // frames before it (the bit reservoir) and the first frame after a decoder reset
+        // lacks the overlap from the previous frame. These frames are decoded, not played.
+        const uint32_t firstFrameToDecode = (targetFrame > numPrerollFrames_) ? targetFrame - numPrerollFrames_ : 0;
+        bool isExact = false;
+        const uint32_t position = seekIndex_.getFramePosition(firstFrameToDecode, isExact);
+        if (!file_.setCursorTo(position))
+        {
+            tearDownStream();
+            return false;
+        }
+        fileReader_.start(file_);
+
+        // the bit reservoir and the overlap of the old position must not be used
+        MP3FreeDecoder(mp3Decoder_);
+        mp3Decoder_ = MP3InitDecoder();
+        if (!mp3Decoder_)
+        {
+            isStreamInUse_ = false;
+            fileReader_.stop();
+            file_.close();
+            return false;
+        }
+        audioBufferTail_ = 0;
+        audioBufferEnd_ = 0;
+
+        nextFrameIndex_ = firstFrameToDecode;
+        firstFrameToPlay_ = targetFrame;
+        // an estimated position may be anywhere in a frame: look for a frame header
+        // and continue the frame numbering from the estimate
+        isResyncing_ = !isExact;
+        isFrameIndexExact_ = isExact;
+        isScanningFrames_ = !isExact;
+        seekIndex_.getLastExactFrame(scanFrameIndex_, scanPosition_);
+        seekIndex_.addFrame(scanFrameIndex_, scanPosition_);
+        // no frame was counted since the seek
+        lastCountedFramePosition_ = UINT32_MAX;
+
+        const uint32_t firstSampleFrameToPlay = decodedSampleFrame - targetFrame * samplesPerFrame;
+        if (numSampleFramesToPlay_ > 0)
+            gaplessTrimmer_.reset(2 * firstSampleFrameToPlay, 2 * (numSampleFramesToPlay_ - sampleFrame));
+        else
+            gaplessTrimmer_.reset(2 * firstSampleFrameToPlay);
+        numSamplesPlayed_ = int(2 * sampleFrame);
+        numSamplesPlayedAtSeek_ = numSamplesPlayed_;
+        return true;
     }
 
     bool isPlaying() const { return isStreamInUse_; }
@@ -69,6 +172,7 @@ public:
 
     int fillBuffer(AudioSampleType* buffer, int bufferSize) override
     {
+        PROFILE_ZONE(mp3FillBuffer);
         // we're not actively used right now, who's calling this function?
         if (!isStreamInUse_)
             return 0;
@@ -80,49 +184,49 @@ public:
 
         while (totalNumSamplesProvided < bufferSize)
         {
+            const auto numSamplesLeftToTransfer = bufferSize - totalNumSamplesProvided;
+
             // are there samples leftover from the last decoding frame?
-            if (audioBufferTail_ < mp3FrameInfo_.outputSamps)
+            if (audioBufferTail_ < audioBufferEnd_)
             {
-                const auto numSamplesLeftInBuffer = mp3FrameInfo_.outputSamps - audioBufferTail_;
-                const auto numSamplesLeftToTransfer = bufferSize - totalNumSamplesProvided;
+                const auto numSamplesLeftInBuffer = audioBufferEnd_ - audioBufferTail_;
                 const auto numSamplesToCopyFromDecodeBuffer = std::min(numSamplesLeftToTransfer, numSamplesLeftInBuffer);
-                int i = numSamplesToCopyFromDecodeBuffer;
-                while (i--)
-                {
-                    *buffer++ = audioBuffer_[audioBufferTail_];
-                    audioBufferTail_++;
-                }
+                memcpy(buffer, &audioBuffer_[audioBufferTail_], size_t(numSamplesToCopyFromDecodeBuffer) * sizeof(AudioSampleType));
+                buffer += numSamplesToCopyFromDecodeBuffer;
+                audioBufferTail_ += numSamplesToCopyFromDecodeBuffer;
                 totalNumSamplesProvided += numSamplesToCopyFromDecodeBuffer;
             }
             else
             {
                 // No samples left from last frame; decode a new frame
 
-                // if the end of the file was reached during the last file
-                // read operation, then we're out of data and there's nothing
-                // left to do.
-                if (isEndOfFileReached_)
+                // if all samples up to the encoder padding were played, then
+                // there's nothing left to do.
+                if (gaplessTrimmer_.isEndReached())
                 {
                     tearDownStream();
                     // return what we have provided so far
                     return totalNumSamplesProvided;
                 }
 
-                // end of file not yet reached, read more.
-                // if the file read buffer becomes too empty, read more from the file
-                if (fileReadBufferNumBytesLeft_ < fileReadBufferSize_ / 2)
+                // keep reading ahead from the file, one small chunk per frame
+                if (!fileReader_.serviceReadRequests() || !scanFrameHeaders())
                 {
-                    if (!refillFileReadBuffer())
-                    {
-                        // stop on file read error
-                        tearDownStream();
-                        // return what we have provided so far
-                        return totalNumSamplesProvided;
-                    }
+                    // stop on file read error
+                    tearDownStream();
+                    // return what we have provided so far
+                    return totalNumSamplesProvided;
                 }
 
-                // decode what we've read from the file.
-                int numSamplesDecoded = decodeNextFrameAndGetNumSamples();
+                // Decode what we've read from the file. If a whole frame fits, it's
+                // decoded straight into the output (e.g. the fifo of the AudioStreamPlayer),
+                // otherwise into the audioBuffer_ and copied from there.
+                const bool isDecodingToOutput = numSamplesLeftToTransfer >= audioBufferSize_;
+                int firstSampleToPlay = 0;
+                int numSamplesToPlay = 0;
+                int numSamplesDecoded = decodeNextFrameAndGetNumSamples(isDecodingToOutput ? buffer : audioBuffer_,
+                                                                        firstSampleToPlay,
+                                                                        numSamplesToPlay);
                 if (numSamplesDecoded <= 0)
                 {
                     // stop on decoding error
@@ -130,12 +234,32 @@ public:
                     // return what we have provided so far
                     return totalNumSamplesProvided;
                 }
+
+                if (isDecodingToOutput)
+                {
+                    // only the first and the last frames of a file are trimmed
+                    if (firstSampleToPlay > 0)
+                        memmove(buffer, buffer + firstSampleToPlay, size_t(numSamplesToPlay) * sizeof(AudioSampleType));
+                    buffer += numSamplesToPlay;
+                    totalNumSamplesProvided += numSamplesToPlay;
+                }
+                else
+                {
+                    audioBufferTail_ = firstSampleToPlay;
+                    audioBufferEnd_ = firstSampleToPlay + numSamplesToPlay;
+                }
             }
         }
 
         return totalNumSamplesProvided;
     }
 
+    void prefetch() override
+    {
+        if (isStreamInUse_)
+            fileReader_.completeReadRequests();
+    }
+
 private:
     void setupStream()
     {
@@ -144,8 +268,17 @@ private:
 
         // setup the decoder
         mp3Decoder_ = MP3InitDecoder();
+        if (!mp3Decoder_)
+            return;
         currentSampleRate_ = 0;
         numSamplesPlayed_ = 0;
+        audioBufferTail_ = 0;
+        audioBufferEnd_ = 0;
+        nextFrameIndex_ = 0;
+        firstFrameToPlay_ = 0;
+        isFrameIndexExact_ = true;
+        isResyncing_ = false;
+        isScanningFrames_ = false;
 
         // open the file
         if (!file_.open(File::AccessMode::read, File::OpenMode::openIfExists))
@@ -155,10 +288,9 @@ private:
             MP3FreeDecoder(mp3Decoder_);
             return;
         }
-
-        isEndOfFileReached_ = false;
-        fileReadBufferTailPtr_ = &fileReadBuffer_[0];
-        fileReadBufferNumBytesLeft_ = 0;
+        // seeks (ID3 tag, Xing frame, ...) shouldn't walk the FAT. If the file
+        // has too many fragments for the map, it's played without fast seek.
+        file_.enableFastSeek(clusterLinkMap_, clusterLinkMapSize_);
 
         // Read ID3v2 Tag
         mp3ReadId3V2Tag(file_, artist_.data(), artist_.maxSize(), title_.data(), title_.maxSize());
@@ -166,58 +298,179 @@ private:
         title_.updateSize(); // update after direct write access to data()
 
         // fill the file read buffer
-        if (!refillFileReadBuffer())
+        isStreamInUse_ = true;
+        fileReader_.start(file_);
+        if (!fileReader_.completeReadRequests())
         {
             tearDownStream();
             return;
         }
 
+        readStreamInfoAndSkipInfoFrame();
+
         // decode the first frame so that the samplerate is accurately reported
-        if (decodeNextFrameAndGetNumSamples() <= 0)
+        int numSamplesToPlay = 0;
+        if (decodeNextFrameAndGetNumSamples(audioBuffer_, audioBufferTail_, numSamplesToPlay) <= 0)
             tearDownStream();
-        else
-            isStreamInUse_ = true;
+        audioBufferEnd_ = audioBufferTail_ + numSamplesToPlay;
     }
 
-    bool refillFileReadBuffer()
+    /** Sets up the seek index from the first frame. If it is a Xing/Info or VBRI frame,
+     *  skips it (it contains no audio), takes the seek table from it and sets up the
+     *  GaplessTrimmer from the encoder delay and padding. */
+    void readStreamInfoAndSkipInfoFrame()
     {
-        // Copy rest of data to the beginning of the read buffer
-        memcpy(fileReadBuffer_, fileReadBufferTailPtr_, fileReadBufferNumBytesLeft_);
-        // Reset read pointer to the start of the buffer
-        fileReadBufferTailPtr_ = fileReadBuffer_;
-
-        // Fill the rest of the buffer with more data from the file
-        uint32_t bytesRead = 0;
-        uint32_t numBytesToRead = fileReadBufferSize_ - fileReadBufferNumBytesLeft_;
-        const bool fileReadResult = file_.tryRead(&fileReadBuffer_[fileReadBufferNumBytesLeft_], numBytesToRead, bytesRead);
-        fileReadBufferNumBytesLeft_ += bytesRead;
-        if (bytesRead < numBytesToRead)
-            isEndOfFileReached_ = true;
-        return fileReadResult;
+        gaplessTrimmer_.reset();
+        seekIndex_.reset();
+        firstFrameHeader_ = Mp3FrameHeader();
+        numSampleFramesToSkip_ = 0;
+        numSampleFramesToPlay_ = 0;
+
+        const auto offset = MP3FindSyncWord((unsigned char*) fileReader_.getReadPointer(), int(fileReader_.getNumContiguousBytes()));
+        if (offset < 0)
+            return;
+        fileReader_.consume(size_t(offset));
+        if (!makeFrameContiguous())
+            return;
+
+        const auto* frame = (const uint8_t*) fileReader_.getReadPointer();
+        const size_t numBytesAvailable = fileReader_.getNumContiguousBytes();
+        Mp3FrameHeader header;
+        if (!header.parse(frame, numBytesAvailable))
+            return;
+        firstFrameHeader_ = header;
+        const auto framePosition = uint32_t(fileReader_.getFilePosition());
+        const auto fileSize = uint32_t(file_.getSize());
+        const auto nextFramePosition = uint32_t(framePosition + header.frameSize);
+
+        Mp3XingHeader xingHeader;
+        Mp3VbriHeader vbriHeader;
+        if (header.frameSize > numBytesAvailable)
+        {
+            seekIndex_.reset(header, framePosition, fileSize);
+            return;
+        }
+        else if (vbriHeader.parse(header, frame, numBytesAvailable))
+        {
+            fileReader_.consume(header.frameSize);
+            seekIndex_.reset(header, nextFramePosition, fileSize);
+            seekIndex_.setSeekTable(vbriHeader.numFrames, vbriHeader.numBytes, vbriHeader.hasToc ? vbriHeader.toc : nullptr, nextFramePosition);
+            return;
+        }
+        else if (!xingHeader.parse(header, frame, numBytesAvailable))
+        {
+            // the first frame is an audio frame
+            seekIndex_.reset(header, framePosition, fileSize);
+            return;
+        }
+
+        // the Xing TOC and the number of bytes include the Xing frame
+        fileReader_.consume(header.frameSize);
+        seekIndex_.reset(header, nextFramePosition, fileSize);
+        seekIndex_.setSeekTable(xingHeader.numFrames, xingHeader.numBytes, xingHeader.hasToc ? xingHeader.toc : nullptr, framePosition);
+
+        if (!xingHeader.hasEncoderDelayAndPadding || (xingHeader.numFrames == 0))
+            return;
+
+        // mono files are duplicated to both channels, so we always count two
+        // samples per sample frame.
+        const uint32_t numSampleFramesDecoded = xingHeader.numFrames * uint32_t(header.samplesPerFrame);
+        const uint32_t numSampleFramesToSkip = uint32_t(xingHeader.encoderDelay) + decoderDelay_;
+        const uint32_t numSampleFramesAdded = uint32_t(xingHeader.encoderDelay + xingHeader.encoderPadding);
+        if (numSampleFramesAdded >= numSampleFramesDecoded)
+            return;
+        numSampleFramesToSkip_ = numSampleFramesToSkip;
+        numSampleFramesToPlay_ = numSampleFramesDecoded - numSampleFramesAdded;
+        gaplessTrimmer_.reset(2 * numSampleFramesToSkip_, 2 * numSampleFramesToPlay_);
+    }
+
+    /** Makes sure that the largest possible frame (and the header of the frame after it)
+     *  is available in one piece in the file read buffer. Blocks until the data was read
+     *  from the file, if required. */
+    bool makeFrameContiguous()
+    {
+        while (!fileReader_.makeContiguous(maxFrameSize_ + Mp3FrameHeader::headerSize))
+        {
+            if (!fileReader_.serviceReadRequests())
+                return false;
+        }
+        return true;
     }
 
-    int decodeNextFrameAndGetNumSamples()
+    /** Decodes the next frame to `output`, which must have space for audioBufferSize_
+     *  samples. Returns the number of samples decoded and which of them must be played. */
+    int decodeNextFrameAndGetNumSamples(int16_t* output, int& firstSampleToPlay, int& numSamplesToPlay)
     {
+        firstSampleToPlay = 0;
+        numSamplesToPlay = 0;
+
         // repeat until a valid frame is found and simply skip all invalid frames
+        uint32_t framePosition = 0;
         while (1)
         {
+            if (!makeFrameContiguous())
+                return 0;
+            const auto numBytesAvailable = int(fileReader_.getNumContiguousBytes());
+            if (numBytesAvailable <= 0)
+                // end of file
+                return 0;
+
             // skip forward to next sync position
-            auto offset = MP3FindSyncWord((unsigned char*) fileReadBufferTailPtr_, fileReadBufferNumBytesLeft_);
+            auto offset = MP3FindSyncWord((unsigned char*) fileReader_.getReadPointer(), numBytesAvailable);
             if (offset < 0)
-                // end of file maybe?
+            {
+                // only the last few bytes of the file are left?
+                if (numBytesAvailable <= 3)
+                    return 0;
+                // no sync word in here; keep the last bytes, they may be the start of one.
+                fileReader_.consume(size_t(numBytesAvailable - 3));
+                continue;
+            }
+            fileReader_.consume(size_t(offset));
+            if (!makeFrameContiguous())
                 return 0;
 
-            fileReadBufferNumBytesLeft_ -= offset;
-            if (fileReadBufferNumBytesLeft_ <= 0)
-                return 0;
-            fileReadBufferTailPtr_ += offset;
+            // after a seek to an estimated position, the sync word may be part of the audio data
+            if (isResyncing_
+                && !firstFrameHeader_.isFrameOfSameStream((const uint8_t*) fileReader_.getReadPointer(),
+                                                          fileReader_.getNumContiguousBytes()))
+            {
+                fileReader_.consume(1);
+                continue;
+            }
+            isResyncing_ = false;
 
             // decode
-            const auto err = MP3Decode(mp3Decoder_,
-                                       (unsigned char**) &fileReadBufferTailPtr_,
-                                       (int*) &fileReadBufferNumBytesLeft_,
-                                       audioBuffer_,
-                                       0);
+            framePosition = uint32_t(fileReader_.getFilePosition());
+            unsigned char* readPtr = (unsigned char*) fileReader_.getReadPointer();
+            const int numBytesBeforeDecoding = int(fileReader_.getNumContiguousBytes());
+            int numBytesLeft = numBytesBeforeDecoding;
+            int err;
+            {
+                PROFILE_ZONE(mp3Decode);
+                err = MP3Decode(mp3Decoder_,
+                                &readPtr,
+                                &numBytesLeft,
+                                output,
+                                0);
+            }
+            fileReader_.consume(size_t(numBytesBeforeDecoding - numBytesLeft));
+            if (err == ERR_MP3_MAINDATA_UNDERFLOW)
+            {
+                // The frame was read, but its main data starts in frames we didn't
+                // decode (after a seek). The next frame will find it in the bit reservoir.
+                countFrame(framePosition);
+                continue;
+            }
+            if ((err == ERR_MP3_INVALID_SCALEFACT) || (err == ERR_MP3_INVALID_HUFFCODES)
+                || (err == ERR_MP3_INVALID_DEQUANTIZE) || (err == ERR_MP3_INVALID_IMDCT)
+                || (err == ERR_MP3_INVALID_SUBBAND))
+            {
+                // The frame was read, but its audio data is broken. The decoder cleared
+                // the output: play it as silence, so that the frame numbering and the
+                // played time stay in step with the file.
+                break;
+            }
             if (err)
             {
                 // error occurred
@@ -226,9 +479,6 @@ private:
                     case ERR_MP3_INDATA_UNDERFLOW:
                         //isStreamInUse_ = false;
                         break;
-                    case ERR_MP3_MAINDATA_UNDERFLOW:
-                        // do nothing - next call to decode will provide more mainData
-                        break;
                     case ERR_MP3_FREE_BITRATE_SYNC:
                     default:
                         // stop reading.
@@ -237,8 +487,8 @@ private:
                 }
 
                 // advance to the next frame
-                fileReadBufferNumBytesLeft_--;
-                fileReadBufferTailPtr_++;
+                if (fileReader_.getNumContiguousBytes() > 0)
+                    fileReader_.consume(1);
             }
             else
                 // this was a valid frame, go on
@@ -246,24 +496,97 @@ private:
         }
 
         // no error
+        const uint32_t frameIndex = countFrame(framePosition);
         MP3GetLastFrameInfo(mp3Decoder_, &mp3FrameInfo_);
         currentSampleRate_ = mp3FrameInfo_.samprate;
 
         // Duplicate data in case of mono to maintain playback speed
         if (mp3FrameInfo_.nChans == 1)
         {
-            for (int i = mp3FrameInfo_.outputSamps; i >= 0; i--)
+            for (int i = mp3FrameInfo_.outputSamps - 1; i >= 0; i--)
             {
-                audioBuffer_[2 * i] = audioBuffer_[i];
-                audioBuffer_[2 * i + 1] = audioBuffer_[i];
+                output[2 * i] = output[i];
+                output[2 * i + 1] = output[i];
             }
             mp3FrameInfo_.outputSamps *= 2;
         }
 
-        audioBufferTail_ = 0;
+        // decoded before the seek target, to fill the bit reservoir: not played
+        if (frameIndex < firstFrameToPlay_)
+            return mp3FrameInfo_.outputSamps;
+
+        gaplessTrimmer_.trim(mp3FrameInfo_.outputSamps, firstSampleToPlay, numSamplesToPlay);
         return mp3FrameInfo_.outputSamps;
     }
 
+    /** Counts a frame that was read by the decoder and returns its index. Records its
+     *  position while the index is known exactly. */
+    uint32_t countFrame(uint32_t framePosition)
+    {
+        const uint32_t frameIndex = nextFrameIndex_++;
+        if (isFrameIndexExact_)
+            seekIndex_.addFrame(frameIndex, framePosition);
+        lastCountedFrameIndex_ = frameIndex;
+        lastCountedFramePosition_ = framePosition;
+        return frameIndex;
+    }
+
+    /** After a seek to an estimated position, counts up to numFramesToScanPerCall_ frame
+     *  headers, starting from the last exactly known frame and following the frame sizes.
+     *  When the count reaches the frame last counted by the decoder, the frame numbering
+     *  and the played time are corrected and the index is exact again. The count stops
+     *  (and the position remains an estimate) if it finds no valid frame header.
+     *  Returns false if the file can't be read any more. */
+    bool scanFrameHeaders()
+    {
+        if (!isScanningFrames_)
+            return true;
+
+        const size_t cursorPosition = file_.getCursorPosition();
+        for (uint32_t i = 0; i < numFramesToScanPerCall_; i++)
+        {
+            if (scanPosition_ == lastCountedFramePosition_)
+            {
+                correctFrameIndex(int32_t(scanFrameIndex_ - lastCountedFrameIndex_));
+                break;
+            }
+            // wait for the decoder to catch up
+            if (scanPosition_ > lastCountedFramePosition_)
+                break;
+
+            // File::tryRead() adds a terminating zero
+            uint8_t headerData[Mp3FrameHeader::headerSize + 1];
+            uint32_t numBytesRead = 0;
+            Mp3FrameHeader header;
+            if (!file_.setCursorTo(scanPosition_)
+                || !file_.tryRead((char*) headerData, Mp3FrameHeader::headerSize, numBytesRead)
+                || !header.parse(headerData, numBytesRead)
+                || (header.version != firstFrameHeader_.version)
+                || (header.sampleRate != firstFrameHeader_.sampleRate))
+            {
+                isScanningFrames_ = false;
+                break;
+            }
+            scanFrameIndex_++;
+            scanPosition_ += uint32_t(header.frameSize);
+            seekIndex_.addFrame(scanFrameIndex_, scanPosition_);
+        }
+        return file_.setCursorTo(cursorPosition);
+    }
+
+    /** Corrects the estimated frame numbering after a seek by `numFrames`, the number of
+     *  frames the decoder actually is ahead of the estimate. */
+    void correctFrameIndex(int32_t numFrames)
+    {
+        const int32_t numSamples = 2 * numFrames * firstFrameHeader_.samplesPerFrame;
+        nextFrameIndex_ = uint32_t(int32_t(nextFrameIndex_) + numFrames);
+        firstFrameToPlay_ = uint32_t(int32_t(firstFrameToPlay_) + numFrames);
+        numSamplesPlayed_ = std::max(numSamplesPlayed_ + numSamples, 0);
+        gaplessTrimmer_.moveEnd(numSamples);
+        isFrameIndexExact_ = true;
+        isScanningFrames_ = false;
+    }
+
     void tearDownStream()
     {
         if (!isStreamInUse_)
@@ -273,8 +596,10 @@ private:
 
         // teardown decoder
         MP3FreeDecoder(mp3Decoder_);
+        mp3Decoder_ = nullptr;
 
         // close file
+        fileReader_.stop();
         file_.close();
     }
 
@@ -292,23 +617,57 @@ private:
         int& source_;
     };
 
-    // only one of these can actively read/decode a file, so it's fine
-    // if we have these variables shared between instances
-    static constexpr int fileReadBufferSize_ = 8192;
-    static char fileReadBuffer_[fileReadBufferSize_];
-    static char* fileReadBufferTailPtr_;
-    static int fileReadBufferNumBytesLeft_;
-    static MP3FrameInfo mp3FrameInfo_;
-    static HMP3Decoder mp3Decoder_;
+    /** The number of samples the decoder itself delays its output by. */
+    static constexpr uint32_t decoderDelay_ = 529;
+    /** The number of frames decoded (and not played) before the target of a seek.
+     *  At common bitrates, they hold the bit reservoir of the target frame. */
+    static constexpr uint32_t numPrerollFrames_ = 2;
+    /** The number of frame headers counted per decoded frame after a seek to an estimated
+     *  position: each one reads a sector, and the count catches up 16 times faster than
+     *  the playback. */
+    static constexpr uint32_t numFramesToScanPerCall_ = 16;
+    /** The largest possible layer III frame: 320kbps at 32kHz, plus padding. */
+    static constexpr size_t maxFrameSize_ = 1441;
+    /** Two 4k blocks, read from the file in chunks of 1k. */
+    FileReadAheadBuffer<4096, 1536, 1024> fileReader_;
+    MP3FrameInfo mp3FrameInfo_;
+    HMP3Decoder mp3Decoder_;
     static constexpr int audioBufferSize_ = MAX_NCHAN * MAX_NGRAN * MAX_NSAMP;
-    static int16_t audioBuffer_[audioBufferSize_];
-    static int audioBufferTail_;
-    static int currentSampleRate_;
-    static int numSamplesPlayed_;
-    static FixedSizeStr<128> artist_;
-    static FixedSizeStr<128> title_;
+    int16_t audioBuffer_[audioBufferSize_];
+    int audioBufferTail_;
+    int audioBufferEnd_;
+    GaplessTrimmer gaplessTrimmer_;
+    int currentSampleRate_;
+    int numSamplesPlayed_;
+
+    Mp3FrameHeader firstFrameHeader_;
+    Mp3SeekIndex seekIndex_;
+    /** The encoder and decoder delay in sample frames, 0 if unknown */
+    uint32_t numSampleFramesToSkip_;
+    /** The number of sample frames of the file without delay and padding, 0 if unknown */
+    uint32_t numSampleFramesToPlay_;
+    /** The index of the next frame the decoder reads (an estimate after some seeks) */
+    uint32_t nextFrameIndex_;
+    /** Frames before this one are decoded, but not played (after a seek) */
+    uint32_t firstFrameToPlay_;
+    bool isFrameIndexExact_;
+    bool isResyncing_;
+    /** The position after the last seek, reported until the frame index is exact again */
+    int numSamplesPlayedAtSeek_;
+    /** True while the frame headers are counted after a seek to an estimated position */
+    bool isScanningFrames_;
+    /** The index and position of the last frame header that was counted */
+    uint32_t scanFrameIndex_;
+    uint32_t scanPosition_;
+    /** The index (an estimate after some seeks) and position of the frame last read by the decoder */
+    uint32_t lastCountedFrameIndex_;
+    uint32_t lastCountedFramePosition_;
+    FixedSizeStr<128> artist_;
+    FixedSizeStr<128> title_;
 
     bool isStreamInUse_;
-    bool isEndOfFileReached_;
     File file_;
+    /** Fast seek map of file_: up to 31 fragments. */
+    static constexpr size_t clusterLinkMapSize_ = 64;
+    uint32_t clusterLinkMap_[clusterLinkMapSize_];
 };
\ No newline at end of file
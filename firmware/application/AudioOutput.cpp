@@ -51,10 +51,10 @@ void WunderkisteAudioOutput::init()
 }
 
 void WunderkisteAudioOutput::start(AudioFormat newAudioFormat,
-                                   AudioStreamPlayerIsrCallbackPtr callbackWhenNewBufferMustBeProvided,
+                                   AudioStreamPlayerBlockCallbackPtr callbackWhenNewBlockMustBeProvided,
                                    void* callbackContext)
 {
-    callbackFunc_ = callbackWhenNewBufferMustBeProvided;
+    callbackFunc_ = callbackWhenNewBlockMustBeProvided;
     callbackContext_ = callbackContext;
 
     if (newAudioFormat == currentFormat_)
@@ -91,7 +91,7 @@ void WunderkisteAudioOutput::start(AudioFormat newAudioFormat,
             return;
     }
 
-    PlayAudioWithCallback(isrCallback, nullptr);
+    PlayAudioBlocksWithCallback(isrCallback, nullptr, silentBlock_, ringBufferBlockSize);
     AudioOn(); // enable DAC
     SetAudioVolume(0xAF);
     amplifierUnmute();
@@ -117,24 +117,15 @@ void WunderkisteAudioOutput::amplifierMute()
     GPIO_ResetBits(STANDBY_MUTE_PORT, STANDBY_PIN | MUTE_PIN);
 }
 
-void WunderkisteAudioOutput::isrCallback(void* /* context */, int bufferNumberToUse)
+const AudioSampleType* WunderkisteAudioOutput::isrCallback(void* /* context */)
 {
-    AudioSampleType* buffer = (bufferNumberToUse == 0) ? audioBufferA_ : audioBufferB_;
-
+    // the DAC plays the silent block for nullptr
     if (callbackFunc_)
-        callbackFunc_(callbackContext_, buffer, bufferSize_);
-    else
-    {
-        // fallback: provide zeros
-        for (int i = 0; i < bufferSize_; i++)
-            buffer[i] = 0;
-    }
-
-    ProvideAudioBuffer(buffer, bufferSize_);
+        return callbackFunc_(callbackContext_);
+    return nullptr;
 }
 
 AudioFormat WunderkisteAudioOutput::currentFormat_;
-AudioStreamPlayerIsrCallbackPtr WunderkisteAudioOutput::callbackFunc_;
+AudioStreamPlayerBlockCallbackPtr WunderkisteAudioOutput::callbackFunc_;
 void* WunderkisteAudioOutput::callbackContext_;
-AudioSampleType WunderkisteAudioOutput::audioBufferA_[WunderkisteAudioOutput::bufferSize_];
-AudioSampleType WunderkisteAudioOutput::audioBufferB_[WunderkisteAudioOutput::bufferSize_];
+const AudioSampleType WunderkisteAudioOutput::silentBlock_[WunderkisteAudioOutput::ringBufferBlockSize] = {};
@@ -19,28 +19,29 @@
 
 #include "AudioStreamPlayer.h"
 
+/** Plays blocks straight from the buffer of the AudioStreamPlayer with a circular DMA,
+ *  so nothing is copied in the audio interrupt. */
 class WunderkisteAudioOutput
 {
 public:
+    static constexpr int ringBufferBlockSize = 512;
+
     static void init();
     static bool isRunning() { return currentFormat_ != AudioFormat::invalid; }
     static void start(AudioFormat audioFormat,
-                      AudioStreamPlayerIsrCallbackPtr callbackWhenNewBufferMustBeProvided,
+                      AudioStreamPlayerBlockCallbackPtr callbackWhenNewBlockMustBeProvided,
                       void* callbackContext);
     static void stop();
     static AudioFormat getCurrentAudioFormat() { return currentFormat_; }
 
 private:
-    static void isrCallback(void* context, int bufferNumberToUse);
+    static const AudioSampleType* isrCallback(void* context);
     static void amplifierMute();
     static void amplifierUnmute();
 
     static AudioFormat currentFormat_;
-    static AudioStreamPlayerIsrCallbackPtr callbackFunc_;
+    static AudioStreamPlayerBlockCallbackPtr callbackFunc_;
     static void* callbackContext_;
-    static constexpr int bufferSize_ = 512;
-    static AudioSampleType audioBufferA_[bufferSize_];
-    static AudioSampleType audioBufferB_[bufferSize_];
-    static AudioSampleType* bufferBeingTransmitted_;
-    static AudioSampleType* bufferBeingPrepared_;
+    /** Played when no block is provided */
+    static const AudioSampleType silentBlock_[ringBufferBlockSize];
 };
\ No newline at end of file
@@ -0,0 +1,130 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include "stdint.h"
+#include <algorithm>
+#include <atomic>
+#include "LockFreeFifo.h"
+
+/**
+ *  @brief  A single reader / single writer ring buffer that an audio DMA can play from
+ *          without copying the samples.
+ *
+ *          The writer uses it like an AtomicLockFreeFifo. The reader either copies samples
+ *          out with prepareRead() / finishRead() or hands whole blocks of `blockSize`
+ *          samples to the DMA with claimBlock() and returns them with releaseBlock() once
+ *          they were played. A claimed block stays occupied until it's released, so the
+ *          writer never overwrites samples that the DMA is still reading. Only one of the
+ *          two ways of reading must be used.
+ *
+ *          The fifo's read index marks the samples that were released. A third index marks
+ *          the samples that were read or claimed. Blocks never wrap around the end of the
+ *          buffer.
+ */
+template <typename ValueType, int size, int blockSize>
+class AudioRingBuffer : private AtomicLockFreeFifo<ValueType, size>
+{
+    using FifoType = AtomicLockFreeFifo<ValueType, size>;
+
+public:
+    static_assert((blockSize > 0) && ((blockSize & (blockSize - 1)) == 0), "blockSize must be a power of two");
+    static_assert(blockSize <= size, "blockSize must not be larger than size");
+
+    AudioRingBuffer()
+    {
+        clear();
+    }
+
+    using FifoType::getSize;
+    int getBlockSize() const { return blockSize; }
+    bool isEmpty() const { return getNumReady() == 0; }
+    using FifoType::isFull;
+    /** Returns the number of samples that were written and not yet read or claimed */
+    int getNumReady() const
+    {
+        return int(writeIndex_.load(std::memory_order_acquire) - claimIndex_.load(std::memory_order_acquire));
+    }
+    /** Returns the number of samples that can be written. Claimed blocks aren't free
+     *  before they're released. */
+    using FifoType::getNumFree;
+    /** Must not be called while the buffer is read or written */
+    void clear()
+    {
+        FifoType::clear();
+        claimIndex_.store(0, std::memory_order_relaxed);
+    }
+
+    using FifoType::prepareWrite;
+    using FifoType::finishWrite;
+
+    /** Writes default values (silence) up to the end of the last block that was only
+     *  partially written, so that it can be claimed. Does nothing if the last block is
+     *  complete. */
+    void completeLastBlock()
+    {
+        const uint32_t writeIndex = writeIndex_.load(std::memory_order_relaxed);
+        const int numMissing = int(-writeIndex & (blockSize - 1));
+        if ((numMissing == 0) || (numMissing > getNumFree()))
+            return;
+        ValueType* block = &buffer_[writeIndex & indexMask_];
+        std::fill(block, block + numMissing, ValueType());
+        finishWrite(numMissing);
+    }
+
+    void prepareRead(int numToRead, ValueType*& block1, int& blockSize1, ValueType*& block2, int& blockSize2)
+    {
+        numToRead = std::min(numToRead, getNumReady());
+        prepare(claimIndex_.load(std::memory_order_relaxed), numToRead, block1, blockSize1, block2, blockSize2);
+    }
+
+    void finishRead(int numRead)
+    {
+        // copied samples are released right away
+        const uint32_t claimIndex = claimIndex_.load(std::memory_order_relaxed) + uint32_t(numRead);
+        claimIndex_.store(claimIndex, std::memory_order_release);
+        readIndex_.store(claimIndex, std::memory_order_release);
+    }
+
+    /** Returns the next block of `blockSize` samples to play, or nullptr if it wasn't
+     *  completely written yet. The block stays occupied until it's released. */
+    const ValueType* claimBlock()
+    {
+        if (getNumReady() < blockSize)
+            return nullptr;
+        const uint32_t claimIndex = claimIndex_.load(std::memory_order_relaxed);
+        const ValueType* block = &buffer_[claimIndex & indexMask_];
+        claimIndex_.store(claimIndex + blockSize, std::memory_order_release);
+        return block;
+    }
+
+    /** Frees the oldest block returned from claimBlock(), so that it can be written again. */
+    void releaseBlock()
+    {
+        readIndex_.store(readIndex_.load(std::memory_order_relaxed) + blockSize, std::memory_order_release);
+    }
+
+private:
+    using FifoType::buffer_;
+    using FifoType::indexMask_;
+    using FifoType::prepare;
+    using FifoType::readIndex_;
+    using FifoType::writeIndex_;
+
+    // free running; written by the reader
+    std::atomic<uint32_t> claimIndex_;
+};
@@ -18,7 +18,11 @@
 #pragma once
 
 #include "stdint.h"
+#include "AudioRingBuffer.h"
 #include "LockFreeFifo.h"
+#include "PolyphaseResampler.h"
+#include "Profiler.h"
+#include <type_traits>
 
 using AudioSampleType = int16_t;
 
@@ -33,11 +37,17 @@ public:
 
     /** Fills the provided interleaved buffer with new audio samples and returns the number of samples written. 
      *  A return value smaller than "bufferSize" indicates that the stream is exhausted. After that, no 
-     *  more calls to fillBuffer() will occur. */
+     *  more calls to fillBuffer() will occur. 
+     *  The AudioStreamPlayer passes the contiguous free space of its fifo, so streams that produce
+     *  samples in blocks (e.g. decoded mp3 frames) can write whole blocks straight into it. */
     virtual int fillBuffer(AudioSampleType* buffer, int bufferSize) = 0;
 
     /** Called when the stream is removed from the playback engine and is no longer used. */
     virtual void completed() {};
+
+    /** Called when the playback buffer is full and there's time to spare, e.g. to read
+     *  ahead from a file so that the next calls to fillBuffer() don't have to wait for it. */
+    virtual void prefetch() {}
 };
 
 /** Valid audio formats. */
@@ -67,16 +77,68 @@ public:
 
     /** Called when a stream is completed */
     virtual void streamCompleted(StereoAudioSampleStream* streamThatWasCompleted) = 0;
+
+    /** Called while the current stream is still playing and the playback buffer is
+     *  full, so that there's the most time available before the buffer runs empty.
+     *  The provider can use this to open and prime the stream it will return from the
+     *  next call to getNextStream(), so that the switch to the next stream doesn't
+     *  cause a gap. Called repeatedly; must return quickly once the stream is primed.
+     */
+    virtual void prepareNextStream() {}
+};
+
+/** Tells how well the AudioStreamPlayer kept up with the audio output while a stream
+ *  was played. All numbers of samples count both channels. */
+struct AudioUnderrunStats
+{
+    /** The number of requests from the audio output that couldn't be served completely
+     *  from the buffer. Each of them is an audible dropout. */
+    uint32_t numUnderruns = 0;
+    /** The number of samples that were replaced with silence in these requests */
+    uint32_t numSamplesZeroFilled = 0;
+    /** The lowest number of samples in the buffer when the audio output requested new samples */
+    uint32_t minNumSamplesBuffered = 0;
+    /** The most samples played between two calls to AudioStreamPlayer::refillBuffers() */
+    uint32_t maxNumSamplesBetweenRefills = 0;
+
+    /** Converts a number of stereo samples played with `sampleRate` to milliseconds */
+    static uint32_t toMs(uint32_t numSamples, int sampleRate)
+    {
+        return (sampleRate > 0) ? uint32_t(uint64_t(numSamples) * 1000 / (2 * uint64_t(sampleRate))) : 0;
+    }
+};
+
+/** Receives the AudioUnderrunStats of each stream that was played by an AudioStreamPlayer */
+class AudioUnderrunStatsListener
+{
+public:
+    virtual ~AudioUnderrunStatsListener() = default;
+
+    /** Called from the main loop when a stream is completed.
+     *  @param sampleRate   the samplerate of the audio output while the stream was played
+     */
+    virtual void streamStatsCompleted(const AudioUnderrunStats& stats, int sampleRate) = 0;
 };
 
 /** A callback function called from the audio driver to request a new block of samples */
 using AudioStreamPlayerIsrCallbackPtr = void (*)(void* context, AudioSampleType* bufferToFill, const int bufferSize);
 
+/** A callback function called from an audio driver that plays straight from the buffer of
+ *  the AudioStreamPlayer. It's called each time the driver has started to play the block
+ *  returned from the previous call, and returns the block to play after that one - or
+ *  nullptr if the driver must play a block of silence instead. Each block stays valid
+ *  until the driver has started to play the block returned from the next call. */
+using AudioStreamPlayerBlockCallbackPtr = const AudioSampleType* (*) (void* context);
+
+/** A callback function called from the audio interrupt when samples were taken from the buffer */
+using AudioStreamPlayerRefillRequestPtr = void (*)(void* context);
+
 /**
  *  @brief  Feeds an audio output with samples from a StereoAudioSampleStream; switches to the next
  *          stream once the current stream is exhausted. Feeds zeros to the audio output when no
  *          stream is available to provide new data. Reconfigures the audio driver when the 
- *          samplerate changes between streams.
+ *          samplerate changes between streams - or, if a PolyphaseResampler is provided, 
+ *          converts all streams to one fixed samplerate so that the audio driver keeps running.
  * 
  *  @tparam AudioDriverType provides the audio output driver and must implement:
  *          \code{.cpp}
@@ -95,6 +157,12 @@ using AudioStreamPlayerIsrCallbackPtr = void (*)(void* context, AudioSampleType*
  *              static void stop();
  *              // returns the AudioFormat in use, or AudioFormat::invalid if audio is stopped.
  *              static AudioFormat getCurrentAudioFormat();
+ *              // 0 if the driver copies the samples into its own buffers when it calls the
+ *              // AudioStreamPlayerIsrCallbackPtr. Otherwise the number of samples in each
+ *              // block that the driver plays straight from the buffer of the AudioStreamPlayer.
+ *              // Such drivers implement start() with an AudioStreamPlayerBlockCallbackPtr
+ *              // instead and don't have to copy anything in the audio interrupt.
+ *              static constexpr int ringBufferBlockSize = 512;
  *          \endcode
  *          None of these functions will ever be called from inside a callback to the 
  *          function provided in start().
@@ -106,8 +174,25 @@ public:
     AudioStreamPlayer() :
         streamProvider_(nullptr),
         currentStream_(nullptr),
+        resampler_(nullptr),
+        fixedOutputSampleRate_(0),
+        isResampling_(false),
         numBlocksOfSilenceProvided_(0),
-        clearBufferForFormatChange_(false)
+        clearBufferForFormatChange_(false),
+        underrunStatsListener_(nullptr),
+        refillRequestCallback_(nullptr),
+        refillRequestContext_(nullptr),
+        isMonitoringUnderruns_(false),
+        numSamplesPlayed_(0),
+        numUnderruns_(0),
+        numSamplesZeroFilled_(0),
+        minNumSamplesBuffered_(fifoSize_),
+        numSamplesPlayedAtLastRefill_(0),
+        numUnderrunsAtStreamStart_(0),
+        numSamplesZeroFilledAtStreamStart_(0),
+        maxNumSamplesBetweenRefills_(0),
+        blocksInUseByDriver_(0),
+        isStartingDriver_(false)
     {
         AudioDriverType::init();
     }
@@ -120,11 +205,19 @@ public:
      *  audio driver if it was turned off. */
     void startPlayingNextStreamFrom(StreamProvider& streamProvider)
     {
-        stopCurrentStream();
-        streamProvider_ = &streamProvider;
-        auto* nextStream = streamProvider_->getNextStream();
-        if (nextStream)
-            setStream(nextStream);
+        startPlayingNextStreamFrom(streamProvider, false);
+    }
+
+    /** Converts all streams to `outputSampleRate` with the provided resampler, so that
+     *  the audio driver doesn't have to be restarted when the samplerate changes between
+     *  two streams. Streams that already have this samplerate are played unchanged.
+     *  Pass nullptr to play all streams with their own samplerate.
+     *  Takes effect when the next stream is started.
+     */
+    void setFixedOutputSampleRate(PolyphaseResampler* resampler, int outputSampleRate)
+    {
+        resampler_ = resampler;
+        fixedOutputSampleRate_ = outputSampleRate;
     }
 
     /** When the samplerate of the audio output must be changed (e.g. when switching
@@ -134,14 +227,46 @@ public:
      */
     bool isAboutToChangeAudioFormat() const { return clearBufferForFormatChange_; }
 
+    /** Returns the AudioUnderrunStats of the current stream, or of the last stream
+     *  if none is playing. Underruns are counted from the first refillBuffers() after
+     *  a stream was started until the stream is stopped or exhausted, so that the
+     *  silence before the first and after the last stream doesn't count.
+     */
+    AudioUnderrunStats getUnderrunStats() const
+    {
+        AudioUnderrunStats stats;
+        stats.numUnderruns = numUnderruns_ - numUnderrunsAtStreamStart_;
+        stats.numSamplesZeroFilled = numSamplesZeroFilled_ - numSamplesZeroFilledAtStreamStart_;
+        stats.minNumSamplesBuffered = minNumSamplesBuffered_;
+        stats.maxNumSamplesBetweenRefills = maxNumSamplesBetweenRefills_;
+        return stats;
+    }
+
+    /** Sets a listener that receives the AudioUnderrunStats of each stream when
+     *  it's completed. Pass nullptr to remove the listener. */
+    void setUnderrunStatsListener(AudioUnderrunStatsListener* listener) { underrunStatsListener_ = listener; }
+
+    /** Sets a function that's called from the audio interrupt each time samples were
+     *  taken from the buffer, e.g. to schedule the next call to refillBuffers().
+     *  Pass nullptr to remove it. */
+    void setRefillRequestCallback(AudioStreamPlayerRefillRequestPtr callback, void* context)
+    {
+        refillRequestCallback_ = nullptr;
+        refillRequestContext_ = context;
+        refillRequestCallback_ = callback;
+    }
+
     /** Stops playing the current stream.
      *  This will finish playing all samples that were already requested 
      *  from the current stream and eventually shut down the audio driver.
      */
     void stopCurrentStream()
     {
+        isMonitoringUnderruns_ = false;
         if (currentStream_)
         {
+            if (underrunStatsListener_)
+                underrunStatsListener_->streamStatsCompleted(getUnderrunStats(), getOutputSampleRate(currentStream_));
             currentStream_->completed();
             if (streamProvider_)
                 streamProvider_->streamCompleted(currentStream_);
@@ -164,6 +289,13 @@ public:
      */
     void refillBuffers()
     {
+        // the samples played since the last call must have been in the fifo
+        const uint32_t numSamplesPlayed = numSamplesPlayed_;
+        const uint32_t numSamplesSinceLastRefill = numSamplesPlayed - numSamplesPlayedAtLastRefill_;
+        numSamplesPlayedAtLastRefill_ = numSamplesPlayed;
+        if (isMonitoringUnderruns_ && (numSamplesSinceLastRefill > maxNumSamplesBetweenRefills_))
+            maxNumSamplesBetweenRefills_ = numSamplesSinceLastRefill;
+
         // Due to the double-buffering in the audio driver, we must have provided TWO
         // full buffers of zeros before the last non-zero audio sample has been played
         // on the audio output. (We provide the first buffer of zeros while the audio
@@ -181,11 +313,13 @@ public:
         if (clearBufferForFormatChange_)
         {
             if (!bufferClearedAndContentsFullyPlayedBack)
+            {
+                completeLastBlockForDriver();
                 return;
+            }
             else
             {
-                const auto formatToUse = getFormatRequiredForStream(currentStream_);
-                AudioDriverType::start(formatToUse, isrCallback, this);
+                startDriver(getFormatRequiredForStream(currentStream_));
                 numBlocksOfSilenceProvided_ = 0;
                 clearBufferForFormatChange_ = false;
             }
@@ -210,14 +344,14 @@ public:
             bool streamExhausted = false;
             if (blockSize1 > 0)
             {
-                const int numWrittenToBlock1 = currentStream_->fillBuffer(block1, blockSize1);
+                const int numWrittenToBlock1 = fillFromCurrentStream(block1, blockSize1);
                 if (numWrittenToBlock1 != blockSize1)
                     streamExhausted = true;
                 numWritten = numWrittenToBlock1;
             }
             if ((blockSize2 > 0) && !streamExhausted)
             {
-                const int numWrittenToBlock2 = currentStream_->fillBuffer(block2, blockSize2);
+                const int numWrittenToBlock2 = fillFromCurrentStream(block2, blockSize2);
                 if (numWrittenToBlock2 != blockSize2)
                     streamExhausted = true;
                 numWritten += numWrittenToBlock2;
@@ -229,24 +363,62 @@ public:
             {
                 // start the next stream, if there's one available
                 if (streamProvider_)
-                    startPlayingNextStreamFrom(*streamProvider_);
+                    startPlayingNextStreamFrom(*streamProvider_, true);
 
                 // avoid continuing to fill the fifo when
                 // a sample rate change is queued
                 if (clearBufferForFormatChange_)
+                {
+                    completeLastBlockForDriver();
                     return;
+                }
             }
         }
+
+        if (!currentStream_)
+            completeLastBlockForDriver();
+
+        // From now on the fifo is expected to never run empty
+        if (currentStream_ && !clearBufferForFormatChange_ && !fifo_.isEmpty())
+            isMonitoringUnderruns_ = true;
+
+        // the fifo is full, so now is the best time to read ahead
+        // and to prepare the stream that will follow the current one.
+        if (currentStream_ && fifo_.isFull())
+        {
+            currentStream_->prefetch();
+            if (streamProvider_)
+                streamProvider_->prepareNextStream();
+        }
     }
 
 private:
-    void setStream(StereoAudioSampleStream* streamToPlay)
+    void startPlayingNextStreamFrom(StreamProvider& streamProvider, bool previousStreamWasExhausted)
+    {
+        stopCurrentStream();
+        streamProvider_ = &streamProvider;
+        auto* nextStream = streamProvider_->getNextStream();
+        if (nextStream)
+            setStream(nextStream, previousStreamWasExhausted);
+    }
+
+    void setStream(StereoAudioSampleStream* streamToPlay, bool previousStreamWasExhausted)
     {
         if (currentStream_)
             stopCurrentStream();
 
         currentStream_ = streamToPlay;
         clearBufferForFormatChange_ = false;
+        resetUnderrunStats();
+
+        // The resampler keeps its state from the previous stream only if that stream
+        // was played until its end, so that both streams are joined without a gap.
+        const bool wasResampling = isResampling_;
+        isResampling_ = resampler_
+                        && (currentStream_->getSampleRate() != fixedOutputSampleRate_)
+                        && resampler_->setSampleRates(currentStream_->getSampleRate(), fixedOutputSampleRate_);
+        if (isResampling_ && !(wasResampling && previousStreamWasExhausted))
+            resampler_->reset();
 
         const auto formatToUse = getFormatRequiredForStream(currentStream_);
         if (formatToUse == AudioFormat::invalid)
@@ -256,38 +428,89 @@ private:
         }
 
         if (!AudioDriverType::isRunning())
-            AudioDriverType::start(formatToUse, isrCallback, this);
+            startDriver(formatToUse);
         else if (AudioDriverType::getCurrentAudioFormat() != formatToUse)
             // Audio is already running but we need to change the audio settings.
             // Clear the Fifo, then reconfigure the audio driver before we start playing the stream.
             clearBufferForFormatChange_ = true;
     }
 
+    /** Called from the main loop. The audio interrupt only updates the stats while
+     *  isMonitoringUnderruns_ is set, so it's cleared first. The interrupt can't be
+     *  interrupted by the main loop, so it doesn't touch the stats from then on,
+     *  until the next refillBuffers() starts monitoring again. */
+    void resetUnderrunStats()
+    {
+        isMonitoringUnderruns_ = false;
+        // The counters are only ever increased by the audio interrupt, so
+        // we remember where they were instead of clearing them.
+        numUnderrunsAtStreamStart_ = numUnderruns_;
+        numSamplesZeroFilledAtStreamStart_ = numSamplesZeroFilled_;
+        minNumSamplesBuffered_ = fifoSize_;
+        maxNumSamplesBetweenRefills_ = 0;
+    }
+
+    int getOutputSampleRate(StereoAudioSampleStream* stream) const
+    {
+        return isResampling_ ? fixedOutputSampleRate_ : stream->getSampleRate();
+    }
+
     AudioFormat getFormatRequiredForStream(StereoAudioSampleStream* stream)
     {
-        if (stream->getSampleRate() == 8000)
+        const auto sampleRate = getOutputSampleRate(stream);
+        if (sampleRate == 8000)
             return AudioFormat::sr8000b16;
-        else if (stream->getSampleRate() == 16000)
+        else if (sampleRate == 16000)
             return AudioFormat::sr16000b16;
-        else if (stream->getSampleRate() == 22050)
+        else if (sampleRate == 22050)
             return AudioFormat::sr22050b16;
-        else if (stream->getSampleRate() == 32000)
+        else if (sampleRate == 32000)
             return AudioFormat::sr32000b16;
-        else if (stream->getSampleRate() == 44100)
+        else if (sampleRate == 44100)
             return AudioFormat::sr44100b16;
-        else if (stream->getSampleRate() == 48000)
+        else if (sampleRate == 48000)
             return AudioFormat::sr48000b16;
-        else if (stream->getSampleRate() == 96000)
+        else if (sampleRate == 96000)
             return AudioFormat::sr96000b16;
         else
             return AudioFormat::invalid;
     }
 
+    void startDriver(AudioFormat format)
+    {
+        if constexpr (playsFromRingBuffer_)
+        {
+            isStartingDriver_ = true;
+            AudioDriverType::start(format, blockCallback, this);
+            isStartingDriver_ = false;
+        }
+        else
+            AudioDriverType::start(format, isrCallback, this);
+    }
+
+    /** The driver only plays complete blocks from the ring buffer, so the last samples
+     *  before a pause or a change of the audio format are padded with silence. */
+    void completeLastBlockForDriver()
+    {
+        if constexpr (playsFromRingBuffer_)
+            fifo_.completeLastBlock();
+    }
+
+    int fillFromCurrentStream(AudioSampleType* buffer, int bufferSize)
+    {
+        if (isResampling_)
+            return resampler_->process(*currentStream_, buffer, bufferSize);
+        else
+            return currentStream_->fillBuffer(buffer, bufferSize);
+    }
+
     static void isrCallback(void* context, AudioSampleType* bufferToFill, const int bufferSize)
     {
+        PROFILE_ZONE(audioIsr);
         AudioStreamPlayer* player = (AudioStreamPlayer*) context;
 
         auto numSamplesToWrite = bufferSize;
+        const int numSamplesBuffered = player->fifo_.getNumReady();
 
         AudioSampleType* block1 = nullptr;
         int blockSize1 = 0;
@@ -313,20 +536,103 @@ private:
         player->fifo_.finishRead(numSamplesTakenFromFifo);
 
         // ... fill the rest with zeros
+        player->blockWasProvided(bufferSize, numSamplesBuffered, numSamplesToWrite);
         while (numSamplesToWrite-- > 0)
             *(bufferToFill++) = 0;
 
+        player->requestRefill();
+    }
+
+    static const AudioSampleType* blockCallback(void* context)
+    {
+        AudioStreamPlayer* player = (AudioStreamPlayer*) context;
+        // the driver asks for its first two blocks from the main loop, which
+        // doesn't count as time spent in the audio interrupt
+        if (player->isStartingDriver_)
+            return player->provideBlock();
+        PROFILE_ZONE(audioIsr);
+        return player->provideBlock();
+    }
+
+    /** Hands the next block of the ring buffer to the driver */
+    const AudioSampleType* provideBlock()
+    {
+        // the driver has finished playing the block returned two calls ago
+        if (blocksInUseByDriver_ & 2)
+            fifo_.releaseBlock();
+
+        const int numSamplesBuffered = fifo_.getNumReady();
+        const AudioSampleType* block = fifo_.claimBlock();
+        blocksInUseByDriver_ = ((blocksInUseByDriver_ << 1) | (block ? 1 : 0)) & 3;
+
+        blockWasProvided(ringBufferBlockSize_, numSamplesBuffered, block ? 0 : ringBufferBlockSize_);
+        requestRefill();
+        return block;
+    }
+
+    /** Updates the statistics from the audio interrupt */
+    void blockWasProvided(int blockSize, int numSamplesBuffered, int numSamplesZeroFilled)
+    {
+        if (isMonitoringUnderruns_)
+        {
+            if (uint32_t(numSamplesBuffered) < minNumSamplesBuffered_)
+                minNumSamplesBuffered_ = uint32_t(numSamplesBuffered);
+            if (numSamplesZeroFilled > 0)
+            {
+                numUnderruns_ += 1;
+                numSamplesZeroFilled_ += uint32_t(numSamplesZeroFilled);
+            }
+        }
+        numSamplesPlayed_ += uint32_t(blockSize);
+
         // update flag that allows us to safely shutdown the DAC after all audio has been played
-        if (numSamplesTakenFromFifo == 0)
-            player->numBlocksOfSilenceProvided_++;
+        if (numSamplesZeroFilled == blockSize)
+            numBlocksOfSilenceProvided_++;
         else
-            player->numBlocksOfSilenceProvided_ = 0;
+            numBlocksOfSilenceProvided_ = 0;
+    }
+
+    void requestRefill()
+    {
+        const auto refillRequestCallback = refillRequestCallback_;
+        if (refillRequestCallback)
+            refillRequestCallback(refillRequestContext_);
     }
 
     StreamProvider* streamProvider_;
     StereoAudioSampleStream* currentStream_;
+    PolyphaseResampler* resampler_;
+    int fixedOutputSampleRate_;
+    bool isResampling_;
     int numBlocksOfSilenceProvided_;
     bool clearBufferForFormatChange_;
-    static constexpr int fifoSize_ = 0x3FFF;
-    LockFreeFifo<AudioSampleType, fifoSize_> fifo_;
+    AudioUnderrunStatsListener* underrunStatsListener_;
+    AudioStreamPlayerRefillRequestPtr volatile refillRequestCallback_;
+    void* volatile refillRequestContext_;
+
+    // written from the audio interrupt
+    volatile bool isMonitoringUnderruns_;
+    volatile uint32_t numSamplesPlayed_;
+    volatile uint32_t numUnderruns_;
+    volatile uint32_t numSamplesZeroFilled_;
+    volatile uint32_t minNumSamplesBuffered_;
+
+    uint32_t numSamplesPlayedAtLastRefill_;
+    uint32_t numUnderrunsAtStreamStart_;
+    uint32_t numSamplesZeroFilledAtStreamStart_;
+    uint32_t maxNumSamplesBetweenRefills_;
+
+    static constexpr int ringBufferBlockSize_ = AudioDriverType::ringBufferBlockSize;
+    static constexpr bool playsFromRingBuffer_ = ringBufferBlockSize_ > 0;
+    // bit 0: the block returned from the last blockCallback() is in the ring buffer,
+    // bit 1: the same for the block returned before that one
+    uint32_t blocksInUseByDriver_;
+    // true while the driver calls blockCallback() from AudioDriverType::start()
+    volatile bool isStartingDriver_;
+
+    static constexpr int fifoSize_ = 0x4000;
+    std::conditional_t<playsFromRingBuffer_,
+                       AudioRingBuffer<AudioSampleType, fifoSize_, std::max(ringBufferBlockSize_, 1)>,
+                       AtomicLockFreeFifo<AudioSampleType, fifoSize_>>
+        fifo_;
 };
\ No newline at end of file
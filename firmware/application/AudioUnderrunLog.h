@@ -0,0 +1,92 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "AudioStreamPlayer.h"
+#include "FixedSizeString.h"
+#include "Profiler.h"
+
+/**
+ *  @brief  Keeps the AudioUnderrunStats of the most recently played streams in RAM,
+ *          so that they can be written to a file when there's time for it.
+ *          When more than `maxNumEntries` streams were played, the oldest ones are dropped.
+ */
+class AudioUnderrunLog : public AudioUnderrunStatsListener
+{
+public:
+    static constexpr size_t maxNumEntries = 16;
+
+    struct Entry
+    {
+        /** Counts all streams since the last clear(), starting at 0 */
+        uint32_t streamNumber = 0;
+        int sampleRate = 0;
+        AudioUnderrunStats stats;
+    };
+
+    AudioUnderrunLog() { clear(); }
+
+    void clear() { numStreams_ = 0; }
+
+    void streamStatsCompleted(const AudioUnderrunStats& stats, int sampleRate) override
+    {
+        Entry& entry = entries_[numStreams_ % maxNumEntries];
+        entry.streamNumber = numStreams_;
+        entry.sampleRate = sampleRate;
+        entry.stats = stats;
+        numStreams_++;
+    }
+
+    size_t getNumEntries() const { return (numStreams_ < maxNumEntries) ? numStreams_ : maxNumEntries; }
+
+    /** Returns an entry; index 0 is the oldest one. */
+    const Entry& getEntry(size_t index) const
+    {
+        return entries_[(numStreams_ - getNumEntries() + index) % maxNumEntries];
+    }
+
+    /** Writes all entries as text, one line per stream, to a File that was
+     *  opened for writing. Returns false if writing failed. */
+    template <typename FileType>
+    bool dumpTo(FileType& file) const
+    {
+        FixedSizeStr<128> line = "stream; underruns; samples zero-filled; min. buffered [ms]; max. between refills [ms]";
+        line.append("\n");
+        if (!file.write(line))
+            return false;
+        for (size_t i = 0; i < getNumEntries(); i++)
+        {
+            const auto& entry = getEntry(i);
+            line.clear();
+            Profiler::appendNumber(line, entry.streamNumber, "");
+            Profiler::appendNumber(line, entry.stats.numUnderruns);
+            Profiler::appendNumber(line, entry.stats.numSamplesZeroFilled);
+            Profiler::appendNumber(line, AudioUnderrunStats::toMs(entry.stats.minNumSamplesBuffered, entry.sampleRate));
+            Profiler::appendNumber(line, AudioUnderrunStats::toMs(entry.stats.maxNumSamplesBetweenRefills, entry.sampleRate));
+            line.append("\n");
+            if (!file.write(line))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    Entry entries_[maxNumEntries];
+    uint32_t numStreams_;
+};
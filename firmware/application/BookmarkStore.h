@@ -0,0 +1,274 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "File.h"
+#include "PlaybackPosition.h"
+#include "RFID.h"
+
+/**
+ *  @brief  Remembers where the playback was stopped for each RFID tag, so that it
+ *          can be resumed when the tag is placed on the reader again.
+ *          All bookmarks are held in RAM, the most recently used one first. When the
+ *          store is full, the least recently used bookmark is dropped. Looking up and
+ *          updating a bookmark never accesses the file.
+ *
+ *          flush() writes all bookmarks as a single record of exactly one sector. The
+ *          file has a fixed size and is used as a ring: each flush writes the slot
+ *          after the previous one and load() picks the newest valid record. The file
+ *          never grows, each sector is rewritten only every `numSlots` flushes, and
+ *          losing power during a write loses only the newest record.
+ */
+class BookmarkStore
+{
+public:
+    /** The size of a record: one sector */
+    static constexpr size_t recordSize = 512;
+    /** The number of records in the file */
+    static constexpr size_t numSlots = 64;
+    static constexpr size_t maxNumBookmarks = 41;
+    /** The interval for flushIfDue() */
+    static constexpr uint32_t flushIntervalMs = 5 * 60 * 1000;
+
+    BookmarkStore(const char* filePath) :
+        filePath_(filePath)
+    {
+        clear();
+    }
+
+    /** Forgets all bookmarks, without changing the file. */
+    void clear()
+    {
+        numBookmarks_ = 0;
+        sequenceNumber_ = 0;
+        nextSlot_ = 0;
+        isDirty_ = false;
+        lastFlushMs_ = 0;
+    }
+
+    /** Loads the bookmarks from the newest valid record in the file. Returns false
+     *  and leaves the store empty if there is none, e.g. on the first start. */
+    bool load()
+    {
+        clear();
+        File file(filePath_);
+        if (!file.open(File::AccessMode::read, File::OpenMode::openIfExists))
+            return false;
+
+        bool isFound = false;
+        for (size_t slot = 0; slot < numSlots; slot++)
+        {
+            if (!readRecord(file, slot))
+                break;
+            if (!isValid(record_)
+                || (isFound && (int32_t(record_.sequenceNumber - sequenceNumber_) <= 0)))
+                continue;
+            isFound = true;
+            sequenceNumber_ = record_.sequenceNumber;
+            nextSlot_ = (slot + 1) % numSlots;
+            numBookmarks_ = record_.numBookmarks;
+            memcpy(bookmarks_, record_.bookmarks, sizeof(bookmarks_));
+        }
+        return isFound;
+    }
+
+    /** Returns true and the position if there is a bookmark for `tag`. */
+    bool find(const RfidTagId& tag, PlaybackPosition& position) const
+    {
+        size_t index;
+        if (!findIndex(tag, index))
+            return false;
+        position = bookmarks_[index].position;
+        return true;
+    }
+
+    /** Sets the bookmark for `tag`. The change is stored with the next flush(). */
+    void update(const RfidTagId& tag, const PlaybackPosition& position)
+    {
+        if (!tag.isValid())
+            return;
+
+        size_t index;
+        if (!findIndex(tag, index))
+        {
+            // new bookmark: drop the least recently used one if full
+            if (numBookmarks_ < maxNumBookmarks)
+                numBookmarks_++;
+            index = numBookmarks_ - 1;
+        }
+        else if ((index == 0) && (bookmarks_[0].position == position))
+            return;
+
+        memmove(&bookmarks_[1], &bookmarks_[0], index * sizeof(Bookmark));
+        bookmarks_[0].tag = uint32_t(tag);
+        bookmarks_[0].position = position;
+        isDirty_ = true;
+    }
+
+    /** Removes the bookmark for `tag`, e.g. when all its files were played. */
+    void remove(const RfidTagId& tag)
+    {
+        size_t index;
+        if (!findIndex(tag, index))
+            return;
+        memmove(&bookmarks_[index], &bookmarks_[index + 1], (numBookmarks_ - index - 1) * sizeof(Bookmark));
+        numBookmarks_--;
+        isDirty_ = true;
+    }
+
+    size_t getNumBookmarks() const { return numBookmarks_; }
+    /** Returns true if there are changes that weren't flushed yet. */
+    bool isDirty() const { return isDirty_; }
+
+    /** Writes the bookmarks to the next slot of the file, if anything changed.
+     *  Returns false if writing failed; the changes are then written with the next flush. */
+    bool flush()
+    {
+        if (!isDirty_)
+            return true;
+
+        record_ = Record();
+        record_.magic = fileMagic_;
+        record_.sequenceNumber = sequenceNumber_ + 1;
+        record_.numBookmarks = uint32_t(numBookmarks_);
+        memcpy(record_.bookmarks, bookmarks_, numBookmarks_ * sizeof(Bookmark));
+        record_.checksum = getChecksum(record_);
+
+        File file(filePath_);
+        uint32_t numBytesWritten = 0;
+        const bool success = file.open(File::AccessMode::readWrite, File::OpenMode::openOrCreate)
+                             && makeFullSize(file)
+                             && file.setCursorTo(nextSlot_ * recordSize)
+                             && file.tryWrite((const char*) &record_, recordSize, numBytesWritten)
+                             && (numBytesWritten == recordSize)
+                             && file.close();
+        if (!success)
+            return false;
+        isDirty_ = false;
+        sequenceNumber_++;
+        nextSlot_ = (nextSlot_ + 1) % numSlots;
+        return true;
+    }
+
+    /** Flushes if the last call that flushed was at least flushIntervalMs ago, so that
+     *  the bookmarks survive a loss of power during long playback. */
+    bool flushIfDue(uint32_t nowMs)
+    {
+        if (nowMs - lastFlushMs_ < flushIntervalMs)
+            return true;
+        lastFlushMs_ = nowMs;
+        return flush();
+    }
+
+private:
+    struct Bookmark
+    {
+        uint32_t tag;
+        PlaybackPosition position;
+    };
+
+    struct Record
+    {
+        uint32_t magic;
+        uint32_t sequenceNumber;
+        uint32_t numBookmarks;
+        Bookmark bookmarks[maxNumBookmarks];
+        uint32_t reserved;
+        /** Over all bytes before it */
+        uint32_t checksum;
+    };
+    static_assert(sizeof(Record) == recordSize, "A record must fill exactly one sector");
+
+    bool findIndex(const RfidTagId& tag, size_t& index) const
+    {
+        if (!tag.isValid())
+            return false;
+        for (index = 0; index < numBookmarks_; index++)
+        {
+            if (bookmarks_[index].tag == uint32_t(tag))
+                return true;
+        }
+        return false;
+    }
+
+    bool readRecord(File& file, size_t slot)
+    {
+        // File::tryRead() adds a terminating zero
+        char buffer[recordSize + 1];
+        uint32_t numBytesRead = 0;
+        if (!file.setCursorTo(slot * recordSize)
+            || !file.tryRead(buffer, recordSize, numBytesRead)
+            || (numBytesRead != recordSize))
+            return false;
+        memcpy(&record_, buffer, recordSize);
+        return true;
+    }
+
+    /** Creates all slots of a new file at once, so that flushing never allocates. */
+    static bool makeFullSize(File& file)
+    {
+        const size_t fileSize = numSlots * recordSize;
+        if (file.getSize() >= fileSize)
+            return true;
+        if (!file.setCursorTo(file.getSize()))
+            return false;
+        static const char zeros[recordSize] = {};
+        while (file.getSize() < fileSize)
+        {
+            const uint32_t numBytesToWrite = uint32_t(recordSize - file.getSize() % recordSize);
+            uint32_t numBytesWritten = 0;
+            if (!file.tryWrite(zeros, numBytesToWrite, numBytesWritten) || (numBytesWritten != numBytesToWrite))
+                return false;
+        }
+        return true;
+    }
+
+    static bool isValid(const Record& record)
+    {
+        return (record.magic == fileMagic_)
+               && (record.numBookmarks <= maxNumBookmarks)
+               && (record.checksum == getChecksum(record));
+    }
+
+    static uint32_t getChecksum(const Record& record)
+    {
+        // FNV-1a
+        const auto* data = (const uint8_t*) &record;
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < offsetof(Record, checksum); i++)
+        {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    static constexpr uint32_t fileMagic_ = 0x314B4D42; // "BMK1"
+
+    const char* filePath_;
+    Bookmark bookmarks_[maxNumBookmarks];
+    size_t numBookmarks_;
+    uint32_t sequenceNumber_;
+    size_t nextSlot_;
+    bool isDirty_;
+    uint32_t lastFlushMs_;
+    /** Holds a record while it's read or written */
+    Record record_;
+};
@@ -18,6 +18,7 @@
 #pragma once
 #include <stdint.h>
 #include <cstddef>
+#include <string.h>
 #include <algorithm>
 #include <utility>
 
@@ -36,6 +37,14 @@ public:
         object_ = new (::std::addressof(storage_)) T(std::forward<Args>(args)...);
     }
 
+    /** Destroys the object, if it was created. */
+    void destroy()
+    {
+        if (object_)
+            object_->~T();
+        object_ = nullptr;
+    }
+
     operator T*() { return object_; }
     operator const T*() const { return object_; }
     T* operator->() { return object_; }
@@ -65,6 +74,12 @@ public:
         return arr_[clampedIndex];
     }
 
+    const ValueType& operator[](std::size_t index) const
+    {
+        const auto clampedIndex = std::clamp(index, std::size_t(0), size_ - 1);
+        return arr_[clampedIndex];
+    }
+
     void clear()
     {
         size_ = 0;
@@ -72,7 +87,7 @@ public:
 
     void remove(std::size_t index)
     {
-        if (index >= 0 && index < size_)
+        if (index < size_)
         {
             for (std::size_t i = index; i < size_ - 1; i++)
             {
@@ -82,20 +97,32 @@ public:
         }
     }
 
+    /** Sorts the elements in ascending order. */
     void sortAscending()
     {
-        // "simplesort" algorithm
-        for (int targetIdx = size_ - 1; targetIdx >= 0; targetIdx--)
+        sort([](const ValueType& a, const ValueType& b) { return a < b; });
+    }
+
+    /** Sorts the elements so that isLess(arr[i + 1], arr[i]) is false for all elements.
+     *  This is a heapsort: It runs in O(n log n), doesn't recurse and only
+     *  ever swaps elements, so large elements like strings are never copied.
+     *  The sort is not stable.
+     */
+    template <typename Comparator>
+    void sort(Comparator isLess)
+    {
+        if (size_ < 2)
+            return;
+
+        // build a max-heap
+        for (std::size_t root = size_ / 2; root > 0; root--)
+            siftDown(root - 1, size_, isLess);
+
+        // repeatedly move the largest element to the end
+        for (std::size_t end = size_ - 1; end > 0; end--)
         {
-            for (int probeIdx = 0; probeIdx < targetIdx; probeIdx++)
-            {
-                if (arr_[probeIdx] > arr_[targetIdx])
-                {
-                    auto tmp = arr_[probeIdx];
-                    arr_[probeIdx] = arr_[targetIdx];
-                    arr_[targetIdx] = tmp;
-                }
-            }
+            swapElements(0, end);
+            siftDown(0, end, isLess);
         }
     }
 
@@ -108,6 +135,18 @@ public:
         }
     }
 
+    void insert(std::size_t index, ValueType val)
+    {
+        if ((size_ < capacity) && (index <= size_))
+        {
+            arr_[size_] = val;
+            size_++;
+            // move into place
+            for (std::size_t i = size_ - 1; i > index; i--)
+                swapElements(i, i - 1);
+        }
+    }
+
     bool contains(const ValueType& value) const
     {
         for (std::size_t i = 0; i < size_; i++)
@@ -140,4 +179,115 @@ public:
     {
         return capacity;
     }
-};
\ No newline at end of file
+
+private:
+    void swapElements(std::size_t a, std::size_t b)
+    {
+        using std::swap; // allows to use a swap() function for ValueType found via ADL
+        swap(arr_[a], arr_[b]);
+    }
+
+    template <typename Comparator>
+    void siftDown(std::size_t root, std::size_t end, Comparator& isLess)
+    {
+        while (2 * root + 1 < end)
+        {
+            // find the larger child
+            std::size_t child = 2 * root + 1;
+            if ((child + 1 < end) && isLess(arr_[child], arr_[child + 1]))
+                child++;
+
+            if (!isLess(arr_[root], arr_[child]))
+                return;
+            swapElements(root, child);
+            root = child;
+        }
+    }
+};
+
+/**
+ *  @brief  A list of strings that share a common prefix, e.g. the file
+ *          names in a directory. The prefix is stored once at the beginning
+ *          of a character arena, followed by all the zero-terminated strings.
+ *          A table of 16 bit offsets points to the individual strings, so
+ *          sorting the list only moves the offsets, never the characters.
+ *
+ *  @tparam arenaSize       The number of bytes available for the prefix and all
+ *                          strings (including a terminating zero for each of them)
+ *  @tparam maxNumStrings   The maximum number of strings in the list
+ */
+template <std::size_t arenaSize, std::size_t maxNumStrings>
+class PackedStringList
+{
+public:
+    static_assert(arenaSize <= 0x10000, "Offsets must fit into 16 bits");
+
+    PackedStringList()
+    {
+        clear();
+    }
+
+    /** Removes all strings and sets a new common prefix. Returns false
+     *  and leaves the prefix empty if the prefix doesn't fit.
+     */
+    bool clear(const char* commonPrefix = "")
+    {
+        offsets_.clear();
+        numBytesUsed_ = 0;
+        if (store(commonPrefix))
+            return true;
+        store("");
+        return false;
+    }
+
+    /** Adds a string and returns true if there was enough space left. */
+    bool add(const char* str)
+    {
+        if (offsets_.size() >= maxNumStrings)
+            return false;
+        const auto offset = numBytesUsed_;
+        if (!store(str))
+            return false;
+        offsets_.add(uint16_t(offset));
+        return true;
+    }
+
+    /** Returns the common prefix that was set with clear(). */
+    const char* getCommonPrefix() const { return arena_; }
+
+    /** Returns the string at the given index (without the common prefix). */
+    const char* operator[](std::size_t index) const
+    {
+        if (index >= offsets_.size())
+            return "";
+        return &arena_[offsets_[index]];
+    }
+
+    std::size_t size() const { return offsets_.size(); }
+    static constexpr std::size_t getCapacity() { return maxNumStrings; }
+    /** Returns the number of bytes used in the arena, including the common prefix. */
+    std::size_t getNumBytesUsed() const { return numBytesUsed_; }
+
+    /** Sorts the strings in ascending order by moving their offsets. */
+    void sortAscending()
+    {
+        offsets_.sort([this](uint16_t a, uint16_t b) {
+            return strcmp(&arena_[a], &arena_[b]) < 0;
+        });
+    }
+
+private:
+    bool store(const char* str)
+    {
+        const auto length = strlen(str);
+        if (numBytesUsed_ + length + 1 > arenaSize)
+            return false;
+        memcpy(&arena_[numBytesUsed_], str, length + 1);
+        numBytesUsed_ += length + 1;
+        return true;
+    }
+
+    char arena_[arenaSize];
+    std::size_t numBytesUsed_;
+    StaticVector<uint16_t, maxNumStrings> offsets_;
+};
@@ -30,8 +30,11 @@ static void StopAudioDMA();
 void SetAudioVolume(int volume);
 bool ProvideAudioBufferWithoutBlocking(void* samples, int numsamples);
 typedef void AudioCallbackFunction(void* context, int buffer);
+typedef const int16_t* AudioBlockCallbackFunction(void* context);
 
 static AudioCallbackFunction* CallbackFunction;
+static AudioBlockCallbackFunction* BlockCallbackFunction;
+static const int16_t* SilentBlock;
 static void* CallbackContext;
 static int16_t* volatile NextBufferSamples;
 static volatile int NextBufferLength;
@@ -44,6 +47,8 @@ void InitializeAudio(int plln, int pllr, int i2sdiv, int i2sodd)
 
     // Intitialize state.
     CallbackFunction = NULL;
+    BlockCallbackFunction = NULL;
+    SilentBlock = NULL;
     CallbackContext = NULL;
     NextBufferSamples = NULL;
     NextBufferLength = 0;
@@ -212,6 +217,7 @@ void PlayAudioWithCallback(AudioCallbackFunction* callback, void* context)
     SPI3->CR2 |= SPI_CR2_TXDMAEN; // Enable I2S TX DMA request.
 
     CallbackFunction = callback;
+    BlockCallbackFunction = NULL;
     CallbackContext = context;
     BufferNumber = 0;
 
@@ -219,12 +225,53 @@ void PlayAudioWithCallback(AudioCallbackFunction* callback, void* context)
         CallbackFunction(CallbackContext, BufferNumber);
 }
 
+void PlayAudioBlocksWithCallback(AudioBlockCallbackFunction* callback, void* context, const int16_t* silence, int numsamples)
+{
+    StopAudioDMA();
+
+    SPI3->CR2 |= SPI_CR2_TXDMAEN; // Enable I2S TX DMA request.
+
+    CallbackFunction = NULL;
+    BlockCallbackFunction = callback;
+    CallbackContext = context;
+    SilentBlock = silence;
+
+    // The first two blocks.
+    const int16_t* block0 = BlockCallbackFunction(CallbackContext);
+    const int16_t* block1 = BlockCallbackFunction(CallbackContext);
+
+    // Configure DMA stream: circular double buffer mode, switches between M0AR and M1AR
+    // after each block. One of them can be changed while the DMA plays from the other one.
+    DMA1->HIFCR = DMA_HIFCR_CTCIF7 | DMA_HIFCR_CHTIF7 | DMA_HIFCR_CTEIF7 | DMA_HIFCR_CDMEIF7 | DMA_HIFCR_CFEIF7;
+    DMA1_Stream7->CR = (0 * DMA_SxCR_CHSEL_0) | // Channel 0
+                       (1 * DMA_SxCR_PL_0) | // Priority 1
+                       (1 * DMA_SxCR_PSIZE_0) | // PSIZE = 16 bit
+                       (1 * DMA_SxCR_MSIZE_0) | // MSIZE = 16 bit
+                       DMA_SxCR_MINC | // Increase memory address
+                       (1 * DMA_SxCR_DIR_0) | // Memory to peripheral
+                       DMA_SxCR_CIRC | // Circular mode
+                       DMA_SxCR_DBM | // Double buffer mode, starting with M0AR
+                       DMA_SxCR_TCIE; // Transfer complete interrupt
+    DMA1_Stream7->NDTR = numsamples;
+    DMA1_Stream7->PAR = (uint32_t) &SPI3->DR;
+    DMA1_Stream7->M0AR = (uint32_t) (block0 ? block0 : SilentBlock);
+    DMA1_Stream7->M1AR = (uint32_t) (block1 ? block1 : SilentBlock);
+    DMA1_Stream7->FCR = DMA_SxFCR_DMDIS;
+
+    NVIC_SetPriority(DMA1_Stream7_IRQn, 4);
+    NVIC_EnableIRQ(DMA1_Stream7_IRQn);
+
+    DMA1_Stream7->CR |= DMA_SxCR_EN;
+    DMARunning = true;
+}
+
 void StopAudio()
 {
     StopAudioDMA();
     SPI3->CR2 &= ~SPI_CR2_TXDMAEN; // Disable I2S TX DMA request.
     NVIC_DisableIRQ(DMA1_Stream7_IRQn);
     CallbackFunction = NULL;
+    BlockCallbackFunction = NULL;
 }
 
 void ProvideAudioBuffer(void* samples, int numsamples)
@@ -315,6 +362,20 @@ void DMA1_Stream7_IRQHandler()
 {
     DMA1->HIFCR |= DMA_HIFCR_CTCIF7; // Clear interrupt flag.
 
+    if (BlockCallbackFunction)
+    {
+        // The DMA has switched to the other memory target. The one that was just
+        // played receives the block after the one that's playing now.
+        const int16_t* block = BlockCallbackFunction(CallbackContext);
+        if (!block)
+            block = SilentBlock;
+        if (DMA1_Stream7->CR & DMA_SxCR_CT)
+            DMA1_Stream7->M0AR = (uint32_t) block;
+        else
+            DMA1_Stream7->M1AR = (uint32_t) block;
+        return;
+    }
+
     if (NextBufferSamples)
     {
         StartAudioDMAAndRequestBuffers();
@@ -22,6 +22,7 @@
 #include <stdbool.h>
 
 typedef void AudioCallbackFunction(void* context, int buffer);
+typedef const int16_t* AudioBlockCallbackFunction(void* context);
 
 #define Audio8000HzSettings 256, 5, 12, 1
 #define Audio16000HzSettings 213, 2, 13, 0
@@ -52,6 +53,14 @@ void OutputAudioSampleWithoutBlocking(int16_t sample);
 void PlayAudioWithCallback(AudioCallbackFunction* callback, void* context);
 void StopAudio();
 
+// Start audio playback with a circular, double buffered DMA that plays blocks of
+// numsamples samples without copying them. The callback is called twice for the
+// first two blocks, then from the DMA interrupt each time a block was played and
+// the DMA started playing the next one. It returns the block to play after the
+// one that's playing now, or NULL to play the silence block instead.
+// All blocks must reside in DMA1-accessible memory (see below).
+void PlayAudioBlocksWithCallback(AudioBlockCallbackFunction* callback, void* context, const int16_t* silence, int numsamples);
+
 // Provide a new buffer to the audio DMA. Output is double buffered, so
 // at least two buffers must be maintained by the program. It is not allowed
 // to overwrite the previously provided buffer until after the next callback
@@ -0,0 +1,472 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "Containers.h"
+#include "DirectoryIterator.h"
+#include "File.h"
+#include "FixedSizeString.h"
+
+/**
+ *  @brief  The alphabetically sorted list of mp3 files in a directory.
+ *          Normally, all file names are read into a PackedStringList and
+ *          sorted once. If a directory has more files than that list can hold,
+ *          the list switches to a streaming mode: It only keeps the current
+ *          file name and a small window of the following names in RAM. When
+ *          the window runs empty, it's refilled with a single pass over the
+ *          directory that picks the next names in sort order. RAM usage is
+ *          therefore bounded, no matter how many files the directory contains.
+ *          In the normal mode, the sorted list is stored in a small cache file
+ *          inside the directory. The directory is still read each time it's
+ *          opened, but if it hasn't changed, the sorted list is loaded from the
+ *          cache file instead of sorting the names again.
+ *
+ *  @tparam arenaSize       The number of bytes available for the directory path and
+ *                          all file names in the normal mode
+ *  @tparam maxNumFiles     The maximum number of files in the normal mode
+ *  @tparam windowSize      The number of file names that are read ahead in the
+ *                          streaming mode
+ */
+template <size_t arenaSize, size_t maxNumFiles, size_t windowSize>
+class DirectoryFileList
+{
+public:
+    using StringType = FixedSizeStr<256>;
+
+    DirectoryFileList() :
+        isStreaming_(false),
+        numFiles_(0),
+        hasCurrentFile_(false),
+        currentFileIndex_(0),
+        isWindowComplete_(false)
+    {
+    }
+    DirectoryFileList(const DirectoryFileList&) = delete;
+
+    /** Reads the list of mp3 files from a directory or from the playlist
+     *  cache file in that directory.
+     */
+    void open(const char* directoryPath)
+    {
+        isStreaming_ = false;
+        numFiles_ = 0;
+        fileNames_.clear(directoryPath);
+        resetWindow();
+
+        Fingerprint fingerprint;
+        collectNames(directoryPath, fingerprint);
+
+        // only keep the directory path in the streaming mode
+        if (isStreaming_)
+        {
+            fileNames_.clear(directoryPath);
+            return;
+        }
+
+        // The cache saves sorting the names, if the directory didn't change.
+        const auto numFiles = numFiles_;
+        if (loadPlaylistCache(fingerprint))
+            return;
+        // a broken cache file may have replaced the names
+        if (fileNames_.size() != numFiles)
+        {
+            fileNames_.clear(directoryPath);
+            collectNames(directoryPath, fingerprint);
+        }
+
+        fileNames_.sortAscending();
+        // The cache only speeds up the next start, we don't care if it fails.
+        savePlaylistCache(fingerprint);
+    }
+
+    /** Returns the number of mp3 files in the directory */
+    size_t size() const { return numFiles_; }
+
+    /** Returns true if the list is in the streaming mode */
+    bool isStreaming() const { return isStreaming_; }
+
+    /** Returns the full path of the file at a position in the sorted list.
+     *  In the streaming mode, this is fast for the current file and its
+     *  neighbours. Accessing other files requires reading the directory
+     *  multiple times.
+     */
+    bool getFilePath(size_t index, StringType& filePath)
+    {
+        if (index >= numFiles_)
+            return false;
+
+        filePath = fileNames_.getCommonPrefix();
+        filePath.append('/');
+
+        if (!isStreaming_)
+        {
+            filePath.append(fileNames_[index]);
+            return true;
+        }
+
+        if (hasCurrentFile_ && (index < currentFileIndex_))
+        {
+            // It's cheaper to start over than to step back multiple times.
+            if (index + 1 == currentFileIndex_)
+            {
+                if (!goToPreviousFile())
+                    return false;
+            }
+            else
+                resetWindow();
+        }
+
+        while (!hasCurrentFile_ || (currentFileIndex_ < index))
+        {
+            if (!goToNextFile())
+                return false;
+        }
+
+        filePath.append(currentFileName_);
+        return true;
+    }
+
+private:
+    static bool isMp3File(const DirectoryIterator& dirIt)
+    {
+        if (!dirIt.isFile()
+            || dirIt.isHidden()
+            || dirIt.isSystemFileOrDirectory())
+            return false;
+
+        // check the extension without copying the entire name
+        const char* name = dirIt.getName();
+        const size_t length = strlen(name);
+        if (length < 4)
+            return false;
+        return FixedSizeStr<4>(name + length - 4).endsWithIgnoringCase(".mp3");
+    }
+
+    /** Identifies the state of the directory that a playlist cache was built from.
+     *  FAT doesn't update the modification time of a directory and without a
+     *  real time clock, all new files get the same date. Renamed or replaced
+     *  files are only detected by the hash over the names and sizes.
+     *  It's built while the names are collected, so it costs no extra pass.
+     */
+    struct Fingerprint
+    {
+        uint32_t numEntries;
+        uint32_t modificationTime;
+        uint32_t entriesHash;
+    };
+
+    struct PlaylistCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        Fingerprint fingerprint;
+        uint32_t numFiles;
+        uint32_t numNameBytes; // all names, including their terminating zeros
+    };
+
+    /** Reads all mp3 file names of the directory in a single pass and switches
+     *  to the streaming mode if they don't fit. Until then, the same pass also
+     *  builds the fingerprint of the directory. It's not needed in the
+     *  streaming mode, because that mode doesn't use the playlist cache.
+     */
+    void collectNames(const char* directoryPath, Fingerprint& fingerprint)
+    {
+        numFiles_ = 0;
+        fingerprint = { 0, 0, 2166136261u };
+
+        DirectoryIterator dirIt(directoryPath);
+        while (dirIt.isValid())
+        {
+            const char* name = dirIt.getName();
+            // the cache file itself is not part of the fingerprint
+            if (!isStreaming_ && (strcmp(name, playlistCacheFileName_) != 0))
+            {
+                fingerprint.numEntries++;
+                // FNV-1a over the name, including its terminating zero, and the size
+                const uint32_t size = dirIt.getSize();
+                fingerprint.entriesHash = hashOf(fingerprint.entriesHash, name, strlen(name) + 1);
+                fingerprint.entriesHash = hashOf(fingerprint.entriesHash, &size, sizeof(size));
+            }
+            if (isMp3File(dirIt))
+            {
+                numFiles_++;
+                // switch to streaming mode when the names don't fit
+                if (!isStreaming_ && !fileNames_.add(name))
+                    isStreaming_ = true;
+            }
+            dirIt.advance();
+        }
+
+        if (!isStreaming_)
+            fingerprint.modificationTime = File(directoryPath).getModificationTime();
+    }
+
+    static uint32_t hashOf(uint32_t hash, const void* data, size_t numBytes)
+    {
+        const uint8_t* bytes = (const uint8_t*) data;
+        for (size_t i = 0; i < numBytes; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    /** Returns false if the path of the cache file would be too long */
+    bool getPlaylistCacheFilePath(StringType& path) const
+    {
+        const char* directoryPath = fileNames_.getCommonPrefix();
+        if (strlen(directoryPath) + 1 + strlen(playlistCacheFileName_) > path.maxSize())
+            return false;
+        path = directoryPath;
+        path.append('/');
+        path.append(playlistCacheFileName_);
+        return true;
+    }
+
+    bool savePlaylistCache(const Fingerprint& fingerprint) const
+    {
+        StringType path;
+        if (!getPlaylistCacheFilePath(path))
+            return false;
+
+        PlaylistCacheHeader header = {
+            playlistCacheMagic_,
+            playlistCacheVersion_,
+            fingerprint,
+            uint32_t(numFiles_),
+            0
+        };
+        for (size_t i = 0; i < numFiles_; i++)
+            header.numNameBytes += uint32_t(strlen(fileNames_[i]) + 1);
+
+        File file(path);
+        if (!file.open(File::AccessMode::readWrite, File::OpenMode::createNewAllowOverwrite))
+            return false;
+        uint32_t numBytesWritten = 0;
+        if (!file.tryWrite((const char*) &header, sizeof(header), numBytesWritten)
+            || (numBytesWritten != sizeof(header)))
+            return false;
+        // the names, in sort order, with their terminating zeros
+        for (size_t i = 0; i < numFiles_; i++)
+        {
+            const auto numBytes = uint32_t(strlen(fileNames_[i]) + 1);
+            if (!file.tryWrite(fileNames_[i], numBytes, numBytesWritten)
+                || (numBytesWritten != numBytes))
+                return false;
+        }
+        return file.close();
+    }
+
+    /** Replaces the collected names with the sorted names from the cache file.
+     *  Returns false and leaves the names untouched if the cache doesn't match the
+     *  directory. If the cache file turns out to be broken while reading the names,
+     *  returns false with no names left in the list.
+     */
+    bool loadPlaylistCache(const Fingerprint& fingerprint)
+    {
+        StringType path;
+        if (!getPlaylistCacheFilePath(path))
+            return false;
+
+        File file(path);
+        if (!file.open(File::AccessMode::read, File::OpenMode::openIfExists))
+            return false;
+
+        // File::tryRead() adds a terminating zero
+        char buffer[readChunkSize_ + 1];
+        uint32_t numBytesRead = 0;
+        PlaylistCacheHeader header;
+        if (!file.tryRead(buffer, sizeof(header), numBytesRead)
+            || (numBytesRead != sizeof(header)))
+            return false;
+        memcpy(&header, buffer, sizeof(header));
+        if ((header.magic != playlistCacheMagic_)
+            || (header.version != playlistCacheVersion_)
+            || (header.fingerprint.numEntries != fingerprint.numEntries)
+            || (header.fingerprint.modificationTime != fingerprint.modificationTime)
+            || (header.fingerprint.entriesHash != fingerprint.entriesHash)
+            || (header.numFiles != numFiles_))
+            return false;
+
+        const StringType directoryPath = fileNames_.getCommonPrefix();
+        fileNames_.clear(directoryPath);
+        if (fileNames_.getNumBytesUsed() + header.numNameBytes > arenaSize)
+            return false;
+
+        // read the names, which are already sorted
+        StringType name;
+        uint32_t numBytesRemaining = header.numNameBytes;
+        while (numBytesRemaining > 0)
+        {
+            const auto numBytesToRead = std::min(numBytesRemaining, uint32_t(readChunkSize_));
+            if (!file.tryRead(buffer, numBytesToRead, numBytesRead)
+                || (numBytesRead != numBytesToRead))
+                break;
+            numBytesRemaining -= numBytesRead;
+
+            for (uint32_t i = 0; i < numBytesRead; i++)
+            {
+                if (buffer[i] != 0)
+                    name.append(buffer[i]);
+                else
+                {
+                    if (!fileNames_.add(name))
+                        break;
+                    name.clear();
+                }
+            }
+        }
+
+        // is the cache file broken?
+        if ((numBytesRemaining > 0) || (fileNames_.size() != header.numFiles))
+        {
+            fileNames_.clear(directoryPath);
+            return false;
+        }
+        return true;
+    }
+
+    /** Starts over at the beginning of the directory in the streaming mode */
+    void resetWindow()
+    {
+        hasCurrentFile_ = false;
+        currentFileIndex_ = 0;
+        currentFileName_.clear();
+        window_.clear();
+        isWindowComplete_ = false;
+    }
+
+    /** Moves to the next file in sort order in the streaming mode */
+    bool goToNextFile()
+    {
+        if (window_.size() == 0)
+        {
+            if (isWindowComplete_)
+                return false;
+            refillWindow();
+            if (window_.size() == 0)
+                return false;
+        }
+
+        if (hasCurrentFile_)
+            currentFileIndex_++;
+        hasCurrentFile_ = true;
+        currentFileName_ = window_[0];
+        window_.remove(0);
+        return true;
+    }
+
+    /** Moves to the previous file in sort order in the streaming mode */
+    bool goToPreviousFile()
+    {
+        if (!hasCurrentFile_ || (currentFileIndex_ == 0))
+            return false;
+
+        // find the largest name that is smaller than the current one
+        StringType previousFileName;
+        bool found = false;
+        DirectoryIterator dirIt(fileNames_.getCommonPrefix());
+        while (dirIt.isValid())
+        {
+            if (isMp3File(dirIt))
+            {
+                const char* name = dirIt.getName();
+                if ((strcmp(name, currentFileName_) < 0)
+                    && (!found || (strcmp(name, previousFileName) > 0)))
+                {
+                    previousFileName = name;
+                    found = true;
+                }
+            }
+            dirIt.advance();
+        }
+        if (!found)
+            return false;
+
+        // the current file becomes the first one in the window
+        if (window_.size() == window_.getCapacity())
+        {
+            window_.remove(window_.size() - 1);
+            isWindowComplete_ = false;
+        }
+        window_.insert(0, currentFileName_);
+        currentFileName_ = previousFileName;
+        currentFileIndex_--;
+        return true;
+    }
+
+    /** Collects the next names after the current file in a single pass over the
+     *  directory. Only the smallest windowSize names are kept.
+     */
+    void refillWindow()
+    {
+        window_.clear();
+        isWindowComplete_ = true;
+
+        DirectoryIterator dirIt(fileNames_.getCommonPrefix());
+        while (dirIt.isValid())
+        {
+            if (isMp3File(dirIt))
+            {
+                const char* name = dirIt.getName();
+                if (!hasCurrentFile_ || (strcmp(name, currentFileName_) > 0))
+                    insertIntoWindow(name);
+            }
+            dirIt.advance();
+        }
+    }
+
+    void insertIntoWindow(const char* name)
+    {
+        // find the insert position, the window is small.
+        size_t position = window_.size();
+        while ((position > 0) && (strcmp(name, window_[position - 1]) < 0))
+            position--;
+
+        if (window_.size() == window_.getCapacity())
+        {
+            // there are more names than fit into the window
+            isWindowComplete_ = false;
+            if (position == window_.size())
+                return;
+            window_.remove(window_.size() - 1);
+        }
+        window_.insert(position, name);
+    }
+
+    static constexpr const char* playlistCacheFileName_ = ".wk_playlist";
+    static constexpr uint32_t playlistCacheMagic_ = 0x4C504B57; // "WKPL"
+    static constexpr uint32_t playlistCacheVersion_ = 2;
+    static constexpr size_t readChunkSize_ = 128;
+
+    bool isStreaming_;
+    size_t numFiles_;
+
+    /** The directory path, followed by all file names in the normal mode */
+    PackedStringList<arenaSize, maxNumFiles> fileNames_;
+
+    // streaming mode
+    bool hasCurrentFile_;
+    size_t currentFileIndex_;
+    StringType currentFileName_;
+    StaticVector<StringType, windowSize> window_;
+    /** When true, window_ contains all the files after the current file */
+    bool isWindowComplete_;
+};
@@ -80,6 +80,16 @@ public:
         return isValid();
     }
 
+    // goes back to the first entry in the directory and returns true, if it
+    // points to a valid file after the operation
+    bool rewind()
+    {
+        errorCode_ = f_rewinddir(&dirHandle_);
+        if (errorCode_ != FR_OK)
+            return false;
+        return advance();
+    }
+
     /** Returns the file or directory name of the current entry or an empty
      *  string if A) there was an error or B) the directory end 
      *  is reached 
@@ -122,6 +132,12 @@ public:
         return isValid() && (fileInfo_.fattrib & AM_RDO);
     }
 
+    /** Returns the size of the current file in bytes */
+    uint32_t getSize() const
+    {
+        return isValid() ? uint32_t(fileInfo_.fsize) : 0;
+    }
+
     const char* getDirectoryPath() const { return directoryPath_; }
     FRESULT getLastError() const { return errorCode_; }
 
@@ -151,6 +167,7 @@ public:
         virtual bool isDirectoryEndReached() const = 0;
         virtual bool hasError() const = 0;
         virtual bool advance() = 0;
+        virtual bool rewind() = 0;
         virtual const char* getName() const = 0;
         virtual bool isDirectory() const = 0;
 
@@ -159,6 +176,7 @@ public:
         virtual bool isSystemFileOrDirectory() const = 0;
         virtual bool isArchived() const = 0;
         virtual bool isReadOnly() const = 0;
+        virtual uint32_t getSize() const = 0;
 
         virtual const char* getDirectoryPath() const = 0;
         virtual FRESULT getLastError() const = 0;
@@ -211,6 +229,15 @@ public:
         return false;
     }
 
+    // goes back to the first entry in the directory and returns true, if it
+    // points to a valid file after the operation
+    bool rewind()
+    {
+        if (impl_)
+            return impl_->rewind();
+        return false;
+    }
+
     const char* getName() const
     {
         if (impl_)
@@ -260,6 +287,13 @@ public:
         return false;
     }
 
+    uint32_t getSize() const
+    {
+        if (impl_)
+            return impl_->getSize();
+        return 0;
+    }
+
     const char* getDirectoryPath() const
     {
         if (impl_)
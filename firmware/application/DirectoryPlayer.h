@@ -19,8 +19,8 @@
 #include "stdint.h"
 #include "AudioStreamPlayer.h"
 #include "AudioFileStream.h"
-#include "Containers.h"
-#include "DirectoryIterator.h"
+#include "DirectoryFileList.h"
+#include "PlaybackPosition.h"
 
 class DirectoryPlayer
 {
@@ -29,6 +29,11 @@ public:
     virtual ~DirectoryPlayer() = default;
     /** starts playing back all audio files from the provided directory in alphabetical order. */
     virtual void startPlayingDirectory(const char* directoryPath) = 0;
+    /** Like startPlayingDirectory(), but starts at `position`. Starts at the beginning
+     *  if the file at that position has changed. */
+    virtual void resumePlayingDirectory(const char* directoryPath, const PlaybackPosition& position) = 0;
+    /** Returns the current position while it's playing. */
+    virtual PlaybackPosition getPlaybackPosition() const = 0;
     /** Returns true while it's playing. */
     virtual bool isPlaying() const = 0;
     /** Restarts the current track if the playtime is <= 2s or starts playing the previous track. */
@@ -50,25 +55,59 @@ public:
     Mp3DirectoryPlayer(StreamPlayerType& streamPlayer) :
         streamPlayer_(streamPlayer),
         nextAction_(NextAction::restartFile),
-        currentFileIndex_(0)
+        currentFileIndex_(0),
+        currentStreamIndex_(0),
+        preparedFileIndex_(0),
+        isNextStreamPrepared_(false),
+        resumePositionMs_(0)
     {
+        filePathHashes_[0] = 0;
+        filePathHashes_[1] = 0;
     }
     Mp3DirectoryPlayer(const Mp3DirectoryPlayer&) = delete;
 
     void startPlayingDirectory(const char* directoryPath) override
     {
+        abortPreparedStream();
         updateAndSortFileList(directoryPath);
+        resumePositionMs_ = 0;
         nextAction_ = NextAction::restartFile;
         streamPlayer_.startPlayingNextStreamFrom(*this);
     }
 
-    bool isPlaying() const override { return currentFileIndex_ < files_.size(); }
+    void resumePlayingDirectory(const char* directoryPath, const PlaybackPosition& position) override
+    {
+        abortPreparedStream();
+        updateAndSortFileList(directoryPath);
+        FixedSizeStr<256> filePath;
+        if (fileList_.getFilePath(position.trackIndex, filePath)
+            && (PlaybackPosition::hashOf(filePath) == position.filePathHash))
+        {
+            currentFileIndex_ = position.trackIndex;
+            resumePositionMs_ = position.positionMs;
+        }
+        nextAction_ = NextAction::restartFile;
+        streamPlayer_.startPlayingNextStreamFrom(*this);
+    }
+
+    PlaybackPosition getPlaybackPosition() const override
+    {
+        PlaybackPosition position;
+        if (!isPlaying())
+            return position;
+        position.trackIndex = uint16_t(currentFileIndex_);
+        position.filePathHash = filePathHashes_[currentStreamIndex_];
+        position.positionMs = uint32_t(getCurrentFileStream().getNumSecondsPlayed() * 1000.0f);
+        return position;
+    }
+
+    bool isPlaying() const override { return currentFileIndex_ < fileList_.size(); }
 
     void goToPreviousTrack() override
     {
         if (isPlaying())
         {
-            if ((fileStream_.getNumSecondsPlayed() <= 5.0f)
+            if ((getCurrentFileStream().getNumSecondsPlayed() <= 5.0f)
                 && (currentFileIndex_ > 0))
                 nextAction_ = NextAction::prevFile;
             else
@@ -76,7 +115,7 @@ public:
 
             // stop the stream so that it completes and getNextStream()
             // gets called.
-            fileStream_.abortStream();
+            getCurrentFileStream().abortStream();
         }
     }
 
@@ -85,14 +124,14 @@ public:
         if (isPlaying())
         {
             // don't go to the next file if we're already playing the last file in the list.
-            if (currentFileIndex_ + 1 == files_.size())
+            if (currentFileIndex_ + 1 == fileList_.size())
                 return;
 
             nextAction_ = NextAction::nextFile;
 
             // stop the stream so that it completes and getNextStream()
             // gets called.
-            fileStream_.abortStream();
+            getCurrentFileStream().abortStream();
         }
     }
 
@@ -104,7 +143,7 @@ public:
 
             // stop the stream so that it completes and getNextStream()
             // gets called.
-            fileStream_.abortStream();
+            getCurrentFileStream().abortStream();
         }
     }
 
@@ -140,57 +179,75 @@ public:
             case NextAction::stop:
                 // We were called because the current file was aborted so that
                 // playback can stop.
-                currentFileIndex_ = files_.size();
+                currentFileIndex_ = fileList_.size();
                 break;
         }
 
-        if (currentFileIndex_ >= files_.size())
+        if (currentFileIndex_ >= fileList_.size())
+        {
+            abortPreparedStream();
             return nullptr;
-        else
+        }
+
+        // use the stream that was primed while the previous file was playing
+        if (isNextStreamPrepared_ && (preparedFileIndex_ == currentFileIndex_))
         {
-            if (fileStream_.restartWithFile(files_[currentFileIndex_]))
-                return &fileStream_;
-            else
-                return nullptr;
+            isNextStreamPrepared_ = false;
+            currentStreamIndex_ = 1 - currentStreamIndex_;
+            if (getCurrentFileStream().isPlaying())
+                return &getCurrentFileStream();
         }
+        abortPreparedStream();
+
+        // only the first file after resumePlayingDirectory() starts in the middle
+        const uint32_t resumePositionMs = resumePositionMs_;
+        resumePositionMs_ = 0;
+
+        FixedSizeStr<256> filePath;
+        if (!fileList_.getFilePath(currentFileIndex_, filePath)
+            || !getCurrentFileStream().restartWithFile(filePath))
+            return nullptr;
+        filePathHashes_[currentStreamIndex_] = PlaybackPosition::hashOf(filePath);
+        if (resumePositionMs > 0)
+            getCurrentFileStream().seekToSeconds(float(resumePositionMs) / 1000.0f);
+        return &getCurrentFileStream();
     }
 
     void streamCompleted(StereoAudioSampleStream*) override {}
 
-private:
-    void updateAndSortFileList(const char* directoryPath)
+    void prepareNextStream() override
     {
-        files_.clear();
-        DirectoryIterator dirIt(directoryPath);
+        if (isNextStreamPrepared_ || (nextAction_ != NextAction::goOn))
+            return;
+        if (currentFileIndex_ + 1 >= fileList_.size())
+            return;
 
-        while (dirIt.isValid())
+        // Mark as prepared even if the file can't be opened, so that we don't
+        // retry on every call. getNextStream() will then try again and skip it.
+        isNextStreamPrepared_ = true;
+        preparedFileIndex_ = currentFileIndex_ + 1;
+        FixedSizeStr<256> filePath;
+        if (fileList_.getFilePath(preparedFileIndex_, filePath))
         {
-            if (!dirIt.isFile()
-                || dirIt.isHidden()
-                || dirIt.isSystemFileOrDirectory())
-            {
-                dirIt.advance();
-                continue;
-            }
-
-            FixedSizeStr<256> filePath;
-
-            // combine full file path
-            filePath = directoryPath;
-            filePath.append('/');
-            filePath.append(dirIt.getName());
-
-            if (!filePath.endsWithIgnoringCase(".mp3"))
-            {
-                dirIt.advance();
-                continue;
-            }
-
-            files_.add(filePath);
-            dirIt.advance();
+            filePathHashes_[1 - currentStreamIndex_] = PlaybackPosition::hashOf(filePath);
+            getNextFileStream().restartWithFile(filePath);
         }
+    }
 
-        files_.sortAscending();
+private:
+    Mp3FileStream& getCurrentFileStream() { return fileStreams_[currentStreamIndex_]; }
+    const Mp3FileStream& getCurrentFileStream() const { return fileStreams_[currentStreamIndex_]; }
+    Mp3FileStream& getNextFileStream() { return fileStreams_[1 - currentStreamIndex_]; }
+
+    void abortPreparedStream()
+    {
+        getNextFileStream().abortStream();
+        isNextStreamPrepared_ = false;
+    }
+
+    void updateAndSortFileList(const char* directoryPath)
+    {
+        fileList_.open(directoryPath);
         currentFileIndex_ = 0;
     }
 
@@ -204,8 +261,20 @@ private:
     };
 
     StreamPlayerType& streamPlayer_;
-    Mp3FileStream fileStream_;
+    /** Two streams, so that the next file can be primed while the current one plays. */
+    Mp3FileStream fileStreams_[2];
     NextAction nextAction_;
     size_t currentFileIndex_;
-    StaticVector<FixedSizeStr<256>, 128> files_;
+    int currentStreamIndex_;
+    size_t preparedFileIndex_;
+    bool isNextStreamPrepared_;
+    /** The hash of the file path of each of the two streams, for the PlaybackPosition */
+    uint16_t filePathHashes_[2];
+    /** Where to start the next file that's played, 0 for the beginning */
+    uint32_t resumePositionMs_;
+    /** Holds the directory path and up to 2048 file names in about the same
+     *  amount of RAM that 128 full file paths would use. Larger directories
+     *  are streamed from the disk.
+     */
+    DirectoryFileList<26 * 1024, 2048, 8> fileList_;
 };
\ No newline at end of file
@@ -141,6 +141,31 @@ public:
         return false;
     }
 
+    /** Switches an opened file to FatFS' fast seek mode: the cluster chain of the
+     *  file is read once into `clusterLinkMap` (the "CLMT"). Afterwards, seeking and
+     *  reading across clusters no longer looks up the FAT, which makes seeks in large
+     *  files take constant time.
+     *  The map needs two entries per fragment of the file, plus two. If it's too
+     *  small, this returns false and the file keeps working without fast seek.
+     *  `clusterLinkMap` must stay valid until the file is closed. The file can't grow
+     *  while in fast seek mode, so use this for files that are only read.
+     */
+    bool enableFastSeek(uint32_t* clusterLinkMap, size_t mapSize)
+    {
+        if (!isOpened_ || (mapSize < 4))
+            return false;
+        clusterLinkMap[0] = DWORD(mapSize);
+        fileHandle_.cltbl = clusterLinkMap;
+        errorCode_ = f_lseek(&fileHandle_, CREATE_LINKMAP);
+        if (errorCode_ != FR_OK)
+        {
+            // too many fragments (or a disk error): stay in the normal mode
+            fileHandle_.cltbl = nullptr;
+            return false;
+        }
+        return true;
+    }
+
     /** Reads up to `numBytesRequested` into `readBuffer`, stores the number
      *  of characters read in `numBytesRead`. Zero terminates the final string in
      *  `readBuffer`. `readBuffer` must be at least `numBytesRequested + 1` bytes long.
@@ -195,6 +220,13 @@ public:
         return setCursorTo(advancedPositon);
     }
 
+    size_t getCursorPosition() const
+    {
+        if (!isOpened_)
+            return 0;
+        return f_tell(&fileHandle_);
+    }
+
     bool write(const char* string)
     {
         if (!isOpened_)
@@ -203,12 +235,37 @@ public:
         return string[numWritten] == 0; // did we write the full string?
     }
 
+    /** Writes `numBytesToWrite` bytes of binary data from `writeBuffer`, stores the
+     *  number of bytes actually written in `numBytesWritten`.
+     *  Returns true, if the write operation was successful.
+     */
+    bool tryWrite(const char* writeBuffer, uint32_t numBytesToWrite, uint32_t& numBytesWritten)
+    {
+        if (!isOpened_)
+            return false;
+        UINT numWritten;
+        errorCode_ = f_write(&fileHandle_, writeBuffer, numBytesToWrite, &numWritten);
+        numBytesWritten = numWritten;
+        return errorCode_ == FR_OK;
+    }
+
     /** Returns true if the file has reach its end and can no longer read more bytes. */
     bool isEndOfFile() const
     {
         return f_eof(&fileHandle_);
     }
 
+    /** Returns the FAT timestamp of the last modification ((date << 16) | time)
+     *  or 0 if the file doesn't exist. The file doesn't have to be opened.
+     */
+    uint32_t getModificationTime() const
+    {
+        FILINFO fileInfo;
+        if (f_stat(filePath_, &fileInfo) != FR_OK)
+            return 0;
+        return (uint32_t(fileInfo.fdate) << 16) | fileInfo.ftime;
+    }
+
     const char* getFilePath() const { return filePath_; }
     FRESULT getLastError() const { return errorCode_; }
 
@@ -254,13 +311,17 @@ public:
         virtual UnitTestImpl& operator=(const char* filePath) = 0;
         virtual bool open(AccessMode accessMode, OpenMode openMode) = 0;
         virtual bool close() = 0;
+        virtual bool enableFastSeek(uint32_t* clusterLinkMap, size_t mapSize) = 0;
         virtual bool tryRead(char* readBuffer, uint32_t numBytesRequested, uint32_t& numBytesRead) = 0;
         virtual bool readLine(FixedSizeStr<1000>& outputString) = 0;
         virtual size_t getSize() const = 0;
         virtual bool setCursorTo(size_t position) = 0;
         virtual bool advanceCursor(size_t numBytes) = 0;
+        virtual size_t getCursorPosition() const = 0;
         virtual bool write(const char* string) = 0;
+        virtual bool tryWrite(const char* writeBuffer, uint32_t numBytesToWrite, uint32_t& numBytesWritten) = 0;
         virtual bool isEndOfFile() const = 0;
+        virtual uint32_t getModificationTime() const = 0;
         virtual const char* getFilePath() const = 0;
         virtual FRESULT getLastError() const = 0;
     };
@@ -322,6 +383,13 @@ public:
         return false;
     }
 
+    bool enableFastSeek(uint32_t* clusterLinkMap, size_t mapSize)
+    {
+        if (impl_)
+            return impl_->enableFastSeek(clusterLinkMap, mapSize);
+        return false;
+    }
+
     bool tryRead(char* readBuffer, uint32_t numBytesRequested, uint32_t& numBytesRead)
     {
         if (impl_)
@@ -365,6 +433,13 @@ public:
         return false;
     }
 
+    size_t getCursorPosition() const
+    {
+        if (impl_)
+            return impl_->getCursorPosition();
+        return 0;
+    }
+
     bool write(const char* string)
     {
         if (impl_)
@@ -372,6 +447,13 @@ public:
         return false;
     }
 
+    bool tryWrite(const char* writeBuffer, uint32_t numBytesToWrite, uint32_t& numBytesWritten)
+    {
+        if (impl_)
+            return impl_->tryWrite(writeBuffer, numBytesToWrite, numBytesWritten);
+        return false;
+    }
+
     bool isEndOfFile() const
     {
         if (impl_)
@@ -379,6 +461,13 @@ public:
         return true;
     }
 
+    uint32_t getModificationTime() const
+    {
+        if (impl_)
+            return impl_->getModificationTime();
+        return 0;
+    }
+
     const char* getFilePath() const
     {
         if (impl_)
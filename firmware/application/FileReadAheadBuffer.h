@@ -0,0 +1,254 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "File.h"
+#include "Profiler.h"
+
+/**
+ *  @brief  Reads a file ahead into two blocks: one block is read by the consumer
+ *          while the other one is filled from the file. Filling a block is a read
+ *          request that is carried out in small chunks by serviceReadRequests(),
+ *          so that the caller never blocks for a whole block at once and can
+ *          interleave the file reads with its other work.
+ *
+ *          The two blocks are adjacent in memory, so that data flows from the first
+ *          into the second block without a copy. Only when the consumer wraps around
+ *          from the end of the second block to the start of the first one, the few
+ *          bytes that are left at the end of the second block are copied to a guard
+ *          area right in front of the first block.
+ *
+ *  @tparam blockSize               The size of each of the two blocks
+ *  @tparam maxNumContiguousBytes   The largest number of bytes the consumer will ever
+ *                                  need in one piece (e.g. the largest mp3 frame)
+ *  @tparam readChunkSize           The number of bytes read by each call to
+ *                                  serviceReadRequests()
+ */
+template <size_t blockSize, size_t maxNumContiguousBytes, size_t readChunkSize>
+class FileReadAheadBuffer
+{
+public:
+    static_assert(maxNumContiguousBytes <= blockSize, "The guard area must not be larger than a block");
+    static_assert(readChunkSize <= blockSize, "A read chunk must fit into a block");
+
+    FileReadAheadBuffer() { stop(); }
+    FileReadAheadBuffer(const FileReadAheadBuffer&) = delete;
+
+    /** Starts reading ahead from the current position of `file`, which must be opened
+     *  and must outlive the reading. Doesn't read anything yet. */
+    void start(File& file)
+    {
+        stop();
+        file_ = &file;
+        filePosition_ = file.getCursorPosition();
+    }
+
+    /** Stops reading and forgets all data. */
+    void stop()
+    {
+        file_ = nullptr;
+        for (auto& block : blocks_)
+        {
+            block.state = BlockState::free;
+            block.numBytes = 0;
+        }
+        blockToFill_ = 0;
+        readBlock_ = 0;
+        readPosition_ = getBlockStart(0);
+        isEndOfFileReached_ = false;
+        hasReadError_ = false;
+        numBytesCopied_ = 0;
+        numReadRequests_ = 0;
+        filePosition_ = 0;
+    }
+
+    /** Continues the pending read request by reading one chunk from the file.
+     *  Returns false if a read error occurred. */
+    bool serviceReadRequests()
+    {
+        PROFILE_ZONE(fileRead);
+        if (hasReadError_)
+            return false;
+        if (!file_ || isEndOfFileReached_)
+            return true;
+
+        auto& block = blocks_[blockToFill_];
+        if (block.state == BlockState::full)
+            return true; // both blocks are full, nothing to do
+
+        block.state = BlockState::filling;
+        const uint32_t numBytesToRead = uint32_t(blockSize - block.numBytes) < uint32_t(readChunkSize)
+                                            ? uint32_t(blockSize - block.numBytes)
+                                            : uint32_t(readChunkSize);
+        // File::tryRead() adds a terminating zero, hence the extra byte at the end of buffer_.
+        uint32_t numBytesRead = 0;
+        numReadRequests_++;
+        if (!file_->tryRead(&buffer_[getBlockStart(blockToFill_) + block.numBytes], numBytesToRead, numBytesRead))
+        {
+            hasReadError_ = true;
+            return false;
+        }
+        block.numBytes += numBytesRead;
+        if (numBytesRead < numBytesToRead)
+            isEndOfFileReached_ = true;
+        if (isEndOfFileReached_ || (block.numBytes == blockSize))
+        {
+            block.state = BlockState::full;
+            blockToFill_ = 1 - blockToFill_;
+        }
+        return true;
+    }
+
+    /** Carries out all pending read requests until both blocks are full.
+     *  Returns false if a read error occurred. */
+    bool completeReadRequests()
+    {
+        while (hasPendingReadRequests())
+        {
+            if (!serviceReadRequests())
+                return false;
+        }
+        return !hasReadError_;
+    }
+
+    /** Returns true if there's a block that can be filled from the file. */
+    bool hasPendingReadRequests() const
+    {
+        return file_ && !isEndOfFileReached_ && !hasReadError_
+               && (blocks_[blockToFill_].state != BlockState::full);
+    }
+
+    /** Tries to make `numBytes` bytes (but no more than maxNumContiguousBytes) available
+     *  in one piece at getReadPointer(). Returns true if successful or if there are
+     *  fewer bytes left until the end of the file. Returns false if the data is not
+     *  yet read from the file; call serviceReadRequests() and try again. */
+    bool makeContiguous(size_t numBytes)
+    {
+        if (numBytes > maxNumContiguousBytes)
+            numBytes = maxNumContiguousBytes;
+        if (getNumContiguousBytes() >= numBytes)
+            return true;
+
+        // wrap around from the end of the second block to the first block,
+        // which is the next one to be filled.
+        if ((readBlock_ == 1) && (blocks_[1].state == BlockState::full))
+        {
+            const size_t numBytesLeft = getNumContiguousBytes();
+            const size_t newReadPosition = getBlockStart(0) - numBytesLeft;
+            memcpy(&buffer_[newReadPosition], &buffer_[readPosition_], numBytesLeft);
+            numBytesCopied_ += numBytesLeft;
+            readPosition_ = newReadPosition;
+            readBlock_ = 0;
+            blocks_[1].state = BlockState::free;
+            blocks_[1].numBytes = 0;
+            if (getNumContiguousBytes() >= numBytes)
+                return true;
+        }
+
+        // the rest of the file is available already
+        return !hasPendingReadRequests() && !isDataInOtherBlock();
+    }
+
+    /** Returns a pointer to the next byte to read. */
+    const char* getReadPointer() const { return &buffer_[readPosition_]; }
+
+    /** Returns the position of getReadPointer() in the file. */
+    size_t getFilePosition() const { return filePosition_; }
+
+    /** Returns the number of bytes available in one piece at getReadPointer(). */
+    size_t getNumContiguousBytes() const
+    {
+        size_t end = getBlockStart(readBlock_) + blocks_[readBlock_].numBytes;
+        // data continues into the second block
+        if ((readBlock_ == 0) && (blocks_[0].state == BlockState::full) && (blocks_[0].numBytes == blockSize))
+            end += blocks_[1].numBytes;
+        return end - readPosition_;
+    }
+
+    /** Marks `numBytes` bytes as read. Must not be more than getNumContiguousBytes(). */
+    void consume(size_t numBytes)
+    {
+        readPosition_ += numBytes;
+        filePosition_ += numBytes;
+        // a block was read completely, it can be filled again
+        if ((readBlock_ == 0) && (readPosition_ >= getBlockStart(1)))
+        {
+            blocks_[0].state = BlockState::free;
+            blocks_[0].numBytes = 0;
+            readBlock_ = 1;
+        }
+        if ((readBlock_ == 1) && (readPosition_ == getBlockStart(1) + blockSize))
+        {
+            blocks_[1].state = BlockState::free;
+            blocks_[1].numBytes = 0;
+            readBlock_ = 0;
+            readPosition_ = getBlockStart(0);
+        }
+    }
+
+    /** Returns true if all the data up to the end of the file was read. */
+    bool isExhausted() const
+    {
+        return isEndOfFileReached_ && (getNumContiguousBytes() == 0) && !isDataInOtherBlock();
+    }
+
+    bool hasReadError() const { return hasReadError_; }
+
+    /** Returns the number of bytes copied when wrapping around from the second to the first block. */
+    size_t getNumBytesCopied() const { return numBytesCopied_; }
+    /** Returns the number of calls to File::tryRead(). */
+    size_t getNumReadRequests() const { return numReadRequests_; }
+
+private:
+    enum class BlockState
+    {
+        free,
+        filling,
+        full
+    };
+
+    struct Block
+    {
+        BlockState state;
+        size_t numBytes;
+    };
+
+    static constexpr size_t getBlockStart(int blockIndex) { return maxNumContiguousBytes + size_t(blockIndex) * blockSize; }
+
+    /** Returns true if the block after the current one holds data that wasn't read yet. */
+    bool isDataInOtherBlock() const
+    {
+        return (readBlock_ == 1) && (blocks_[0].numBytes > 0);
+    }
+
+    File* file_;
+    Block blocks_[2];
+    int blockToFill_;
+    int readBlock_;
+    size_t readPosition_;
+    bool isEndOfFileReached_;
+    bool hasReadError_;
+    size_t numBytesCopied_;
+    size_t numReadRequests_;
+    size_t filePosition_;
+    /** guard area, two blocks and an extra byte for File::tryRead() */
+    char buffer_[maxNumContiguousBytes + 2 * blockSize + 1];
+};
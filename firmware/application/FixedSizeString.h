@@ -113,6 +113,7 @@ public:
         {
             buffer_[size_] = singleChar;
             size_++;
+            buffer_[size_] = '\0';
         }
     }
 
@@ -254,7 +255,8 @@ public:
         size_ = rhs.size_;
         rhs.size_ = tmp;
 
-        swap_(buffer_, rhs.buffer_, std::max(size_, rhs.size_));
+        // include the terminating zero
+        swap_(buffer_, rhs.buffer_, std::max(size_, rhs.size_) + 1);
     }
 
 private:
@@ -367,7 +369,7 @@ private:
 };
 
 template <class CharType, std::size_t capacity, class Traits = std::char_traits<CharType>>
-inline constexpr void swap(const FixedSizeStr<capacity, CharType>& lhs, const FixedSizeStr<capacity, CharType>& rhs) noexcept
+inline constexpr void swap(FixedSizeStr<capacity, CharType>& lhs, FixedSizeStr<capacity, CharType>& rhs) noexcept
 {
     rhs.swap(lhs);
 }
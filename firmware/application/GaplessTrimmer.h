@@ -0,0 +1,103 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <stdint.h>
+
+/**
+ *  @brief  Removes the encoder delay from the start and the padding from the end of
+ *          a decoded stream so that consecutive tracks play back without a gap.
+ *          Decoded blocks are passed through trim() in the order they were decoded;
+ *          the trimmer tells which part of each block must be played.
+ *          All numbers are in interleaved samples (i.e. two per stereo sample frame).
+ */
+class GaplessTrimmer
+{
+public:
+    GaplessTrimmer() { reset(); }
+
+    /** Resets the trimmer so that it passes through all samples. */
+    void reset()
+    {
+        numSamplesToSkip_ = 0;
+        numSamplesLeftToPlay_ = 0;
+        hasEnd_ = false;
+    }
+
+    /** Resets the trimmer so that it drops the first `numSamplesToSkip` samples and
+     *  passes through everything after that. */
+    void reset(uint32_t numSamplesToSkip)
+    {
+        numSamplesToSkip_ = numSamplesToSkip;
+        numSamplesLeftToPlay_ = 0;
+        hasEnd_ = false;
+    }
+
+    /** Resets the trimmer so that it drops the first `numSamplesToSkip` samples,
+     *  then passes through `numSamplesToPlay` samples and drops everything after that. */
+    void reset(uint32_t numSamplesToSkip, uint32_t numSamplesToPlay)
+    {
+        numSamplesToSkip_ = numSamplesToSkip;
+        numSamplesLeftToPlay_ = numSamplesToPlay;
+        hasEnd_ = true;
+    }
+
+    /** Trims the next decoded block of `numSamples` samples. On return, the
+     *  samples [firstSampleToPlay, firstSampleToPlay + numSamplesToPlay) of the
+     *  block must be played, the rest must be dropped. */
+    void trim(int numSamples, int& firstSampleToPlay, int& numSamplesToPlay)
+    {
+        firstSampleToPlay = 0;
+        numSamplesToPlay = numSamples;
+
+        if (numSamplesToSkip_ > 0)
+        {
+            const auto numToSkip = (uint32_t(numSamples) < numSamplesToSkip_) ? numSamples : int(numSamplesToSkip_);
+            numSamplesToSkip_ -= uint32_t(numToSkip);
+            firstSampleToPlay = numToSkip;
+            numSamplesToPlay -= numToSkip;
+        }
+
+        if (hasEnd_)
+        {
+            if (uint32_t(numSamplesToPlay) > numSamplesLeftToPlay_)
+                numSamplesToPlay = int(numSamplesLeftToPlay_);
+            numSamplesLeftToPlay_ -= uint32_t(numSamplesToPlay);
+        }
+    }
+
+    /** Moves the end by `numSamples` towards the start (or away from it, if negative),
+     *  e.g. when the position of the stream turned out to differ from an estimate. */
+    void moveEnd(int32_t numSamples)
+    {
+        if (!hasEnd_)
+            return;
+        if ((numSamples > 0) && (uint32_t(numSamples) > numSamplesLeftToPlay_))
+            numSamplesLeftToPlay_ = 0;
+        else
+            numSamplesLeftToPlay_ = uint32_t(int64_t(numSamplesLeftToPlay_) - numSamples);
+    }
+
+    /** Returns true when all samples that should be played have passed through trim(). */
+    bool isEndReached() const { return hasEnd_ && (numSamplesToSkip_ == 0) && (numSamplesLeftToPlay_ == 0); }
+
+private:
+    uint32_t numSamplesToSkip_;
+    uint32_t numSamplesLeftToPlay_;
+    bool hasEnd_;
+};
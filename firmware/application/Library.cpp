@@ -20,41 +20,60 @@
 #include "DirectoryIterator.h"
 
 Library::Library() :
-    isValid_(checkLibraryFile())
+    isValid_(false),
+    isCacheComplete_(false),
+    unlinkedFolderCursorPosition_(0)
 {
+    isValid_ = loadOrRebuildCache();
 }
 
-bool Library::getNextUnlinkedFolder(StringType& path)
+Library::~Library()
 {
-    DirectoryIterator iterator(""); // open root directory
+    unlinkedFolderCursor_.destroy();
+}
 
-    while (iterator.isValid())
+bool Library::getNextUnlinkedFolder(StringType& path)
+{
+    if (!unlinkedFolderCursor_)
     {
-        if (iterator.isFile()
-            || iterator.isSystemFileOrDirectory()
-            || iterator.isHidden()
-            || iterator.isArchived())
+        unlinkedFolderCursor_.create(""); // open root directory
+        unlinkedFolderCursorPosition_ = 0;
+    }
+    DirectoryIterator& iterator = *unlinkedFolderCursor_;
+
+    // Continue where the last call stopped. Links are never removed, so all
+    // folders before that position were linked already. Wrap around once
+    // to pick up anything that we didn't see before (e.g. after an error).
+    const size_t startPosition = unlinkedFolderCursorPosition_;
+    bool hasWrappedAround = (startPosition == 0);
+    while (true)
+    {
+        if (!iterator.isValid())
         {
-            iterator.advance();
+            if (hasWrappedAround)
+                break;
+            iterator.rewind();
+            unlinkedFolderCursorPosition_ = 0;
+            hasWrappedAround = true;
             continue;
         }
+        if ((startPosition > 0)
+            && hasWrappedAround
+            && (unlinkedFolderCursorPosition_ >= startPosition))
+            break;
 
-        // entry is a normal directory
-        path = iterator.getName();
-
-        // skip hidden directories that don't actually have the "hidden" flag
-        // but are hidden via their filename
-        if (path[0] == '.')
+        if (isCandidateForLinking(iterator))
         {
-            iterator.advance();
-            continue;
+            // check if this folder is linked. Stay on this entry if
+            // it's not, so that the next call returns it again until
+            // it was linked.
+            path = iterator.getName();
+            if (!isLinked(path))
+                return true;
         }
 
-        // check if this folder is linked
-        if (!isLinked(path))
-            return true;
-
         iterator.advance();
+        unlinkedFolderCursorPosition_++;
     }
 
     // all folders are linked
@@ -62,7 +81,110 @@ bool Library::getNextUnlinkedFolder(StringType& path)
     return false;
 }
 
+bool Library::isCandidateForLinking(const DirectoryIterator& iterator)
+{
+    if (iterator.isFile()
+        || iterator.isSystemFileOrDirectory()
+        || iterator.isHidden()
+        || iterator.isArchived())
+        return false;
+
+    // skip hidden directories that don't actually have the "hidden" flag
+    // but are hidden via their filename
+    if (iterator.getName()[0] == '.')
+        return false;
+
+    // entry is a normal directory
+    return true;
+}
+
 bool Library::getFolderFor(const RfidTagId& tag, StringType& path) const
+{
+    const char* folder = cache_.findFolderFor(tag);
+    if (folder)
+    {
+        path = folder;
+        return true;
+    }
+    if (!isCacheComplete_)
+        return scanLibraryFileForFolder(tag, path);
+
+    path = "";
+    return false;
+}
+
+bool Library::isLinked(const StringType& path) const
+{
+    if (cache_.containsFolder(path))
+        return true;
+    if (!isCacheComplete_)
+        return scanLibraryFileForLink(path);
+    return false;
+}
+
+bool Library::isLinked(const RfidTagId& tag) const
+{
+    if (cache_.containsTag(tag))
+        return true;
+    if (!isCacheComplete_)
+        return scanLibraryFileForLink(tag);
+    return false;
+}
+
+bool Library::storeLink(const RfidTagId& tag, const StringType& path)
+{
+    if (isLinked(path))
+        return false;
+    if (isLinked(tag))
+        return false;
+
+    {
+        File libFile(libraryFilePath_);
+
+        // check if file opens at all
+        if (!libFile.open(File::AccessMode::readWrite, File::OpenMode::openOrCreate))
+            return false;
+
+        StringType stringToWrite = getPrefixStr(tag);
+        stringToWrite.append(path);
+
+        // check if last character is a newline already
+        if (libFile.getSize() > 0)
+        {
+            if (!libFile.setCursorTo(libFile.getSize() - 1))
+                return false;
+            char lastCharacterInFile[2]; // space for terminating zero...
+            uint32_t numBytesRead = 0;
+            if (!libFile.tryRead(lastCharacterInFile, 1, numBytesRead))
+                return false;
+            // skip to file end
+            if (!libFile.setCursorTo(libFile.getSize()))
+                return false;
+            if (lastCharacterInFile[0] != '\n')
+                if (!libFile.write("\n"))
+                    return false;
+        }
+
+        // finally write the string
+        if (!libFile.write(stringToWrite))
+            return false;
+
+        // manually close the file to catch disk errors when flusing the buffers
+        if (!libFile.close())
+            return false;
+    }
+
+    // write-through: keep the cache in sync with the library file
+    if (cache_.add(tag, path) != CacheType::AddResult::added)
+        isCacheComplete_ = false;
+    cache_.setFingerprint(getLibraryFileFingerprint());
+    if (isCacheComplete_)
+        saveCache();
+
+    return true;
+}
+
+bool Library::scanLibraryFileForFolder(const RfidTagId& tag, StringType& path) const
 {
     File libFile(libraryFilePath_);
 
@@ -99,7 +221,7 @@ bool Library::getFolderFor(const RfidTagId& tag, StringType& path) const
     return false;
 }
 
-bool Library::isLinked(const StringType& path) const
+bool Library::scanLibraryFileForLink(const StringType& path) const
 {
     File libFile(libraryFilePath_);
 
@@ -129,7 +251,7 @@ bool Library::isLinked(const StringType& path) const
     return false;
 }
 
-bool Library::isLinked(const RfidTagId& tag) const
+bool Library::scanLibraryFileForLink(const RfidTagId& tag) const
 {
     File libFile(libraryFilePath_);
 
@@ -152,79 +274,127 @@ bool Library::isLinked(const RfidTagId& tag) const
     return false;
 }
 
-bool Library::storeLink(const RfidTagId& tag, const StringType& path) const
+bool Library::checkLibraryFileAndFillCache()
 {
-    if (isLinked(path))
-        return false;
-    if (isLinked(tag))
-        return false;
+    cache_.clear();
+    isCacheComplete_ = true;
 
-    File libFile(libraryFilePath_);
+    {
+        File libFile(libraryFilePath_);
 
-    // check if file opens at all
-    if (!libFile.open(File::AccessMode::readWrite, File::OpenMode::openOrCreate))
-        return false;
+        // check if file opens at all
+        if (!libFile.open(File::AccessMode::read, File::OpenMode::openOrCreate))
+            return false;
 
-    StringType stringToWrite = getPrefixStr(tag);
-    stringToWrite.append(path);
+        // read line by line, check format and cache the links
+        while (!libFile.isEndOfFile())
+        {
+            StringType line;
+            if (!libFile.readLine(line))
+                return false;
 
-    // check if last character is a newline already
-    if (libFile.getSize() > 0)
-    {
-        if (!libFile.setCursorTo(libFile.getSize() - 1))
-            return false;
-        char lastCharacterInFile[2]; // space for terminating zero...
-        uint32_t numBytesRead = 0;
-        if (!libFile.tryRead(lastCharacterInFile, 1, numBytesRead))
-            return false;
-        // skip to file end
-        if (!libFile.setCursorTo(libFile.getSize()))
-            return false;
-        if (lastCharacterInFile[0] != '\n')
-            if (!libFile.write("\n"))
+            // parseLine() checks that the line has the format "XXXXXXXX:foldername"
+            RfidTagId tag;
+            if (!parseLine(line, tag))
                 return false;
+
+            // A line like "XXXXXXXX:\n" is valid, but doesn't link anything.
+            if (line.empty())
+                continue;
+
+            // The cache stores only one folder per tag and one tag per folder.
+            // If a tag or a folder appears multiple times or if the cache is full,
+            // lookups for the remaining links fall back to scanning the library file.
+            // Scanning returns the first folder for a tag, so does the cache.
+            if (cache_.add(tag, line) != CacheType::AddResult::added)
+                isCacheComplete_ = false;
+        }
     }
 
-    // finally write the string
-    if (!libFile.write(stringToWrite))
+    cache_.setFingerprint(getLibraryFileFingerprint());
+    return true;
+}
+
+bool Library::loadOrRebuildCache()
+{
+    const auto fingerprint = getLibraryFileFingerprint();
+
+    // try to use the cache that was stored the last time
+    {
+        File cacheFile(cacheFilePath_);
+        if (cacheFile.open(File::AccessMode::read, File::OpenMode::openIfExists)
+            && cache_.loadFrom(cacheFile)
+            && (cache_.getFingerprint() == fingerprint))
+        {
+            // the library file was already checked when this cache was built
+            isCacheComplete_ = true;
+            return true;
+        }
+    }
+
+    // The cache is missing or the library file was modified since.
+    if (!checkLibraryFileAndFillCache())
+    {
+        // leave the cache incomplete so that we keep reading from the library file
+        cache_.clear();
+        isCacheComplete_ = false;
         return false;
+    }
 
-    // manually close the file to catch disk errors when flusing the buffers
-    return libFile.close();
+    // Storing the cache only speeds up the next startup, we don't
+    // care too much if it fails.
+    if (isCacheComplete_)
+        saveCache();
+    return true;
 }
 
-bool Library::checkLibraryFile()
+bool Library::saveCache() const
 {
-    File libFile(libraryFilePath_);
+    File cacheFile(cacheFilePath_);
+    // truncate, so that nothing of a larger previous cache remains at the end
+    if (!cacheFile.open(File::AccessMode::readWrite, File::OpenMode::createNewAllowOverwrite))
+        return false;
+    if (!cache_.saveTo(cacheFile))
+        return false;
+    return cacheFile.close();
+}
 
-    // check if file opens at all
+Library::CacheType::Fingerprint Library::getLibraryFileFingerprint() const
+{
+    File libFile(libraryFilePath_);
     if (!libFile.open(File::AccessMode::read, File::OpenMode::openOrCreate))
+        return { 0, 0 };
+    const auto fileSize = uint32_t(libFile.getSize());
+    libFile.close();
+    return { fileSize, libFile.getModificationTime() };
+}
+
+bool Library::parseLine(StringType& line, RfidTagId& tag)
+{
+    // must store at least the RFID-ID, the ":" and 1+ characters for the foldername
+    if (line.size() < 8 /* RFID ID */ + 1 /* : */ + 1 /* Foldername */)
+        return false;
+    if (line.data()[8] != ':')
         return false;
 
-    // read line by line and check format
-    while (!libFile.isEndOfFile())
+    uint32_t tagId = 0;
+    for (int i = 0; i < 8; i++)
     {
-        StringType line;
-        if (!libFile.readLine(line))
-            return false;
-        // must store at least the RFID-ID, the ":" and 1+ characters for the foldername
-        if (line.size() < 8 /* RFID ID */ + 1 /* : */ + 1 /* Foldername */)
-            return false;
-        // first 8 characters must be HEX
-        for (int i = 0; i < 8; i++)
-        {
-            const char c = line.data()[i];
-            const bool is0to9 = (c >= '0') && (c <= '9');
-            const bool isAtoF = (c >= 'A') && (c <= 'F');
-            if (!(is0to9 || isAtoF))
-                return false;
-        }
-        // 9th character must be ":"
-        if (line.data()[8] != ':')
+        const char c = line.data()[i];
+        if ((c >= '0') && (c <= '9'))
+            tagId = (tagId << 4) | uint32_t(c - '0');
+        else if ((c >= 'A') && (c <= 'F'))
+            tagId = (tagId << 4) | uint32_t(c - 'A' + 10);
+        else
             return false;
-        // okay, seems good! Go on with next line
     }
+    tag = tagId;
 
+    // truncate the FRID-ID and ":" from the beginning
+    line.removePrefix(9);
+    // remove any trailing newlines
+    if (line.endsWith("\n"))
+        line.removeSuffix(1);
     return true;
 }
 
@@ -236,4 +406,5 @@ FixedSizeStr<9> Library::getPrefixStr(const RfidTagId& tag)
     return result;
 }
 
-const char* Library::libraryFilePath_ = "library.txt";
\ No newline at end of file
+const char* Library::libraryFilePath_ = "library.txt";
+const char* Library::cacheFilePath_ = "library.idx";
\ No newline at end of file
@@ -17,7 +17,10 @@
 
 #pragma once
 #include <stdint.h>
+#include "Containers.h"
+#include "DirectoryIterator.h"
 #include "FixedSizeString.h"
+#include "LibraryCache.h"
 #include "RFID.h"
 
 class Library
@@ -27,6 +30,7 @@ public:
 
     Library();
     Library(const Library&) = delete;
+    ~Library();
 
     /** Returns true if the library file has a valid format. */
     bool isLibraryFileValid() { return isValid_; }
@@ -36,6 +40,8 @@ public:
      *  this returns false and path == "".
      *  When an unlicked directory is found, this returns true and
      *  path contains the name of the unlicked directory.
+     *  The search resumes where the last call stopped, so that linking
+     *  all folders one after another reads the root directory only once.
      */
     bool getNextUnlinkedFolder(StringType& path);
 
@@ -55,12 +61,43 @@ public:
     /** Saves a link in the library and returns true if successful. 
      *  If the link is already there, the operation will fail.
      */
-    bool storeLink(const RfidTagId& tag, const StringType& path) const;
+    bool storeLink(const RfidTagId& tag, const StringType& path);
+
+    /** The maximum number of links that are held in RAM. Libraries with more
+     *  links still work, but lookups for the remaining links are slow because
+     *  they fall back to scanning the library file. With folder names of about
+     *  30 characters, the name arena fills up first: the cache holds all links
+     *  of libraries with up to about 250 links (see y_benchmark_10kLinks).
+     */
+    static constexpr size_t maxNumCachedLinks_ = 256;
+    /** The number of bytes available to store the folder names of all cached links. */
+    static constexpr size_t cacheNameArenaSize_ = 8192;
+    using CacheType = LibraryCache<maxNumCachedLinks_, cacheNameArenaSize_>;
 
 private:
-    bool checkLibraryFile();
+    /** Checks the library file format and fills the cache in a single pass. */
+    bool checkLibraryFileAndFillCache();
+    bool loadOrRebuildCache();
+    bool saveCache() const;
+    CacheType::Fingerprint getLibraryFileFingerprint() const;
+    static bool parseLine(StringType& line, RfidTagId& tag);
     static FixedSizeStr<9> getPrefixStr(const RfidTagId& tag);
 
+    bool scanLibraryFileForFolder(const RfidTagId& tag, StringType& path) const;
+    bool scanLibraryFileForLink(const StringType& path) const;
+    bool scanLibraryFileForLink(const RfidTagId& tag) const;
+
+    /** Returns true if the current entry of the iterator is a normal, visible directory */
+    static bool isCandidateForLinking(const DirectoryIterator& iterator);
+
     static const char* libraryFilePath_;
+    static const char* cacheFilePath_;
     bool isValid_;
+    /** When true, all links from the library file are held in the cache */
+    bool isCacheComplete_;
+    CacheType cache_;
+    /** Root directory iterator used by getNextUnlinkedFolder(). Created on first use. */
+    LateInitializedObject<DirectoryIterator> unlinkedFolderCursor_;
+    /** Number of entries that unlinkedFolderCursor_ has advanced since the last rewind */
+    size_t unlinkedFolderCursorPosition_;
 };
\ No newline at end of file
@@ -0,0 +1,361 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "File.h"
+#include "RFID.h"
+
+/**
+ *  @brief  An in-RAM copy of all the links stored in the library file.
+ *          Links are stored in a fixed-capacity open-addressing hash table
+ *          keyed by the RFID tag, so that the folder for a tag can be found
+ *          in O(1). Folder names are stored once in a string arena and are
+ *          additionally indexed by a second hash table so that "is this folder
+ *          linked?" can be answered in O(1), too.
+ *          The cache can be stored to and loaded from a compact binary file so
+ *          that it doesn't have to be rebuilt from the library text file on
+ *          every startup.
+ *
+ *  @tparam capacity        The maximum number of links that can be cached
+ *  @tparam nameArenaSize   The number of bytes available to store all folder names
+ *                          (including a terminating zero for each of them)
+ */
+template <size_t capacity, size_t nameArenaSize>
+class LibraryCache
+{
+public:
+    /** Identifies the version of the library text file that the cache was built from. */
+    struct Fingerprint
+    {
+        uint32_t fileSize;
+        uint32_t modificationTime;
+
+        bool operator==(const Fingerprint& other) const
+        {
+            return (fileSize == other.fileSize)
+                   && (modificationTime == other.modificationTime);
+        }
+        bool operator!=(const Fingerprint& other) const { return !(*this == other); }
+    };
+
+    /** The result of LibraryCache::add() */
+    enum class AddResult
+    {
+        added,
+        tagAlreadyInUse,
+        folderAlreadyLinked,
+        outOfMemory
+    };
+
+    LibraryCache()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        numLinks_ = 0;
+        namesSize_ = 0;
+        fingerprint_ = { 0, 0 };
+        for (size_t i = 0; i < tableSize_; i++)
+        {
+            tagTable_[i] = { 0, emptySlot_ };
+            nameTable_[i] = emptySlot_;
+        }
+    }
+
+    size_t getNumLinks() const { return numLinks_; }
+    static constexpr size_t getCapacity() { return capacity; }
+
+    const Fingerprint& getFingerprint() const { return fingerprint_; }
+    void setFingerprint(const Fingerprint& fingerprint) { fingerprint_ = fingerprint; }
+
+    /** Adds a link to the cache. */
+    AddResult add(const RfidTagId& tag, const char* folderName)
+    {
+        size_t tagSlot;
+        if (findTag(tag, tagSlot))
+            return AddResult::tagAlreadyInUse;
+        size_t nameSlot;
+        if (findFolder(folderName, nameSlot))
+            return AddResult::folderAlreadyLinked;
+
+        const auto nameLength = strlen(folderName);
+        if ((numLinks_ >= capacity) || (namesSize_ + nameLength + 1 > nameArenaSize))
+            return AddResult::outOfMemory;
+
+        // store the name
+        const auto nameOffset = uint32_t(namesSize_);
+        memcpy(&names_[namesSize_], folderName, nameLength + 1);
+        namesSize_ += nameLength + 1;
+
+        tagTable_[tagSlot] = { uint32_t(tag), nameOffset };
+        nameTable_[nameSlot] = nameOffset;
+        numLinks_++;
+        return AddResult::added;
+    }
+
+    /** Returns the folder name linked to the tag, or nullptr if the tag is not cached. */
+    const char* findFolderFor(const RfidTagId& tag) const
+    {
+        size_t tagSlot;
+        if (findTag(tag, tagSlot))
+            return &names_[tagTable_[tagSlot].nameOffset];
+        return nullptr;
+    }
+
+    /** Returns true if the tag is cached. */
+    bool containsTag(const RfidTagId& tag) const
+    {
+        size_t tagSlot;
+        return findTag(tag, tagSlot);
+    }
+
+    /** Returns true if the folder is cached. */
+    bool containsFolder(const char* folderName) const
+    {
+        size_t nameSlot;
+        return findFolder(folderName, nameSlot);
+    }
+
+    /** Writes the cache to a file that was opened for writing. */
+    bool saveTo(File& file) const
+    {
+        const FileHeader header = {
+            fileMagic_,
+            fileVersion_,
+            uint32_t(tableSize_),
+            uint32_t(numLinks_),
+            uint32_t(namesSize_),
+            fingerprint_,
+            getChecksum(namesSize_)
+        };
+        return writeBinary(file, &header, sizeof(header))
+               && writeBinary(file, tagTable_, sizeof(tagTable_))
+               && writeBinary(file, nameTable_, sizeof(nameTable_))
+               && writeBinary(file, names_, namesSize_);
+    }
+
+    /** Reads the cache from a file that was opened for reading.
+     *  Returns false and leaves the cache empty if the file doesn't
+     *  contain a valid cache or if it was written for a cache of
+     *  different capacity. A file that was only partially written
+     *  or that's corrupted is never loaded: all lookups rely on
+     *  valid name offsets and on at least one empty slot per table.
+     */
+    bool loadFrom(File& file)
+    {
+        clear();
+
+        FileHeader header;
+        if (!readBinary(file, &header, sizeof(header)))
+            return false;
+        if ((header.magic != fileMagic_)
+            || (header.version != fileVersion_)
+            || (header.tableSize != tableSize_)
+            || (header.numLinks > capacity)
+            || (header.namesSize > nameArenaSize))
+            return false;
+
+        const bool success = readBinary(file, tagTable_, sizeof(tagTable_))
+                             && readBinary(file, nameTable_, sizeof(nameTable_))
+                             && readBinary(file, names_, header.namesSize)
+                             && (getChecksum(header.namesSize) == header.checksum)
+                             && areTablesValid(header.numLinks, header.namesSize);
+        if (!success)
+        {
+            clear();
+            return false;
+        }
+
+        numLinks_ = header.numLinks;
+        namesSize_ = header.namesSize;
+        fingerprint_ = header.fingerprint;
+        return true;
+    }
+
+private:
+    struct TagSlot
+    {
+        uint32_t tag;
+        uint32_t nameOffset; // emptySlot_ for unused slots
+    };
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t tableSize;
+        uint32_t numLinks;
+        uint32_t namesSize;
+        Fingerprint fingerprint;
+        /** Over the tables and the names */
+        uint32_t checksum;
+    };
+
+    static constexpr size_t getTableSize()
+    {
+        // a power of two with at least 50% free slots
+        size_t size = 1;
+        while (size < 2 * capacity)
+            size <<= 1;
+        return size;
+    }
+
+    /** FNV-1a */
+    static uint32_t hashOf(const char* str)
+    {
+        uint32_t hash = 2166136261u;
+        while (*str)
+        {
+            hash ^= uint8_t(*str++);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    /** Tag IDs are random-ish already, but we mix the bits anyway so that
+     *  sequential IDs don't end up in neighbouring slots.
+     */
+    static uint32_t hashOf(uint32_t tag)
+    {
+        tag ^= tag >> 16;
+        tag *= 0x45D9F3Bu;
+        tag ^= tag >> 16;
+        return tag;
+    }
+
+    /** FNV-1a over the tables and the first `namesSize` bytes of the names */
+    uint32_t getChecksum(size_t namesSize) const
+    {
+        uint32_t hash = 2166136261u;
+        hash = hashOf(hash, tagTable_, sizeof(tagTable_));
+        hash = hashOf(hash, nameTable_, sizeof(nameTable_));
+        return hashOf(hash, names_, namesSize);
+    }
+
+    static uint32_t hashOf(uint32_t hash, const void* data, size_t numBytes)
+    {
+        const uint8_t* bytes = (const uint8_t*) data;
+        for (size_t i = 0; i < numBytes; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    /** Returns true if all name offsets point into the names, the last name is
+     *  terminated, both tables contain `numLinks` links and at least one empty slot. */
+    bool areTablesValid(size_t numLinks, size_t namesSize) const
+    {
+        if ((namesSize > 0) && (names_[namesSize - 1] != '\0'))
+            return false;
+        size_t numTags = 0;
+        size_t numNames = 0;
+        for (size_t i = 0; i < tableSize_; i++)
+        {
+            if (tagTable_[i].nameOffset != emptySlot_)
+            {
+                if (tagTable_[i].nameOffset >= namesSize)
+                    return false;
+                numTags++;
+            }
+            if (nameTable_[i] != emptySlot_)
+            {
+                if (nameTable_[i] >= namesSize)
+                    return false;
+                numNames++;
+            }
+        }
+        return (numTags == numLinks) && (numNames == numLinks) && (numLinks < tableSize_);
+    }
+
+    /** Returns true and the slot in the tag table if the tag is cached.
+     *  Returns false and the first free slot in the tag table if it's not.
+     */
+    bool findTag(const RfidTagId& tag, size_t& tagSlot) const
+    {
+        tagSlot = hashOf(uint32_t(tag)) & (tableSize_ - 1);
+        // linear probing; there's always at least one empty slot
+        while (tagTable_[tagSlot].nameOffset != emptySlot_)
+        {
+            if (tagTable_[tagSlot].tag == uint32_t(tag))
+                return true;
+            tagSlot = (tagSlot + 1) & (tableSize_ - 1);
+        }
+        return false;
+    }
+
+    /** Returns true and the slot in the name table if the folder is cached.
+     *  Returns false and the first free slot in the name table if it's not.
+     */
+    bool findFolder(const char* folderName, size_t& nameSlot) const
+    {
+        nameSlot = hashOf(folderName) & (tableSize_ - 1);
+        // linear probing; there's always at least one empty slot
+        while (nameTable_[nameSlot] != emptySlot_)
+        {
+            if (strcmp(&names_[nameTable_[nameSlot]], folderName) == 0)
+                return true;
+            nameSlot = (nameSlot + 1) & (tableSize_ - 1);
+        }
+        return false;
+    }
+
+    static bool writeBinary(File& file, const void* data, size_t numBytes)
+    {
+        uint32_t numBytesWritten = 0;
+        return file.tryWrite((const char*) data, numBytes, numBytesWritten)
+               && (numBytesWritten == numBytes);
+    }
+
+    static bool readBinary(File& file, void* data, size_t numBytes)
+    {
+        // File::tryRead() adds a terminating zero, so read in chunks through a
+        // small intermediate buffer.
+        char* dest = (char*) data;
+        while (numBytes > 0)
+        {
+            char buffer[readChunkSize_ + 1];
+            const uint32_t numBytesToRead = uint32_t(std::min(numBytes, readChunkSize_));
+            uint32_t numBytesRead = 0;
+            if (!file.tryRead(buffer, numBytesToRead, numBytesRead) || (numBytesRead != numBytesToRead))
+                return false;
+            memcpy(dest, buffer, numBytesRead);
+            dest += numBytesRead;
+            numBytes -= numBytesRead;
+        }
+        return true;
+    }
+
+    static constexpr uint32_t fileMagic_ = 0x58494B57; // "WKIX"
+    static constexpr uint32_t fileVersion_ = 3;
+    static constexpr size_t readChunkSize_ = 128;
+    static constexpr size_t tableSize_ = getTableSize();
+    static constexpr uint32_t emptySlot_ = 0xFFFFFFFF;
+
+    TagSlot tagTable_[tableSize_];
+    uint32_t nameTable_[tableSize_]; // offsets into names_ or emptySlot_
+    char names_[nameArenaSize];
+    size_t numLinks_;
+    size_t namesSize_;
+    Fingerprint fingerprint_;
+};
@@ -18,6 +18,9 @@
 #pragma once
 #include "stdint.h"
 #include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <type_traits>
 
 /** A single reader / single writer lock-free FIFO */
 template <typename ValueType, int size>
@@ -146,4 +149,146 @@ private:
     ValueType buffer_[rawBufferSize_];
     int head_;
     int tail_;
-};
\ No newline at end of file
+};
+
+/**
+ *  @brief  A single reader / single writer lock-free FIFO like LockFreeFifo, for a reader
+ *          and a writer that run in different threads or interrupts.
+ *
+ *          The indices are atomics: the writer publishes new values with a release store
+ *          that the reader loads with acquire, and vice versa for the values that were read.
+ *          The capacity is a power of two, so the indices run freely and are only masked when
+ *          the buffer is accessed, and all `size` values can be used. Values are copied with
+ *          memcpy, so they must be trivially copyable. AudioRingBuffer adds blocks that an
+ *          audio DMA plays in place.
+ */
+template <typename ValueType, int size>
+class AtomicLockFreeFifo
+{
+public:
+    static_assert((size > 0) && ((size & (size - 1)) == 0), "size must be a power of two");
+    static_assert(std::is_trivially_copyable<ValueType>::value, "values are copied with memcpy");
+
+    AtomicLockFreeFifo()
+    {
+        clear();
+    }
+
+    int getSize() const { return size; }
+    bool isEmpty() const { return getNumReady() == 0; }
+    bool isFull() const { return getNumFree() == 0; }
+    int getNumReady() const
+    {
+        return int(writeIndex_.load(std::memory_order_acquire) - readIndex_.load(std::memory_order_acquire));
+    }
+    int getNumFree() const { return size - getNumReady(); }
+    /** Must not be called while the fifo is read or written */
+    void clear()
+    {
+        writeIndex_.store(0, std::memory_order_relaxed);
+        readIndex_.store(0, std::memory_order_relaxed);
+    }
+
+    void prepareWrite(int numToWrite, ValueType*& block1, int& blockSize1, ValueType*& block2, int& blockSize2)
+    {
+        numToWrite = std::min(numToWrite, getNumFree());
+        prepare(writeIndex_.load(std::memory_order_relaxed), numToWrite, block1, blockSize1, block2, blockSize2);
+    }
+
+    void finishWrite(int numWritten)
+    {
+        writeIndex_.store(writeIndex_.load(std::memory_order_relaxed) + uint32_t(numWritten), std::memory_order_release);
+    }
+
+    bool writeSingle(const ValueType& value)
+    {
+        if (isFull())
+            return false;
+        const uint32_t writeIndex = writeIndex_.load(std::memory_order_relaxed);
+        buffer_[writeIndex & indexMask_] = value;
+        writeIndex_.store(writeIndex + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Writes as many values as there is space for and returns their number */
+    int writeBulk(const ValueType* values, int numToWrite)
+    {
+        ValueType* block1 = nullptr;
+        int blockSize1 = 0;
+        ValueType* block2 = nullptr;
+        int blockSize2 = 0;
+        prepareWrite(numToWrite, block1, blockSize1, block2, blockSize2);
+        if (blockSize1 > 0)
+            memcpy(block1, values, size_t(blockSize1) * sizeof(ValueType));
+        if (blockSize2 > 0)
+            memcpy(block2, values + blockSize1, size_t(blockSize2) * sizeof(ValueType));
+        finishWrite(blockSize1 + blockSize2);
+        return blockSize1 + blockSize2;
+    }
+
+    void prepareRead(int numToRead, ValueType*& block1, int& blockSize1, ValueType*& block2, int& blockSize2)
+    {
+        numToRead = std::min(numToRead, getNumReady());
+        prepare(readIndex_.load(std::memory_order_relaxed), numToRead, block1, blockSize1, block2, blockSize2);
+    }
+
+    void finishRead(int numRead)
+    {
+        readIndex_.store(readIndex_.load(std::memory_order_relaxed) + uint32_t(numRead), std::memory_order_release);
+    }
+
+    bool readSingle(ValueType& value)
+    {
+        if (isEmpty())
+            return false;
+        const uint32_t readIndex = readIndex_.load(std::memory_order_relaxed);
+        value = buffer_[readIndex & indexMask_];
+        readIndex_.store(readIndex + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Reads as many values as are available, up to `numToRead`, and returns their number */
+    int readBulk(ValueType* values, int numToRead)
+    {
+        ValueType* block1 = nullptr;
+        int blockSize1 = 0;
+        ValueType* block2 = nullptr;
+        int blockSize2 = 0;
+        prepareRead(numToRead, block1, blockSize1, block2, blockSize2);
+        if (blockSize1 > 0)
+            memcpy(values, block1, size_t(blockSize1) * sizeof(ValueType));
+        if (blockSize2 > 0)
+            memcpy(values + blockSize1, block2, size_t(blockSize2) * sizeof(ValueType));
+        finishRead(blockSize1 + blockSize2);
+        return blockSize1 + blockSize2;
+    }
+
+protected:
+    void prepare(uint32_t index, int num, ValueType*& block1, int& blockSize1, ValueType*& block2, int& blockSize2)
+    {
+        if (num > 0)
+        {
+            const int start = int(index & indexMask_);
+            block1 = &buffer_[start];
+            blockSize1 = std::min(size - start, num);
+            blockSize2 = num - blockSize1;
+            block2 = (blockSize2 > 0) ? &buffer_[0] : nullptr;
+        }
+        else
+        {
+            block1 = nullptr;
+            block2 = nullptr;
+            blockSize1 = 0;
+            blockSize2 = 0;
+        }
+    }
+
+    static constexpr uint32_t indexMask_ = uint32_t(size - 1);
+    // Each index is only written by one side. On separate cache lines, a write from one
+    // core doesn't evict the other index from the cache of the other core. The Cortex-M4
+    // has no data cache, there it only costs a few bytes of padding.
+    static constexpr size_t cacheLineSize_ = 64;
+    alignas(cacheLineSize_) std::atomic<uint32_t> writeIndex_;
+    alignas(cacheLineSize_) std::atomic<uint32_t> readIndex_;
+    alignas(cacheLineSize_) ValueType buffer_[size];
+};
@@ -0,0 +1,229 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ *  @brief  Checks if an RFID tag is on an MFRC522 reader, without ever waiting for
+ *          the reader or the tag. A poll is started with startPoll() and advanced with
+ *          step(); each call only does a few register accesses. The time until a tag
+ *          answers is measured by the timer of the MFRC522 (which is started
+ *          automatically after each transmission, see TM_MFRC522_Init()), so
+ *          step() can be called at any rate.
+ *
+ *          A poll turns on the antenna, waits until the tag has powered up, sends REQA
+ *          and then reads the UID with an anticollision command. Afterwards the antenna
+ *          is turned off again to save power, which also resets the tag, so that it
+ *          answers the next poll.
+ *
+ *  @tparam RegistersType provides access to the registers of the MFRC522 and must implement:
+ *          \code{.cpp}
+ *              void write(uint8_t reg, uint8_t value);
+ *              uint8_t read(uint8_t reg);
+ *              // writes to / reads from the FIFO with one burst transfer
+ *              void writeFifo(const uint8_t* data, size_t numBytes);
+ *              void readFifo(uint8_t* data, size_t numBytes);
+ *          \endcode
+ */
+template <typename RegistersType>
+class Mfrc522Poller
+{
+public:
+    enum class Result
+    {
+        /** No poll is running */
+        idle,
+        /** The poll is waiting for the antenna, the reader or the tag */
+        busy,
+        /** The poll is completed and found a tag, see getTagId() */
+        tagFound,
+        /** The poll is completed and found no tag */
+        noTag
+    };
+
+    /** If the reader doesn't complete a command in this time (e.g. because it's not
+     *  connected), the poll is aborted. The timer of the MFRC522 times out much earlier. */
+    static constexpr uint32_t commandTimeoutMs = 50;
+    /** A tag must answer REQA within 5ms after it entered the field (ISO/IEC 14443-3) */
+    static constexpr uint32_t antennaSettleTimeMs = 5;
+
+    /** The registers used */
+    enum Register : uint8_t
+    {
+        command = 0x01,
+        comIrq = 0x04,
+        error = 0x06,
+        fifoData = 0x09,
+        fifoLevel = 0x0A,
+        control = 0x0C,
+        bitFraming = 0x0D,
+        txControl = 0x14
+    };
+
+    /** ComIrqReg bits */
+    static constexpr uint8_t txIrq = 0x40;
+    static constexpr uint8_t rxIrq = 0x20;
+    static constexpr uint8_t idleIrq = 0x10;
+    static constexpr uint8_t timerIrq = 0x01;
+
+    /** Commands of the reader */
+    static constexpr uint8_t idleCommand = 0x00;
+    static constexpr uint8_t transceiveCommand = 0x0C;
+
+    Mfrc522Poller(RegistersType& registers) :
+        registers_(registers),
+        state_(State::idle),
+        commandStartMs_(0),
+        tagId_(0)
+    {
+    }
+
+    bool isIdle() const { return state_ == State::idle; }
+
+    /** Starts a new poll, if none is running. */
+    void startPoll(uint32_t nowMs)
+    {
+        if (state_ != State::idle)
+            return;
+        setAntenna(true);
+        commandStartMs_ = nowMs;
+        state_ = State::waitingForAntenna;
+    }
+
+    /** Advances the poll by one step. Returns the result once when the poll is completed. */
+    Result step(uint32_t nowMs)
+    {
+        if (state_ == State::idle)
+            return Result::idle;
+
+        if (state_ == State::waitingForAntenna)
+        {
+            // The ms counter may have advanced just after the antenna was turned on
+            if (nowMs - commandStartMs_ <= antennaSettleTimeMs)
+                return Result::busy;
+            // REQA is a short frame of 7 bits
+            static const uint8_t request[] = { 0x26 };
+            startTransceive(request, sizeof(request), 7, nowMs);
+            state_ = State::waitingForAnswerToRequest;
+            return Result::busy;
+        }
+
+        const uint8_t irq = registers_.read(comIrq);
+        if (!(irq & (rxIrq | idleIrq | timerIrq)))
+        {
+            if (nowMs - commandStartMs_ < commandTimeoutMs)
+                return Result::busy;
+            return finish(Result::noTag);
+        }
+        // stop sending
+        registers_.write(bitFraming, 0x00);
+
+        switch (state_)
+        {
+            case State::waitingForAnswerToRequest:
+            {
+                // ATQA: two bytes
+                if (!isAnswerValid(irq) || (getNumBitsReceived() != 16))
+                    return finish(Result::noTag);
+                static const uint8_t anticollision[] = { 0x93, 0x20 };
+                startTransceive(anticollision, sizeof(anticollision), 0, nowMs);
+                state_ = State::waitingForUid;
+                return Result::busy;
+            }
+            case State::waitingForUid:
+            default:
+            {
+                // four bytes UID and a checksum
+                uint8_t uid[5];
+                const bool isValid = isAnswerValid(irq)
+                                     && (getNumBitsReceived() == 40)
+                                     && readUid(uid);
+                if (!isValid)
+                    return finish(Result::noTag);
+                tagId_ = uint32_t(uid[0]) | (uint32_t(uid[1]) << 8) | (uint32_t(uid[2]) << 16) | (uint32_t(uid[3]) << 24);
+                return finish(Result::tagFound);
+            }
+        }
+    }
+
+    /** The first four bytes of the UID of the tag that was found by the last poll */
+    uint32_t getTagId() const { return tagId_; }
+
+private:
+    enum class State
+    {
+        idle,
+        waitingForAntenna,
+        waitingForAnswerToRequest,
+        waitingForUid
+    };
+
+    void startTransceive(const uint8_t* data, size_t numBytes, uint8_t numBitsInLastByte, uint32_t nowMs)
+    {
+        registers_.write(command, idleCommand);
+        // clear all interrupt requests and the FIFO
+        registers_.write(comIrq, 0x7F);
+        registers_.write(fifoLevel, 0x80);
+        registers_.writeFifo(data, numBytes);
+        registers_.write(command, transceiveCommand);
+        // start sending
+        registers_.write(bitFraming, 0x80 | numBitsInLastByte);
+        commandStartMs_ = nowMs;
+    }
+
+    bool isAnswerValid(uint8_t irq)
+    {
+        // no timeout, no buffer overflow, collision, parity or protocol error
+        return !(irq & timerIrq) && !(registers_.read(error) & 0x1B);
+    }
+
+    uint32_t getNumBitsReceived()
+    {
+        const uint32_t numBytes = registers_.read(fifoLevel) & 0x7F;
+        const uint32_t numBitsInLastByte = registers_.read(control) & 0x07;
+        if (numBitsInLastByte == 0)
+            return numBytes * 8;
+        return (numBytes > 0) ? (numBytes - 1) * 8 + numBitsInLastByte : 0;
+    }
+
+    bool readUid(uint8_t (&uid)[5])
+    {
+        registers_.readFifo(uid, sizeof(uid));
+        return (uid[0] ^ uid[1] ^ uid[2] ^ uid[3]) == uid[4];
+    }
+
+    void setAntenna(bool isOn)
+    {
+        const uint8_t txControlValue = registers_.read(txControl);
+        registers_.write(txControl, isOn ? uint8_t(txControlValue | 0x03) : uint8_t(txControlValue & ~0x03));
+    }
+
+    Result finish(Result result)
+    {
+        registers_.write(command, idleCommand);
+        setAntenna(false);
+        state_ = State::idle;
+        return result;
+    }
+
+    RegistersType& registers_;
+    State state_;
+    uint32_t commandStartMs_;
+    uint32_t tagId_;
+};
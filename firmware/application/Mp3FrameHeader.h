@@ -0,0 +1,288 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ *  @brief  The header of a single MPEG audio layer III frame. Parsing the header
+ *          doesn't require the decoder, so that the stream can be inspected
+ *          (e.g. for Xing/Info frames) before any frame is decoded.
+ */
+struct Mp3FrameHeader
+{
+    enum class Version
+    {
+        mpeg1,
+        mpeg2,
+        mpeg2_5
+    };
+
+    static constexpr size_t headerSize = 4;
+
+    Version version = Version::mpeg1;
+    bool isMono = false;
+    bool hasCrc = false;
+    int bitrateKbps = 0;
+    int sampleRate = 0;
+    /** The total size of the frame in bytes, including the header. */
+    size_t frameSize = 0;
+    /** The number of samples per channel that this frame decodes to. */
+    int samplesPerFrame = 0;
+
+    /** Parses the four header bytes at the start of `data`. Returns false if
+     *  they are not a valid layer III header. Free format frames are not supported. */
+    bool parse(const uint8_t* data, size_t numBytes)
+    {
+        if (numBytes < headerSize)
+            return false;
+        if ((data[0] != 0xFF) || ((data[1] & 0xE0) != 0xE0))
+            return false;
+
+        const int versionBits = (data[1] >> 3) & 0x03;
+        const int layerBits = (data[1] >> 1) & 0x03;
+        const int bitrateIndex = data[2] >> 4;
+        const int sampleRateIndex = (data[2] >> 2) & 0x03;
+        if ((versionBits == 1) || (layerBits != 1) || (bitrateIndex == 0) || (bitrateIndex == 15) || (sampleRateIndex == 3))
+            return false;
+
+        static constexpr int bitratesMpeg1[15] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+        static constexpr int bitratesMpeg2[15] = { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 };
+        static constexpr int sampleRatesMpeg1[3] = { 44100, 48000, 32000 };
+
+        version = (versionBits == 3) ? Version::mpeg1 : (versionBits == 2) ? Version::mpeg2 : Version::mpeg2_5;
+        isMono = (data[3] >> 6) == 3;
+        hasCrc = (data[1] & 0x01) == 0;
+        const bool isPadded = (data[2] & 0x02) != 0;
+        if (version == Version::mpeg1)
+        {
+            bitrateKbps = bitratesMpeg1[bitrateIndex];
+            sampleRate = sampleRatesMpeg1[sampleRateIndex];
+            samplesPerFrame = 1152;
+        }
+        else
+        {
+            bitrateKbps = bitratesMpeg2[bitrateIndex];
+            sampleRate = sampleRatesMpeg1[sampleRateIndex] / ((version == Version::mpeg2) ? 2 : 4);
+            samplesPerFrame = 576;
+        }
+        frameSize = size_t(samplesPerFrame / 8) * size_t(bitrateKbps) * 1000 / size_t(sampleRate) + (isPadded ? 1 : 0);
+        return true;
+    }
+
+    /** Returns true if `data` starts with the header of a frame of the same stream as
+     *  this header (same version and samplerate) that is followed by another one, or by
+     *  the end of the data. Sync words also appear within the audio data; this tells
+     *  them apart from real frame headers after a jump into the middle of a stream. */
+    bool isFrameOfSameStream(const uint8_t* data, size_t numBytes) const
+    {
+        Mp3FrameHeader header;
+        if (!header.parse(data, numBytes) || (header.version != version) || (header.sampleRate != sampleRate))
+            return false;
+        if (header.frameSize + headerSize > numBytes)
+            return true;
+        Mp3FrameHeader nextHeader;
+        return nextHeader.parse(&data[header.frameSize], numBytes - header.frameSize)
+               && (nextHeader.version == version) && (nextHeader.sampleRate == sampleRate);
+    }
+
+    /** Returns the size of the side information that follows the header (and the CRC, if present). */
+    size_t getSideInfoSize() const
+    {
+        if (version == Version::mpeg1)
+            return isMono ? 17 : 32;
+        else
+            return isMono ? 9 : 17;
+    }
+};
+
+/**
+ *  @brief  The Xing/Info header that VBR encoders (and LAME for CBR files, too) place
+ *          in the first frame of a file, including the optional LAME extension that
+ *          holds the encoder delay and padding required for gapless playback.
+ *          The frame that carries this header contains no audio and must not be played.
+ */
+struct Mp3XingHeader
+{
+    static constexpr size_t tocSize = 100;
+
+    /** The number of audio frames in the file, not counting the Xing frame itself. 0 if unknown. */
+    uint32_t numFrames = 0;
+    /** The number of bytes in the file, including the Xing frame. 0 if unknown. */
+    uint32_t numBytes = 0;
+    bool hasToc = false;
+    uint8_t toc[tocSize] = {};
+    bool hasEncoderDelayAndPadding = false;
+    /** The number of samples (per channel) the encoder added to the start of the stream. */
+    int encoderDelay = 0;
+    /** The number of samples (per channel) the encoder added to the end of the stream. */
+    int encoderPadding = 0;
+
+    /** Looks for a Xing/Info header in the frame that starts at `frame`. Returns false
+     *  if the frame is not a Xing/Info frame. */
+    bool parse(const Mp3FrameHeader& header, const uint8_t* frame, size_t numBytesAvailable)
+    {
+        *this = Mp3XingHeader();
+
+        const size_t frameSize = (header.frameSize < numBytesAvailable) ? header.frameSize : numBytesAvailable;
+        size_t position = Mp3FrameHeader::headerSize + header.getSideInfoSize();
+        if (position + 8 > frameSize)
+            return false;
+        if ((memcmp(&frame[position], "Xing", 4) != 0) && (memcmp(&frame[position], "Info", 4) != 0))
+            return false;
+
+        const uint32_t flags = readUint32(&frame[position + 4]);
+        position += 8;
+        if (flags & framesFlag_)
+        {
+            if (position + 4 > frameSize)
+                return false;
+            numFrames = readUint32(&frame[position]);
+            position += 4;
+        }
+        if (flags & bytesFlag_)
+        {
+            if (position + 4 > frameSize)
+                return false;
+            numBytes = readUint32(&frame[position]);
+            position += 4;
+        }
+        if (flags & tocFlag_)
+        {
+            if (position + tocSize > frameSize)
+                return false;
+            memcpy(toc, &frame[position], tocSize);
+            hasToc = true;
+            position += tocSize;
+        }
+        if (flags & qualityFlag_)
+            position += 4;
+
+        // optional LAME extension: a 9 character encoder version string, followed by
+        // a few bytes of encoder settings and then delay and padding as two 12 bit values.
+        if ((position + lameTagDelayOffset_ + 3 <= frameSize) && isLameTag(&frame[position]))
+        {
+            const uint8_t* delayAndPadding = &frame[position + lameTagDelayOffset_];
+            encoderDelay = (int(delayAndPadding[0]) << 4) | (delayAndPadding[1] >> 4);
+            encoderPadding = (int(delayAndPadding[1] & 0x0F) << 8) | delayAndPadding[2];
+            hasEncoderDelayAndPadding = true;
+        }
+        return true;
+    }
+
+private:
+    static constexpr uint32_t framesFlag_ = 0x01;
+    static constexpr uint32_t bytesFlag_ = 0x02;
+    static constexpr uint32_t tocFlag_ = 0x04;
+    static constexpr uint32_t qualityFlag_ = 0x08;
+    static constexpr size_t lameTagDelayOffset_ = 21;
+
+    static uint32_t readUint32(const uint8_t* bigEndianData)
+    {
+        return (uint32_t(bigEndianData[0]) << 24) | (uint32_t(bigEndianData[1]) << 16)
+               | (uint32_t(bigEndianData[2]) << 8) | uint32_t(bigEndianData[3]);
+    }
+
+    static bool isLameTag(const uint8_t* data)
+    {
+        return (memcmp(data, "LAME", 4) == 0) || (memcmp(data, "Lavf", 4) == 0) || (memcmp(data, "Lavc", 4) == 0);
+    }
+};
+
+/**
+ *  @brief  The VBRI header that the Fraunhofer encoder places in the first frame of a
+ *          VBR file, instead of a Xing header. Its seek table holds the size of every
+ *          few frames; it's converted to a table like the Xing TOC, so that both can be
+ *          used in the same way. Like the Xing frame, this frame contains no audio.
+ */
+struct Mp3VbriHeader
+{
+    static constexpr size_t tocSize = Mp3XingHeader::tocSize;
+
+    /** The number of audio frames in the file. */
+    uint32_t numFrames = 0;
+    /** The number of bytes of audio frames, starting after the VBRI frame. */
+    uint32_t numBytes = 0;
+    /** Like Mp3XingHeader::toc: entry i holds the position of i percent of the
+     *  duration, in 1/256 of numBytes. */
+    bool hasToc = false;
+    uint8_t toc[tocSize] = {};
+
+    /** Looks for a VBRI header in the frame that starts at `frame`. Returns false
+     *  if the frame is not a VBRI frame. */
+    bool parse(const Mp3FrameHeader& header, const uint8_t* frame, size_t numBytesAvailable)
+    {
+        *this = Mp3VbriHeader();
+
+        // the VBRI header always sits 32 bytes after the frame header
+        const size_t frameSize = (header.frameSize < numBytesAvailable) ? header.frameSize : numBytesAvailable;
+        const size_t position = Mp3FrameHeader::headerSize + 32;
+        if ((position + headerSize_ > frameSize) || (memcmp(&frame[position], "VBRI", 4) != 0))
+            return false;
+
+        numFrames = readBigEndian(&frame[position + 14], 4);
+        const uint32_t numEntries = readBigEndian(&frame[position + 18], 2);
+        const uint32_t scale = readBigEndian(&frame[position + 20], 2);
+        const uint32_t entrySize = readBigEndian(&frame[position + 22], 2);
+        const uint32_t numFramesPerEntry = readBigEndian(&frame[position + 24], 2);
+        const uint8_t* entries = &frame[position + headerSize_];
+        if ((numEntries == 0) || (entrySize < 1) || (entrySize > 4) || (numFramesPerEntry == 0) || (numFrames == 0)
+            || (position + headerSize_ + numEntries * entrySize > frameSize))
+            return true; // no usable seek table
+
+        for (uint32_t i = 0; i < numEntries; i++)
+            numBytes += readBigEndian(&entries[i * entrySize], entrySize) * scale;
+        if (numBytes == 0)
+            return true;
+
+        // the position of each percent of the frames, interpolated within the entries
+        uint32_t entry = 0;
+        uint32_t entryPosition = 0;
+        for (size_t i = 0; i < tocSize; i++)
+        {
+            const uint32_t frameIndex = uint32_t(uint64_t(numFrames) * i / tocSize);
+            while ((entry < numEntries) && ((entry + 1) * numFramesPerEntry <= frameIndex))
+            {
+                entryPosition += readBigEndian(&entries[entry * entrySize], entrySize) * scale;
+                entry++;
+            }
+            uint64_t framePosition = entryPosition;
+            if (entry < numEntries)
+                framePosition += uint64_t(readBigEndian(&entries[entry * entrySize], entrySize)) * scale
+                                 * (frameIndex - entry * numFramesPerEntry) / numFramesPerEntry;
+            const uint64_t tocValue = framePosition * 256 / numBytes;
+            toc[i] = uint8_t((tocValue > 255) ? 255 : tocValue);
+        }
+        hasToc = true;
+        return true;
+    }
+
+private:
+    /** "VBRI", version, delay, quality, bytes, frames, entries, scale, entry size, frames per entry */
+    static constexpr size_t headerSize_ = 26;
+
+    static uint32_t readBigEndian(const uint8_t* data, uint32_t numBytes)
+    {
+        uint32_t result = 0;
+        for (uint32_t i = 0; i < numBytes; i++)
+            result = (result << 8) | data[i];
+        return result;
+    }
+};
@@ -0,0 +1,251 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "Mp3FrameHeader.h"
+
+/**
+ *  @brief  Finds the position of a frame in an mp3 file, so that playback can continue
+ *          from any point in time. The position is taken from, in this order:
+ *          - the positions of frames that were recorded while the file was played,
+ *            if the frame was recorded exactly,
+ *          - the TOC of a Xing or VBRI header,
+ *          - the recorded positions, interpolated between the recorded frames,
+ *          - the average frame size, from the Xing/VBRI header, the recorded frames
+ *            or the first frame header (exact for CBR files, apart from padding).
+ *          Only an exactly recorded position is guaranteed to be the start of a frame;
+ *          for all others, the caller must look for the next frame header. The caller
+ *          can count the frame headers from getLastExactFrame() and record them to make
+ *          the later positions exact.
+ *
+ *          The recorded positions take a fixed amount of memory: when the index is full,
+ *          every other entry is dropped and only every 2nd (4th, 8th, ...) frame is
+ *          recorded from then on. Finding a position never reads from the file.
+ */
+class Mp3SeekIndex
+{
+public:
+    static constexpr size_t maxNumEntries = 64;
+
+    Mp3SeekIndex() { reset(); }
+
+    /** Forgets everything about the current file. */
+    void reset()
+    {
+        reset(Mp3FrameHeader(), 0, 0);
+    }
+
+    /** Starts a new file.
+     *  @param header               The header of the first frame
+     *  @param firstFramePosition   The position of the first audio frame in the file
+     *  @param endPosition          The position of the end of the audio data, e.g. the file size
+     */
+    void reset(const Mp3FrameHeader& header, uint32_t firstFramePosition, uint32_t endPosition)
+    {
+        firstFramePosition_ = firstFramePosition;
+        endPosition_ = endPosition;
+        // samplesPerFrame / 8 * bitrate / sampleRate, without the padding
+        nominalFrameSizeNumerator_ = uint64_t(header.samplesPerFrame / 8) * uint64_t(header.bitrateKbps) * 1000;
+        nominalFrameSizeDenominator_ = uint64_t(header.sampleRate);
+        numFrames_ = 0;
+        numBytes_ = 0;
+        tocStartPosition_ = 0;
+        hasToc_ = false;
+        numEntries_ = 0;
+        numFramesPerEntry_ = 1;
+        numFramesAdded_ = 0;
+        lastFramePosition_ = firstFramePosition;
+    }
+
+    /** Sets the information from a Xing or VBRI header.
+     *  @param numFrames        The number of audio frames in the file, 0 if unknown
+     *  @param numBytes         The number of bytes covered by the TOC, 0 if unknown
+     *  @param toc              The TOC, as in Mp3XingHeader::toc, nullptr if there is none
+     *  @param tocStartPosition The position in the file that the TOC is relative to
+     */
+    void setSeekTable(uint32_t numFrames, uint32_t numBytes, const uint8_t* toc, uint32_t tocStartPosition)
+    {
+        numFrames_ = numFrames;
+        numBytes_ = numBytes;
+        if ((numBytes_ == 0) && (endPosition_ > tocStartPosition))
+            numBytes_ = endPosition_ - tocStartPosition;
+        tocStartPosition_ = tocStartPosition;
+        hasToc_ = (toc != nullptr) && (numFrames_ > 0) && (numBytes_ > 0);
+        if (hasToc_)
+            memcpy(toc_, toc, sizeof(toc_));
+    }
+
+    /** Records the position of a frame while the file is played. Frames must be added
+     *  in order, starting with frame 0; all other frames are ignored. */
+    void addFrame(uint32_t frameIndex, uint32_t position)
+    {
+        if (frameIndex != numFramesAdded_)
+            return;
+        numFramesAdded_++;
+        lastFramePosition_ = position;
+        if (frameIndex % numFramesPerEntry_ != 0)
+            return;
+
+        if (numEntries_ == maxNumEntries)
+        {
+            // full: keep every other entry and record half as many frames from now on
+            for (size_t i = 0; i < maxNumEntries / 2; i++)
+                entries_[i] = entries_[2 * i];
+            numEntries_ = maxNumEntries / 2;
+            numFramesPerEntry_ *= 2;
+            if (frameIndex % numFramesPerEntry_ != 0)
+                return;
+        }
+        entries_[numEntries_++] = position;
+    }
+
+    /** Returns the position of the frame `frameIndex`. `isExact` is set to true if the
+     *  position is known to be the start of that frame. */
+    uint32_t getFramePosition(uint32_t frameIndex, bool& isExact) const
+    {
+        isExact = false;
+        if ((numFrames_ > 0) && (frameIndex > numFrames_))
+            frameIndex = numFrames_;
+
+        // recorded exactly
+        if (frameIndex == 0)
+        {
+            isExact = true;
+            return firstFramePosition_;
+        }
+        if (numFramesAdded_ > 0)
+        {
+            const uint32_t lastFrameIndex = numFramesAdded_ - 1;
+            const uint32_t entry = frameIndex / numFramesPerEntry_;
+            if ((frameIndex == lastFrameIndex)
+                || ((frameIndex % numFramesPerEntry_ == 0) && (entry < numEntries_)))
+            {
+                isExact = true;
+                return (frameIndex == lastFrameIndex) ? lastFramePosition_ : entries_[entry];
+            }
+        }
+
+        if (hasToc_)
+            return clip(getFramePositionFromToc(frameIndex));
+
+        // between the recorded frames
+        if ((numFramesAdded_ > 0) && (frameIndex < numFramesAdded_))
+        {
+            const uint32_t entry = frameIndex / numFramesPerEntry_;
+            const uint32_t entryFrameIndex = entry * numFramesPerEntry_;
+            const bool isLastEntry = entry + 1 >= numEntries_;
+            const uint32_t nextFrameIndex = isLastEntry ? numFramesAdded_ - 1 : entryFrameIndex + numFramesPerEntry_;
+            const uint32_t nextPosition = isLastEntry ? lastFramePosition_ : entries_[entry + 1];
+            return interpolate(frameIndex, entryFrameIndex, entries_[entry], nextFrameIndex, nextPosition);
+        }
+
+        // beyond the recorded frames: the average frame size, from the best source available
+        const uint32_t knownFrameIndex = (numFramesAdded_ > 0) ? numFramesAdded_ - 1 : 0;
+        const uint32_t knownPosition = (numFramesAdded_ > 0) ? lastFramePosition_ : firstFramePosition_;
+        uint64_t numerator = nominalFrameSizeNumerator_;
+        uint64_t denominator = nominalFrameSizeDenominator_;
+        if ((numFrames_ > 0) && (numBytes_ > 0))
+        {
+            numerator = numBytes_;
+            denominator = numFrames_;
+        }
+        else if (knownFrameIndex >= minNumFramesForAverage_)
+        {
+            numerator = knownPosition - firstFramePosition_;
+            denominator = knownFrameIndex;
+        }
+        if (denominator == 0)
+            return knownPosition;
+        // the padding makes CBR frames up to a byte longer or shorter than the average:
+        // start a little early, so that the next frame header is the one of frameIndex
+        const uint64_t position = knownPosition + uint64_t(frameIndex - knownFrameIndex) * numerator / denominator;
+        return clip(uint32_t((position > paddingMargin_) ? position - paddingMargin_ : 0));
+    }
+
+    /** Returns the last frame whose position was recorded, or frame 0 if none was recorded
+     *  yet. Both are exact, so counting the frame headers from there finds the exact
+     *  position of any later frame. */
+    void getLastExactFrame(uint32_t& frameIndex, uint32_t& position) const
+    {
+        frameIndex = (numFramesAdded_ > 0) ? numFramesAdded_ - 1 : 0;
+        position = lastFramePosition_;
+    }
+
+    /** Returns the number of audio frames in the file from the Xing/VBRI header, 0 if unknown. */
+    uint32_t getNumFrames() const { return numFrames_; }
+    /** Returns the number of frames between two recorded positions. */
+    uint32_t getNumFramesPerEntry() const { return numFramesPerEntry_; }
+
+private:
+    uint32_t getFramePositionFromToc(uint32_t frameIndex) const
+    {
+        // the percentage in 1/256 steps, then the TOC entries around it
+        const uint64_t scaledPercent = uint64_t(frameIndex) * 100 * 256 / numFrames_;
+        const size_t index = (scaledPercent / 256 < 99) ? size_t(scaledPercent / 256) : 99;
+        const int64_t fraction = int64_t(scaledPercent) - int64_t(index) * 256;
+        const int64_t tocValue = toc_[index];
+        const int64_t nextTocValue = (index < 99) ? toc_[index + 1] : 256;
+        int64_t scaledTocValue = tocValue * 256 + (nextTocValue - tocValue) * fraction;
+        if (scaledTocValue < 0)
+            scaledTocValue = 0;
+        return uint32_t(tocStartPosition_ + uint64_t(scaledTocValue) * numBytes_ / (256 * 256));
+    }
+
+    static uint32_t interpolate(uint32_t frameIndex,
+                                uint32_t frameIndex1,
+                                uint32_t position1,
+                                uint32_t frameIndex2,
+                                uint32_t position2)
+    {
+        if (frameIndex2 <= frameIndex1)
+            return position1;
+        return uint32_t(position1 + uint64_t(position2 - position1) * (frameIndex - frameIndex1) / (frameIndex2 - frameIndex1));
+    }
+
+    uint32_t clip(uint32_t position) const
+    {
+        if (position < firstFramePosition_)
+            return firstFramePosition_;
+        if ((endPosition_ > 0) && (position > endPosition_))
+            return endPosition_;
+        return position;
+    }
+
+    /** The recorded frames give the average frame size once there are enough of them. */
+    static constexpr uint32_t minNumFramesForAverage_ = 16;
+    static constexpr uint32_t paddingMargin_ = 2;
+
+    uint32_t firstFramePosition_;
+    uint32_t endPosition_;
+    uint64_t nominalFrameSizeNumerator_;
+    uint64_t nominalFrameSizeDenominator_;
+
+    uint32_t numFrames_;
+    uint32_t numBytes_;
+    uint32_t tocStartPosition_;
+    bool hasToc_;
+    uint8_t toc_[Mp3XingHeader::tocSize];
+
+    uint32_t entries_[maxNumEntries];
+    size_t numEntries_;
+    uint32_t numFramesPerEntry_;
+    uint32_t numFramesAdded_;
+    uint32_t lastFramePosition_;
+};
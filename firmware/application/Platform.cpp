@@ -85,6 +85,7 @@ volatile uint32_t systickTicks;
 extern "C" void SysTick_Handler(void)
 {
     systickTicks++;
+    PROFILE_ZONE(systickListeners);
     for (size_t i = 0; i < Systick::listeners_.size(); i++)
         Systick::listeners_[i]->systickCallback();
 }
@@ -127,6 +128,25 @@ void Systick::delayMs(uint32_t milliseconds)
 
 StaticVector<Systick::Listener*, 10> Systick::listeners_;
 
+// =============================================================================
+// Profiler
+// =============================================================================
+
+#ifdef PROFILING_ENABLED
+ProfilingStats Profiler::stats_[int(ProfilingZone::numZones)];
+#endif
+
+void Profiler::init()
+{
+#ifdef PROFILING_ENABLED
+    // start the DWT cycle counter
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    reset();
+#endif
+}
+
 // =============================================================================
 // Power
 // =============================================================================
@@ -136,6 +156,7 @@ class AutoShutdownTimer : public Systick::Listener
 public:
     AutoShutdownTimer() :
         isActive_(false),
+        isDue_(false),
         timeoutCounter_(timeoutCounterMaxMs_)
     {
     }
@@ -143,6 +164,7 @@ public:
     void enableAndReset()
     {
         timeoutCounter_ = timeoutCounterMaxMs_;
+        isDue_ = false;
         if (!isActive_)
         {
             Systick::addListener(this);
@@ -152,6 +174,7 @@ public:
 
     void disable()
     {
+        isDue_ = false;
         if (isActive_)
         {
             Systick::removeListener(this);
@@ -159,15 +182,22 @@ public:
         }
     }
 
+    bool isDue() const { return isDue_; }
+
     void systickCallback() override
     {
-        if (timeoutCounter_-- == 0)
-            Power::shutdownImmediately();
+        // Only raise a flag. The shutdown listener accesses the filesystem,
+        // which must never happen from within this interrupt.
+        if (timeoutCounter_ > 0)
+            timeoutCounter_--;
+        else
+            isDue_ = true;
     }
 
 private:
     bool isActive_;
-    uint32_t timeoutCounter_;
+    volatile bool isDue_;
+    volatile uint32_t timeoutCounter_;
     static constexpr uint32_t timeoutCounterMaxMs_ = 30000; // 30s
 };
 
@@ -193,8 +223,19 @@ void Power::initAndLatchOn()
     autoShutdownTimer.create();
 }
 
+static Power::ShutdownListener* shutdownListener = nullptr;
+
+void Power::setShutdownListener(ShutdownListener* l)
+{
+    shutdownListener = l;
+}
+
 void Power::shutdownImmediately()
 {
+    // don't shut down again if we're still powered, e.g. by the debugger
+    autoShutdownTimer->disable();
+    if (shutdownListener)
+        shutdownListener->aboutToShutdown();
     //unmount the filesystem
     Filesystem::unmount();
     // turn off the mosfet to cut power
@@ -211,6 +252,11 @@ void Power::disableAutoShutdownTimer()
     autoShutdownTimer->disable();
 }
 
+bool Power::isAutoShutdownDue()
+{
+    return autoShutdownTimer->isDue();
+}
+
 // =============================================================================
 // Watchdog
 // =============================================================================
@@ -17,6 +17,7 @@
 
 #pragma once
 #include "Containers.h"
+#include "Profiler.h"
 
 // =============================================================================
 // Filesystem / SD card
@@ -59,10 +60,24 @@ public:
 class Power
 {
 public:
+    /** Is notified right before the power is cut, e.g. to store unsaved data.
+     *  Always called from the main loop, never from an interrupt. */
+    class ShutdownListener
+    {
+    public:
+        virtual ~ShutdownListener() = default;
+        virtual void aboutToShutdown() = 0;
+    };
+
     static void initAndLatchOn();
+    static void setShutdownListener(ShutdownListener* l);
+    /** Notifies the shutdown listener and cuts the power. Call from the main loop only. */
     static void shutdownImmediately();
     static void enableOrResetAutoShutdownTimer();
     static void disableAutoShutdownTimer();
+    /** Returns true when the auto shutdown timer has expired. The main loop
+     *  then calls shutdownImmediately(). */
+    static bool isAutoShutdownDue();
 };
 
 // =============================================================================
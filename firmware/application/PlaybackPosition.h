@@ -0,0 +1,50 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdint.h>
+
+/** A position in the playback of a directory, so that playback can be resumed later. */
+struct PlaybackPosition
+{
+    /** The index of the file in the sorted file list of the directory */
+    uint16_t trackIndex = 0;
+    /** The hash of the file path, to detect that the directory was changed since */
+    uint16_t filePathHash = 0;
+    /** The time played in the file */
+    uint32_t positionMs = 0;
+
+    /** Returns a 16 bit FNV-1a hash of the file path. */
+    static uint16_t hashOf(const char* filePath)
+    {
+        uint32_t hash = 2166136261u;
+        while (*filePath)
+        {
+            hash ^= uint8_t(*filePath++);
+            hash *= 16777619u;
+        }
+        return uint16_t(hash ^ (hash >> 16));
+    }
+
+    bool operator==(const PlaybackPosition& other) const
+    {
+        return (trackIndex == other.trackIndex)
+               && (filePathHash == other.filePathHash)
+               && (positionMs == other.positionMs);
+    }
+    bool operator!=(const PlaybackPosition& other) const { return !(*this == other); }
+};
@@ -0,0 +1,338 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+#include <stdint.h>
+#include <math.h>
+
+/**
+ *  @brief  A fixed-point polyphase resampler that converts a stereo stream to a
+ *          different samplerate. The filter is a windowed sinc, stored as a table
+ *          of `numPhases_` polyphase branches. For positions between two branches, the
+ *          results of both branches are linearly interpolated, so that any ratio of samplerates
+ *          can be converted with the same table. The table is recalculated when the
+ *          samplerates change, so that the cutoff frequency is always below the
+ *          Nyquist frequency of the lower samplerate.
+ *
+ *          The filter state is kept between calls to process(), even when the source
+ *          stream changes, so that consecutive streams are joined without a gap.
+ */
+class PolyphaseResampler
+{
+public:
+    /** The quality/CPU tradeoff. */
+    enum class Quality
+    {
+        /** 8 taps, nearest polyphase branch; the cheapest setting. */
+        low,
+        /** 16 taps, interpolated between two polyphase branches. */
+        medium,
+        /** 32 taps, interpolated between two polyphase branches. */
+        high
+    };
+
+    using SampleType = int16_t;
+
+    PolyphaseResampler() :
+        quality_(Quality::medium),
+        numTaps_(16),
+        inputSampleRate_(0),
+        outputSampleRate_(0),
+        positionStepInt_(0),
+        positionStepFrac_(0)
+    {
+        for (auto& phase : coefficients_)
+            for (auto& coefficient : phase)
+                coefficient = 0;
+        reset();
+    }
+
+    PolyphaseResampler(const PolyphaseResampler&) = delete;
+
+    /** Sets the quality. Takes effect on the next call to setSampleRates(). */
+    void setQuality(Quality quality) { quality_ = quality; }
+    Quality getQuality() const { return quality_; }
+
+    /** Sets the input and output samplerates and recalculates the filter if required.
+     *  The filter state is kept. Returns false if a samplerate is invalid. */
+    bool setSampleRates(int inputSampleRate, int outputSampleRate)
+    {
+        if ((inputSampleRate <= 0) || (outputSampleRate <= 0))
+            return false;
+
+        const int numTaps = getNumTapsFor(quality_);
+        if ((inputSampleRate == inputSampleRate_) && (outputSampleRate == outputSampleRate_) && (numTaps == numTaps_))
+            return true;
+
+        if (numTaps != numTaps_)
+            reset();
+        numTaps_ = numTaps;
+        inputSampleRate_ = inputSampleRate;
+        outputSampleRate_ = outputSampleRate;
+        positionStepInt_ = uint32_t(inputSampleRate / outputSampleRate);
+        positionStepFrac_ = uint32_t((uint64_t(inputSampleRate % outputSampleRate) << 32) / uint64_t(outputSampleRate));
+        calculateCoefficients();
+        return true;
+    }
+
+    int getInputSampleRate() const { return inputSampleRate_; }
+    int getOutputSampleRate() const { return outputSampleRate_; }
+    /** Returns the filter length of the current quality. Each output frame costs this many
+     *  multiply-accumulates per channel, twice as many if neighbouring phases are interpolated. */
+    int getNumTaps() const { return numTaps_; }
+
+    /** Clears the filter state, e.g. before a new, unrelated stream is played. */
+    void reset()
+    {
+        for (auto& sample : history_)
+            sample = 0;
+        historyWritePosition_ = 0;
+        numInputFramesToPush_ = 0;
+        positionFrac_ = 0;
+        inputBufferTail_ = 0;
+        inputBufferEnd_ = 0;
+        isSourceExhausted_ = false;
+        hasPendingSample_ = false;
+        pendingSample_ = 0;
+    }
+
+    /** Fills `buffer` with `bufferSize` interleaved stereo samples resampled from `source`,
+     *  which must provide `int fillBuffer(int16_t* buffer, int bufferSize)` like a
+     *  StereoAudioSampleStream. Returns fewer samples only when `source` is exhausted;
+     *  after that, the next call can continue with another source, seamlessly. */
+    template <typename SourceType>
+    int process(SourceType& source, SampleType* buffer, int bufferSize)
+    {
+        int numSamplesWritten = 0;
+
+        // the right channel of the last output frame, if it didn't fit into the last buffer
+        if (hasPendingSample_ && (bufferSize > 0))
+        {
+            buffer[numSamplesWritten++] = pendingSample_;
+            hasPendingSample_ = false;
+        }
+
+        while (numSamplesWritten < bufferSize)
+        {
+            // push the input frames we need for the next output frame into the history
+            while (numInputFramesToPush_ > 0)
+            {
+                if (inputBufferTail_ >= inputBufferEnd_)
+                {
+                    if (!refillInputBuffer(source))
+                        return numSamplesWritten;
+                }
+                pushToHistory(&inputBuffer_[inputBufferTail_]);
+                inputBufferTail_ += 2;
+                numInputFramesToPush_--;
+            }
+
+            SampleType outputFrame[2];
+            if (quality_ == Quality::low)
+                calculateOutputFrame(outputFrame);
+            else
+                calculateInterpolatedOutputFrame(outputFrame);
+            buffer[numSamplesWritten++] = outputFrame[0];
+            if (numSamplesWritten < bufferSize)
+                buffer[numSamplesWritten++] = outputFrame[1];
+            else
+            {
+                pendingSample_ = outputFrame[1];
+                hasPendingSample_ = true;
+            }
+
+            // advance to the position of the next output frame
+            const uint32_t previousFrac = positionFrac_;
+            positionFrac_ += positionStepFrac_;
+            numInputFramesToPush_ += positionStepInt_ + ((positionFrac_ < previousFrac) ? 1 : 0);
+        }
+        return numSamplesWritten;
+    }
+
+private:
+    static constexpr int maxNumTaps_ = 32;
+    static constexpr int numPhasesLog2_ = 6;
+    static constexpr int numPhases_ = 1 << numPhasesLog2_;
+    static constexpr int coefficientFractionalBits_ = 15;
+    static constexpr int inputBufferSize_ = 256;
+    /** The cutoff frequency relative to the Nyquist frequency of the lower samplerate. */
+    static constexpr float cutoff_ = 0.9f;
+
+    static int getNumTapsFor(Quality quality)
+    {
+        switch (quality)
+        {
+            case Quality::low:
+                return 8;
+            case Quality::high:
+                return maxNumTaps_;
+            case Quality::medium:
+            default:
+                return 16;
+        }
+    }
+
+    void calculateCoefficients()
+    {
+        static constexpr float pi = 3.14159265358979f;
+        const float relativeCutoff = (outputSampleRate_ < inputSampleRate_)
+                                         ? cutoff_ * float(outputSampleRate_) / float(inputSampleRate_)
+                                         : cutoff_;
+
+        // Tap k of phase p is placed at the distance
+        //   d = p / numPhases + numTaps / 2 - 1 - k
+        // from the output position. The extra phase at the end is used for
+        // interpolation between the last phase and the first phase of the next input frame.
+        for (int phase = 0; phase <= numPhases_; phase++)
+        {
+            float coefficients[maxNumTaps_];
+            float sum = 0.0f;
+            for (int tap = 0; tap < numTaps_; tap++)
+            {
+                const float distance = float(phase) / float(numPhases_) + float(numTaps_ / 2 - 1 - tap);
+                const float x = pi * relativeCutoff * distance;
+                const float sinc = (fabsf(x) < 1e-6f) ? 1.0f : sinf(x) / x;
+                // Blackman window over [-numTaps / 2, numTaps / 2]
+                const float w = 2.0f * pi * (distance + float(numTaps_ / 2)) / float(numTaps_);
+                const float window = 0.42f - 0.5f * cosf(w) + 0.08f * cosf(2.0f * w);
+                coefficients[tap] = sinc * window;
+                sum += coefficients[tap];
+            }
+            // normalize each phase to unity gain at DC; the rounding error goes
+            // to the largest tap so that the gain is exact after quantization, too.
+            int32_t quantizedSum = 0;
+            int largestTap = 0;
+            for (int tap = 0; tap < numTaps_; tap++)
+            {
+                const float scaled = coefficients[tap] / sum * float(1 << coefficientFractionalBits_);
+                const long rounded = lroundf(scaled);
+                coefficients_[phase][tap] = int16_t(rounded > 32767 ? 32767 : (rounded < -32768 ? -32768 : rounded));
+                quantizedSum += coefficients_[phase][tap];
+                if (coefficients_[phase][tap] > coefficients_[phase][largestTap])
+                    largestTap = tap;
+            }
+            coefficients_[phase][largestTap] += int16_t((1 << coefficientFractionalBits_) - quantizedSum);
+        }
+    }
+
+    template <typename SourceType>
+    bool refillInputBuffer(SourceType& source)
+    {
+        if (isSourceExhausted_)
+        {
+            // the next call to process() can continue with the next source
+            isSourceExhausted_ = false;
+            return false;
+        }
+        inputBufferTail_ = 0;
+        inputBufferEnd_ = source.fillBuffer(inputBuffer_, inputBufferSize_) & ~1;
+        if (inputBufferEnd_ < inputBufferSize_)
+            isSourceExhausted_ = true;
+        if (inputBufferEnd_ == 0)
+        {
+            isSourceExhausted_ = false;
+            return false;
+        }
+        return true;
+    }
+
+    void pushToHistory(const SampleType* frame)
+    {
+        // Each frame is written twice, so that the last numTaps_ frames
+        // are always available as a contiguous block.
+        SampleType* first = &history_[2 * historyWritePosition_];
+        SampleType* second = &history_[2 * (historyWritePosition_ + numTaps_)];
+        first[0] = second[0] = frame[0];
+        first[1] = second[1] = frame[1];
+        historyWritePosition_++;
+        if (historyWritePosition_ >= numTaps_)
+            historyWritePosition_ = 0;
+    }
+
+    static SampleType roundAndSaturate(int64_t accumulator)
+    {
+        const int64_t result = (accumulator + (int64_t(1) << (coefficientFractionalBits_ - 1))) >> coefficientFractionalBits_;
+        if (result > 32767)
+            return 32767;
+        if (result < -32768)
+            return -32768;
+        return SampleType(result);
+    }
+
+    void calculateOutputFrame(SampleType* outputFrame) const
+    {
+        const int phase = int(positionFrac_ >> (32 - numPhasesLog2_));
+        const int16_t* coefficients = coefficients_[phase];
+        const SampleType* frames = &history_[2 * historyWritePosition_];
+        int64_t left = 0;
+        int64_t right = 0;
+        for (int tap = 0; tap < numTaps_; tap++)
+        {
+            left += int32_t(frames[2 * tap]) * coefficients[tap];
+            right += int32_t(frames[2 * tap + 1]) * coefficients[tap];
+        }
+        outputFrame[0] = roundAndSaturate(left);
+        outputFrame[1] = roundAndSaturate(right);
+    }
+
+    void calculateInterpolatedOutputFrame(SampleType* outputFrame) const
+    {
+        // Filters with the two neighbouring phases and interpolates the results;
+        // that's the same as interpolating the coefficients, but without the
+        // rounding error of the interpolated coefficients.
+        const int phase = int(positionFrac_ >> (32 - numPhasesLog2_));
+        const int64_t weight = int64_t((positionFrac_ >> (32 - numPhasesLog2_ - 15)) & 0x7FFF);
+        const int16_t* coefficients0 = coefficients_[phase];
+        const int16_t* coefficients1 = coefficients_[phase + 1];
+        const SampleType* frames = &history_[2 * historyWritePosition_];
+        int64_t left0 = 0;
+        int64_t right0 = 0;
+        int64_t left1 = 0;
+        int64_t right1 = 0;
+        for (int tap = 0; tap < numTaps_; tap++)
+        {
+            left0 += int32_t(frames[2 * tap]) * coefficients0[tap];
+            right0 += int32_t(frames[2 * tap + 1]) * coefficients0[tap];
+            left1 += int32_t(frames[2 * tap]) * coefficients1[tap];
+            right1 += int32_t(frames[2 * tap + 1]) * coefficients1[tap];
+        }
+        outputFrame[0] = roundAndSaturate(left0 + (((left1 - left0) * weight) >> 15));
+        outputFrame[1] = roundAndSaturate(right0 + (((right1 - right0) * weight) >> 15));
+    }
+
+    Quality quality_;
+    int numTaps_;
+    int inputSampleRate_;
+    int outputSampleRate_;
+    /** The distance between two output frames in input frames, as 32.32 fixed point number. */
+    uint32_t positionStepInt_;
+    uint32_t positionStepFrac_;
+    /** The fractional part of the current output position, between the two frames in the middle of the history. */
+    uint32_t positionFrac_;
+    /** The number of input frames to push into the history before the next output frame can be calculated. */
+    uint32_t numInputFramesToPush_;
+    int16_t coefficients_[numPhases_ + 1][maxNumTaps_];
+    SampleType history_[2 * 2 * maxNumTaps_];
+    int historyWritePosition_;
+    SampleType inputBuffer_[inputBufferSize_];
+    int inputBufferTail_;
+    int inputBufferEnd_;
+    bool isSourceExhausted_;
+    bool hasPendingSample_;
+    SampleType pendingSample_;
+};
@@ -0,0 +1,258 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "FixedSizeString.h"
+
+// On the target, time is measured with the DWT cycle counter and profiling
+// is only compiled in with `make PROFILING=1`. On the host, time is measured
+// with std::chrono in nanoseconds and profiling is always enabled, so that
+// benchmarks see the same zones.
+#if defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_7M__)
+#    define PROFILER_USES_CYCLE_COUNTER
+extern "C" uint32_t SystemCoreClock;
+#    if defined(ENABLE_PROFILING)
+#        define PROFILING_ENABLED
+#    endif
+#else
+#    include <chrono>
+#    define PROFILING_ENABLED
+#endif
+
+/** The parts of the code that are measured. */
+enum class ProfilingZone
+{
+    /** Decoding a single mp3 frame with MP3Decode() */
+    mp3Decode,
+    /** Mp3FileStream::fillBuffer(), including decoding and reading from the file */
+    mp3FillBuffer,
+    /** Reading one chunk from an mp3 file with FileReadAheadBuffer::serviceReadRequests() */
+    fileRead,
+    /** AudioStreamPlayer::isrCallback(), in the interrupt of the audio DMA */
+    audioIsr,
+    /** RfidReader::readAndGenerateEvents() */
+    rfidRead,
+    /** All Systick::Listeners, in the systick interrupt */
+    systickListeners,
+
+    numZones
+};
+
+/** The statistics of a ProfilingZone. All times are in ticks of Profiler::getTicks(). */
+struct ProfilingStats
+{
+    /** Bin i counts the durations in [2^(i + firstBinLog2), 2^(i + 1 + firstBinLog2)).
+     *  The first and the last bin include everything below and above. */
+    static constexpr int numHistogramBins = 16;
+    static constexpr int firstBinLog2 = 8;
+
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t histogram[numHistogramBins];
+
+    void reset()
+    {
+        count = 0;
+        min = 0;
+        max = 0;
+        total = 0;
+        for (auto& bin : histogram)
+            bin = 0;
+    }
+
+    void add(uint32_t ticks)
+    {
+        count++;
+        if ((count == 1) || (ticks < min))
+            min = ticks;
+        if (ticks > max)
+            max = ticks;
+        total += ticks;
+        histogram[getHistogramBin(ticks)]++;
+    }
+
+    uint32_t getMean() const { return (count > 0) ? uint32_t(total / count) : 0; }
+
+    static int getHistogramBin(uint32_t ticks)
+    {
+        // a single CLZ instruction on the Cortex-M4
+        const int log2 = 31 - __builtin_clz(ticks | 1);
+        const int bin = log2 - firstBinLog2;
+        if (bin < 0)
+            return 0;
+        return (bin < numHistogramBins) ? bin : numHistogramBins - 1;
+    }
+};
+
+/**
+ *  @brief  Measures how much CPU time the zones of the audio path take.
+ *          Place PROFILE_ZONE(zoneName) at the start of a scope to measure
+ *          the time until the end of the scope, including the time spent in
+ *          interrupts that preempt it. Every zone must only be used either from
+ *          interrupts or from the main loop, so that its statistics are never
+ *          updated from two places at the same time.
+ */
+class Profiler
+{
+public:
+    /** Starts the cycle counter and resets all statistics. */
+    static void init();
+
+    /** Returns the current time in ticks. Wraps around (every 25s with 168MHz). */
+    static uint32_t getTicks()
+    {
+#ifdef PROFILER_USES_CYCLE_COUNTER
+        // DWT->CYCCNT
+        return *(volatile uint32_t*) 0xE0001004;
+#else
+        const auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+#endif
+    }
+
+    static uint32_t getTicksPerSecond()
+    {
+#ifdef PROFILER_USES_CYCLE_COUNTER
+        return SystemCoreClock;
+#else
+        return 1000000000;
+#endif
+    }
+
+    static void addSample(ProfilingZone zone, uint32_t ticks) { stats_[int(zone)].add(ticks); }
+    static const ProfilingStats& getStats(ProfilingZone zone) { return stats_[int(zone)]; }
+
+    static void reset()
+    {
+        for (auto& stats : stats_)
+            stats.reset();
+    }
+
+    static const char* getName(ProfilingZone zone)
+    {
+        switch (zone)
+        {
+            case ProfilingZone::mp3Decode:
+                return "MP3Decode";
+            case ProfilingZone::mp3FillBuffer:
+                return "Mp3FileStream::fillBuffer";
+            case ProfilingZone::fileRead:
+                return "FileReadAheadBuffer::serviceReadRequests";
+            case ProfilingZone::audioIsr:
+                return "AudioStreamPlayer::isrCallback";
+            case ProfilingZone::rfidRead:
+                return "RfidReader::readAndGenerateEvents";
+            case ProfilingZone::systickListeners:
+                return "Systick listeners";
+            default:
+                return "";
+        }
+    }
+
+    /** Converts ticks to microseconds. */
+    static uint32_t toUs(uint64_t ticks)
+    {
+        return uint32_t(ticks * 1000000 / getTicksPerSecond());
+    }
+
+    /** Writes all statistics as text, one line per zone, to a File that was
+     *  opened for writing. Returns false if writing failed. */
+    template <typename FileType>
+    static bool dumpTo(FileType& file)
+    {
+        FixedSizeStr<256> line = "zone; count; min [us]; mean [us]; max [us]; histogram";
+        line.append("\n");
+        if (!file.write(line))
+            return false;
+        for (int i = 0; i < int(ProfilingZone::numZones); i++)
+        {
+            const auto zone = ProfilingZone(i);
+            const auto& stats = getStats(zone);
+            line = getName(zone);
+            appendNumber(line, stats.count);
+            appendNumber(line, toUs(stats.min));
+            appendNumber(line, toUs(stats.getMean()));
+            appendNumber(line, toUs(stats.max));
+            for (const auto bin : stats.histogram)
+                appendNumber(line, bin);
+            line.append("\n");
+            if (!file.write(line))
+                return false;
+        }
+        return true;
+    }
+
+    /** Appends the separator and a number to a line of a file written with dumpTo() */
+    template <size_t capacity>
+    static void appendNumber(FixedSizeStr<capacity>& str, uint32_t value, const char* separator = "; ")
+    {
+        char digits[10];
+        int numDigits = 0;
+        do
+        {
+            digits[numDigits++] = char('0' + value % 10);
+            value /= 10;
+        } while (value > 0);
+        str.append(separator);
+        while (numDigits > 0)
+            str.append(digits[--numDigits]);
+    }
+
+private:
+    static ProfilingStats stats_[int(ProfilingZone::numZones)];
+};
+
+/** Adds the time from its construction to its destruction to a zone */
+class ProfilingScope
+{
+public:
+    ProfilingScope(ProfilingZone zone) :
+        zone_(zone),
+        startTicks_(Profiler::getTicks())
+    {
+    }
+
+    ~ProfilingScope()
+    {
+        Profiler::addSample(zone_, Profiler::getTicks() - startTicks_);
+    }
+
+private:
+    ProfilingScope(const ProfilingScope&) = delete;
+    ProfilingScope& operator=(const ProfilingScope&) = delete;
+
+    const ProfilingZone zone_;
+    const uint32_t startTicks_;
+};
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+
+#ifdef PROFILING_ENABLED
+/** Measures the time until the end of the current scope */
+#    define PROFILE_ZONE(zoneName) \
+        ProfilingScope PROFILER_CONCAT(profilingScope, __LINE__)(ProfilingZone::zoneName)
+#else
+#    define PROFILE_ZONE(zoneName) \
+        do                         \
+        {                          \
+        } while (0)
+#endif
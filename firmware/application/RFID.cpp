@@ -21,14 +21,26 @@ extern "C"
 #include "tm_stm32f4_mfrc522.h"
 }
 #include "Platform.h"
+#include "Mfrc522Poller.h"
+#include "RfidTagTracker.h"
 
 #define RFID_RESET_PORT_CLK RCC_AHB1Periph_GPIOD
 #define RFID_RESET_PORT GPIOD
 #define RFID_RESET_PIN GPIO_PIN_7
 
-static RfidTagId currentTag;
-static uint32_t lastTimeValidMs;
-constexpr uint32_t tagRemovedTimeoutMs = 500;
+/** Accesses the MFRC522 registers over SPI */
+class Mfrc522Spi
+{
+public:
+    void write(uint8_t reg, uint8_t value) { TM_MFRC522_WriteRegister(reg, value); }
+    uint8_t read(uint8_t reg) { return TM_MFRC522_ReadRegister(reg); }
+    void writeFifo(const uint8_t* data, size_t numBytes) { TM_MFRC522_WriteFifo(data, uint8_t(numBytes)); }
+    void readFifo(uint8_t* data, size_t numBytes) { TM_MFRC522_ReadFifo(data, uint8_t(numBytes)); }
+};
+
+static Mfrc522Spi mfrc522Spi;
+static LateInitializedObject<Mfrc522Poller<Mfrc522Spi>> poller;
+static LateInitializedObject<RfidTagTracker> tracker;
 
 void RfidReader::init()
 {
@@ -49,57 +61,44 @@ void RfidReader::init()
     Systick::delayMs(10);
 
     TM_MFRC522_Init();
-    currentTag = RfidTagId::invalid();
-    lastTimeValidMs = Systick::getMsCounter();
+    // Tags answer REQA and the anticollision command within 0.1ms, so a 2ms
+    // timeout is plenty and keeps the antenna on for a shorter time.
+    TM_MFRC522_WriteRegister(MFRC522_REG_T_RELOAD_L, 4);
+    // the antenna is only turned on while polling
+    TM_MFRC522_AntennaOff();
+    poller.create(mfrc522Spi);
+    tracker.create(Systick::getMsCounter());
 }
 
-void RfidReader::readAndGenerateEvents(UiEventQueue& queue)
+void RfidReader::setPollIntervalsMs(uint32_t searchIntervalMs, uint32_t presenceCheckIntervalMs)
 {
-    union
-    {
-        uint32_t asUint32;
-        uint8_t asCharStringBuffer[5];
-    } newTagId;
-    TM_MFRC522_Status_t res = TM_MFRC522_Check(newTagId.asCharStringBuffer);
+    tracker->setPollIntervalsMs(searchIntervalMs, presenceCheckIntervalMs);
+}
 
-    // there's currently a tag on the reader
-    if (res == MI_OK)
-    {
-        // there was no tag on the reader before
-        if (!currentTag.isValid())
-        {
-            queue.pushEvent(UiEvent { UiEvent::Type::rfidTagAdded, newTagId.asUint32 });
-            currentTag = newTagId.asUint32;
-            lastTimeValidMs = Systick::getMsCounter();
-        }
-        else
-        // there WAS a tag on the reader before
-        {
-            // but it's was a different one!
-            if (currentTag != newTagId.asUint32)
-            {
-                queue.pushEvent(UiEvent { UiEvent::Type::rfidTagRemoved, 0 });
-                queue.pushEvent(UiEvent { UiEvent::Type::rfidTagAdded, newTagId.asUint32 });
-                currentTag = newTagId.asUint32;
-                lastTimeValidMs = Systick::getMsCounter();
-            }
-            else
-                // the tag has not changed.
-                lastTimeValidMs = Systick::getMsCounter();
-        }
-    }
-    // there's no tag on the reader anymore
-    else
+const RfidPollStats& RfidReader::getPollStats()
+{
+    return tracker->getStats();
+}
+
+void RfidReader::readAndGenerateEvents(UiEventQueue& queue)
+{
+    PROFILE_ZONE(rfidRead);
+    const auto now = Systick::getMsCounter();
+    if (poller->isIdle())
     {
-        // there was a tag before so it must have been removed
-        if (currentTag.isValid())
+        if (tracker->isPollDue(now))
         {
-            const auto now = Systick::getMsCounter();
-            if (now - lastTimeValidMs > tagRemovedTimeoutMs)
-            {
-                queue.pushEvent(UiEvent { UiEvent::Type::rfidTagRemoved, 0 });
-                currentTag = RfidTagId::invalid();
-            }
+            tracker->pollStarted(now);
+            poller->startPoll(now);
         }
+        return;
     }
-}
\ No newline at end of file
+
+    const auto result = poller->step(now);
+    if (result == Mfrc522Poller<Mfrc522Spi>::Result::busy)
+        return;
+    tracker->pollCompleted(now,
+                           result == Mfrc522Poller<Mfrc522Spi>::Result::tagFound,
+                           poller->getTagId(),
+                           queue);
+}
@@ -78,9 +78,23 @@ private:
     bool isValid_;
 };
 
+struct RfidPollStats;
+
 class RfidReader
 {
 public:
     static void init();
+
+    /** Advances the communication with the reader by one step and pushes an event
+     *  when a tag was added or removed. Never waits for the reader, so it should
+     *  be called every millisecond or so. */
     static void readAndGenerateEvents(UiEventQueue& queue);
+
+    /** Sets how often the reader checks for a tag while there's none, which bounds
+     *  the time until a new tag is detected, and while a tag is on the reader.
+     *  See RfidTagTracker. */
+    static void setPollIntervalsMs(uint32_t searchIntervalMs, uint32_t presenceCheckIntervalMs);
+
+    /** Returns the number of polls and the power used for them in the last second. */
+    static const RfidPollStats& getPollStats();
 };
\ No newline at end of file
@@ -0,0 +1,162 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdint.h>
+#include "RFID.h"
+#include "UiEventQueue.h"
+
+/** Statistics of the RFID reader over the last second */
+struct RfidPollStats
+{
+    uint32_t numPollsPerSecond = 0;
+    /** The time the antenna was on, in 1/1000 of the time */
+    uint32_t antennaOnPermille = 0;
+    /** The estimated supply current of the reader */
+    uint32_t estimatedCurrentUa = 0;
+};
+
+/**
+ *  @brief  Decides when the RFID reader polls for a tag and turns the results of the
+ *          polls into UiEvents.
+ *          While no tag is on the reader, it polls often so that a new tag is found
+ *          quickly. While the same tag stays on the reader, it polls just often enough
+ *          to notice within tagRemovedTimeoutMs when the tag was removed.
+ *          The antenna is only on during a poll, see Mfrc522Poller.
+ */
+class RfidTagTracker
+{
+public:
+    /** A tag is removed when it wasn't found for this long */
+    static constexpr uint32_t tagRemovedTimeoutMs = 500;
+    /** The poll interval while waiting for a tag */
+    static constexpr uint32_t defaultSearchIntervalMs = 50;
+    /** The poll interval while a tag is on the reader. A missing tag is polled
+     *  with the search interval until the timeout has passed. */
+    static constexpr uint32_t defaultPresenceCheckIntervalMs = 150;
+
+    /** Rough supply currents of an RC522 reader board */
+    static constexpr uint32_t readerIdleCurrentUa = 10000;
+    static constexpr uint32_t readerAntennaOnCurrentUa = 30000;
+
+    RfidTagTracker(uint32_t nowMs) :
+        currentTag_(RfidTagId::invalid()),
+        searchIntervalMs_(defaultSearchIntervalMs),
+        presenceCheckIntervalMs_(defaultPresenceCheckIntervalMs),
+        lastTimeValidMs_(nowMs),
+        lastPollStartMs_(nowMs - defaultSearchIntervalMs),
+        isTagMissing_(false),
+        isPolling_(false),
+        statsWindowStartMs_(nowMs),
+        numPollsInWindow_(0),
+        antennaOnMsInWindow_(0)
+    {
+    }
+
+    void setPollIntervalsMs(uint32_t searchIntervalMs, uint32_t presenceCheckIntervalMs)
+    {
+        searchIntervalMs_ = searchIntervalMs;
+        presenceCheckIntervalMs_ = presenceCheckIntervalMs;
+    }
+
+    /** Returns the interval to the next poll, depending on whether there's a tag */
+    uint32_t getPollIntervalMs() const
+    {
+        return (currentTag_.isValid() && !isTagMissing_) ? presenceCheckIntervalMs_ : searchIntervalMs_;
+    }
+
+    bool isPollDue(uint32_t nowMs) const
+    {
+        return !isPolling_ && (nowMs - lastPollStartMs_ >= getPollIntervalMs());
+    }
+
+    void pollStarted(uint32_t nowMs)
+    {
+        lastPollStartMs_ = nowMs;
+        isPolling_ = true;
+    }
+
+    /** Called with the result of a poll. Pushes the events for added and removed tags. */
+    void pollCompleted(uint32_t nowMs, bool isTagFound, uint32_t tagId, UiEventQueue& queue)
+    {
+        isPolling_ = false;
+        updateStats(nowMs);
+
+        if (isTagFound)
+        {
+            // a tag was put on the reader or replaced by another one
+            if (!currentTag_.isValid() || (uint32_t(currentTag_) != tagId))
+            {
+                if (currentTag_.isValid())
+                    queue.pushEvent(UiEvent { UiEvent::Type::rfidTagRemoved, { 0 } });
+                queue.pushEvent(UiEvent { UiEvent::Type::rfidTagAdded, { tagId } });
+                currentTag_ = tagId;
+            }
+            lastTimeValidMs_ = nowMs;
+            isTagMissing_ = false;
+        }
+        else if (currentTag_.isValid())
+        {
+            isTagMissing_ = true;
+            if (nowMs - lastTimeValidMs_ > tagRemovedTimeoutMs)
+            {
+                queue.pushEvent(UiEvent { UiEvent::Type::rfidTagRemoved, { 0 } });
+                currentTag_ = RfidTagId::invalid();
+                isTagMissing_ = false;
+            }
+        }
+    }
+
+    RfidTagId getCurrentTag() const { return currentTag_; }
+
+    /** Returns the statistics of the last full second */
+    const RfidPollStats& getStats() const { return stats_; }
+
+private:
+    void updateStats(uint32_t nowMs)
+    {
+        numPollsInWindow_++;
+        antennaOnMsInWindow_ += nowMs - lastPollStartMs_;
+
+        const uint32_t windowMs = nowMs - statsWindowStartMs_;
+        if (windowMs < 1000)
+            return;
+        stats_.numPollsPerSecond = uint32_t(uint64_t(numPollsInWindow_) * 1000 / windowMs);
+        stats_.antennaOnPermille = uint32_t(uint64_t(antennaOnMsInWindow_) * 1000 / windowMs);
+        if (stats_.antennaOnPermille > 1000)
+            stats_.antennaOnPermille = 1000;
+        stats_.estimatedCurrentUa = readerIdleCurrentUa
+                                    + (readerAntennaOnCurrentUa - readerIdleCurrentUa) * stats_.antennaOnPermille / 1000;
+        statsWindowStartMs_ = nowMs;
+        numPollsInWindow_ = 0;
+        antennaOnMsInWindow_ = 0;
+    }
+
+    RfidTagId currentTag_;
+    uint32_t searchIntervalMs_;
+    uint32_t presenceCheckIntervalMs_;
+    uint32_t lastTimeValidMs_;
+    uint32_t lastPollStartMs_;
+    /** The current tag wasn't found by the last poll */
+    bool isTagMissing_;
+    bool isPolling_;
+
+    uint32_t statsWindowStartMs_;
+    uint32_t numPollsInWindow_;
+    uint32_t antennaOnMsInWindow_;
+    RfidPollStats stats_;
+};
@@ -0,0 +1,147 @@
+/**	
+ * Copyright (C) Johannes Elliesen, 2021
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *  
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ *  @brief  Runs the work of the main loop as a set of tasks, one at a time. A task is due
+ *          when its interval has passed or when it was woken, e.g. from an interrupt.
+ *          runNextTask() runs the due task with the highest priority; of tasks with
+ *          the same priority, the one that's overdue the longest runs first.
+ *          Tasks are never interrupted by other tasks, so they must return quickly.
+ *          The time is passed in from the outside, so that the scheduler can be tested
+ *          with a virtual clock.
+ *
+ *  @tparam maxNumTasks the maximum number of tasks
+ */
+template <size_t maxNumTasks>
+class CooperativeScheduler
+{
+public:
+    using TaskFunctionPtr = void (*)(void* context);
+    using TaskId = int;
+    static constexpr TaskId invalidTaskId = -1;
+
+    CooperativeScheduler() :
+        numTasks_(0)
+    {
+    }
+
+    /** Adds a task and returns its id, or invalidTaskId if there's no space left.
+     *  @param priority     tasks with a higher priority run first
+     *  @param intervalMs   the task runs every `intervalMs`, starting immediately.
+     *                      With 0, the task only runs when it's woken.
+     */
+    TaskId addTask(TaskFunctionPtr function, void* context, int priority, uint32_t intervalMs, uint32_t nowMs)
+    {
+        if (numTasks_ >= maxNumTasks)
+            return invalidTaskId;
+        Task& task = tasks_[numTasks_];
+        task.function = function;
+        task.context = context;
+        task.priority = priority;
+        task.intervalMs = intervalMs;
+        task.dueMs = nowMs;
+        task.isWoken = false;
+        return TaskId(numTasks_++);
+    }
+
+    /** Makes a task due immediately. Can be called from interrupts. */
+    void wake(TaskId id)
+    {
+        if ((id >= 0) && (size_t(id) < numTasks_))
+            tasks_[id].isWoken = true;
+    }
+
+    /** Runs the due task with the highest priority. Returns false if no task was due. */
+    bool runNextTask(uint32_t nowMs)
+    {
+        Task* next = nullptr;
+        uint32_t nextOverdueMs = 0;
+        for (size_t i = 0; i < numTasks_; i++)
+        {
+            Task& task = tasks_[i];
+            uint32_t overdueMs;
+            if (!isDue(task, nowMs, overdueMs))
+                continue;
+            if (!next
+                || (task.priority > next->priority)
+                || ((task.priority == next->priority) && (overdueMs > nextOverdueMs)))
+            {
+                next = &task;
+                nextOverdueMs = overdueMs;
+            }
+        }
+        if (!next)
+            return false;
+
+        // cleared before running, so that a task can be woken again while it's running
+        next->isWoken = false;
+        if ((next->intervalMs > 0) && (int32_t(nowMs - next->dueMs) >= 0))
+        {
+            // Keeps a steady rate; a task that fell behind by more
+            // than an interval doesn't run repeatedly to catch up.
+            next->dueMs += next->intervalMs;
+            if (int32_t(nowMs - next->dueMs) >= 0)
+                next->dueMs = nowMs + next->intervalMs;
+        }
+        next->function(next->context);
+        return true;
+    }
+
+    /** Returns the time until the next task with an interval is due, or 0 if a task is due now. */
+    uint32_t getTimeUntilNextTaskMs(uint32_t nowMs) const
+    {
+        uint32_t minTimeMs = UINT32_MAX;
+        for (size_t i = 0; i < numTasks_; i++)
+        {
+            const Task& task = tasks_[i];
+            uint32_t overdueMs;
+            if (isDue(task, nowMs, overdueMs))
+                return 0;
+            if ((task.intervalMs > 0) && (task.dueMs - nowMs < minTimeMs))
+                minTimeMs = task.dueMs - nowMs;
+        }
+        return minTimeMs;
+    }
+
+private:
+    struct Task
+    {
+        TaskFunctionPtr function;
+        void* context;
+        int priority;
+        uint32_t intervalMs;
+        uint32_t dueMs;
+        volatile bool isWoken;
+    };
+
+    static bool isDue(const Task& task, uint32_t nowMs, uint32_t& overdueMs)
+    {
+        overdueMs = 0;
+        if ((task.intervalMs > 0) && (int32_t(nowMs - task.dueMs) >= 0))
+            overdueMs = nowMs - task.dueMs;
+        else if (!task.isWoken)
+            return false;
+        return true;
+    }
+
+    Task tasks_[maxNumTasks];
+    size_t numTasks_;
+};
@@ -66,5 +66,5 @@ public:
     size_t getNumEvents() const { return fifo_.getNumReady(); }
 
 private:
-    LockFreeFifo<UiEvent, 32> fifo_;
+    AtomicLockFreeFifo<UiEvent, 32> fifo_;
 };
\ No newline at end of file
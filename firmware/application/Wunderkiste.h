@@ -18,8 +18,10 @@
 #pragma once
 
 #include "AudioOutput.h"
+#include "AudioUnderrunLog.h"
 #include "UiEventQueue.h"
 #include "Library.h"
+#include "BookmarkStore.h"
 #include "RFID.h"
 #include "DirectoryPlayer.h"
 #include "UI.h"
@@ -30,7 +32,7 @@
 #    define UNIT_TEST_FRIEND_CLASS
 #endif
 
-class Wunderkiste
+class Wunderkiste : public Power::ShutdownListener
 {
 public:
     /** Application state */
@@ -62,13 +64,26 @@ public:
                 DirectoryPlayer& player) :
         eventQueue_(eventQueue),
         player_(player),
-        state_(State::startup)
+        state_(State::startup),
+        bookmarks_(bookmarkFilePath_),
+        lastBookmarkUpdateMs_(0)
     {
         Power::enableOrResetAutoShutdownTimer();
+        // loaded once, so that resuming a tag doesn't wait for the card
+        bookmarks_.load();
+        Power::setShutdownListener(this);
+    }
+
+    ~Wunderkiste() override
+    {
+        Power::setShutdownListener(nullptr);
     }
 
     State getState() const { return state_; }
 
+    /** Must receive the AudioUnderrunStats of the audio output. */
+    AudioUnderrunLog& getUnderrunLog() { return underrunLog_; }
+
     void handleEvents()
     {
         const auto uiEvent = eventQueue_.popEvent();
@@ -136,7 +151,14 @@ public:
                     const RfidTagId tagId = uiEvent.payload.asRfidTagId;
                     if (library_.getFolderFor(tagId, directoryToPlay))
                     {
-                        player_.startPlayingDirectory(directoryToPlay);
+                        // continue where this tag was removed the last time
+                        PlaybackPosition position;
+                        if (bookmarks_.find(tagId, position))
+                            player_.resumePlayingDirectory(directoryToPlay, position);
+                        else
+                            player_.startPlayingDirectory(directoryToPlay);
+                        currentTag_ = tagId;
+                        lastBookmarkUpdateMs_ = Systick::getMsCounter();
                         transitionTo(State::playing);
                     }
                 }
@@ -148,30 +170,76 @@ public:
                 // during playback
                 Power::enableOrResetAutoShutdownTimer();
 
+                // keep the bookmark up to date in RAM and store it now and then
+                const uint32_t nowMs = Systick::getMsCounter();
+                if (nowMs - lastBookmarkUpdateMs_ >= bookmarkUpdateIntervalMs_)
+                {
+                    lastBookmarkUpdateMs_ = nowMs;
+                    updateBookmark();
+                }
+                bookmarks_.flushIfDue(nowMs);
+
                 if (uiEvent.type == UiEvent::Type::prevBttnPressed)
                     player_.goToPreviousTrack();
                 else if (uiEvent.type == UiEvent::Type::nextBttnPressed)
                     player_.goToNextTrack();
                 else if (uiEvent.type == UiEvent::Type::rfidTagRemoved)
                 {
+                    updateBookmark();
                     player_.stopPlaying();
+                    bookmarks_.flush();
+                    dumpProfile();
                     transitionTo(State::waitingForTag);
                 }
                 // no more music to play
                 else if (!player_.isPlaying())
+                {
+                    // start from the beginning next time
+                    bookmarks_.remove(currentTag_);
                     transitionTo(State::stoppedWaitingForTagRemove);
+                }
             }
             break;
             case State::stoppedWaitingForTagRemove:
             {
                 if (uiEvent.type == UiEvent::Type::rfidTagRemoved)
+                {
+                    bookmarks_.flush();
                     transitionTo(State::waitingForTag);
+                }
             }
             break;
         }
     }
 
+    /** Stores the bookmarks before the power is cut. */
+    void aboutToShutdown() override
+    {
+        if (state_ == State::playing)
+            updateBookmark();
+        bookmarks_.flush();
+    }
+
 private:
+    /** With `make PROFILING=1`, writes the CPU time of the audio path and the
+     *  underruns of the recently played files to the SD card. */
+    void dumpProfile()
+    {
+#ifdef ENABLE_PROFILING
+        File file(profileFilePath_);
+        if (file.open(File::AccessMode::readWrite, File::OpenMode::createNewAllowOverwrite)
+            && Profiler::dumpTo(file)
+            && file.write("\n"))
+            underrunLog_.dumpTo(file);
+#endif
+    }
+
+    void updateBookmark()
+    {
+        if (player_.isPlaying())
+            bookmarks_.update(currentTag_, player_.getPlaybackPosition());
+    }
+
     void transitionTo(State newState)
     {
         if (state_ == newState)
@@ -213,6 +281,14 @@ private:
     State state_;
     Library library_;
     Library::StringType directoryToLink_;
+    BookmarkStore bookmarks_;
+    /** The tag that started the current playback */
+    RfidTagId currentTag_;
+    uint32_t lastBookmarkUpdateMs_;
+    AudioUnderrunLog underrunLog_;
+    static constexpr uint32_t bookmarkUpdateIntervalMs_ = 1000;
+    static constexpr const char* bookmarkFilePath_ = "bookmarks.bin";
+    static constexpr const char* profileFilePath_ = "profile.txt";
 };
 
 #if 0
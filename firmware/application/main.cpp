@@ -28,6 +28,7 @@ extern "C"
 #include "RFID.h"
 #include "UI.h"
 #include "UiEventQueue.h"
+#include "Scheduler.h"
 #include <type_traits>
 #include <memory>
 
@@ -35,10 +36,25 @@ using AudioStreamPlayerType = AudioStreamPlayer<WunderkisteAudioOutput>;
 using Mp3DirectoryPlayerType = Mp3DirectoryPlayer<AudioStreamPlayerType>;
 
 LateInitializedObject<AudioStreamPlayerType> streamPlayer;
+LateInitializedObject<PolyphaseResampler> resampler;
 LateInitializedObject<Mp3DirectoryPlayerType> mp3DirectoryPlayer;
 LateInitializedObject<UiEventQueue> uiEventQueue;
 LateInitializedObject<Wunderkiste> wunderkisteApp;
 
+using SchedulerType = CooperativeScheduler<3>;
+LateInitializedObject<SchedulerType> scheduler;
+SchedulerType::TaskId audioRefillTask = SchedulerType::invalidTaskId;
+
+// Task priorities: the audio refill always runs first, then the RFID
+// reader which only does a few register accesses each time. The UI can wait.
+constexpr int audioRefillPriority = 2;
+constexpr int rfidPriority = 1;
+constexpr int uiPriority = 0;
+// The audio refill is woken by the audio interrupt; the interval is only a fallback.
+constexpr uint32_t audioRefillIntervalMs = 10;
+constexpr uint32_t rfidIntervalMs = 1;
+constexpr uint32_t uiIntervalMs = 10;
+
 /**
  * Main function. Called when startup code is done with
  * copying memory and setting up clocks.
@@ -49,6 +65,7 @@ int main(void)
     Power::initAndLatchOn();
     WatchdogTimer::init();
     Systick::init();
+    Profiler::init();
     LED::init();
     const bool filesystemMounted = Filesystem::mount();
     if (!filesystemMounted)
@@ -60,6 +77,8 @@ int main(void)
         while (1)
         {
             WatchdogTimer::reset();
+            if (Power::isAutoShutdownDue())
+                Power::shutdownImmediately();
         }
     }
 
@@ -69,14 +88,33 @@ int main(void)
     ButtonScanner::init(*uiEventQueue); // debouncing executed via the systick interrupt
 
     streamPlayer.create();
+    // Most files are 44.1kHz and are played unchanged; everything else is
+    // converted so that the audio output never restarts in a playlist.
+    resampler.create();
+    resampler->setQuality(PolyphaseResampler::Quality::medium);
+    streamPlayer->setFixedOutputSampleRate(resampler, 44100);
     mp3DirectoryPlayer.create(*streamPlayer);
     wunderkisteApp.create(*uiEventQueue, *mp3DirectoryPlayer);
+    streamPlayer->setUnderrunStatsListener(&wunderkisteApp->getUnderrunLog());
+
+    scheduler.create();
+    const uint32_t nowMs = Systick::getMsCounter();
+    audioRefillTask = scheduler->addTask([](void*) { streamPlayer->refillBuffers(); },
+                                         nullptr, audioRefillPriority, audioRefillIntervalMs, nowMs);
+    streamPlayer->setRefillRequestCallback([](void*) { scheduler->wake(audioRefillTask); }, nullptr);
+    scheduler->addTask([](void*) { RfidReader::readAndGenerateEvents(*uiEventQueue); },
+                       nullptr, rfidPriority, rfidIntervalMs, nowMs);
+    scheduler->addTask([](void*) { wunderkisteApp->handleEvents(); },
+                       nullptr, uiPriority, uiIntervalMs, nowMs);
 
     while (1)
     {
         WatchdogTimer::reset();
-        RfidReader::readAndGenerateEvents(*uiEventQueue);
-        wunderkisteApp->handleEvents();
-        streamPlayer->refillBuffers();
+        // store the bookmarks and cut the power from here, not from the systick interrupt
+        if (Power::isAutoShutdownDue())
+            Power::shutdownImmediately();
+        if (!scheduler->runNextTask(Systick::getMsCounter()))
+            // nothing to do until the next systick or audio interrupt
+            __WFI();
     }
 }
\ No newline at end of file
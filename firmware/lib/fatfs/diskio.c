@@ -13,9 +13,30 @@
 
 
 #include "diskio.h"		// FatFs lower layer API
+#ifndef UNIT_TEST
 #include "drivers/stm32_ub_usbdisk.h"	// UB: USB drive control
 #include "drivers/stm32_ub_atadrive.h"	// UB: ATA drive control
 #include "drivers/stm32_ub_sdcard.h"	// UB: MMC/SDC control
+#else
+// Host tests: the SD card is simulated behind the SPI transport of
+// sdcard_spi.c (see tests/SimulatedSdCard.h), there is no USB or ATA drive.
+#include "drivers/sdcard_spi.h"
+#define MMC_disk_initialize()		SDSPI_disk_initialize()
+#define MMC_disk_status()			SDSPI_disk_status()
+#define MMC_disk_read(b, s, c)		SDSPI_disk_read(b, s, c)
+#define MMC_disk_write(b, s, c)		SDSPI_disk_write(b, s, c)
+#define MMC_disk_ioctl(c, b)		SDSPI_disk_ioctl(c, b)
+#define ATA_disk_initialize()		(1)
+#define ATA_disk_status()			(1)
+#define ATA_disk_read(b, s, c)		(1)
+#define ATA_disk_write(b, s, c)		(1)
+#define ATA_disk_ioctl(c, b)		(1)
+#define USB_disk_initialize()		(1)
+#define USB_disk_status()			(1)
+#define USB_disk_read(b, s, c)		(1)
+#define USB_disk_write(b, s, c)		(1)
+#define USB_disk_ioctl(c, b)		(1)
+#endif
 
 /* Definitions of physical drive number for each media */
 #define MMC		0
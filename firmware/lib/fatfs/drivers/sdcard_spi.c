@@ -0,0 +1,542 @@
+//--------------------------------------------------------------
+// File     : sdcard_spi.c
+// Funktion : FATFS-Dateisystem fuer SD-Medien
+//            Kommando-Ebene (SPI-Mode)
+//            Quelle = STM32-Example von ChaN
+// Hinweis  : The hardware is accessed through an SPI transport
+//            (SDSPI_Transport_t), so that this file doesn't depend
+//            on the MCU and can be tested on the host.
+//
+//            Multi block reads (CMD18) and writes (CMD25) are kept
+//            open when a call returns. If the next call continues
+//            at the following sector, the transfer continues without
+//            a new command. Everything else stops the open transfer
+//            first. CTRL_SYNC stops an open write, so that the data
+//            is programmed when f_sync() / f_close() return.
+//            The card keeps CS asserted while a transfer is open,
+//            so it must be the only device on its SPI bus.
+//
+//            SDSPI_TimerProc() must be called every 1ms.
+//
+//--------------------------------------------------------------
+//
+// Copyright (C) 2014, ChaN, all right reserved.
+//
+// * This software is a free software and there is NO WARRANTY.
+// * No restriction on use. You can use, modify and redistribute it for
+//   personal, non-profit or commercial products UNDER YOUR RESPONSIBILITY.
+// * Redistributions of source code must retain the above copyright notice.
+//
+//-------------------------------------------------------------------------
+
+//--------------------------------------------------------------
+// Includes
+//--------------------------------------------------------------
+#include "sdcard_spi.h"
+
+//--------------------------------------------------------------
+// Globale Variabeln
+//--------------------------------------------------------------
+static volatile DSTATUS Stat = STA_NOINIT;
+static volatile UINT Timer1, Timer2;
+static BYTE CardType;
+static const SDSPI_Transport_t *Spi;
+static BYTE StreamCmd;      // open multi block transfer (0, CMD18 or CMD25)
+static DWORD StreamSector;  // next sector (LBA) of the open transfer
+
+
+
+//--------------------------------------------------------------
+// interne Funktionen
+//--------------------------------------------------------------
+static BYTE xchg_spi(BYTE dat);
+static int wait_ready(UINT wt);
+static void deselect(void);
+static int select(void);
+static int rcvr_datablock (BYTE *buff, UINT btr);
+#if _USE_WRITE
+static int xmit_datablock(const BYTE *buff,BYTE token);
+#endif
+static BYTE send_cmd (BYTE cmd, DWORD arg);
+static BYTE send_cmd_no_wait_ready (BYTE cmd, DWORD arg);
+static DWORD card_address(DWORD sector);
+static int stop_transfer(void);
+//--------------------------------------------------------------
+
+
+
+//--------------------------------------------------------------
+// Set the SPI transport, must be called before everything else
+//--------------------------------------------------------------
+void SDSPI_Init(const SDSPI_Transport_t *transport)
+{
+  Spi = transport;
+  Stat = STA_NOINIT;
+  CardType = 0;
+  StreamCmd = 0;
+}
+
+
+//--------------------------------------------------------------
+// Wait for ms milliseconds (needs the 1ms timer)
+//--------------------------------------------------------------
+void SDSPI_Delay(UINT ms)
+{
+  for (Timer1 = ms; Timer1; ) {
+    if (Spi->yield) Spi->yield();
+  }
+}
+
+
+//--------------------------------------------------------------
+// init der Disk
+//--------------------------------------------------------------
+DSTATUS SDSPI_disk_initialize(void)
+{
+  BYTE n, cmd, ty, ocr[4];
+
+  StreamCmd = 0; // the card is reset, there is no open transfer anymore
+
+  SDSPI_Delay(10); // 10ms
+
+  if (Stat & STA_NODISK) return Stat;
+
+  Spi->setSlowClock();
+  for (n = 10; n; n--) xchg_spi(0xFF);	// Send 80 dummy clocks
+
+  ty = 0;
+  Spi->select();
+  if (send_cmd_no_wait_ready(CMD0, 0) == 1) { //Put the card SPI/Idle state
+    Timer1 = 1000; // Initialization timeout = 1 sec
+    if (send_cmd_no_wait_ready(CMD8, 0x1AA) == 1) {	// SDv2?
+      for (n = 0; n < 4; n++) ocr[n] = xchg_spi(0xFF); // Get 32 bit return value of R7 resp
+      if (ocr[2] == 0x01 && ocr[3] == 0xAA) { // Is the card supports vcc of 2.7-3.6V?
+        while (Timer1 && send_cmd(ACMD41, 1UL << 30)) ; // Wait for end of initialization with ACMD41(HCS)
+        if (Timer1 && send_cmd(CMD58, 0) == 0) { // Check CCS bit in the OCR
+          for (n = 0; n < 4; n++) ocr[n] = xchg_spi(0xFF);
+          ty = (ocr[0] & 0x40) ? CT_SD2 | CT_BLOCK : CT_SD2; // Card id SDv2
+        }
+      }
+    }
+    else { // Not SDv2 card
+      if (send_cmd(ACMD41, 0) <= 1) { // SDv1 or MMC?
+        ty = CT_SD1; cmd = ACMD41; //SDv1 (ACMD41(0))
+      } else {
+        ty = CT_MMC; cmd = CMD1; // MMCv3 (CMD1(0))
+      }
+      while (Timer1 && send_cmd(cmd, 0)) ; // Wait for end of initialization
+      if (!Timer1 || send_cmd(CMD16, 512) != 0) ty = 0; // Set block length: 512
+    }
+  }
+  CardType = ty; // Card type
+  deselect();
+
+  if (ty) { // OK
+    Spi->setFastClock(); // Set fast clock
+    Stat &= ~STA_NOINIT; // Clear STA_NOINIT flag
+  } else { // Failed
+    Stat = STA_NOINIT;
+  }
+
+  return Stat;
+}
+
+
+//--------------------------------------------------------------
+// Disk Status abfragen
+//--------------------------------------------------------------
+DSTATUS SDSPI_disk_status(void)
+{
+  return Stat;
+}
+
+
+//--------------------------------------------------------------
+// READ-Funktion
+// buff : Pointer to the data buffer to store read data
+// sector : Start sector number (LBA)
+// count : Number of sectors to read (1..128)
+//--------------------------------------------------------------
+DRESULT SDSPI_disk_read(BYTE *buff,DWORD sector,UINT count)
+{
+  if (!count) return RES_PARERR;
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+  // continue the open READ_MULTIPLE_BLOCK or start a new one
+  if (StreamCmd != CMD18 || StreamSector != sector) {
+    stop_transfer();
+    if (send_cmd(CMD18, card_address(sector)) != 0) {
+      deselect();
+      return RES_ERROR;
+    }
+    StreamCmd = CMD18;
+  }
+  StreamSector = sector + count;
+
+  do {
+    if (!rcvr_datablock(buff, 512)) break;
+    buff += 512;
+  } while (--count);
+  if (count) stop_transfer(); // abort the transfer on errors
+
+  return count ? RES_ERROR : RES_OK;
+}
+
+
+//--------------------------------------------------------------
+// WRITE-Funktion
+// buff : Ponter to the data to write
+// sector : Start sector number (LBA)
+// count : Number of sectors to write (1..128)
+//--------------------------------------------------------------
+#if _USE_WRITE
+DRESULT SDSPI_disk_write(const BYTE *buff,DWORD sector,	UINT count)
+{
+  if (!count) return RES_PARERR;
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+  if (Stat & STA_PROTECT) return RES_WRPRT;
+
+  // continue the open WRITE_MULTIPLE_BLOCK or start a new write
+  if (StreamCmd != CMD25 || StreamSector != sector) {
+    if (!stop_transfer()) return RES_ERROR; // the previous write failed
+    if (count == 1) { // Single sector write, programmed right away
+      // WRITE_BLOCK
+      if (send_cmd(CMD24, card_address(sector)) == 0)
+      {
+          if (xmit_datablock(buff, 0xFE))
+            count = 0;
+      }
+      deselect();
+      return count ? RES_ERROR : RES_OK;
+    }
+    if (CardType & CT_SDC) send_cmd(ACMD23, count); // Predefine number of sectors
+    if (send_cmd(CMD25, card_address(sector)) != 0) { // WRITE_MULTIPLE_BLOCK
+      deselect();
+      return RES_ERROR;
+    }
+    StreamCmd = CMD25;
+  }
+  StreamSector = sector + count;
+
+  do {
+    if (!xmit_datablock(buff, 0xFC)) break;
+    buff += 512;
+  } while (--count);
+  if (count) stop_transfer(); // abort the transfer on errors
+
+  return count ? RES_ERROR : RES_OK;
+}
+#endif
+
+
+//--------------------------------------------------------------
+// IOCTL-Funktion
+// cmd : Control command code
+// buff : Pointer to the conrtol data
+//--------------------------------------------------------------
+#if _USE_IOCTL
+DRESULT SDSPI_disk_ioctl(BYTE cmd,void *buff)
+{
+  DRESULT res;
+  BYTE n, csd[16];
+  DWORD *dp, st, ed, csize;
+  int isTransferStopped;
+
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+  // all of these need the card for themselves
+  isTransferStopped = stop_transfer();
+
+  res = RES_ERROR;
+
+  switch (cmd) {
+    case CTRL_SYNC : // Wait for end of internal write process of the drive
+      if (isTransferStopped && select()) res = RES_OK;
+    break;
+
+    case GET_SECTOR_COUNT : // Get drive capacity in unit of sector (DWORD)
+      if ((send_cmd(CMD9, 0) == 0) && rcvr_datablock(csd, 16)) {
+        if ((csd[0] >> 6) == 1) { // SDC ver 2.00
+          csize = csd[9] + ((WORD)csd[8] << 8) + ((DWORD)(csd[7] & 63) << 16) + 1;
+          *(DWORD*)buff = csize << 10;
+        } else { // SDC ver 1.XX or MMC ver 3
+          n = (csd[5] & 15) + ((csd[10] & 128) >> 7) + ((csd[9] & 3) << 1) + 2;
+          csize = (csd[8] >> 6) + ((WORD)csd[7] << 2) + ((WORD)(csd[6] & 3) << 10) + 1;
+          *(DWORD*)buff = csize << (n - 9);
+        }
+        res = RES_OK;
+      }
+    break;
+
+    case GET_BLOCK_SIZE : // Get erase block size in unit of sector (DWORD)
+      if (CardType & CT_SD2) { // SDC ver 2.00
+        if (send_cmd(ACMD13, 0) == 0) { // Read SD status
+          xchg_spi(0xFF);
+          if (rcvr_datablock(csd, 16)) { // Read partial block
+            for (n = 64 - 16; n; n--) xchg_spi(0xFF);	// Purge trailing data
+            *(DWORD*)buff = 16UL << (csd[10] >> 4);
+            res = RES_OK;
+          }
+        }
+      } else { // SDC ver 1.XX or MMC
+        if ((send_cmd(CMD9, 0) == 0) && rcvr_datablock(csd, 16)) { // Read CSD
+          if (CardType & CT_SD1) { // SDC ver 1.XX
+            *(DWORD*)buff = (((csd[10] & 63) << 1) + ((WORD)(csd[11] & 128) >> 7) + 1) << ((csd[13] >> 6) - 1);
+          } else { // MMC
+            *(DWORD*)buff = ((WORD)((csd[10] & 124) >> 2) + 1) * (((csd[11] & 3) << 3) + ((csd[11] & 224) >> 5) + 1);
+          }
+          res = RES_OK;
+        }
+      }
+    break;
+
+    case CTRL_TRIM : // Erase a block of sectors (used when _USE_ERASE == 1)
+      if (!(CardType & CT_SDC)) break; // Check if the card is SDC
+      if (SDSPI_disk_ioctl(MMC_GET_CSD, csd)!=0) break; // Get CSD
+      if (!(csd[0] >> 6) && !(csd[10] & 0x40)) break; // Check if sector erase can be applied to the card
+      dp = buff; st = dp[0]; ed = dp[1]; // Load sector block
+      if (!(CardType & CT_BLOCK)) {
+        st *= 512; ed *= 512;
+      }
+      // Erase sector block
+      if (send_cmd(CMD32, st) == 0 && send_cmd(CMD33, ed) == 0 && send_cmd(CMD38, 0) == 0 && wait_ready(30000))
+        res = RES_OK; // FatFs does not check result of this command
+    break;
+
+    default:
+      res = RES_PARERR;
+  }
+
+  deselect();
+
+  return res;
+}
+#endif
+
+
+//--------------------------------------------------------------
+// Exchange a byte
+// dat : Data to send
+//--------------------------------------------------------------
+static BYTE xchg_spi(BYTE dat)
+{
+  return Spi->exchange(dat);
+}
+
+
+//--------------------------------------------------------------
+// Wait for card ready
+// wt :  Timeout [ms]
+// ret_wert : 1:Ready, 0:Timeout
+//--------------------------------------------------------------
+static int wait_ready(UINT wt)
+{
+  BYTE d;
+
+  Timer2 = wt;
+  do {
+    d = xchg_spi(0xFF);
+    // This loop takes a time. Insert rot_rdq() here for multitask envilonment.
+  } while (d != 0xFF && Timer2); // Wait for card goes ready or timeout
+
+  return (d == 0xFF) ? 1 : 0;
+}
+
+
+//--------------------------------------------------------------
+// Deselect card and release SPI
+//--------------------------------------------------------------
+static void deselect(void)
+{
+  Spi->deselect(); // CS = H
+  xchg_spi(0xFF); // Dummy clock (force DO hi-z for multiple slave SPI)
+}
+
+
+//--------------------------------------------------------------
+// Select card and wait for ready
+// ret_wert :  1:OK, 0:Timeout
+//--------------------------------------------------------------
+static int select(void)
+{
+  Spi->select();
+  xchg_spi(0xFF); // Dummy clock (force DO enabled)
+
+  if (wait_ready(500)) return 1; // OK
+  deselect();
+  return 0; // Timeout
+}
+
+
+//--------------------------------------------------------------
+// Receive a data packet from the MMC
+// buf : Data buffer
+// btr : Data block length (byte)
+// ret_wert : 1:OK, 0:Error
+//--------------------------------------------------------------
+static int rcvr_datablock (BYTE *buff, UINT btr)
+{
+  BYTE token;
+
+  Timer1 = 200;
+  do { // Wait for DataStart token in timeout of 200ms
+    token = xchg_spi(0xFF);
+    // This loop will take a time. Insert rot_rdq() here for multitask envilonment.
+  } while ((token == 0xFF) && Timer1);
+  if(token != 0xFE)
+    return 0; // Function fails if invalid DataStart token or timeout
+
+  Spi->receive(buff, btr); // Store trailing data to the buffer
+  xchg_spi(0xFF); xchg_spi(0xFF); // Discard CRC
+
+  return 1; // Function succeeded
+}
+
+
+//--------------------------------------------------------------
+// Send a data packet to the MMC
+// buf : Ponter to 512 byte data to be sent
+// token : Token
+// ret_wert : 1:OK, 0:Failed
+//--------------------------------------------------------------
+#if _USE_WRITE
+static int xmit_datablock(const BYTE *buff,BYTE token)
+{
+  BYTE resp;
+
+  if (!wait_ready(500)) return 0; // Wait for card ready
+  xchg_spi(token); // Send token
+  if (token != 0xFD) { // Send data if token is other than StopTran
+    Spi->transmit(buff, 512); // Data
+    xchg_spi(0xFF); xchg_spi(0xFF); // Dummy CRC
+
+    int n = 10; // Wait for response (10 bytes max)
+    do {
+      resp = xchg_spi(0xFF);
+    } while ((resp == 0xFF) && --n);
+
+    // Function fails if the data packet was not accepted
+    if ((resp & 0x1F) != 0x05) return 0;
+  }
+  return 1;
+}
+#endif
+
+
+//--------------------------------------------------------------
+// Send a command packet to the MMC
+// cmd : Command index
+// arg : Argument
+// ret_wert : R1 resp (bit7==1:Failed to send)
+//--------------------------------------------------------------
+static BYTE send_cmd (BYTE cmd, DWORD arg)
+{
+  BYTE res;
+
+  if (cmd & 0x80) { // Send a CMD55 prior to ACMD<n>
+    cmd &= 0x7F;
+    res = send_cmd(CMD55, 0);
+    if (res > 1) return res;
+  }
+
+  // Select the card and wait for ready except to stop multiple block read
+  if (cmd != CMD12) {
+    deselect();
+    if (!select()) return 0xFF;
+  }
+
+  return send_cmd_no_wait_ready(cmd, arg);
+}
+
+//--------------------------------------------------------------
+// Send a command packet to the MMC, don't wait for the card to be ready (used for initialization)
+// cmd : Command index
+// arg : Argument
+// ret_wert : R1 resp (bit7==1:Failed to send)
+//--------------------------------------------------------------
+static BYTE send_cmd_no_wait_ready (BYTE cmd, DWORD arg)
+{
+  BYTE n, res;
+
+  // Send command packet
+  xchg_spi(0x40 | cmd); // Start + command index
+  xchg_spi((BYTE)(arg >> 24)); // Argument[31..24]
+  xchg_spi((BYTE)(arg >> 16)); // Argument[23..16]
+  xchg_spi((BYTE)(arg >> 8)); // Argument[15..8]
+  xchg_spi((BYTE)arg); // Argument[7..0]
+  n = 0x01; // Dummy CRC + Stop
+  if (cmd == CMD0) n = 0x95; // Valid CRC for CMD0(0)
+  if (cmd == CMD8) n = 0x87; // Valid CRC for CMD8(0x1AA)
+  xchg_spi(n);
+
+  // Receive command resp
+  if (cmd == CMD12) xchg_spi(0xFF); // Diacard following one byte when CMD12
+  n = 10; // Wait for response (10 bytes max)
+  do {
+    res = xchg_spi(0xFF);
+  }while ((res & 0x80) && --n);
+
+  return res; // Return received response
+}
+
+
+//--------------------------------------------------------------
+// LBA to BA conversion (byte addressing cards)
+//--------------------------------------------------------------
+static DWORD card_address(DWORD sector)
+{
+  return (CardType & CT_BLOCK) ? sector : sector * 512;
+}
+
+
+//--------------------------------------------------------------
+// Stop the open multi block transfer and release the card
+// ret_wert : 1:OK (or nothing was open), 0:Failed
+//--------------------------------------------------------------
+static int stop_transfer(void)
+{
+  int ret_wert = 1;
+
+  if (!StreamCmd) return 1;
+
+  if (StreamCmd == CMD18) {
+    send_cmd(CMD12, 0); // STOP_TRANSMISSION
+  }
+#if _USE_WRITE
+  else {
+    if (!xmit_datablock(0, 0xFD)) ret_wert = 0; // STOP_TRAN token
+  }
+#endif
+  StreamCmd = 0;
+  deselect();
+
+  return ret_wert;
+}
+
+
+//--------------------------------------------------------------
+// Device timer function
+// This function must be called from timer interrupt routine in period
+// of 1 ms to generate card control timing.
+//--------------------------------------------------------------
+void SDSPI_TimerProc(int isCardPresent, int isWriteProtected)
+{
+  WORD n;
+  BYTE s;
+
+  n = Timer1;
+  if (n) Timer1 = --n;
+  n = Timer2;
+  if (n) Timer2 = --n;
+
+  s = Stat;
+  if (isWriteProtected)
+    s |= STA_PROTECT;
+  else
+    s &= ~STA_PROTECT;
+  if (isCardPresent)
+    s &= ~STA_NODISK;
+  else
+    s |= (STA_NODISK | STA_NOINIT);
+  Stat = s;
+}
@@ -0,0 +1,76 @@
+//--------------------------------------------------------------
+// File     : sdcard_spi.h
+//--------------------------------------------------------------
+
+//--------------------------------------------------------------
+#ifndef __SDCARD_SPI_H
+#define __SDCARD_SPI_H
+
+//--------------------------------------------------------------
+// Includes
+//--------------------------------------------------------------
+#include "ff.h"
+#include "diskio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//--------------------------------------------------------------
+// SPI transport of the SD card
+// On the target, this is SPI2 with DMA (stm32_ub_sdcard.c),
+// on the host it's a simulated card (tests/SimulatedSdCard.h).
+//--------------------------------------------------------------
+typedef struct {
+  void (*select)(void);                         // CS = L
+  void (*deselect)(void);                       // CS = H
+  void (*setSlowClock)(void);                   // clock for the initialization (100..400kHz)
+  void (*setFastClock)(void);                   // clock for data transfers
+  BYTE (*exchange)(BYTE dat);                   // send a byte, return the received byte
+  void (*receive)(BYTE *buff, UINT btr);        // receive btr bytes while sending 0xFF
+  void (*transmit)(const BYTE *buff, UINT btx); // send btx bytes, discard the received bytes
+  void (*yield)(void);                          // called while waiting for the timer (optional)
+} SDSPI_Transport_t;
+
+//--------------------------------------------------------------
+/* MMC/SD command */
+//--------------------------------------------------------------
+#define CMD0	(0)        // GO_IDLE_STATE
+#define CMD1	(1)        // SEND_OP_COND (MMC)
+#define	ACMD41	(0x80+41)  // SEND_OP_COND (SDC)
+#define CMD8	(8)        // SEND_IF_COND
+#define CMD9	(9)        // SEND_CSD
+#define CMD10	(10)       // SEND_CID
+#define CMD12	(12)       // STOP_TRANSMISSION
+#define ACMD13	(0x80+13)  // SD_STATUS (SDC)
+#define CMD16	(16)       // SET_BLOCKLEN
+#define CMD17	(17)       // READ_SINGLE_BLOCK
+#define CMD18	(18)       // READ_MULTIPLE_BLOCK
+#define CMD23	(23)       // SET_BLOCK_COUNT (MMC)
+#define	ACMD23	(0x80+23)  // SET_WR_BLK_ERASE_COUNT (SDC)
+#define CMD24	(24)       // WRITE_BLOCK
+#define CMD25	(25)       // WRITE_MULTIPLE_BLOCK
+#define CMD32	(32)       // ERASE_ER_BLK_START
+#define CMD33	(33)       // ERASE_ER_BLK_END
+#define CMD38	(38)       // ERASE
+#define CMD55	(55)       // APP_CMD
+#define CMD58	(58)       // READ_OCR
+
+//--------------------------------------------------------------
+// Globale Funktionen
+//--------------------------------------------------------------
+void SDSPI_Init(const SDSPI_Transport_t *transport);
+void SDSPI_Delay(UINT ms);
+DSTATUS SDSPI_disk_initialize(void);
+DSTATUS SDSPI_disk_status(void);
+DRESULT SDSPI_disk_read(BYTE *buff, DWORD sector, UINT count);
+DRESULT SDSPI_disk_write(const BYTE *buff, DWORD sector, UINT count);
+DRESULT SDSPI_disk_ioctl(BYTE cmd, void *buff);
+void SDSPI_TimerProc(int isCardPresent, int isWriteProtected);
+
+#ifdef __cplusplus
+}
+#endif
+
+//--------------------------------------------------------------
+#endif // __SDCARD_SPI_H
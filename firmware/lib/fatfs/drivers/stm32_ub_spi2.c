@@ -10,7 +10,9 @@
 // Module   : GPIO, SPI
 // Funktion : SPI-LoLevel-Funktionen (SPI-2)
 //
-// Hinweis  : m�gliche Pinbelegungen
+// Hinweis  : Bloecke werden per DMA uebertragen
+//            (SPI2_RX = DMA1 Stream3, SPI2_TX = DMA1 Stream4)
+//            m�gliche Pinbelegungen
 //            SPI2 : SCK :[PB10, PB13]
 //                   MOSI:[PB15, PC3]
 //                   MISO:[PB14, PC2]
@@ -34,6 +36,7 @@ SPI2_DEV_t SPI2DEV = {
 };
 
 void initSpi2Interrupt();
+void initSpi2Dma();
 
 //--------------------------------------------------------------
 // Init von SPI2
@@ -118,6 +121,7 @@ ErrorStatus UB_SPI2_Init(SPI2_Mode_t mode)
     SPI_Init(SPI2, &SPI_InitStructure);
 
     initSpi2Interrupt();
+    initSpi2Dma();
 
     // SPI enable
     SPI_Cmd(SPI2, ENABLE);
@@ -241,3 +245,125 @@ void UB_SPI2_SendAndReceiveMultipleBytes(uint8_t* txData, uint32_t txSize, uint8
     while ((numLeftToSend > 0) || (numLeftToReceive > 0))
         ;
 }
+
+// DMA1 can't access the CCM RAM
+#define IS_DMA_CAPABLE(ptr) ((((uint32_t) (ptr)) & 0xFFFF0000) != CCMDATARAM_BASE)
+
+volatile uint8_t isDmaTransferComplete;
+static uint8_t dmaDummyRxByte;
+static uint8_t dmaDummyTxByte = 0xFF;
+
+void initSpi2Dma()
+{
+    // Sending or receiving a data block byte by byte costs two interrupts
+    // per byte. The DMA moves the bytes instead, and only the end of the
+    // transfer raises an interrupt. The RX stream always runs, so that its
+    // transfer complete interrupt marks the point when the last byte was
+    // clocked out of the card.
+    RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA1, ENABLE);
+
+    NVIC_InitTypeDef NVIC_InitStructure;
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Stream3_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+}
+
+void DMA1_Stream3_IRQHandler()
+{
+    if (DMA1->LISR & (DMA_LISR_TCIF3 | DMA_LISR_TEIF3))
+    {
+        DMA1->LIFCR = DMA_LIFCR_CTCIF3 | DMA_LIFCR_CHTIF3 | DMA_LIFCR_CTEIF3
+                      | DMA_LIFCR_CDMEIF3 | DMA_LIFCR_CFEIF3;
+        SPI2->CR2 &= ~(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+        // back to the byte wise transfers
+        SPI_I2S_ITConfig(SPI2, SPI_I2S_IT_RXNE, ENABLE);
+        isDmaTransferComplete = 1;
+    }
+}
+
+void startDmaTransfer(const uint8_t* txData, uint8_t* rxData, uint32_t size)
+{
+    while(SPI2->SR & SPI_I2S_FLAG_BSY)
+        ;
+
+    // the DMA reads the data register, not the interrupt
+    SPI_I2S_ITConfig(SPI2, SPI_I2S_IT_RXNE, DISABLE);
+    (void) SPI2->DR;
+
+    DMA1_Stream3->CR &= ~DMA_SxCR_EN;
+    DMA1_Stream4->CR &= ~DMA_SxCR_EN;
+    while ((DMA1_Stream3->CR & DMA_SxCR_EN) || (DMA1_Stream4->CR & DMA_SxCR_EN))
+        ;
+    DMA1->LIFCR = DMA_LIFCR_CTCIF3 | DMA_LIFCR_CHTIF3 | DMA_LIFCR_CTEIF3
+                  | DMA_LIFCR_CDMEIF3 | DMA_LIFCR_CFEIF3;
+    DMA1->HIFCR = DMA_HIFCR_CTCIF4 | DMA_HIFCR_CHTIF4 | DMA_HIFCR_CTEIF4
+                  | DMA_HIFCR_CDMEIF4 | DMA_HIFCR_CFEIF4;
+
+    // RX: SPI2->DR to memory, channel 0
+    DMA1_Stream3->CR = (0 * DMA_SxCR_CHSEL_0) | // Channel 0
+                       DMA_SxCR_PL_1 | // High priority
+                       (rxData ? DMA_SxCR_MINC : 0) |
+                       DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+    DMA1_Stream3->NDTR = size;
+    DMA1_Stream3->PAR = (uint32_t) &SPI2->DR;
+    DMA1_Stream3->M0AR = (uint32_t) (rxData ? rxData : &dmaDummyRxByte);
+    DMA1_Stream3->FCR = 0; // direct mode
+
+    // TX: memory to SPI2->DR, channel 0
+    DMA1_Stream4->CR = (0 * DMA_SxCR_CHSEL_0) | // Channel 0
+                       DMA_SxCR_PL_1 | // High priority
+                       DMA_SxCR_DIR_0 | // Memory to peripheral
+                       (txData ? DMA_SxCR_MINC : 0);
+    DMA1_Stream4->NDTR = size;
+    DMA1_Stream4->PAR = (uint32_t) &SPI2->DR;
+    DMA1_Stream4->M0AR = (uint32_t) (txData ? txData : &dmaDummyTxByte);
+    DMA1_Stream4->FCR = 0; // direct mode
+
+    isDmaTransferComplete = 0;
+    DMA1_Stream3->CR |= DMA_SxCR_EN;
+    DMA1_Stream4->CR |= DMA_SxCR_EN;
+    SPI2->CR2 |= SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN;
+}
+
+void waitForDmaTransfer()
+{
+    // Sleep until the transfer complete interrupt (or any other interrupt)
+    // instead of spinning on the flag. The caller still blocks for the whole
+    // block. Interrupts are masked while checking the flag, so that the
+    // interrupt can't slip in between the check and the __WFI(). A pending
+    // interrupt still wakes the core and runs as soon as they're unmasked.
+    __disable_irq();
+    while (!isDmaTransferComplete)
+    {
+        __WFI();
+        __enable_irq();
+        __disable_irq();
+    }
+    __enable_irq();
+}
+
+void UB_SPI2_SendMultipleBytesDMA(const uint8_t* data, uint32_t size)
+{
+    if (!IS_DMA_CAPABLE(data))
+    {
+        UB_SPI2_SendMultipleBytes(data, size);
+        return;
+    }
+
+    startDmaTransfer(data, 0, size);
+    waitForDmaTransfer();
+}
+
+void UB_SPI2_ReceiveMultipleBytesDMA(uint8_t* data, uint32_t size)
+{
+    if (!IS_DMA_CAPABLE(data))
+    {
+        UB_SPI2_ReceiveMultipleBytes(data, size);
+        return;
+    }
+
+    startDmaTransfer(0, data, size);
+    waitForDmaTransfer();
+}
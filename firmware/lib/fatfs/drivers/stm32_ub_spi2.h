@@ -72,6 +72,8 @@ ErrorStatus UB_SPI2_Init(SPI2_Mode_t mode);
 void UB_SPI2_SendMultipleBytes(const uint8_t* data, uint32_t size);
 void UB_SPI2_ReceiveMultipleBytes(uint8_t* data, uint32_t size);
 void UB_SPI2_SendAndReceiveMultipleBytes(uint8_t* txData, uint32_t txSize, uint8_t* rxData, uint32_t rxSize);
+void UB_SPI2_SendMultipleBytesDMA(const uint8_t* data, uint32_t size);
+void UB_SPI2_ReceiveMultipleBytesDMA(uint8_t* data, uint32_t size);
 
 
 
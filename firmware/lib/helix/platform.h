@@ -10,7 +10,15 @@
 
 #include <stdint.h>
 
-#define ARM_TEST
+/* Selects the implementation of the arithmetic functions in real/assembly.h:
+ * DSP instructions on the Cortex-M4, portable C everywhere else (e.g. on the
+ * host that runs the unit tests).
+ */
+#if defined(__ARM_ARCH_7EM__)
+#define HELIX_CORTEX_M4
+#else
+#define HELIX_PORTABLE_C
+#endif
 
 typedef long long Word64;
 typedef uint32_t ULONG32;
@@ -64,7 +64,7 @@
 #
 #elif defined(_AEE_SIMULATOR) || defined(_BREW)
 #
-#elif defined(ARM_TEST)
+#elif defined(HELIX_CORTEX_M4) || defined(HELIX_PORTABLE_C)
 #
 #else
 #error No platform defined. See valid options in mp3dec.h
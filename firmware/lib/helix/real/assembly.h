@@ -42,6 +42,7 @@
  *
  * - inline rountines with access to 64-bit multiply results 
  * - x86 (_WIN32) and ARM (ARM_ADS, _WIN32_WCE) versions included
+ * - Cortex-M4 (HELIX_CORTEX_M4) and portable C (HELIX_PORTABLE_C) versions, see platform.h
  * - some inline functions are mix of asm and C for speed
  * - some functions are in native asm files, so only the prototype is given here
  *
@@ -319,63 +320,43 @@ static __inline int CLZ(int x)
 	return numZeros;
 }
 
-#elif defined(ARM_TEST)
-static __inline__ int MULSHIFT32(int x, int y)
+#elif defined(HELIX_CORTEX_M4)
+
+/* Cortex-M4 (ARMv7E-M): single cycle multiplies, CLZ and saturation instructions.
+ * All functions must return exactly the same results as the portable versions below,
+ * which are used for the bit-exact comparison on the host.
+ */
+
+static __inline int MULSHIFT32(int x, int y)
 {
-	int zlow;
-	__asm__ volatile ("smull %0,%1,%2,%3" : "=&r" (zlow), "=r" (y) : "r" (x), "1" (y) : "cc");
-	return y;
+	/* smmul only writes the top 32 bits, so it doesn't occupy a second register like smull */
+	int z;
+	__asm__ ("smmul %0, %1, %2" : "=r" (z) : "r" (x), "r" (y));
+	return z;
 }
 
 static __inline int FASTABS(int x)
 {
-	int sign;
-
-	sign = x >> (sizeof(int) * 8 - 1);
-	x ^= sign;
-	x -= sign;
-
-	return x;
+	/* eor + sub with shifted operands: two instructions, no branch */
+	int t;
+	__asm__ ("eor %0, %1, %1, asr #31\n\t"
+			 "sub %0, %0, %1, asr #31"
+			 : "=&r" (t) : "r" (x));
+	return t;
 }
 
 static __inline int CLZ(int x)
 {
+	/* the clz instruction returns 32 for x == 0, like the portable version */
 	int numZeros;
-
-	/*if (!x)
-return (sizeof(int) * 8);
-
-numZeros = 0;
-while (!(x & 0x80000000)) {
-numZeros++;
-x <
-}*/
-
-	__asm__ ("clz %0, %1" : "=r" (numZeros) : "r" (x) : "cc");
-
+	__asm__ ("clz %0, %1" : "=r" (numZeros) : "r" (x));
 	return numZeros;
 }
 
-//static __inline int CLZ(int x) {
-//	int numZeros;
-//
-//	if (!x) {
-//		return (sizeof(int) * 8);
-//	}
-//
-//	numZeros = 0;
-//	while (!(x & 0x80000000)) {
-//		numZeros++;
-//		x <<= 1;
-//	}
-//
-//	return numZeros;
-//}
-
 typedef union _U64 {
 	Word64 w64;
 	struct {
-		/* ARM ADS = little endian */
+		/* little endian */
 		unsigned int lo32;
 		signed int hi32;
 	} r;
@@ -385,15 +366,63 @@ static __inline Word64 MADD64(Word64 sum64, int x, int y)
 {
 	U64 u;
 	u.w64 = sum64;
-
-	__asm__ volatile ("smlal %0,%1,%2,%3" : "+&r" (u.r.lo32), "+&r" (u.r.hi32) : "r" (x), "r" (y) : "cc");
-
+	__asm__ ("smlal %0, %1, %2, %3" : "+r" (u.r.lo32), "+r" (u.r.hi32) : "r" (x), "r" (y));
 	return u.w64;
 }
+
 static __inline Word64 SAR64(Word64 x, int n)
 {
+	/* the compiler emits lsr/orr/asr for a constant n */
 	return x >> n;
+}
+
+#elif defined(HELIX_PORTABLE_C)
+
+/* Portable C for all other platforms, e.g. the host that runs the unit tests.
+ * This is the reference for the bit-exact comparison with the Cortex-M4 version.
+ */
+
+static __inline int MULSHIFT32(int x, int y)
+{
+	return (int)(((Word64)x * (Word64)y) >> 32);
+}
 
+static __inline int FASTABS(int x)
+{
+	int sign;
+
+	sign = x >> (sizeof(int) * 8 - 1);
+
+	/* unsigned, so that FASTABS(INT_MIN) wraps to INT_MIN like on the Cortex-M4 */
+	return (int)(((unsigned int)x ^ (unsigned int)sign) - (unsigned int)sign);
+}
+
+static __inline int CLZ(int x)
+{
+	/* unsigned, so that shifting into the sign bit is well defined */
+	unsigned int u = (unsigned int)x;
+	int numZeros;
+
+	if (!u)
+		return (sizeof(int) * 8);
+
+	numZeros = 0;
+	while (!(u & 0x80000000u)) {
+		numZeros++;
+		u <<= 1;
+	}
+
+	return numZeros;
+}
+
+static __inline Word64 MADD64(Word64 sum64, int x, int y)
+{
+	return sum64 + (Word64)x * (Word64)y;
+}
+
+static __inline Word64 SAR64(Word64 x, int n)
+{
+	return x >> n;
 }
 
 #else
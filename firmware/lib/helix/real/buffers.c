@@ -89,6 +89,37 @@ static void ClearBuffer(void *buf, int nBytes)
  * Notes:       if one or more mallocs fail, function frees any buffers already
  *                allocated before returning
  **************************************************************************************/
+/*
+ * Use static buffers to make the RAM usage known at compile time. A small
+ * pool of decoder instances is provided so that the next file can be opened
+ * and primed while the current one is still decoding (gapless playback).
+ * On the STM32F4 the pool lives in the core coupled memory; the decoder
+ * state is never accessed by DMA.
+ */
+#ifndef MP3_NUM_DECODER_INSTANCES
+#define MP3_NUM_DECODER_INSTANCES 2
+#endif
+
+#if defined(STM32F4XX)
+#define MP3_DECODER_BUFFER_SECTION __attribute__ ((section (".ccmdata")))
+#else
+#define MP3_DECODER_BUFFER_SECTION
+#endif
+
+typedef struct _DecoderBuffers {
+	MP3DecInfo mp3DecInfo;
+	FrameHeader fh;
+	SideInfo si;
+	ScaleFactorInfo sfi;
+	HuffmanInfo hi;
+	DequantInfo di;
+	IMDCTInfo mi;
+	SubbandInfo sbi;
+} DecoderBuffers;
+
+static DecoderBuffers s_decoderBuffers[MP3_NUM_DECODER_INSTANCES] MP3_DECODER_BUFFER_SECTION;
+static unsigned char s_decoderBuffersInUse[MP3_NUM_DECODER_INSTANCES];
+
 MP3DecInfo *AllocateBuffers(void)
 {
 	MP3DecInfo *mp3DecInfo;
@@ -99,28 +130,28 @@ MP3DecInfo *AllocateBuffers(void)
 	DequantInfo *di;
 	IMDCTInfo *mi;
 	SubbandInfo *sbi;
+	DecoderBuffers *buffers = 0;
+	int i;
 
-	/*
-	 * Use static buffers to make the RAM usage
-	 * known at compile time.
-	 */
-	static MP3DecInfo s_mp3DecInfo;
-	static FrameHeader s_fh;
-	static SideInfo s_si;
-	static ScaleFactorInfo s_sfi;
-	static HuffmanInfo s_hi;
-	static DequantInfo s_di;
-	static IMDCTInfo s_mi;
-	static SubbandInfo s_sbi;
-	
-	mp3DecInfo = &s_mp3DecInfo;
-	fh = &s_fh;
-	si = &s_si;
-	sfi = &s_sfi;
-	hi = &s_hi;
-	di = &s_di;
-	mi = &s_mi;
-	sbi = &s_sbi;
+	for (i = 0; i < MP3_NUM_DECODER_INSTANCES; i++) {
+		if (!s_decoderBuffersInUse[i]) {
+			s_decoderBuffersInUse[i] = 1;
+			buffers = &s_decoderBuffers[i];
+			break;
+		}
+	}
+	if (!buffers)
+		return 0;
+
+	mp3DecInfo = &buffers->mp3DecInfo;
+	fh = &buffers->fh;
+	si = &buffers->si;
+	sfi = &buffers->sfi;
+	hi = &buffers->hi;
+	di = &buffers->di;
+	mi = &buffers->mi;
+	sbi = &buffers->sbi;
+	ClearBuffer(mp3DecInfo, sizeof(MP3DecInfo));
 
 //	mp3DecInfo = (MP3DecInfo *)malloc(sizeof(MP3DecInfo));
 //	if (!mp3DecInfo) {
@@ -178,9 +209,15 @@ MP3DecInfo *AllocateBuffers(void)
  **************************************************************************************/
 void FreeBuffers(MP3DecInfo *mp3DecInfo)
 {
+	int i;
+
 	if (!mp3DecInfo)
 		return;
-	// Malloc not used, nothing to do
+	// Malloc not used, just return the buffers to the pool
+	for (i = 0; i < MP3_NUM_DECODER_INSTANCES; i++) {
+		if (mp3DecInfo == &s_decoderBuffers[i].mp3DecInfo)
+			s_decoderBuffersInUse[i] = 0;
+	}
 //	SAFE_FREE(mp3DecInfo->FrameHeaderPS);
 //	SAFE_FREE(mp3DecInfo->SideInfoPS);
 //	SAFE_FREE(mp3DecInfo->ScaleFactorInfoPS);
@@ -58,6 +58,15 @@
 
 static __inline short ClipToShort(int x, int fracBits)
 {
+#if defined(HELIX_CORTEX_M4)
+	/* assumes you've already rounded (x += (1 << (fracBits-1))) */
+	x >>= fracBits;
+
+	/* saturating to 16 bits is a single instruction */
+	__asm__ ("ssat %0, #16, %1" : "=r" (x) : "r" (x));
+
+	return (short)x;
+#else
 	int sign;
 	
 	/* assumes you've already rounded (x += (1 << (fracBits-1))) */
@@ -69,6 +78,7 @@ static __inline short ClipToShort(int x, int fracBits)
 		x = sign ^ ((1 << 15) - 1);
 
 	return (short)x;
+#endif
 }
 
 #define MC0M(x)	{ \
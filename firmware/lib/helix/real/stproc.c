@@ -139,7 +139,7 @@ void IntensityProcMPEG1(int x[MAX_NCHAN][MAX_NSAMP], int nSamps, FrameHeader *fh
 	/* long blocks */
 	for (cb = cbStartL; cb < cbEndL && sampsLeft > 0; cb++) {
 		isf = sfis->l[cb];
-		if (isf == 7) {
+		if (isf >= 7) {	/* illegal intensity position, isf > 7 only occurs in corrupt streams */
 			fl = ISFIIP[midSideFlag][0];
 			fr = ISFIIP[midSideFlag][1];
 		} else {
@@ -159,7 +159,7 @@ void IntensityProcMPEG1(int x[MAX_NCHAN][MAX_NSAMP], int nSamps, FrameHeader *fh
 	for (cb = cbStartS; cb < cbEndS && sampsLeft >= 3; cb++) {
 		for (w = 0; w < 3; w++) {
 			isf = sfis->s[cb][w];
-			if (isf == 7) {
+			if (isf >= 7) {	/* illegal intensity position, isf > 7 only occurs in corrupt streams */
 				fls[w] = ISFIIP[midSideFlag][0];
 				frs[w] = ISFIIP[midSideFlag][1];
 			} else {
@@ -102,6 +102,36 @@ uint8_t TM_MFRC522_ReadRegister(uint8_t addr) {
 	return val;	
 }
 
+void TM_MFRC522_WriteFifo(const uint8_t* data, uint8_t len) {
+	uint8_t i;
+	//CS low
+	MFRC522_CS_LOW;
+	//Send address once, then all data bytes
+	TM_SPI_Send(MFRC522_SPI, (MFRC522_REG_FIFO_DATA << 1) & 0x7E);
+	for (i = 0; i < len; i++) {
+		TM_SPI_Send(MFRC522_SPI, data[i]);
+	}
+	//CS high
+	MFRC522_CS_HIGH;
+}
+
+void TM_MFRC522_ReadFifo(uint8_t* data, uint8_t len) {
+	uint8_t i;
+	if (len == 0) {
+		return;
+	}
+	//CS low
+	MFRC522_CS_LOW;
+	//Each byte received belongs to the address sent before it
+	TM_SPI_Send(MFRC522_SPI, ((MFRC522_REG_FIFO_DATA << 1) & 0x7E) | 0x80);
+	for (i = 0; i < len - 1; i++) {
+		data[i] = TM_SPI_Send(MFRC522_SPI, ((MFRC522_REG_FIFO_DATA << 1) & 0x7E) | 0x80);
+	}
+	data[len - 1] = TM_SPI_Send(MFRC522_SPI, MFRC522_DUMMY);
+	//CS high
+	MFRC522_CS_HIGH;
+}
+
 void TM_MFRC522_SetBitMask(uint8_t reg, uint8_t mask) {
 	TM_MFRC522_WriteRegister(reg, TM_MFRC522_ReadRegister(reg) | mask);
 }
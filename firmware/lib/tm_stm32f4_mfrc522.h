@@ -243,6 +243,8 @@ extern TM_MFRC522_Status_t TM_MFRC522_Compare(uint8_t* CardID, uint8_t* CompareI
 extern void TM_MFRC522_InitPins(void);
 extern void TM_MFRC522_WriteRegister(uint8_t addr, uint8_t val);
 extern uint8_t TM_MFRC522_ReadRegister(uint8_t addr);
+extern void TM_MFRC522_WriteFifo(const uint8_t* data, uint8_t len);
+extern void TM_MFRC522_ReadFifo(uint8_t* data, uint8_t len);
 extern void TM_MFRC522_SetBitMask(uint8_t reg, uint8_t mask);
 extern void TM_MFRC522_ClearBitMask(uint8_t reg, uint8_t mask);
 extern void TM_MFRC522_AntennaOn(void);
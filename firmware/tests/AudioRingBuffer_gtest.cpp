@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include "AudioRingBuffer.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+class AudioRingBuffer_Fixture : public ::testing::Test
+{
+protected:
+    static constexpr int bufferSize_ = 64;
+    static constexpr int blockSize_ = 16;
+    AudioRingBuffer<int, bufferSize_, blockSize_> buffer_;
+
+    /** Writes the values [firstValue, firstValue + num), returns the number written */
+    int write(int firstValue, int num)
+    {
+        int* block1 = nullptr;
+        int blockSize1 = 0;
+        int* block2 = nullptr;
+        int blockSize2 = 0;
+        buffer_.prepareWrite(num, block1, blockSize1, block2, blockSize2);
+        for (int i = 0; i < blockSize1; i++)
+            block1[i] = firstValue++;
+        for (int i = 0; i < blockSize2; i++)
+            block2[i] = firstValue++;
+        buffer_.finishWrite(blockSize1 + blockSize2);
+        return blockSize1 + blockSize2;
+    }
+};
+
+TEST_F(AudioRingBuffer_Fixture, a_emptyAfterInit)
+{
+    EXPECT_EQ(buffer_.getSize(), bufferSize_);
+    EXPECT_EQ(buffer_.getBlockSize(), blockSize_);
+    EXPECT_TRUE(buffer_.isEmpty());
+    EXPECT_FALSE(buffer_.isFull());
+    EXPECT_EQ(buffer_.getNumReady(), 0);
+    EXPECT_EQ(buffer_.getNumFree(), bufferSize_);
+    EXPECT_EQ(buffer_.claimBlock(), nullptr);
+}
+
+TEST_F(AudioRingBuffer_Fixture, b_claimOnlyCompleteBlocks)
+{
+    EXPECT_EQ(write(0, blockSize_ - 1), blockSize_ - 1);
+    EXPECT_EQ(buffer_.claimBlock(), nullptr);
+    EXPECT_EQ(write(blockSize_ - 1, 1), 1);
+
+    const int* block = buffer_.claimBlock();
+    ASSERT_NE(block, nullptr);
+    for (int i = 0; i < blockSize_; i++)
+        EXPECT_EQ(block[i], i);
+    EXPECT_TRUE(buffer_.isEmpty());
+    EXPECT_EQ(buffer_.claimBlock(), nullptr);
+}
+
+TEST_F(AudioRingBuffer_Fixture, c_claimedBlocksAreOccupiedUntilReleased)
+{
+    EXPECT_EQ(write(0, bufferSize_), bufferSize_);
+    EXPECT_TRUE(buffer_.isFull());
+
+    const int* block1 = buffer_.claimBlock();
+    const int* block2 = buffer_.claimBlock();
+    ASSERT_NE(block1, nullptr);
+    ASSERT_NE(block2, nullptr);
+    EXPECT_EQ(block2, block1 + blockSize_);
+    EXPECT_EQ(buffer_.getNumReady(), bufferSize_ - 2 * blockSize_);
+    EXPECT_TRUE(buffer_.isFull());
+    EXPECT_EQ(write(1000, 1), 0);
+
+    buffer_.releaseBlock();
+    EXPECT_EQ(buffer_.getNumFree(), blockSize_);
+    // the second block wasn't released and is still intact
+    EXPECT_EQ(write(1000, 2 * blockSize_), blockSize_);
+    for (int i = 0; i < blockSize_; i++)
+        EXPECT_EQ(block2[i], blockSize_ + i);
+
+    buffer_.releaseBlock();
+    EXPECT_EQ(buffer_.getNumFree(), blockSize_);
+}
+
+TEST_F(AudioRingBuffer_Fixture, d_wrapAround)
+{
+    // many times around the buffer, with writes that don't line up with the blocks
+    int numWritten = 0;
+    int numRead = 0;
+    int numClaimed = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        numWritten += write(numWritten, 7 + (i % 13));
+        while (const int* block = buffer_.claimBlock())
+        {
+            for (int j = 0; j < blockSize_; j++)
+                ASSERT_EQ(block[j], numRead + j);
+            numRead += blockSize_;
+            // the driver releases the block before last
+            if (++numClaimed > 1)
+                buffer_.releaseBlock();
+        }
+        EXPECT_EQ(buffer_.getNumReady(), numWritten - numRead);
+        EXPECT_EQ(buffer_.getNumFree(), bufferSize_ - (numWritten - numRead) - ((numClaimed > 0) ? blockSize_ : 0));
+    }
+    EXPECT_GT(numRead, 10 * bufferSize_);
+}
+
+TEST_F(AudioRingBuffer_Fixture, e_completeLastBlock)
+{
+    // does nothing for complete blocks
+    buffer_.completeLastBlock();
+    EXPECT_TRUE(buffer_.isEmpty());
+    write(1, blockSize_);
+    buffer_.completeLastBlock();
+    EXPECT_EQ(buffer_.getNumReady(), blockSize_);
+
+    // fills the rest of the last block with silence
+    write(1, 3);
+    buffer_.completeLastBlock();
+    EXPECT_EQ(buffer_.getNumReady(), 2 * blockSize_);
+    ASSERT_NE(buffer_.claimBlock(), nullptr);
+    const int* block = buffer_.claimBlock();
+    ASSERT_NE(block, nullptr);
+    const std::vector<int> expected = { 1, 2, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    EXPECT_EQ(std::vector<int>(block, block + blockSize_), expected);
+}
+
+TEST_F(AudioRingBuffer_Fixture, f_copyOut)
+{
+    // like an AtomicLockFreeFifo: reading releases the samples immediately
+    EXPECT_EQ(write(0, bufferSize_ - 5), bufferSize_ - 5);
+    int* block1 = nullptr;
+    int blockSize1 = 0;
+    int* block2 = nullptr;
+    int blockSize2 = 0;
+    buffer_.prepareRead(bufferSize_ - 10, block1, blockSize1, block2, blockSize2);
+    EXPECT_EQ(blockSize1, bufferSize_ - 10);
+    EXPECT_EQ(blockSize2, 0);
+    buffer_.finishRead(blockSize1);
+    EXPECT_EQ(buffer_.getNumFree(), bufferSize_ - 5);
+
+    EXPECT_EQ(write(1000, 20), 20);
+    buffer_.prepareRead(100, block1, blockSize1, block2, blockSize2);
+    ASSERT_EQ(blockSize1, 10);
+    ASSERT_EQ(blockSize2, 15);
+    EXPECT_EQ(block1[0], bufferSize_ - 10);
+    EXPECT_EQ(block1[5], 1000);
+    EXPECT_EQ(block2[0], 1005);
+    EXPECT_EQ(block2[14], 1019);
+}
+
+// A writer thread fills the buffer while the reader thread plays it like the DMA:
+// it claims blocks and releases each one two blocks later. Meant to be run under
+// ThreadSanitizer, too: `make tsan`
+TEST(AudioRingBuffer, g_twoThreadStressTest)
+{
+    static constexpr int bufferSize = 1024;
+    static constexpr int blockSize = 64;
+    static constexpr uint32_t numValues = 1 << 20;
+    auto buffer = std::make_unique<AudioRingBuffer<uint32_t, bufferSize, blockSize>>();
+
+    std::thread writer([&buffer]() {
+        uint32_t nextValue = 0;
+        int chunkSize = 1;
+        while (nextValue < numValues)
+        {
+            chunkSize = (chunkSize * 5 + 3) % bufferSize + 1;
+            uint32_t* block1 = nullptr;
+            int blockSize1 = 0;
+            uint32_t* block2 = nullptr;
+            int blockSize2 = 0;
+            buffer->prepareWrite(int(std::min(uint32_t(chunkSize), numValues - nextValue)),
+                                 block1, blockSize1, block2, blockSize2);
+            for (int i = 0; i < blockSize1; i++)
+                block1[i] = nextValue++;
+            for (int i = 0; i < blockSize2; i++)
+                block2[i] = nextValue++;
+            buffer->finishWrite(blockSize1 + blockSize2);
+            if (buffer->isFull())
+                std::this_thread::yield();
+        }
+    });
+
+    const uint32_t* blocksInUse[2] = { nullptr, nullptr };
+    uint32_t expectedValue = 0;
+    uint32_t numErrors = 0;
+    while (expectedValue < numValues)
+    {
+        const uint32_t* block = buffer->claimBlock();
+        if (!block)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        // the block played two blocks ago must still be intact when it's released
+        if (blocksInUse[1])
+        {
+            for (int i = 0; i < blockSize; i++)
+                numErrors += (blocksInUse[1][i] != expectedValue++) ? 1 : 0;
+            buffer->releaseBlock();
+        }
+        blocksInUse[1] = blocksInUse[0];
+        blocksInUse[0] = block;
+        // the last two blocks are never released by the loop
+        if (expectedValue + 2 * blockSize >= numValues)
+            break;
+    }
+    writer.join();
+
+    EXPECT_EQ(numErrors, 0u);
+    EXPECT_EQ(expectedValue, numValues - 2 * blockSize);
+    EXPECT_TRUE(buffer->isEmpty());
+}
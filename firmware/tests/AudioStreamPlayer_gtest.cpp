@@ -1,6 +1,9 @@
 #include "AudioStreamPlayer.h"
+#include "AudioUnderrunLog.h"
+#include "GaplessTrimmer.h"
 #include <gtest/gtest.h>
 #include <deque>
+#include <vector>
 
 // ==============================================================
 // A dummy audio driver
@@ -9,6 +12,9 @@
 class UnitTestAudioDriver
 {
 public:
+    // copies the samples in the callback
+    static constexpr int ringBufferBlockSize = 0;
+
     UnitTestAudioDriver()
     {
         const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
@@ -67,6 +73,82 @@ public:
 
 std::map<std::string, UnitTestAudioDriver*> UnitTestAudioDriver::instances_;
 
+// ==============================================================
+// A dummy audio driver that plays blocks straight from the
+// buffer of the player, like the circular DMA on the target
+// ==============================================================
+
+class UnitTestBlockAudioDriver
+{
+public:
+    static constexpr int ringBufferBlockSize = 64;
+
+    UnitTestBlockAudioDriver()
+    {
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        instances_[testName] = this;
+    }
+    ~UnitTestBlockAudioDriver()
+    {
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        instances_.erase(testName);
+    }
+    UnitTestBlockAudioDriver(const UnitTestBlockAudioDriver& other) = delete;
+
+    static void init() {}
+    static bool isRunning() { return getInstance()->isRunning_; }
+    static void start(AudioFormat audioFormat,
+                      AudioStreamPlayerBlockCallbackPtr callbackWhenNewBlockMustBeProvided,
+                      void* callbackContext)
+    {
+        auto* driver = getInstance();
+        driver->numStarts_++;
+        driver->audioFormat_ = audioFormat;
+        driver->callback_ = callbackWhenNewBlockMustBeProvided;
+        driver->callbackContext_ = callbackContext;
+        driver->isRunning_ = true;
+        // the block to play now and the one after it
+        driver->blockPlaying_ = driver->callback_(driver->callbackContext_);
+        driver->blockQueued_ = driver->callback_(driver->callbackContext_);
+    }
+    static void stop()
+    {
+        getInstance()->isRunning_ = false;
+        getInstance()->audioFormat_ = AudioFormat::invalid;
+    }
+    static AudioFormat getCurrentAudioFormat() { return getInstance()->audioFormat_; }
+
+    /** Finishes playing the current block and appends its samples to `output_`. Then
+     *  starts playing the queued block and requests the one after it. The samples are
+     *  only taken once the block was played, so they must not have been overwritten
+     *  in the meantime. */
+    void playBlock()
+    {
+        for (int i = 0; i < ringBufferBlockSize; i++)
+            output_.push_back(blockPlaying_ ? blockPlaying_[i] : 0);
+        blockPlaying_ = blockQueued_;
+        blockQueued_ = callback_(callbackContext_);
+    }
+
+    bool isRunning_ = false;
+    int numStarts_ = 0;
+    AudioFormat audioFormat_ = AudioFormat::invalid;
+    AudioStreamPlayerBlockCallbackPtr callback_ = nullptr;
+    void* callbackContext_ = nullptr;
+    const AudioSampleType* blockPlaying_ = nullptr;
+    const AudioSampleType* blockQueued_ = nullptr;
+    std::vector<AudioSampleType> output_;
+
+    static UnitTestBlockAudioDriver* getInstance()
+    {
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        return instances_[testName];
+    }
+    static std::map<std::string, UnitTestBlockAudioDriver*> instances_;
+};
+
+std::map<std::string, UnitTestBlockAudioDriver*> UnitTestBlockAudioDriver::instances_;
+
 // ==============================================================
 // A dummy StereoAudioSampleStream that plays N samples with values from 0..N-1
 // ==============================================================
@@ -109,6 +191,100 @@ public:
     bool completedCalled_;
 };
 
+// ==============================================================
+// A synthetic stream that behaves like a decoded mp3 file: The
+// decoder outputs whole frames, starting with the encoder delay
+// plus the decoder delay and ending with the encoder padding, all
+// of which is silence. The actual content is a ramp of values,
+// starting at firstValue (the same value on both channels).
+// The stream must be primed before it can be played.
+// ==============================================================
+
+class SyntheticDecodedStream : public StereoAudioSampleStream
+{
+public:
+    static constexpr int samplesPerFrame = 1152;
+    static constexpr int decoderDelay = 529;
+
+    SyntheticDecodedStream(int firstValue, int numSampleFrames, int encoderDelay, bool useTrimmer) :
+        wasPrimedBeforeFirstUse_(false),
+        firstValue_(firstValue),
+        numSampleFrames_(numSampleFrames),
+        numSilentSampleFramesAtStart_(encoderDelay + decoderDelay),
+        numFrames_((numSilentSampleFramesAtStart_ + numSampleFrames + samplesPerFrame - 1) / samplesPerFrame + 1),
+        numFramesDecoded_(0),
+        audioBufferTail_(0),
+        audioBufferEnd_(0),
+        isPrimed_(false),
+        isFirstUse_(true)
+    {
+        if (useTrimmer)
+        {
+            // The same calculation the Mp3FileStream does from the LAME tag
+            const int encoderPadding = numFrames_ * samplesPerFrame - encoderDelay - numSampleFrames;
+            trimmer_.reset(2 * uint32_t(encoderDelay + decoderDelay),
+                           2 * uint32_t(numFrames_ * samplesPerFrame - encoderDelay - encoderPadding));
+        }
+    }
+
+    void prime() { isPrimed_ = true; }
+
+    int getSampleRate() const override { return 44100; }
+
+    int fillBuffer(AudioSampleType* buffer, int bufferSize) override
+    {
+        if (isFirstUse_)
+        {
+            wasPrimedBeforeFirstUse_ = isPrimed_;
+            isFirstUse_ = false;
+        }
+
+        int numWritten = 0;
+        while (numWritten < bufferSize)
+        {
+            if (audioBufferTail_ < audioBufferEnd_)
+                buffer[numWritten++] = decodedFrame_[audioBufferTail_++];
+            else if (trimmer_.isEndReached() || (numFramesDecoded_ >= numFrames_))
+                break;
+            else
+                decodeNextFrame();
+        }
+        return numWritten;
+    }
+
+    bool wasPrimedBeforeFirstUse_;
+
+private:
+    void decodeNextFrame()
+    {
+        for (int i = 0; i < samplesPerFrame; i++)
+        {
+            const int sampleFrame = numFramesDecoded_ * samplesPerFrame + i - numSilentSampleFramesAtStart_;
+            const bool isContent = (sampleFrame >= 0) && (sampleFrame < numSampleFrames_);
+            const AudioSampleType value = isContent ? AudioSampleType(firstValue_ + sampleFrame) : 0;
+            decodedFrame_[2 * i] = value;
+            decodedFrame_[2 * i + 1] = value;
+        }
+        numFramesDecoded_++;
+
+        int numToPlay = 0;
+        trimmer_.trim(2 * samplesPerFrame, audioBufferTail_, numToPlay);
+        audioBufferEnd_ = audioBufferTail_ + numToPlay;
+    }
+
+    const int firstValue_;
+    const int numSampleFrames_;
+    const int numSilentSampleFramesAtStart_;
+    const int numFrames_;
+    int numFramesDecoded_;
+    AudioSampleType decodedFrame_[2 * samplesPerFrame];
+    int audioBufferTail_;
+    int audioBufferEnd_;
+    GaplessTrimmer trimmer_;
+    bool isPrimed_;
+    bool isFirstUse_;
+};
+
 // ==============================================================
 // A dummy StreamProvider that plays a queue of streams
 // ==============================================================
@@ -135,6 +311,53 @@ public:
     std::deque<StereoAudioSampleStream*> streamsCompleted_;
 };
 
+// ==============================================================
+// A StreamProvider that primes the next SyntheticDecodedStream
+// while the current one is playing
+// ==============================================================
+
+class PrimingStreamProvider : public StreamProvider
+{
+public:
+    StereoAudioSampleStream* getNextStream() override
+    {
+        if (streamsToPlay_.empty())
+            return nullptr;
+        auto* front = streamsToPlay_.front();
+        streamsToPlay_.pop_front();
+        return front;
+    }
+
+    void streamCompleted(StereoAudioSampleStream*) override {}
+
+    void prepareNextStream() override
+    {
+        numPrepareCalls_++;
+        if (!streamsToPlay_.empty())
+            streamsToPlay_.front()->prime();
+    }
+
+    std::deque<SyntheticDecodedStream*> streamsToPlay_;
+    int numPrepareCalls_ = 0;
+};
+
+// ==============================================================
+// Collects the AudioUnderrunStats of all streams
+// ==============================================================
+
+class UnderrunStatsCollector : public AudioUnderrunStatsListener
+{
+public:
+    void streamStatsCompleted(const AudioUnderrunStats& stats, int sampleRate) override
+    {
+        stats_.push_back(stats);
+        sampleRates_.push_back(sampleRate);
+    }
+
+    std::vector<AudioUnderrunStats> stats_;
+    std::vector<int> sampleRates_;
+};
+
 // ==============================================================
 // Tests
 // ==============================================================
@@ -525,4 +748,351 @@ TEST_F(AudioStreamPlayer_Fixture, f_provideAudioSamplesAndAutoSwitchSampleRate)
     EXPECT_TRUE(stream2.completedCalled_);
     EXPECT_EQ(streamProvider_.streamsCompleted_.size(), size_t(2));
     EXPECT_EQ(streamProvider_.streamsCompleted_[1], &stream2);
-}
\ No newline at end of file
+}
+
+namespace
+{
+    /** Plays all streams from the provider and returns the samples passed to the audio
+     *  driver up to (but not including) the silence after the last stream. */
+    std::vector<AudioSampleType> playAndRecord(AudioStreamPlayer<UnitTestAudioDriver>& player,
+                                               StreamProvider& streamProvider,
+                                               UnitTestAudioDriver& driver)
+    {
+        static constexpr int dacBufferSize = 256;
+        AudioSampleType dacBuffer[dacBufferSize];
+        std::vector<AudioSampleType> output;
+
+        player.startPlayingNextStreamFrom(streamProvider);
+        while (driver.stopCalled_ < 0)
+        {
+            player.refillBuffers();
+            driver.callback_(driver.callbackContext_, dacBuffer, dacBufferSize);
+            output.insert(output.end(), dacBuffer, dacBuffer + dacBufferSize);
+        }
+
+        while (!output.empty() && (output.back() == 0))
+            output.pop_back();
+        return output;
+    }
+} // namespace
+
+TEST_F(AudioStreamPlayer_Fixture, g_gaplessPlaybackOfPrimedStreams)
+{
+    // Plays two streams with encoder delay and padding back to back.
+    // The second stream must be primed through prepareNextStream() while
+    // the first one is still playing and there must be no silence between
+    // the two streams: the audio output receives the ramp 1..N from
+    // the first stream directly followed by N+1..N+M from the second one.
+
+    static constexpr int numSampleFrames1 = 10000;
+    static constexpr int numSampleFrames2 = 12345;
+    SyntheticDecodedStream stream1(1, numSampleFrames1, 576, true);
+    SyntheticDecodedStream stream2(1 + numSampleFrames1, numSampleFrames2, 1105, true);
+    PrimingStreamProvider streamProvider;
+    streamProvider.streamsToPlay_.push_back(&stream1);
+    streamProvider.streamsToPlay_.push_back(&stream2);
+
+    const auto output = playAndRecord(player_, streamProvider, dummyDriver_);
+
+    EXPECT_GT(streamProvider.numPrepareCalls_, 0);
+    EXPECT_TRUE(stream2.wasPrimedBeforeFirstUse_);
+
+    ASSERT_EQ(output.size(), size_t(2 * (numSampleFrames1 + numSampleFrames2)));
+    int numSilentSamples = 0;
+    for (size_t i = 0; i < output.size(); i++)
+    {
+        if (output[i] == 0)
+            numSilentSamples++;
+        ASSERT_EQ(output[i], AudioSampleType(1 + i / 2)) << "at sample " << i;
+    }
+    EXPECT_EQ(numSilentSamples, 0);
+}
+
+TEST_F(AudioStreamPlayer_Fixture, h_untrimmedStreamsHaveGap)
+{
+    // Counter check for the test above: without trimming the encoder
+    // delay and padding, there's silence between the two streams.
+
+    SyntheticDecodedStream stream1(1, 10000, 576, false);
+    SyntheticDecodedStream stream2(10001, 10000, 576, false);
+    PrimingStreamProvider streamProvider;
+    streamProvider.streamsToPlay_.push_back(&stream1);
+    streamProvider.streamsToPlay_.push_back(&stream2);
+
+    const auto output = playAndRecord(player_, streamProvider, dummyDriver_);
+
+    // skip the leading silence of the first stream
+    size_t i = 0;
+    while ((i < output.size()) && (output[i] == 0))
+        i++;
+    int numSilentSamples = 0;
+    for (; i < output.size(); i++)
+    {
+        if (output[i] == 0)
+            numSilentSamples++;
+    }
+    EXPECT_GT(numSilentSamples, 2 * (576 + 529));
+}
+
+TEST_F(AudioStreamPlayer_Fixture, i_fixedOutputSampleRate)
+{
+    // With a resampler, streams of different samplerates are converted
+    // to the fixed output samplerate. The audio driver is started once
+    // and never reconfigured between the streams.
+
+    PolyphaseResampler resampler;
+    player_.setFixedOutputSampleRate(&resampler, 44100);
+
+    DummyStream stream1(1000, 44100);
+    DummyStream stream2(2000, 48000);
+    DummyStream stream3(1000, 44100);
+    streamProvider_.streamsToPlay_.push_back(&stream1);
+    streamProvider_.streamsToPlay_.push_back(&stream2);
+    streamProvider_.streamsToPlay_.push_back(&stream3);
+
+    dummyDriver_.callCounter_ = 0;
+    player_.startPlayingNextStreamFrom(streamProvider_);
+    EXPECT_EQ(dummyDriver_.startCalled_, 0);
+    EXPECT_EQ(dummyDriver_.audioFormatProvided_, AudioFormat::sr44100b16);
+
+    // all three streams fit into the fifo and are consumed in one go
+    player_.refillBuffers();
+    EXPECT_FALSE(player_.isAboutToChangeAudioFormat());
+    EXPECT_EQ(stream1.numSamplesLeft_, 0);
+    EXPECT_EQ(stream2.numSamplesLeft_, 0);
+    EXPECT_EQ(stream3.numSamplesLeft_, 0);
+    EXPECT_EQ(streamProvider_.streamsCompleted_.size(), size_t(3));
+
+    // the first stream is played unchanged
+    dummyDriver_.callback_(dummyDriver_.callbackContext_, dummyDacBuffer_, dacBufferSize_);
+    for (int i = 0; i < dacBufferSize_; i++)
+        EXPECT_EQ(dummyDacBuffer_[i], i);
+
+    // no more calls to the driver, except for the start
+    EXPECT_EQ(dummyDriver_.callCounter_, 1);
+    EXPECT_EQ(resampler.getInputSampleRate(), 48000);
+    EXPECT_EQ(resampler.getOutputSampleRate(), 44100);
+}
+
+TEST_F(AudioStreamPlayer_Fixture, j_underrunStats)
+{
+    // Counts the requests from the audio output that couldn't be served
+    // from the fifo while a stream was playing.
+
+    UnderrunStatsCollector collector;
+    player_.setUnderrunStatsListener(&collector);
+    constexpr int fifoCapacity = 0x4000;
+
+    DummyStream stream1(100000, 44100);
+    DummyStream stream2(1000, 44100);
+    streamProvider_.streamsToPlay_.push_back(&stream1);
+    streamProvider_.streamsToPlay_.push_back(&stream2);
+    player_.startPlayingNextStreamFrom(streamProvider_);
+
+    // the fifo wasn't filled yet: not an underrun
+    dummyDriver_.callback_(dummyDriver_.callbackContext_, dummyDacBuffer_, dacBufferSize_);
+    EXPECT_EQ(player_.getUnderrunStats().numUnderruns, 0u);
+
+    // refilled in time
+    player_.refillBuffers();
+    for (int i = 0; i < 10; i++)
+    {
+        dummyDriver_.callback_(dummyDriver_.callbackContext_, dummyDacBuffer_, dacBufferSize_);
+        player_.refillBuffers();
+    }
+    auto stats = player_.getUnderrunStats();
+    EXPECT_EQ(stats.numUnderruns, 0u);
+    EXPECT_EQ(stats.numSamplesZeroFilled, 0u);
+    EXPECT_EQ(stats.minNumSamplesBuffered, uint32_t(fifoCapacity));
+    EXPECT_EQ(stats.maxNumSamplesBetweenRefills, uint32_t(dacBufferSize_));
+
+    // refilled too late: the last three requests can't be served completely
+    const int numRequests = fifoCapacity / dacBufferSize_ + 3;
+    for (int i = 0; i < numRequests; i++)
+        dummyDriver_.callback_(dummyDriver_.callbackContext_, dummyDacBuffer_, dacBufferSize_);
+    player_.refillBuffers();
+    stats = player_.getUnderrunStats();
+    EXPECT_EQ(stats.numUnderruns, 3u);
+    EXPECT_EQ(stats.numSamplesZeroFilled, uint32_t(numRequests * dacBufferSize_ - fifoCapacity));
+    EXPECT_EQ(stats.minNumSamplesBuffered, 0u);
+    EXPECT_EQ(stats.maxNumSamplesBetweenRefills, uint32_t(numRequests * dacBufferSize_));
+
+    // play until the end
+    while (player_.isPlayingStream())
+    {
+        dummyDriver_.callback_(dummyDriver_.callbackContext_, dummyDacBuffer_, dacBufferSize_);
+        player_.refillBuffers();
+    }
+    for (int i = 0; i < 2 * fifoCapacity / dacBufferSize_; i++)
+        dummyDriver_.callback_(dummyDriver_.callbackContext_, dummyDacBuffer_, dacBufferSize_);
+
+    // the stats of each stream were reported when it was completed
+    ASSERT_EQ(collector.stats_.size(), size_t(2));
+    EXPECT_EQ(collector.stats_[0].numUnderruns, 3u);
+    EXPECT_EQ(collector.stats_[0].maxNumSamplesBetweenRefills, uint32_t(numRequests * dacBufferSize_));
+    EXPECT_EQ(collector.sampleRates_[0], 44100);
+    EXPECT_EQ(collector.stats_[1].numUnderruns, 0u);
+    // the silence after the last stream is not an underrun
+    EXPECT_EQ(player_.getUnderrunStats().numUnderruns, 0u);
+
+    EXPECT_EQ(AudioUnderrunStats::toMs(2 * 44100, 44100), 1000u);
+    EXPECT_EQ(AudioUnderrunStats::toMs(fifoCapacity, 44100), 185u);
+}
+
+TEST_F(AudioStreamPlayer_Fixture, k_underrunLog)
+{
+    // Keeps the stats of the most recent streams and writes them as text
+
+    struct StringFile
+    {
+        bool write(const char* string)
+        {
+            contents += string;
+            return true;
+        }
+        std::string contents;
+    };
+
+    AudioUnderrunLog log;
+    AudioUnderrunStats stats;
+    for (uint32_t i = 0; i < AudioUnderrunLog::maxNumEntries + 4; i++)
+    {
+        stats.numUnderruns = i;
+        stats.numSamplesZeroFilled = 10 * i;
+        stats.minNumSamplesBuffered = 4410;
+        stats.maxNumSamplesBetweenRefills = 882;
+        log.streamStatsCompleted(stats, 44100);
+    }
+
+    ASSERT_EQ(log.getNumEntries(), AudioUnderrunLog::maxNumEntries);
+    EXPECT_EQ(log.getEntry(0).streamNumber, 4u);
+    EXPECT_EQ(log.getEntry(0).stats.numUnderruns, 4u);
+    EXPECT_EQ(log.getEntry(AudioUnderrunLog::maxNumEntries - 1).streamNumber, AudioUnderrunLog::maxNumEntries + 3);
+
+    StringFile file;
+    EXPECT_TRUE(log.dumpTo(file));
+    EXPECT_EQ(file.contents.find("stream; underruns; samples zero-filled; min. buffered [ms]; max. between refills [ms]\n4; 4; 40; 50; 10\n5; 5; 50; 50; 10\n"),
+              0u)
+        << file.contents;
+
+    log.clear();
+    EXPECT_EQ(log.getNumEntries(), 0u);
+}
+
+TEST_F(AudioStreamPlayer_Fixture, l_refillRequestCallback)
+{
+    // The audio interrupt requests a refill each time it took samples
+
+    int numRequests = 0;
+    player_.setRefillRequestCallback([](void* context) { (*(int*) context)++; }, &numRequests);
+
+    DummyStream stream(1000, 44100);
+    streamProvider_.streamsToPlay_.push_back(&stream);
+    player_.startPlayingNextStreamFrom(streamProvider_);
+    player_.refillBuffers();
+    EXPECT_EQ(numRequests, 0);
+
+    dummyDriver_.callback_(dummyDriver_.callbackContext_, dummyDacBuffer_, dacBufferSize_);
+    dummyDriver_.callback_(dummyDriver_.callbackContext_, dummyDacBuffer_, dacBufferSize_);
+    EXPECT_EQ(numRequests, 2);
+
+    player_.setRefillRequestCallback(nullptr, nullptr);
+    dummyDriver_.callback_(dummyDriver_.callbackContext_, dummyDacBuffer_, dacBufferSize_);
+    EXPECT_EQ(numRequests, 2);
+}
+
+TEST_F(AudioStreamPlayer_Fixture, m_playBlocksFromRingBuffer)
+{
+    // A driver that plays straight from the ring buffer receives the same
+    // samples as one that copies them: two streams without a gap. The
+    // last block is completed with silence, so that the driver can play
+    // it and is stopped afterwards.
+
+    UnitTestBlockAudioDriver driver;
+    AudioStreamPlayer<UnitTestBlockAudioDriver> player;
+
+    static constexpr int numSampleFrames1 = 10000;
+    static constexpr int numSampleFrames2 = 12345;
+    SyntheticDecodedStream stream1(1, numSampleFrames1, 576, true);
+    SyntheticDecodedStream stream2(1 + numSampleFrames1, numSampleFrames2, 1105, true);
+    PrimingStreamProvider streamProvider;
+    streamProvider.streamsToPlay_.push_back(&stream1);
+    streamProvider.streamsToPlay_.push_back(&stream2);
+
+    Profiler::reset();
+    player.startPlayingNextStreamFrom(streamProvider);
+    // the first two blocks are silence
+    EXPECT_EQ(driver.blockPlaying_, nullptr);
+    EXPECT_EQ(driver.blockQueued_, nullptr);
+    // they were requested from the main loop, not from the audio interrupt
+    EXPECT_EQ(Profiler::getStats(ProfilingZone::audioIsr).count, 0u);
+    int numBlocks = 0;
+    while (driver.isRunning_)
+    {
+        // refill more rarely than blocks are played, so that the buffer wraps around
+        if (numBlocks++ % 3 == 0)
+            player.refillBuffers();
+        driver.playBlock();
+        ASSERT_LT(numBlocks, 10000);
+    }
+    EXPECT_EQ(driver.numStarts_, 1);
+    EXPECT_EQ(Profiler::getStats(ProfilingZone::audioIsr).count, uint32_t(numBlocks));
+
+    auto& output = driver.output_;
+    output.erase(output.begin(), std::find_if(output.begin(), output.end(), [](AudioSampleType s) { return s != 0; }));
+    while (!output.empty() && (output.back() == 0))
+        output.pop_back();
+    ASSERT_EQ(output.size(), size_t(2 * (numSampleFrames1 + numSampleFrames2)));
+    for (size_t i = 0; i < output.size(); i++)
+        ASSERT_EQ(output[i], AudioSampleType(1 + i / 2)) << "at sample " << i;
+}
+
+TEST_F(AudioStreamPlayer_Fixture, n_ringBufferUnderruns)
+{
+    // When the next block isn't completely in the ring buffer, the driver
+    // plays a block of silence. The samples that were already written are
+    // played after it, so nothing is lost.
+
+    UnitTestBlockAudioDriver driver;
+    AudioStreamPlayer<UnitTestBlockAudioDriver> player;
+    constexpr int blockSize = UnitTestBlockAudioDriver::ringBufferBlockSize;
+    constexpr int ringBufferSize = 0x4000;
+
+    DummyStream stream(100000, 44100);
+    streamProvider_.streamsToPlay_.push_back(&stream);
+    player.startPlayingNextStreamFrom(streamProvider_);
+    player.refillBuffers();
+    EXPECT_EQ(stream.totalNumSamplesWritten_, ringBufferSize);
+
+    // the blocks in use by the driver can't be written before they were played
+    driver.playBlock();
+    driver.playBlock();
+    driver.playBlock();
+    player.refillBuffers();
+    EXPECT_EQ(stream.totalNumSamplesWritten_, ringBufferSize + blockSize);
+
+    // refilled too late: the driver plays the remaining blocks, then three blocks of silence
+    constexpr int numBlocksLeft = ringBufferSize / blockSize + 1 - 3;
+    for (int i = 0; i < numBlocksLeft + 3; i++)
+        driver.playBlock();
+    auto stats = player.getUnderrunStats();
+    EXPECT_EQ(stats.numUnderruns, 3u);
+    EXPECT_EQ(stats.numSamplesZeroFilled, uint32_t(3 * blockSize));
+    EXPECT_EQ(stats.minNumSamplesBuffered, 0u);
+
+    player.refillBuffers();
+    for (int i = 0; i < 3; i++)
+        driver.playBlock();
+    player.stopCurrentStreamAndTurnOffImmediately();
+
+    // the ramp after the two silent blocks from the start, interrupted by the underrun
+    const auto& output = driver.output_;
+    std::vector<AudioSampleType> expected(2 * blockSize, 0);
+    for (int i = 0; i < ringBufferSize + blockSize; i++)
+        expected.push_back(AudioSampleType(i));
+    expected.insert(expected.end(), 3 * blockSize, 0);
+    for (int i = ringBufferSize + blockSize; i < ringBufferSize + 2 * blockSize; i++)
+        expected.push_back(AudioSampleType(i));
+    ASSERT_EQ(output.size(), expected.size());
+    EXPECT_EQ(output, expected);
+}
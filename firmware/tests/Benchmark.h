@@ -0,0 +1,23 @@
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+
+/** Wall-clock times depend on the machine and on its load, so the tests never
+ *  assert them - they check deterministic counters instead, e.g. the number of
+ *  file accesses or comparisons. The timings are only measured and printed
+ *  when the tests run via `make bench`, which sets WUNDERKISTE_BENCH.
+ */
+namespace Benchmark
+{
+    inline bool isEnabled()
+    {
+        return std::getenv("WUNDERKISTE_BENCH") != nullptr;
+    }
+
+    inline double getMicrosecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        const auto duration = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+} // namespace Benchmark
@@ -0,0 +1,212 @@
+#include "DummyLibraryFile.h"
+#include "BookmarkStore.h"
+#include <string>
+#include <gtest/gtest.h>
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+class BookmarkStore_Fixture : public ::testing::Test
+{
+protected:
+    BookmarkStore_Fixture()
+    {
+        DummyLibraryFile::initTestEnv();
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        File::implFactories_[testName] = [](const char* filePath) {
+            return std::make_unique<DummyLibraryFile>(filePath);
+        };
+    }
+
+    ~BookmarkStore_Fixture()
+    {
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        File::implFactories_.erase(testName);
+        DummyLibraryFile::deleteTestEnv();
+    }
+
+    static PlaybackPosition makePosition(uint16_t trackIndex, uint32_t positionMs)
+    {
+        PlaybackPosition position;
+        position.trackIndex = trackIndex;
+        position.filePathHash = PlaybackPosition::hashOf("My Folder/Track.mp3");
+        position.positionMs = positionMs;
+        return position;
+    }
+
+    std::string& getFile() { return DummyLibraryFile::getTestEnv().otherFiles_[filePath_]; }
+
+    static constexpr const char* filePath_ = "bookmarks.bin";
+};
+
+TEST_F(BookmarkStore_Fixture, a_updateFindAndRemove)
+{
+    BookmarkStore store(filePath_);
+    PlaybackPosition position;
+    EXPECT_FALSE(store.find(0x11223344, position));
+    EXPECT_FALSE(store.isDirty());
+
+    store.update(0x11223344, makePosition(3, 1000));
+    store.update(0x22334455, makePosition(4, 2000));
+    EXPECT_TRUE(store.isDirty());
+    EXPECT_EQ(store.getNumBookmarks(), 2u);
+    EXPECT_TRUE(store.find(0x11223344, position));
+    EXPECT_EQ(position, makePosition(3, 1000));
+    EXPECT_TRUE(store.find(0x22334455, position));
+    EXPECT_EQ(position, makePosition(4, 2000));
+
+    // updating replaces the bookmark
+    store.update(0x11223344, makePosition(5, 3000));
+    EXPECT_EQ(store.getNumBookmarks(), 2u);
+    EXPECT_TRUE(store.find(0x11223344, position));
+    EXPECT_EQ(position, makePosition(5, 3000));
+
+    // invalid tags are ignored
+    store.update(RfidTagId::invalid(), makePosition(1, 1));
+    EXPECT_EQ(store.getNumBookmarks(), 2u);
+    EXPECT_FALSE(store.find(RfidTagId::invalid(), position));
+
+    store.remove(0x11223344);
+    EXPECT_FALSE(store.find(0x11223344, position));
+    EXPECT_TRUE(store.find(0x22334455, position));
+    EXPECT_EQ(store.getNumBookmarks(), 1u);
+
+    // nothing was written so far
+    EXPECT_EQ(getFile().size(), 0u);
+}
+
+TEST_F(BookmarkStore_Fixture, b_dropsLeastRecentlyUsedWhenFull)
+{
+    BookmarkStore store(filePath_);
+    for (uint32_t tag = 1; tag <= BookmarkStore::maxNumBookmarks; tag++)
+        store.update(tag, makePosition(uint16_t(tag), tag * 1000));
+    EXPECT_EQ(store.getNumBookmarks(), BookmarkStore::maxNumBookmarks);
+
+    // tag 1 is used again, tag 2 is now the least recently used one
+    store.update(1, makePosition(1, 1500));
+    store.update(1000, makePosition(1, 1000));
+    EXPECT_EQ(store.getNumBookmarks(), BookmarkStore::maxNumBookmarks);
+
+    PlaybackPosition position;
+    EXPECT_TRUE(store.find(1, position));
+    EXPECT_EQ(position.positionMs, 1500u);
+    EXPECT_FALSE(store.find(2, position));
+    for (uint32_t tag = 3; tag <= BookmarkStore::maxNumBookmarks; tag++)
+    {
+        EXPECT_TRUE(store.find(tag, position)) << "tag " << tag;
+        EXPECT_EQ(position.positionMs, tag * 1000);
+    }
+    EXPECT_TRUE(store.find(1000, position));
+}
+
+TEST_F(BookmarkStore_Fixture, c_flushAndLoad)
+{
+    {
+        BookmarkStore store(filePath_);
+        EXPECT_FALSE(store.load()); // no file yet
+        store.update(0x11223344, makePosition(3, 1000));
+        store.update(0x22334455, makePosition(4, 2000));
+        EXPECT_TRUE(store.flush());
+        EXPECT_FALSE(store.isDirty());
+        // all slots are created at once
+        EXPECT_EQ(getFile().size(), BookmarkStore::numSlots * BookmarkStore::recordSize);
+
+        // nothing changed: nothing is written
+        const std::string contentsBefore = getFile();
+        const int numOpenCallsBefore = DummyLibraryFile::getTestEnv().numOpenCalls_;
+        store.update(0x22334455, makePosition(4, 2000));
+        EXPECT_TRUE(store.flush());
+        EXPECT_EQ(DummyLibraryFile::getTestEnv().numOpenCalls_, numOpenCallsBefore);
+        EXPECT_EQ(getFile(), contentsBefore);
+    }
+
+    BookmarkStore store(filePath_);
+    EXPECT_TRUE(store.load());
+    EXPECT_EQ(store.getNumBookmarks(), 2u);
+    PlaybackPosition position;
+    EXPECT_TRUE(store.find(0x11223344, position));
+    EXPECT_EQ(position, makePosition(3, 1000));
+    EXPECT_TRUE(store.find(0x22334455, position));
+    EXPECT_EQ(position, makePosition(4, 2000));
+    EXPECT_FALSE(store.isDirty());
+}
+
+TEST_F(BookmarkStore_Fixture, d_eachFlushWritesTheNextSector)
+{
+    BookmarkStore store(filePath_);
+    const size_t fileSize = BookmarkStore::numSlots * BookmarkStore::recordSize;
+    std::string contentsBefore(fileSize, '\0');
+    size_t expectedSlot = 0;
+    for (uint32_t i = 0; i < 3 * BookmarkStore::numSlots + 5; i++)
+    {
+        store.update(0x11223344 + i % 7, makePosition(uint16_t(i), i));
+        EXPECT_TRUE(store.flush());
+
+        // the file never grows and only the slot after the previous one changed
+        const std::string& contents = getFile();
+        ASSERT_EQ(contents.size(), fileSize);
+        for (size_t slot = 0; slot < BookmarkStore::numSlots; slot++)
+        {
+            const size_t position = slot * BookmarkStore::recordSize;
+            const bool isChanged = contents.compare(position, BookmarkStore::recordSize,
+                                                    contentsBefore, position, BookmarkStore::recordSize)
+                                   != 0;
+            EXPECT_EQ(isChanged, slot == expectedSlot) << "flush " << i << ", slot " << slot;
+        }
+        contentsBefore = contents;
+        expectedSlot = (expectedSlot + 1) % BookmarkStore::numSlots;
+
+        // a new store finds the newest record
+        BookmarkStore loadedStore(filePath_);
+        EXPECT_TRUE(loadedStore.load());
+        PlaybackPosition position;
+        EXPECT_TRUE(loadedStore.find(0x11223344 + i % 7, position));
+        EXPECT_EQ(position, makePosition(uint16_t(i), i));
+    }
+
+    // a loaded store continues with the next slot
+    BookmarkStore loadedStore(filePath_);
+    EXPECT_TRUE(loadedStore.load());
+    loadedStore.update(0x55667788, makePosition(1, 1));
+    EXPECT_TRUE(loadedStore.flush());
+    EXPECT_EQ(getFile().compare(expectedSlot * BookmarkStore::recordSize, BookmarkStore::recordSize,
+                                contentsBefore, expectedSlot * BookmarkStore::recordSize, BookmarkStore::recordSize)
+                  != 0,
+              true);
+}
+
+TEST_F(BookmarkStore_Fixture, e_interruptedWriteLosesOnlyTheNewestRecord)
+{
+    BookmarkStore store(filePath_);
+    store.update(0x11223344, makePosition(1, 1000));
+    EXPECT_TRUE(store.flush());
+    store.update(0x11223344, makePosition(2, 2000));
+    EXPECT_TRUE(store.flush());
+
+    // the power was cut while the second record was written
+    getFile()[BookmarkStore::recordSize + 100] ^= 0x55;
+
+    BookmarkStore loadedStore(filePath_);
+    EXPECT_TRUE(loadedStore.load());
+    PlaybackPosition position;
+    EXPECT_TRUE(loadedStore.find(0x11223344, position));
+    EXPECT_EQ(position, makePosition(1, 1000));
+}
+
+TEST_F(BookmarkStore_Fixture, f_flushIfDue)
+{
+    BookmarkStore store(filePath_);
+    store.update(0x11223344, makePosition(1, 1000));
+    EXPECT_TRUE(store.flushIfDue(1000));
+    EXPECT_TRUE(store.isDirty()); // not yet
+
+    EXPECT_TRUE(store.flushIfDue(BookmarkStore::flushIntervalMs));
+    EXPECT_FALSE(store.isDirty());
+
+    store.update(0x11223344, makePosition(1, 2000));
+    EXPECT_TRUE(store.flushIfDue(2 * BookmarkStore::flushIntervalMs - 1));
+    EXPECT_TRUE(store.isDirty());
+    EXPECT_TRUE(store.flushIfDue(2 * BookmarkStore::flushIntervalMs));
+    EXPECT_FALSE(store.isDirty());
+}
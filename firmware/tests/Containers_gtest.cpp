@@ -0,0 +1,222 @@
+#include <gtest/gtest.h>
+#include "Containers.h"
+#include "FixedSizeString.h"
+#include "Benchmark.h"
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+
+TEST(StaticVector, a_sortAscending)
+{
+    StaticVector<int, 16> vec;
+    for (int value : { 5, 3, 9, 1, 5, 7, 0, 8, 2 })
+        vec.add(value);
+    vec.sortAscending();
+    ASSERT_EQ(vec.size(), 9u);
+    const int expected[] = { 0, 1, 2, 3, 5, 5, 7, 8, 9 };
+    for (size_t i = 0; i < vec.size(); i++)
+        EXPECT_EQ(vec[i], expected[i]);
+
+    // empty vector and single element
+    StaticVector<int, 4> empty;
+    empty.sortAscending();
+    EXPECT_EQ(empty.size(), 0u);
+    empty.add(42);
+    empty.sortAscending();
+    EXPECT_EQ(empty[0], 42);
+}
+
+TEST(StaticVector, b_sortWithComparator)
+{
+    StaticVector<int, 16> vec;
+    for (int value : { 5, 3, 9, 1, 7 })
+        vec.add(value);
+    vec.sort([](int a, int b) { return a > b; });
+    const int expected[] = { 9, 7, 5, 3, 1 };
+    for (size_t i = 0; i < vec.size(); i++)
+        EXPECT_EQ(vec[i], expected[i]);
+}
+
+TEST(StaticVector, c_sortStrings)
+{
+    StaticVector<FixedSizeStr<16>, 8> vec;
+    vec.add("track 10.mp3");
+    vec.add("b");
+    vec.add("track 02.mp3");
+    vec.add("a very long n");
+    vec.add("track 1.mp3");
+    vec.sortAscending();
+    EXPECT_STREQ(vec[0], "a very long n");
+    EXPECT_STREQ(vec[1], "b");
+    EXPECT_STREQ(vec[2], "track 02.mp3");
+    EXPECT_STREQ(vec[3], "track 1.mp3");
+    EXPECT_STREQ(vec[4], "track 10.mp3");
+}
+
+TEST(PackedStringList, a_addAndAccess)
+{
+    PackedStringList<64, 4> list;
+    EXPECT_EQ(list.size(), 0u);
+    EXPECT_STREQ(list.getCommonPrefix(), "");
+
+    EXPECT_TRUE(list.clear("My Folder"));
+    EXPECT_STREQ(list.getCommonPrefix(), "My Folder");
+    EXPECT_TRUE(list.add("b.mp3"));
+    EXPECT_TRUE(list.add("a.mp3"));
+    EXPECT_TRUE(list.add(""));
+    EXPECT_EQ(list.size(), 3u);
+    EXPECT_STREQ(list[0], "b.mp3");
+    EXPECT_STREQ(list[1], "a.mp3");
+    EXPECT_STREQ(list[2], "");
+    EXPECT_STREQ(list[3], ""); // out of range
+    // the prefix and each string are stored once, with a terminating zero
+    EXPECT_EQ(list.getNumBytesUsed(), 10u + 6u + 6u + 1u);
+
+    // clear() removes all strings
+    EXPECT_TRUE(list.clear("Other"));
+    EXPECT_EQ(list.size(), 0u);
+    EXPECT_STREQ(list.getCommonPrefix(), "Other");
+    EXPECT_EQ(list.getNumBytesUsed(), 6u);
+}
+
+TEST(PackedStringList, b_capacity)
+{
+    PackedStringList<16, 3> list;
+    EXPECT_TRUE(list.clear("abc"));
+    EXPECT_TRUE(list.add("0123456"));
+    // arena is full
+    EXPECT_FALSE(list.add("0123"));
+    EXPECT_TRUE(list.add("012"));
+    EXPECT_EQ(list.getNumBytesUsed(), 16u);
+    EXPECT_FALSE(list.add(""));
+    EXPECT_EQ(list.size(), 2u);
+    EXPECT_STREQ(list[0], "0123456");
+    EXPECT_STREQ(list[1], "012");
+
+    // number of strings is limited
+    EXPECT_TRUE(list.clear());
+    EXPECT_TRUE(list.add("a"));
+    EXPECT_TRUE(list.add("b"));
+    EXPECT_TRUE(list.add("c"));
+    EXPECT_FALSE(list.add("d"));
+    EXPECT_EQ(list.size(), 3u);
+
+    // a prefix that doesn't fit is not stored
+    EXPECT_FALSE(list.clear("This is way too long for the list"));
+    EXPECT_STREQ(list.getCommonPrefix(), "");
+    EXPECT_EQ(list.size(), 0u);
+}
+
+TEST(PackedStringList, c_sortAscending)
+{
+    PackedStringList<128, 8> list;
+    list.clear("Folder");
+    list.add("track 10.mp3");
+    list.add("b");
+    list.add("track 02.mp3");
+    list.add("a very long name.mp3");
+    list.add("track 1.mp3");
+    const auto numBytesUsed = list.getNumBytesUsed();
+    list.sortAscending();
+    EXPECT_STREQ(list[0], "a very long name.mp3");
+    EXPECT_STREQ(list[1], "b");
+    EXPECT_STREQ(list[2], "track 02.mp3");
+    EXPECT_STREQ(list[3], "track 1.mp3");
+    EXPECT_STREQ(list[4], "track 10.mp3");
+    EXPECT_STREQ(list.getCommonPrefix(), "Folder");
+    EXPECT_EQ(list.getNumBytesUsed(), numBytesUsed);
+}
+
+// ==============================================================
+// Benchmarks
+// ==============================================================
+
+namespace
+{
+    using FileNameType = FixedSizeStr<256>;
+
+    /** The sort that was used before StaticVector::sort().
+     *  Returns the number of comparisons.
+     */
+    template <size_t capacity>
+    size_t simpleSort(StaticVector<FileNameType, capacity>& vec)
+    {
+        size_t numComparisons = 0;
+        for (int targetIdx = int(vec.size()) - 1; targetIdx >= 0; targetIdx--)
+        {
+            for (int probeIdx = 0; probeIdx < targetIdx; probeIdx++)
+            {
+                numComparisons++;
+                if (vec[probeIdx] > vec[targetIdx])
+                {
+                    auto tmp = vec[probeIdx];
+                    vec[probeIdx] = vec[targetIdx];
+                    vec[targetIdx] = tmp;
+                }
+            }
+        }
+        return numComparisons;
+    }
+
+    template <size_t capacity>
+    void fillWithLongNames(StaticVector<FileNameType, capacity>& vec, size_t numEntries)
+    {
+        std::mt19937 random(1234);
+        for (size_t i = 0; i < numEntries; i++)
+        {
+            // long names with a common prefix, like in a typical audiobook folder
+            const auto name = "The Complete Collection of Very Long Audiobook Titles - Part "
+                              + std::to_string(random() % 100000)
+                              + " - Narrated by Someone With A Long Name.mp3";
+            vec.add(name.c_str());
+        }
+    }
+
+    template <size_t numEntries>
+    void runSortBenchmark()
+    {
+        using VectorType = StaticVector<FileNameType, numEntries>;
+        auto reference = std::make_unique<VectorType>();
+        auto vec = std::make_unique<VectorType>();
+        fillWithLongNames(*reference, numEntries);
+        fillWithLongNames(*vec, numEntries);
+
+        auto start = std::chrono::steady_clock::now();
+        const size_t simpleSortNumComparisons = simpleSort(*reference);
+        const auto simpleSortTimeUs = Benchmark::getMicrosecondsSince(start);
+
+        size_t numComparisons = 0;
+        start = std::chrono::steady_clock::now();
+        vec->sort([&numComparisons](const FileNameType& a, const FileNameType& b) {
+            numComparisons++;
+            return a < b;
+        });
+        const auto sortTimeUs = Benchmark::getMicrosecondsSince(start);
+
+        for (size_t i = 0; i < numEntries; i++)
+            ASSERT_STREQ((*vec)[i], (*reference)[i]);
+
+        if (Benchmark::isEnabled())
+            std::cout << "[ BENCH    ] sorting " << numEntries << " long names: "
+                      << simpleSortTimeUs << " us -> " << sortTimeUs << " us" << std::endl;
+
+        // the heapsort needs at most 2 * n * log2(n) comparisons, the old sort always n * (n - 1) / 2
+        size_t log2NumEntries = 0;
+        while ((size_t(1) << log2NumEntries) < numEntries)
+            log2NumEntries++;
+        EXPECT_EQ(simpleSortNumComparisons, numEntries * (numEntries - 1) / 2);
+        EXPECT_LE(numComparisons, 2 * numEntries * log2NumEntries);
+        EXPECT_LT(numComparisons, simpleSortNumComparisons);
+    }
+} // namespace
+
+TEST(StaticVector, d_benchmark_sort128)
+{
+    runSortBenchmark<128>();
+}
+
+TEST(StaticVector, e_benchmark_sort1024)
+{
+    runSortBenchmark<1024>();
+}
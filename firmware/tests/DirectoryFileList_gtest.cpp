@@ -0,0 +1,374 @@
+#include "DummyLibraryFile.h"
+#include "DummyDirectoryIterator.h"
+#include "DirectoryFileList.h"
+#include "Benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+class DirectoryFileList_Fixture : public ::testing::Test
+{
+protected:
+    DirectoryFileList_Fixture()
+    {
+        // init the "pseudo-static" environment for the dummy implementations
+        DummyLibraryFile::initTestEnv();
+        DummyDirectoryIterator::initTestEnv();
+
+        // install test implementations of File and DirectoryIterator
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        File::implFactories_[testName] = [](const char* filePath) {
+            return std::make_unique<DummyLibraryFile>(filePath);
+        };
+        DirectoryIterator::implFactories_[testName] = [](const char* directoryPath) {
+            return std::make_unique<DummyDirectoryIterator>(directoryPath);
+        };
+    }
+
+    ~DirectoryFileList_Fixture()
+    {
+        // remove test implementations of File and DirectoryIterator
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        File::implFactories_.erase(testName);
+        DirectoryIterator::implFactories_.erase(testName);
+
+        DummyLibraryFile::deleteTestEnv();
+        DummyDirectoryIterator::deleteTestEnv();
+    }
+
+    static DummyDirectoryIterator::Entry makeFile(const std::string& name)
+    {
+        return { name,
+                 DummyDirectoryIterator::Entry::Type::file,
+                 DummyDirectoryIterator::Entry::Hidden::no,
+                 DummyDirectoryIterator::Entry::SystemFileOrDir::no,
+                 DummyDirectoryIterator::Entry::Archived::no,
+                 DummyDirectoryIterator::Entry::ReadOnly::no };
+    }
+
+    /** Fills the directory with mp3 files in random order and returns their names in sort order */
+    static std::vector<std::string> fillDirectory(size_t numFiles)
+    {
+        std::vector<std::string> names;
+        std::mt19937 random(1234);
+        for (size_t i = 0; i < numFiles; i++)
+            names.push_back("Chapter " + std::to_string(random() % 1000000) + "-" + std::to_string(i) + ".mp3");
+
+        auto& entries = DummyDirectoryIterator::getTestEnv().directoryEntries_;
+        for (const auto& name : names)
+            entries.push_back(makeFile(name));
+
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    // small enough so that the tests can easily exceed it
+    using SmallListType = DirectoryFileList<256, 8, 4>;
+};
+
+TEST_F(DirectoryFileList_Fixture, a_normalMode)
+{
+    auto& entries = DummyDirectoryIterator::getTestEnv().directoryEntries_;
+    entries = {
+        makeFile("02 - b.mp3"),
+        makeFile("some text.txt"),
+        makeFile("01 - a.MP3"),
+        { "A directory.mp3",
+          DummyDirectoryIterator::Entry::Type::directory,
+          DummyDirectoryIterator::Entry::Hidden::no,
+          DummyDirectoryIterator::Entry::SystemFileOrDir::no,
+          DummyDirectoryIterator::Entry::Archived::no,
+          DummyDirectoryIterator::Entry::ReadOnly::no },
+        { "A hidden file.mp3",
+          DummyDirectoryIterator::Entry::Type::file,
+          DummyDirectoryIterator::Entry::Hidden::yes,
+          DummyDirectoryIterator::Entry::SystemFileOrDir::no,
+          DummyDirectoryIterator::Entry::Archived::no,
+          DummyDirectoryIterator::Entry::ReadOnly::no },
+        makeFile("mp3"),
+        makeFile("03 - c.mp3"),
+    };
+
+    SmallListType list;
+    list.open("My Folder");
+    EXPECT_FALSE(list.isStreaming());
+    ASSERT_EQ(list.size(), 3u);
+
+    SmallListType::StringType path;
+    EXPECT_TRUE(list.getFilePath(0, path));
+    EXPECT_STREQ(path, "My Folder/01 - a.MP3");
+    EXPECT_TRUE(list.getFilePath(2, path));
+    EXPECT_STREQ(path, "My Folder/03 - c.mp3");
+    EXPECT_TRUE(list.getFilePath(1, path));
+    EXPECT_STREQ(path, "My Folder/02 - b.mp3");
+    EXPECT_FALSE(list.getFilePath(3, path));
+
+    // the names and the fingerprint for the playlist cache are collected in a single pass
+    EXPECT_EQ(DummyDirectoryIterator::getTestEnv().numEntriesRead_, entries.size() + 1);
+}
+
+TEST_F(DirectoryFileList_Fixture, b_streamingMode_sameOrderAsNormalMode)
+{
+    const auto names = fillDirectory(50);
+
+    SmallListType list;
+    list.open("Folder");
+    EXPECT_TRUE(list.isStreaming());
+    ASSERT_EQ(list.size(), names.size());
+
+    // step forward through all files
+    SmallListType::StringType path;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        ASSERT_TRUE(list.getFilePath(i, path));
+        EXPECT_EQ(path, ("Folder/" + names[i]).c_str());
+        // restarting the same file
+        ASSERT_TRUE(list.getFilePath(i, path));
+        EXPECT_EQ(path, ("Folder/" + names[i]).c_str());
+    }
+    EXPECT_FALSE(list.getFilePath(names.size(), path));
+
+    // step backwards through all files
+    for (size_t i = names.size(); i > 0; i--)
+    {
+        ASSERT_TRUE(list.getFilePath(i - 1, path));
+        EXPECT_EQ(path, ("Folder/" + names[i - 1]).c_str());
+    }
+
+    // alternate between next and previous
+    for (size_t i : { 10, 11, 10, 11, 12, 11, 10, 9, 10, 20, 3, 4, 49, 0 })
+    {
+        ASSERT_TRUE(list.getFilePath(i, path));
+        EXPECT_EQ(path, ("Folder/" + names[i]).c_str());
+    }
+}
+
+TEST_F(DirectoryFileList_Fixture, c_streamingMode_50kFiles)
+{
+    constexpr size_t numFiles = 50000;
+    constexpr size_t numFilesToPlay = 50;
+    const auto names = fillDirectory(numFiles);
+
+    // the real configuration, as it's used in the Mp3DirectoryPlayer
+    using ListType = DirectoryFileList<26 * 1024, 2048, 8>;
+    auto list = std::make_unique<ListType>();
+    list->open("Audiobook");
+    EXPECT_TRUE(list->isStreaming());
+    ASSERT_EQ(list->size(), numFiles);
+
+    const auto numEntriesReadForOpen = DummyDirectoryIterator::getTestEnv().numEntriesRead_;
+    DummyDirectoryIterator::getTestEnv().numEntriesRead_ = 0;
+
+    ListType::StringType path;
+    for (size_t i = 0; i < numFilesToPlay; i++)
+    {
+        ASSERT_TRUE(list->getFilePath(i, path));
+        ASSERT_EQ(path, ("Audiobook/" + names[i]).c_str());
+    }
+    const auto numEntriesRead = DummyDirectoryIterator::getTestEnv().numEntriesRead_;
+
+    // go to the previous file
+    ASSERT_TRUE(list->getFilePath(numFilesToPlay - 2, path));
+    EXPECT_EQ(path, ("Audiobook/" + names[numFilesToPlay - 2]).c_str());
+    ASSERT_TRUE(list->getFilePath(numFilesToPlay - 1, path));
+    EXPECT_EQ(path, ("Audiobook/" + names[numFilesToPlay - 1]).c_str());
+
+    // The memory used by the list is fixed at compile time and independent of
+    // the number of files. There's no dynamic allocation.
+    if (Benchmark::isEnabled())
+        std::cout << "[ BENCH    ] " << numFiles << " files: "
+                  << "peak memory " << sizeof(ListType) << " bytes, "
+                  << "entries read: open " << numEntriesReadForOpen << ", "
+                  << numEntriesRead / numFilesToPlay << " per file while playing" << std::endl;
+    EXPECT_LE(sizeof(ListType), 34u * 1024u);
+    // opening reads the directory once, there's no fingerprint in the streaming mode
+    EXPECT_EQ(numEntriesReadForOpen, numFiles + 1);
+    // the window of 8 files is refilled with a single pass over the directory
+    EXPECT_LE(numEntriesRead, (numFilesToPlay / 8 + 1) * (numFiles + 1));
+}
+
+TEST_F(DirectoryFileList_Fixture, d_playlistCache_loadedWhenDirectoryIsUnchanged)
+{
+    const auto names = fillDirectory(8);
+    DummyLibraryFile::getTestEnv().modificationTime_ = 1234;
+    {
+        SmallListType list;
+        list.open("Folder");
+        EXPECT_FALSE(list.isStreaming());
+    }
+    EXPECT_FALSE(DummyLibraryFile::getTestEnv().otherFiles_["Folder/.wk_playlist"].empty());
+
+    // The cache file is now part of the directory, but it doesn't count.
+    auto& entries = DummyDirectoryIterator::getTestEnv().directoryEntries_;
+    entries.push_back(makeFile(".wk_playlist"));
+    entries.back().size = 123;
+    DummyDirectoryIterator::getTestEnv().numEntriesRead_ = 0;
+
+    SmallListType list;
+    list.open("Folder");
+    ASSERT_EQ(list.size(), names.size());
+    SmallListType::StringType path;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        ASSERT_TRUE(list.getFilePath(i, path));
+        EXPECT_EQ(path, ("Folder/" + names[i]).c_str());
+    }
+    // the directory was only read once to compare the fingerprint
+    EXPECT_EQ(DummyDirectoryIterator::getTestEnv().numEntriesRead_, entries.size() + 1);
+}
+
+TEST_F(DirectoryFileList_Fixture, e_playlistCache_rebuiltWhenDirectoryChanges)
+{
+    auto names = fillDirectory(4);
+    auto& entries = DummyDirectoryIterator::getTestEnv().directoryEntries_;
+    auto& cacheFile = DummyLibraryFile::getTestEnv().otherFiles_["Folder/.wk_playlist"];
+
+    const auto checkList = [&]() {
+        SmallListType list;
+        list.open("Folder");
+        ASSERT_EQ(list.size(), names.size());
+        SmallListType::StringType path;
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            ASSERT_TRUE(list.getFilePath(i, path));
+            EXPECT_EQ(path, ("Folder/" + names[i]).c_str());
+        }
+    };
+    checkList();
+
+    // a file was added
+    entries.push_back(makeFile("0 - A new file.mp3"));
+    names.insert(names.begin(), "0 - A new file.mp3");
+    checkList();
+
+    // a file was renamed and the modification time changed
+    entries.back().name = "1 - A new file.mp3";
+    names[0] = "1 - A new file.mp3";
+    DummyLibraryFile::getTestEnv().modificationTime_ = 5678;
+    checkList();
+
+    // the cache file contains garbage
+    cacheFile = "This is not a playlist";
+    checkList();
+
+    // the cache file was truncated
+    checkList();
+    cacheFile.resize(cacheFile.size() - 3);
+    checkList();
+}
+
+TEST_F(DirectoryFileList_Fixture, h_playlistCache_rebuiltWhenAFileIsRenamedOrReplaced)
+{
+    // FAT doesn't update the modification time of the directory and without
+    // a real time clock, all files have the same date. Renaming or replacing a
+    // file changes neither the number of entries nor the modification time.
+    auto names = fillDirectory(4);
+    auto& entries = DummyDirectoryIterator::getTestEnv().directoryEntries_;
+    DummyLibraryFile::getTestEnv().modificationTime_ = 1234;
+
+    const auto checkList = [&]() {
+        SmallListType list;
+        list.open("Folder");
+        ASSERT_EQ(list.size(), names.size());
+        SmallListType::StringType path;
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            ASSERT_TRUE(list.getFilePath(i, path));
+            EXPECT_EQ(path, ("Folder/" + names[i]).c_str());
+        }
+    };
+    checkList();
+    entries.push_back(makeFile(".wk_playlist"));
+    checkList(); // from the cache
+
+    // Opens the list and returns true if the cache was rebuilt. The directory
+    // is read exactly once, no matter if the cache is used or not.
+    auto& numEntriesRead = DummyDirectoryIterator::getTestEnv().numEntriesRead_;
+    auto& filesOverwritten = DummyLibraryFile::getTestEnv().filesOverwritten_;
+    const auto isCacheRebuilt = [&]() {
+        numEntriesRead = 0;
+        const auto numFilesOverwritten = filesOverwritten.size();
+        checkList();
+        EXPECT_EQ(numEntriesRead, entries.size() + 1);
+        return filesOverwritten.size() > numFilesOverwritten;
+    };
+    EXPECT_FALSE(isCacheRebuilt());
+
+    // a file was renamed
+    *std::find(names.begin(), names.end(), entries[0].name) = "0 - A renamed file.mp3";
+    entries[0].name = "0 - A renamed file.mp3";
+    std::sort(names.begin(), names.end());
+    EXPECT_TRUE(isCacheRebuilt());
+    EXPECT_FALSE(isCacheRebuilt());
+
+    // a file was replaced by one with the same name, but a different size
+    entries[1].size = 4711;
+    EXPECT_TRUE(isCacheRebuilt());
+    EXPECT_FALSE(isCacheRebuilt());
+}
+
+TEST_F(DirectoryFileList_Fixture, f_playlistCache_notUsedInStreamingMode)
+{
+    const auto names = fillDirectory(20);
+    SmallListType list;
+    list.open("Folder");
+    EXPECT_TRUE(list.isStreaming());
+    EXPECT_TRUE(DummyLibraryFile::getTestEnv().otherFiles_["Folder/.wk_playlist"].empty());
+}
+
+TEST_F(DirectoryFileList_Fixture, g_benchmark_startWithPlaylistCache)
+{
+    // measures the time from opening a directory with 1000 files until the
+    // path of the first file is known.
+    constexpr size_t numFiles = 1000;
+    const auto names = fillDirectory(numFiles);
+
+    using ListType = DirectoryFileList<26 * 1024, 2048, 8>;
+    auto list = std::make_unique<ListType>();
+    ListType::StringType path;
+
+    auto& numEntriesRead = DummyDirectoryIterator::getTestEnv().numEntriesRead_;
+    auto& fileEnv = DummyLibraryFile::getTestEnv();
+    const size_t onePass = numFiles + 1;
+
+    auto start = std::chrono::steady_clock::now();
+    list->open("Audiobook");
+    ASSERT_TRUE(list->getFilePath(0, path));
+    const auto rescanTimeUs = Benchmark::getMicrosecondsSince(start);
+    ASSERT_FALSE(list->isStreaming());
+    EXPECT_EQ(path, ("Audiobook/" + names[0]).c_str());
+    // the names and the fingerprint are collected in a single pass
+    EXPECT_EQ(numEntriesRead, onePass);
+    const auto& cacheFile = fileEnv.otherFiles_["Audiobook/.wk_playlist"];
+    ASSERT_FALSE(cacheFile.empty());
+
+    numEntriesRead = 0;
+    fileEnv.numOpenCalls_ = 0;
+    fileEnv.numBytesRead_ = 0;
+    start = std::chrono::steady_clock::now();
+    list->open("Audiobook");
+    ASSERT_TRUE(list->getFilePath(0, path));
+    const auto cachedTimeUs = Benchmark::getMicrosecondsSince(start);
+    EXPECT_EQ(path, ("Audiobook/" + names[0]).c_str());
+    ASSERT_EQ(list->size(), numFiles);
+    ASSERT_TRUE(list->getFilePath(numFiles - 1, path));
+    EXPECT_EQ(path, ("Audiobook/" + names[numFiles - 1]).c_str());
+    // with the cache, the directory is still read once and the sorted names
+    // come from a single read of the cache file instead of being sorted
+    EXPECT_EQ(numEntriesRead, onePass);
+    EXPECT_EQ(fileEnv.numBytesRead_, cacheFile.size());
+
+    if (Benchmark::isEnabled())
+        std::cout << "[ BENCH    ] " << numFiles << " files: "
+                  << "start with rescan " << rescanTimeUs / 1000.0 << " ms, "
+                  << "start with playlist cache " << cachedTimeUs / 1000.0 << " ms, "
+                  << "cache file " << cacheFile.size() << " bytes" << std::endl;
+}
@@ -13,6 +13,7 @@ public:
         directoryPath_(directoryPath),
         currentIdx_(0)
     {
+        getTestEnv().numEntriesRead_++;
     }
 
     ~DummyDirectoryIterator() {}
@@ -23,6 +24,13 @@ public:
     bool advance() override
     {
         currentIdx_++;
+        getTestEnv().numEntriesRead_++;
+        return isValid();
+    }
+    bool rewind() override
+    {
+        currentIdx_ = 0;
+        getTestEnv().numEntriesRead_++;
         return isValid();
     }
     const char* getName() const override
@@ -75,6 +83,13 @@ public:
         else
             return false;
     }
+    uint32_t getSize() const override
+    {
+        if (isValid())
+            return getTestEnv().directoryEntries_[currentIdx_].size;
+        else
+            return 0;
+    }
 
     const char* getDirectoryPath() const override { return directoryPath_.c_str(); }
     FRESULT getLastError() const override { return FRESULT::FR_INT_ERR; }
@@ -113,6 +128,7 @@ public:
         SystemFileOrDir systemFileOrDir;
         Archived archived;
         ReadOnly readOnly;
+        uint32_t size = 0;
     };
 
     /** Tests running in parallel need to be isolated from each other.
@@ -126,6 +142,8 @@ public:
     struct TestEnvironment
     {
         std::vector<Entry> directoryEntries_;
+        /** counts all entries read via advance() or rewind() */
+        size_t numEntriesRead_ = 0;
     };
 
     static void initTestEnv()
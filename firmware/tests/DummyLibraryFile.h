@@ -11,7 +11,7 @@ class DummyLibraryFile : public File::UnitTestImpl
 public:
     DummyLibraryFile(const char* filePath) :
         filePath_(filePath),
-        readIndex_(int(getTestEnv().fileContents_.size())) // imitate file not opened
+        readIndex_(int(getContents().size())) // imitate file not opened
     {
     }
 
@@ -23,19 +23,20 @@ public:
     UnitTestImpl& operator=(const UnitTestImpl& other) override
     {
         filePath_ = other.getFilePath();
-        readIndex_ = int(getTestEnv().fileContents_.size()); // imitate file not opened
+        readIndex_ = int(getContents().size()); // imitate file not opened
         return *this;
     }
 
     DummyLibraryFile& operator=(const char* filePath) override
     {
         filePath_ = filePath;
-        readIndex_ = int(getTestEnv().fileContents_.size()); // imitate file not opened
+        readIndex_ = int(getContents().size()); // imitate file not opened
         return *this;
     }
 
     bool open(File::AccessMode, File::OpenMode openMode) override
     {
+        getTestEnv().numOpenCalls_++;
         getTestEnv().numSimultaneousFilesOpen_++;
         if (getTestEnv().numSimultaneousFilesOpen_
             > getTestEnv().maxObservedNumSimultaneousFilesOpen_)
@@ -50,6 +51,7 @@ public:
                 break;
             case File::OpenMode::createNewAllowOverwrite:
                 getTestEnv().filesOverwritten_.push_back(filePath_.c_str());
+                getContents().clear();
                 break;
             case File::OpenMode::openOrCreateAndSeekToEof:
                 readIndex_ = getSize();
@@ -70,25 +72,26 @@ public:
         return true;
     }
 
+    bool enableFastSeek(uint32_t*, size_t) override { return true; }
+
     bool tryRead(char* readBuffer, uint32_t numBytesRequested, uint32_t& numBytesRead) override
     {
+        if (getTestEnv().onRead_)
+            getTestEnv().onRead_(numBytesRequested);
+        const auto& contents = getContents();
         numBytesRead = 0;
-        // this is horribly inefficient, but who cares?
-        while (numBytesRequested > 0 && !isEndOfFile())
-        {
-            *readBuffer = getTestEnv().fileContents_[readIndex_];
-            readIndex_++;
-            numBytesRequested--;
-            readBuffer++;
-            numBytesRead++;
-        }
+        if (readIndex_ < int(contents.size()))
+            numBytesRead = std::min(numBytesRequested, uint32_t(int(contents.size()) - readIndex_));
+        memcpy(readBuffer, contents.data() + readIndex_, numBytesRead);
+        readIndex_ += int(numBytesRead);
         readBuffer[numBytesRead] = 0;
+        getTestEnv().numBytesRead_ += numBytesRead;
         return true;
     }
 
     size_t getSize() const override
     {
-        return getTestEnv().fileContents_.size();
+        return getContents().size();
     }
 
     bool setCursorTo(size_t position) override
@@ -106,37 +109,58 @@ public:
         return setCursorTo(readIndex_ + numBytes);
     }
 
+    size_t getCursorPosition() const override
+    {
+        return size_t(readIndex_);
+    }
+
     bool readLine(FixedSizeStr<1000>& outputString) override
     {
         // this is horribly inefficient, but who cares?
-        while ((getTestEnv().fileContents_[readIndex_] != '\n')
+        const auto& contents = getContents();
+        const auto startIndex = readIndex_;
+        while ((contents[readIndex_] != '\n')
                && (outputString.size() < outputString.maxSize())
                && !isEndOfFile())
         {
-            outputString.append(getTestEnv().fileContents_[readIndex_]);
+            outputString.append(contents[readIndex_]);
             readIndex_++;
         }
-        if (getTestEnv().fileContents_[readIndex_] == '\n')
+        if (contents[readIndex_] == '\n')
         {
-            outputString.append(getTestEnv().fileContents_[readIndex_]);
+            outputString.append(contents[readIndex_]);
             readIndex_++;
         }
+        getTestEnv().numBytesRead_ += size_t(readIndex_ - startIndex);
         return true;
     }
 
     bool write(const char* string) override
     {
-        const auto strLen = std::char_traits<char>::length(string);
-        getTestEnv().fileContents_.resetAt(string, readIndex_);
-        readIndex_ += strLen;
-        if (readIndex_ > int(getTestEnv().fileContents_.maxSize()))
-            return false; // capacity exceeded
+        uint32_t numBytesWritten;
+        const auto strLen = uint32_t(std::char_traits<char>::length(string));
+        return tryWrite(string, strLen, numBytesWritten);
+    }
+
+    bool tryWrite(const char* writeBuffer, uint32_t numBytesToWrite, uint32_t& numBytesWritten) override
+    {
+        auto& contents = getContents();
+        if (readIndex_ > int(contents.size()))
+            return false;
+        contents.replace(size_t(readIndex_), numBytesToWrite, writeBuffer, numBytesToWrite);
+        readIndex_ += numBytesToWrite;
+        numBytesWritten = numBytesToWrite;
         return true;
     }
 
     bool isEndOfFile() const override
     {
-        return readIndex_ >= int(getTestEnv().fileContents_.size());
+        return readIndex_ >= int(getContents().size());
+    }
+
+    uint32_t getModificationTime() const override
+    {
+        return getTestEnv().modificationTime_;
     }
 
     const char* getFilePath() const override { return filePath_; }
@@ -152,11 +176,20 @@ public:
      */
     struct TestEnvironment
     {
-        FixedSizeStr<1000> fileContents_;
+        /** Contents of the library file "library.txt" */
+        std::string fileContents_;
+        /** Contents of all other files, e.g. the library index */
+        std::map<std::string, std::string> otherFiles_;
+        uint32_t modificationTime_ = 0;
+        int numOpenCalls_ = 0;
+        /** counts all bytes read via tryRead() or readLine() */
+        size_t numBytesRead_ = 0;
         int numSimultaneousFilesOpen_ = 0;
         int maxObservedNumSimultaneousFilesOpen_ = 0;
         std::vector<std::string> filesInExistance_;
         std::vector<std::string> filesOverwritten_;
+        /** Called for each read, e.g. to simulate the latency of the card */
+        std::function<void(uint32_t numBytesRequested)> onRead_;
     };
 
     static void initTestEnv()
@@ -178,6 +211,13 @@ public:
     }
 
 private:
+    std::string& getContents() const
+    {
+        if (filePath_ == "library.txt")
+            return getTestEnv().fileContents_;
+        return getTestEnv().otherFiles_[filePath_.c_str()];
+    }
+
     static std::map<std::string, TestEnvironment> testEnvironments_;
     FixedSizeStr<32> filePath_;
     int readIndex_;
@@ -0,0 +1,347 @@
+#include "DummyLibraryFile.h"
+#include "Benchmark.h"
+#include "FileReadAheadBuffer.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <gtest/gtest.h>
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+class FileReadAheadBuffer_Fixture : public ::testing::Test
+{
+protected:
+    FileReadAheadBuffer_Fixture()
+    {
+        // init the "pseudo-static" environment for the dummy implementation
+        DummyLibraryFile::initTestEnv();
+
+        // install test implementation of File
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        File::implFactories_[testName] = [](const char* filePath) {
+            return std::make_unique<DummyLibraryFile>(filePath);
+        };
+    }
+
+    ~FileReadAheadBuffer_Fixture()
+    {
+        // remove test implementation of File
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        File::implFactories_.erase(testName);
+
+        DummyLibraryFile::deleteTestEnv();
+    }
+
+    static std::string makeFileContents(size_t numBytes)
+    {
+        std::string contents(numBytes, 0);
+        std::mt19937 random(1234);
+        for (auto& c : contents)
+            c = char(random());
+        return contents;
+    }
+
+    /** Reads the entire file in pieces of random sizes and returns what was read. */
+    template <typename ReaderType>
+    static std::string readAll(ReaderType& reader, size_t maxPieceSize)
+    {
+        std::mt19937 random(5678);
+        std::string result;
+        while (!reader.isExhausted())
+        {
+            const size_t pieceSize = 1 + random() % maxPieceSize;
+            // interleave the file reads with the consumer, like the decoder does
+            EXPECT_TRUE(reader.serviceReadRequests());
+            while (!reader.makeContiguous(pieceSize))
+                EXPECT_TRUE(reader.serviceReadRequests());
+            const size_t numBytes = std::min(pieceSize, reader.getNumContiguousBytes());
+            if ((numBytes < pieceSize) && !reader.isExhausted())
+            {
+                // only allowed at the end of the file
+                EXPECT_FALSE(reader.hasPendingReadRequests());
+            }
+            result.append(reader.getReadPointer(), numBytes);
+            reader.consume(numBytes);
+        }
+        return result;
+    }
+
+    using SmallReaderType = FileReadAheadBuffer<64, 16, 16>;
+};
+
+TEST_F(FileReadAheadBuffer_Fixture, a_readsWholeFileInOrder)
+{
+    for (const size_t fileSize : { 0, 1, 15, 16, 64, 65, 128, 129, 1000, 4096, 10007 })
+    {
+        const auto contents = makeFileContents(fileSize);
+        DummyLibraryFile::getTestEnv().otherFiles_["test.mp3"] = contents;
+
+        File file("test.mp3");
+        ASSERT_TRUE(file.open(File::AccessMode::read, File::OpenMode::openIfExists));
+        SmallReaderType reader;
+        reader.start(file);
+        const auto result = readAll(reader, 16);
+        EXPECT_EQ(result, contents) << "file size " << fileSize;
+        EXPECT_FALSE(reader.hasReadError());
+    }
+}
+
+TEST_F(FileReadAheadBuffer_Fixture, b_readAheadAndWrapAround)
+{
+    DummyLibraryFile::getTestEnv().otherFiles_["test.mp3"] = makeFileContents(1000);
+    File file("test.mp3");
+    ASSERT_TRUE(file.open(File::AccessMode::read, File::OpenMode::openIfExists));
+    SmallReaderType reader;
+    reader.start(file);
+
+    // nothing is read until the read requests are serviced
+    EXPECT_EQ(reader.getNumReadRequests(), 0u);
+    EXPECT_EQ(reader.getNumContiguousBytes(), 0u);
+    EXPECT_TRUE(reader.hasPendingReadRequests());
+    EXPECT_FALSE(reader.makeContiguous(1));
+
+    // each call reads a chunk
+    EXPECT_TRUE(reader.serviceReadRequests());
+    EXPECT_EQ(reader.getNumReadRequests(), 1u);
+    EXPECT_EQ(reader.getNumContiguousBytes(), 16u);
+
+    // both blocks are filled, the data is contiguous across the blocks
+    EXPECT_TRUE(reader.completeReadRequests());
+    EXPECT_EQ(reader.getNumReadRequests(), 8u);
+    EXPECT_FALSE(reader.hasPendingReadRequests());
+    EXPECT_EQ(reader.getNumContiguousBytes(), 128u);
+
+    // reading from the second block frees the first one
+    reader.consume(70);
+    EXPECT_TRUE(reader.hasPendingReadRequests());
+    EXPECT_EQ(reader.getNumContiguousBytes(), 58u);
+    EXPECT_TRUE(reader.completeReadRequests());
+    EXPECT_EQ(reader.getNumContiguousBytes(), 58u);
+
+    // wrapping around copies the bytes left at the end of the second block
+    reader.consume(50);
+    EXPECT_TRUE(reader.makeContiguous(16));
+    EXPECT_EQ(reader.getNumBytesCopied(), 8u);
+    EXPECT_EQ(reader.getNumContiguousBytes(), 8u + 64u);
+
+    // the data wasn't modified
+    const auto& contents = DummyLibraryFile::getTestEnv().otherFiles_["test.mp3"];
+    EXPECT_EQ(std::string(reader.getReadPointer(), 72), contents.substr(120, 72));
+    EXPECT_EQ(reader.getFilePosition(), 120u);
+
+    // restarting in the middle of the file, e.g. after a seek
+    ASSERT_TRUE(file.setCursorTo(500));
+    reader.start(file);
+    EXPECT_EQ(reader.getFilePosition(), 500u);
+    EXPECT_TRUE(reader.completeReadRequests());
+    reader.consume(10);
+    EXPECT_EQ(reader.getFilePosition(), 510u);
+    EXPECT_EQ(std::string(reader.getReadPointer(), 16), contents.substr(510, 16));
+}
+
+namespace
+{
+    /** Simulates the audio fifo that is drained by the DAC while the main loop
+     *  decodes frames and reads the file, all in virtual time. */
+    class SimulatedPlayback
+    {
+    public:
+        static constexpr double fifoSize = 16383.0;
+        static constexpr double samplesPerMs = 88.2;
+        static constexpr double samplesPerFrame = 2304.0;
+        static constexpr size_t bytesPerFrame = 418;
+        static constexpr double decodeTimePerFrameMs = 4.0;
+
+        /** Card model: 1ms latency and 1MB/s for each read; the card is busy for
+         *  `worstCaseLatencyMs` once every 2 seconds. */
+        void onRead(uint32_t numBytes, double worstCaseLatencyMs)
+        {
+            double latencyMs = 1.0;
+            if (nowMs_ >= nextBusyTimeMs_)
+            {
+                latencyMs = worstCaseLatencyMs;
+                nextBusyTimeMs_ += 2000.0;
+            }
+            advance(latencyMs + double(numBytes) / 1000.0);
+        }
+
+        bool hasRoomForFrame()
+        {
+            update();
+            return fifoLevel_ + samplesPerFrame <= fifoSize;
+        }
+
+        void decodeFrame()
+        {
+            advance(decodeTimePerFrameMs);
+            fifoLevel_ += samplesPerFrame;
+            if (fifoLevel_ + samplesPerFrame > fifoSize)
+                isFifoFilled_ = true;
+        }
+
+        void waitForRoom()
+        {
+            update();
+            advance((fifoLevel_ + samplesPerFrame - fifoSize) / samplesPerMs + 0.01);
+        }
+
+        double getMinHeadroomMs() const { return minFifoLevel_ / samplesPerMs; }
+
+    private:
+        void advance(double ms)
+        {
+            nowMs_ += ms;
+            update();
+        }
+
+        void update()
+        {
+            fifoLevel_ -= (nowMs_ - lastUpdateMs_) * samplesPerMs;
+            lastUpdateMs_ = nowMs_;
+            if (isFifoFilled_)
+                minFifoLevel_ = std::min(minFifoLevel_, fifoLevel_);
+            fifoLevel_ = std::max(fifoLevel_, 0.0);
+        }
+
+        double nowMs_ = 0.0;
+        double lastUpdateMs_ = 0.0;
+        double nextBusyTimeMs_ = 1000.0;
+        double fifoLevel_ = 0.0;
+        double minFifoLevel_ = fifoSize;
+        bool isFifoFilled_ = false;
+    };
+
+    struct PlaybackResult
+    {
+        double minHeadroomMs;
+        size_t numBytesCopied;
+        size_t numBytesPlayed;
+    };
+
+    /** Plays the file like Mp3FileStream did before: an 8k buffer that is compacted with
+     *  memcpy and refilled with a single blocking read when less than half of it is left. */
+    PlaybackResult playWithLegacyBuffer(SimulatedPlayback& playback)
+    {
+        File file("test.mp3");
+        file.open(File::AccessMode::read, File::OpenMode::openIfExists);
+        static constexpr int bufferSize = 8192;
+        char buffer[bufferSize + 1];
+        char* tail = buffer;
+        int numBytesLeft = 0;
+        bool isEndOfFile = false;
+        PlaybackResult result { 0.0, 0, 0 };
+
+        auto refill = [&]() {
+            memcpy(buffer, tail, size_t(numBytesLeft));
+            result.numBytesCopied += size_t(numBytesLeft);
+            tail = buffer;
+            uint32_t numBytesRead = 0;
+            const uint32_t numBytesToRead = uint32_t(bufferSize - numBytesLeft);
+            file.tryRead(&buffer[numBytesLeft], numBytesToRead, numBytesRead);
+            numBytesLeft += int(numBytesRead);
+            isEndOfFile = numBytesRead < numBytesToRead;
+        };
+
+        refill();
+        while (true)
+        {
+            if (!playback.hasRoomForFrame())
+            {
+                playback.waitForRoom();
+                continue;
+            }
+            if (!isEndOfFile && (numBytesLeft < bufferSize / 2))
+                refill();
+            const int numBytes = std::min(int(SimulatedPlayback::bytesPerFrame), numBytesLeft);
+            if (numBytes == 0)
+                break;
+            tail += numBytes;
+            numBytesLeft -= numBytes;
+            result.numBytesPlayed += size_t(numBytes);
+            playback.decodeFrame();
+        }
+        result.minHeadroomMs = playback.getMinHeadroomMs();
+        return result;
+    }
+
+    /** Plays the file like Mp3FileStream does now. */
+    PlaybackResult playWithReadAheadBuffer(SimulatedPlayback& playback)
+    {
+        File file("test.mp3");
+        file.open(File::AccessMode::read, File::OpenMode::openIfExists);
+        FileReadAheadBuffer<4096, 1536, 1024> reader;
+        reader.start(file);
+        PlaybackResult result { 0.0, 0, 0 };
+
+        reader.completeReadRequests();
+        while (true)
+        {
+            if (!playback.hasRoomForFrame())
+            {
+                // AudioStreamPlayer calls prefetch() when the fifo is full
+                reader.completeReadRequests();
+                playback.waitForRoom();
+                continue;
+            }
+            // Mp3FileStream::fillBuffer()
+            reader.serviceReadRequests();
+            while (!reader.makeContiguous(SimulatedPlayback::bytesPerFrame))
+                reader.serviceReadRequests();
+            const size_t numBytes = std::min(SimulatedPlayback::bytesPerFrame, reader.getNumContiguousBytes());
+            if (numBytes == 0)
+                break;
+            reader.consume(numBytes);
+            result.numBytesPlayed += numBytes;
+            playback.decodeFrame();
+        }
+        result.minHeadroomMs = playback.getMinHeadroomMs();
+        result.numBytesCopied = reader.getNumBytesCopied();
+        return result;
+    }
+} // namespace
+
+TEST_F(FileReadAheadBuffer_Fixture, c_benchmark_fifoHeadroomUnderCardLatency)
+{
+    // 30 seconds of a 128kbps file
+    static constexpr size_t fileSize = 30 * 16000;
+    DummyLibraryFile::getTestEnv().otherFiles_["test.mp3"] = makeFileContents(fileSize);
+
+    for (const double worstCaseLatencyMs : { 10.0, 50.0, 100.0 })
+    {
+        SimulatedPlayback legacyPlayback;
+        DummyLibraryFile::getTestEnv().onRead_ = [&](uint32_t numBytes) {
+            legacyPlayback.onRead(numBytes, worstCaseLatencyMs);
+        };
+        const auto legacy = playWithLegacyBuffer(legacyPlayback);
+
+        SimulatedPlayback playback;
+        DummyLibraryFile::getTestEnv().onRead_ = [&](uint32_t numBytes) {
+            playback.onRead(numBytes, worstCaseLatencyMs);
+        };
+        Profiler::reset();
+        const auto readAhead = playWithReadAheadBuffer(playback);
+        DummyLibraryFile::getTestEnv().onRead_ = nullptr;
+        const auto& readStats = Profiler::getStats(ProfilingZone::fileRead);
+
+        if (Benchmark::isEnabled())
+        {
+            std::cout << "[ BENCH    ] worst case card latency " << worstCaseLatencyMs << "ms: "
+                      << "min. fifo headroom " << legacy.minHeadroomMs << "ms -> " << readAhead.minHeadroomMs << "ms, "
+                      << "bytes copied " << legacy.numBytesCopied << " -> " << readAhead.numBytesCopied << std::endl;
+            std::cout << "[ BENCH    ] " << Profiler::getName(ProfilingZone::fileRead) << ": "
+                      << readStats.count << " calls, mean " << readStats.getMean() << "ns, max "
+                      << readStats.max << "ns (host CPU time, without the card latency)" << std::endl;
+        }
+
+        EXPECT_EQ(legacy.numBytesPlayed, fileSize);
+        EXPECT_EQ(readAhead.numBytesPlayed, fileSize);
+        // no underrun and at least as much headroom as before
+        EXPECT_GT(readAhead.minHeadroomMs, 0.0);
+        EXPECT_GE(readAhead.minHeadroomMs, legacy.minHeadroomMs);
+        // copying is limited to less than a frame per 8k
+        EXPECT_LT(readAhead.numBytesCopied, legacy.numBytesCopied / 10);
+    }
+}
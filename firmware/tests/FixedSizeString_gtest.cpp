@@ -192,6 +192,12 @@ TEST(FixedSizeString, k_appendCharacter)
     str2.append('1');
     EXPECT_STREQ(str2, "abcd");
 
+    // terminate after a shorter string was stored before
+    auto str3 = FixedSizeStr<9>("abcd");
+    str3.clear();
+    str3.append('1');
+    EXPECT_STREQ(str3, "1");
+
     // should also work in a constexpr use case
     constexpr auto getStringFunc = []() {
         FixedSizeStr<9> str("abcd");
@@ -254,6 +260,16 @@ TEST(FixedSizeString, n_swap)
     };
     static constexpr auto constexprAppendTest = getStringFunc() == "34";
     EXPECT_TRUE(constexprAppendTest);
+
+    // strings of different length
+    auto str3 = FixedSizeStr<8>("1");
+    auto str4 = FixedSizeStr<8>("23456");
+    str3.swap(str4);
+    EXPECT_STREQ(str3, "23456");
+    EXPECT_STREQ(str4, "1");
+    swap(str3, str4);
+    EXPECT_STREQ(str3, "1");
+    EXPECT_STREQ(str4, "23456");
 }
 
 TEST(FixedSizeString, o_updateSize)
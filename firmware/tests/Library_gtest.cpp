@@ -1,8 +1,10 @@
 #include "DummyLibraryFile.h"
 #include "DummyDirectoryIterator.h"
+#include "Benchmark.h"
 #include "Library.h"
 #include <vector>
 #include <string>
+#include <chrono>
 #include <gtest/gtest.h>
 
 // ==============================================================
@@ -43,8 +45,9 @@ protected:
     {
         // never open library file multiple times simultaneously to avoid disk corruption.
         EXPECT_LE(DummyLibraryFile::getTestEnv().maxObservedNumSimultaneousFilesOpen_, 1);
-        // never delete or overwrite any file
-        EXPECT_EQ(DummyLibraryFile::getTestEnv().filesOverwritten_.size(), 0u);
+        // never delete or overwrite the library file. Only the cache is rewritten from scratch.
+        for (const auto& filename : DummyLibraryFile::getTestEnv().filesOverwritten_)
+            EXPECT_EQ(filename, "library.idx");
         bool libraryFileWasCreated = false;
         for (const auto filename : DummyLibraryFile::getTestEnv().filesInExistance_)
             libraryFileWasCreated |= (filename == "library.txt");
@@ -187,7 +190,7 @@ TEST_F(Library_Fixture, m_storeLink_newLineAlreadyThere)
     FixedSizeStr<32> folderToStore = "My Third Folder";
     EXPECT_TRUE(library.storeLink(tag, folderToStore));
 
-    EXPECT_STREQ(DummyLibraryFile::getTestEnv().fileContents_, "1A2B3C4D:A Test Directory Name\n2A3B4C5D:Another Directory Name\n11223344:My Third Folder");
+    EXPECT_STREQ(DummyLibraryFile::getTestEnv().fileContents_.c_str(), "1A2B3C4D:A Test Directory Name\n2A3B4C5D:Another Directory Name\n11223344:My Third Folder");
     EXPECT_TRUE(library.isLinked(folderToStore));
 
     commonEndOfTestChecks();
@@ -203,7 +206,7 @@ TEST_F(Library_Fixture, n_storeLink_newLineNotThere)
     FixedSizeStr<32> folderToStore = "My Third Folder";
     EXPECT_TRUE(library.storeLink(tag, folderToStore));
 
-    EXPECT_STREQ(DummyLibraryFile::getTestEnv().fileContents_, "1A2B3C4D:A Test Directory Name\n2A3B4C5D:Another Directory Name\n11223344:My Third Folder");
+    EXPECT_STREQ(DummyLibraryFile::getTestEnv().fileContents_.c_str(), "1A2B3C4D:A Test Directory Name\n2A3B4C5D:Another Directory Name\n11223344:My Third Folder");
     EXPECT_TRUE(library.isLinked(folderToStore));
 
     commonEndOfTestChecks();
@@ -220,7 +223,7 @@ TEST_F(Library_Fixture, o_storeLink_emptyFile)
     EXPECT_TRUE(library.storeLink(tag, folderToStore));
 
     // No newline inserted at the beginning of the file
-    EXPECT_STREQ(DummyLibraryFile::getTestEnv().fileContents_, "11223344:My Folder");
+    EXPECT_STREQ(DummyLibraryFile::getTestEnv().fileContents_.c_str(), "11223344:My Folder");
     EXPECT_TRUE(library.isLinked(folderToStore));
 
     commonEndOfTestChecks();
@@ -237,7 +240,7 @@ TEST_F(Library_Fixture, p_storeLink_tagAlreadyInUse)
     EXPECT_FALSE(library.storeLink(tag, folderToStore)); // fails!
 
     // no new antry added
-    EXPECT_STREQ(DummyLibraryFile::getTestEnv().fileContents_, "11223344:My Folder A");
+    EXPECT_STREQ(DummyLibraryFile::getTestEnv().fileContents_.c_str(), "11223344:My Folder A");
     EXPECT_FALSE(library.isLinked(folderToStore));
 
     commonEndOfTestChecks();
@@ -304,3 +307,658 @@ TEST_F(Library_Fixture, q_getNextUnlinked)
 
     commonEndOfTestChecks();
 }
+
+TEST_F(Library_Fixture, r_cache_lookupsDontAccessTheFile)
+{
+    // once the library is constructed, lookups are served from the in-RAM cache
+    DummyLibraryFile::getTestEnv().fileContents_ = "1A2B3C4D:A Test Directory Name\n2A3B4C5D:Another Directory Name\n";
+    Library library;
+    EXPECT_TRUE(library.isLibraryFileValid());
+
+    DummyLibraryFile::getTestEnv().numOpenCalls_ = 0;
+    Library::StringType result;
+    EXPECT_TRUE(library.getFolderFor(0x2A3B4C5D, result));
+    EXPECT_EQ(result, "Another Directory Name");
+    EXPECT_FALSE(library.getFolderFor(0x11223344, result));
+    EXPECT_TRUE(library.isLinked(0x1A2B3C4D));
+    EXPECT_FALSE(library.isLinked(0x11223344));
+    EXPECT_TRUE(library.isLinked(Library::StringType("A Test Directory Name")));
+    EXPECT_FALSE(library.isLinked(Library::StringType("A Test Directory")));
+    EXPECT_EQ(DummyLibraryFile::getTestEnv().numOpenCalls_, 0);
+
+    commonEndOfTestChecks();
+}
+
+TEST_F(Library_Fixture, s_cache_loadedFromCacheFile)
+{
+    // the cache is stored next to the library file and is reused on the
+    // next startup as long as the library file is unchanged
+    DummyLibraryFile::getTestEnv().fileContents_ = "1A2B3C4D:A Test Directory Name\n";
+    DummyLibraryFile::getTestEnv().modificationTime_ = 1234;
+    {
+        Library library;
+        EXPECT_TRUE(library.isLibraryFileValid());
+    }
+    EXPECT_FALSE(DummyLibraryFile::getTestEnv().otherFiles_["library.idx"].empty());
+
+    // modify the library file without changing its size or modification time.
+    // The next library must not see this change, because it uses the stored cache.
+    DummyLibraryFile::getTestEnv().fileContents_ = "1A2B3C4D:A Test Directory Nope\n";
+    {
+        Library library;
+        EXPECT_TRUE(library.isLibraryFileValid());
+        Library::StringType result;
+        EXPECT_TRUE(library.getFolderFor(0x1A2B3C4D, result));
+        EXPECT_EQ(result, "A Test Directory Name");
+    }
+
+    commonEndOfTestChecks();
+}
+
+TEST_F(Library_Fixture, t_cache_rebuiltWhenLibraryFileChanges)
+{
+    DummyLibraryFile::getTestEnv().fileContents_ = "1A2B3C4D:A Test Directory Name\n";
+    DummyLibraryFile::getTestEnv().modificationTime_ = 1234;
+    {
+        Library library;
+        EXPECT_TRUE(library.isLibraryFileValid());
+    }
+
+    // library file was edited with the same size, but the modification time changed
+    DummyLibraryFile::getTestEnv().fileContents_ = "1A2B3C4D:A Test Directory Nope\n";
+    DummyLibraryFile::getTestEnv().modificationTime_ = 5678;
+    {
+        Library library;
+        Library::StringType result;
+        EXPECT_TRUE(library.getFolderFor(0x1A2B3C4D, result));
+        EXPECT_EQ(result, "A Test Directory Nope");
+    }
+
+    // library file was edited and has a different size
+    DummyLibraryFile::getTestEnv().fileContents_ = "1A2B3C4D:A Test Directory Nope\n2A3B4C5D:Another Directory Name";
+    {
+        Library library;
+        EXPECT_TRUE(library.isLinked(0x2A3B4C5D));
+        EXPECT_TRUE(library.isLinked(Library::StringType("Another Directory Name")));
+    }
+
+    // the cache file contains garbage
+    DummyLibraryFile::getTestEnv().otherFiles_["library.idx"] = "This is not a cache";
+    {
+        Library library;
+        EXPECT_TRUE(library.isLibraryFileValid());
+        EXPECT_TRUE(library.isLinked(0x2A3B4C5D));
+    }
+
+    // the cache file was built from an invalid library file
+    DummyLibraryFile::getTestEnv().fileContents_ = "1A2B3C4X:A Test Directory Name\n";
+    {
+        Library library;
+        EXPECT_FALSE(library.isLibraryFileValid());
+    }
+
+    commonEndOfTestChecks();
+}
+
+TEST_F(Library_Fixture, u_cache_updatedByStoreLink)
+{
+    DummyLibraryFile::getTestEnv().fileContents_ = "1A2B3C4D:A Test Directory Name\n";
+    {
+        Library library;
+        EXPECT_TRUE(library.storeLink(0x11223344, "My Third Folder"));
+    }
+
+    // the stored cache matches the new library file and is loaded
+    // without reading the library file line by line
+    DummyLibraryFile::getTestEnv().fileContents_.back() = 'X'; // changes content, but not the size
+    {
+        Library library;
+        EXPECT_TRUE(library.isLibraryFileValid());
+        Library::StringType result;
+        EXPECT_TRUE(library.getFolderFor(0x11223344, result));
+        EXPECT_EQ(result, "My Third Folder");
+    }
+
+    commonEndOfTestChecks();
+}
+
+TEST_F(Library_Fixture, v_cache_writeThrough)
+{
+    // storeLink() updates the library file and the cache, so that
+    // the new link can be looked up without reading the file again
+    DummyLibraryFile::getTestEnv().fileContents_ = "1A2B3C4D:A Test Directory Name\n";
+    Library library;
+    EXPECT_TRUE(library.storeLink(0x11223344, "My Third Folder"));
+    EXPECT_STREQ(DummyLibraryFile::getTestEnv().fileContents_.c_str(),
+                 "1A2B3C4D:A Test Directory Name\n11223344:My Third Folder");
+
+    DummyLibraryFile::getTestEnv().numOpenCalls_ = 0;
+    Library::StringType result;
+    EXPECT_TRUE(library.getFolderFor(0x11223344, result));
+    EXPECT_EQ(result, "My Third Folder");
+    EXPECT_TRUE(library.isLinked(0x11223344));
+    EXPECT_TRUE(library.isLinked(Library::StringType("My Third Folder")));
+    EXPECT_EQ(DummyLibraryFile::getTestEnv().numOpenCalls_, 0);
+
+    // storing a link for a linked tag or folder fails and doesn't touch the cache
+    EXPECT_FALSE(library.storeLink(0x11223344, "Some Other Folder"));
+    EXPECT_FALSE(library.storeLink(0x55667788, "My Third Folder"));
+    EXPECT_FALSE(library.isLinked(0x55667788));
+    EXPECT_FALSE(library.isLinked(Library::StringType("Some Other Folder")));
+
+    commonEndOfTestChecks();
+}
+
+TEST_F(Library_Fixture, w_cache_capacityExceeded)
+{
+    // libraries with more links than the cache can hold still work,
+    // the remaining links are looked up in the library file
+    constexpr size_t numLinks = Library::maxNumCachedLinks_ + 10;
+    std::string& contents = DummyLibraryFile::getTestEnv().fileContents_;
+    for (size_t i = 0; i < numLinks; i++)
+    {
+        contents += RfidTagId(uint32_t(0x10000000 + i)).asString().c_str();
+        contents += ":Folder " + std::to_string(i) + "\n";
+    }
+
+    Library library;
+    EXPECT_TRUE(library.isLibraryFileValid());
+    for (size_t i = 0; i < numLinks; i++)
+    {
+        Library::StringType result;
+        EXPECT_TRUE(library.getFolderFor(uint32_t(0x10000000 + i), result));
+        EXPECT_EQ(result, ("Folder " + std::to_string(i)).c_str());
+    }
+    EXPECT_TRUE(library.isLinked(Library::StringType("Folder 0")));
+    EXPECT_TRUE(library.isLinked(Library::StringType(("Folder " + std::to_string(numLinks - 1)).c_str())));
+    EXPECT_FALSE(library.isLinked(Library::StringType("Folder")));
+
+    // an incomplete cache is never stored, it would hide the remaining links
+    EXPECT_TRUE(DummyLibraryFile::getTestEnv().otherFiles_["library.idx"].empty());
+
+    // new links are still stored in the library file
+    EXPECT_TRUE(library.storeLink(0x01020304, "Yet Another Folder"));
+    Library::StringType result;
+    EXPECT_TRUE(library.getFolderFor(0x01020304, result));
+    EXPECT_EQ(result, "Yet Another Folder");
+
+    commonEndOfTestChecks();
+}
+
+TEST_F(Library_Fixture, w_cache_twoTagsLinkedToOneFolder)
+{
+    // a hand-edited library file can link the same folder to multiple tags.
+    // All of them must be found, even though the cache only holds the first one.
+    DummyLibraryFile::getTestEnv().fileContents_ = "1A2B3C4D:Shared Folder\n2A3B4C5D:Other Folder\n11223344:Shared Folder\n";
+    Library library;
+    EXPECT_TRUE(library.isLibraryFileValid());
+
+    Library::StringType result;
+    EXPECT_TRUE(library.getFolderFor(0x1A2B3C4D, result));
+    EXPECT_EQ(result, "Shared Folder");
+    EXPECT_TRUE(library.getFolderFor(0x11223344, result));
+    EXPECT_EQ(result, "Shared Folder");
+    EXPECT_TRUE(library.getFolderFor(0x2A3B4C5D, result));
+    EXPECT_EQ(result, "Other Folder");
+    EXPECT_TRUE(library.isLinked(0x11223344));
+    EXPECT_TRUE(library.isLinked(Library::StringType("Shared Folder")));
+    EXPECT_FALSE(library.getFolderFor(0x55667788, result));
+
+    // the incomplete cache isn't stored, so the next startup finds the link as well
+    EXPECT_TRUE(DummyLibraryFile::getTestEnv().otherFiles_["library.idx"].empty());
+    Library library2;
+    EXPECT_TRUE(library2.getFolderFor(0x11223344, result));
+    EXPECT_EQ(result, "Shared Folder");
+
+    commonEndOfTestChecks();
+}
+
+TEST_F(Library_Fixture, w_cache_oneTagLinkedToTwoFolders)
+{
+    // a hand-edited library file can link the same tag to multiple folders.
+    // The tag leads to the first folder, but all folders count as linked.
+    DummyLibraryFile::getTestEnv().fileContents_ = "1A2B3C4D:First Folder\n1A2B3C4D:Second Folder\n";
+    DummyDirectoryIterator::getTestEnv().directoryEntries_ = {
+        { "First Folder",
+          DummyDirectoryIterator::Entry::Type::directory,
+          DummyDirectoryIterator::Entry::Hidden::no,
+          DummyDirectoryIterator::Entry::SystemFileOrDir::no,
+          DummyDirectoryIterator::Entry::Archived::no,
+          DummyDirectoryIterator::Entry::ReadOnly::no },
+        { "Second Folder",
+          DummyDirectoryIterator::Entry::Type::directory,
+          DummyDirectoryIterator::Entry::Hidden::no,
+          DummyDirectoryIterator::Entry::SystemFileOrDir::no,
+          DummyDirectoryIterator::Entry::Archived::no,
+          DummyDirectoryIterator::Entry::ReadOnly::no },
+    };
+    Library library;
+    EXPECT_TRUE(library.isLibraryFileValid());
+
+    Library::StringType result;
+    EXPECT_TRUE(library.getFolderFor(0x1A2B3C4D, result));
+    EXPECT_EQ(result, "First Folder");
+    EXPECT_TRUE(library.isLinked(Library::StringType("First Folder")));
+    EXPECT_TRUE(library.isLinked(Library::StringType("Second Folder")));
+    EXPECT_FALSE(library.getNextUnlinkedFolder(result));
+
+    // the incomplete cache isn't stored, so the next startup finds the link as well
+    EXPECT_TRUE(DummyLibraryFile::getTestEnv().otherFiles_["library.idx"].empty());
+    Library library2;
+    EXPECT_TRUE(library2.isLinked(Library::StringType("Second Folder")));
+
+    commonEndOfTestChecks();
+}
+
+TEST(LibraryCache, a_collisionsAndDuplicates)
+{
+    using CacheType = LibraryCache<8, 256>;
+    auto cache = std::make_unique<CacheType>();
+
+    // tags that differ only in their upper bits and would collide with a naive hash
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        const auto name = "Folder " + std::to_string(i);
+        EXPECT_EQ(cache->add(i << 24, name.c_str()), CacheType::AddResult::added);
+    }
+    EXPECT_EQ(cache->getNumLinks(), 8u);
+    EXPECT_EQ(cache->add(0x12345678, "One Too Many"), CacheType::AddResult::outOfMemory);
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        const auto name = "Folder " + std::to_string(i);
+        ASSERT_NE(cache->findFolderFor(i << 24), nullptr);
+        EXPECT_STREQ(cache->findFolderFor(i << 24), name.c_str());
+        EXPECT_TRUE(cache->containsFolder(name.c_str()));
+    }
+    EXPECT_EQ(cache->findFolderFor(1), nullptr);
+    EXPECT_FALSE(cache->containsTag(1));
+    EXPECT_FALSE(cache->containsFolder("Folder"));
+
+    EXPECT_EQ(cache->add(3 << 24, "Other Folder"), CacheType::AddResult::tagAlreadyInUse);
+    EXPECT_EQ(cache->add(0x12345678, "Folder 3"), CacheType::AddResult::folderAlreadyLinked);
+
+    cache->clear();
+    EXPECT_EQ(cache->getNumLinks(), 0u);
+    EXPECT_FALSE(cache->containsTag(3 << 24));
+}
+
+TEST_F(Library_Fixture, x_cache_corruptedCacheFileIsNotLoaded)
+{
+    // A cache file that was only partially written or is corrupted must never be
+    // loaded: invalid name offsets or tables without empty slots would make the
+    // lookups read past the names or loop forever.
+    using CacheType = LibraryCache<8, 256>;
+    auto cache = std::make_unique<CacheType>();
+    cache->add(0x01020304, "Folder A");
+    cache->add(0x05060708, "Folder B");
+    {
+        File cacheFile("library.idx");
+        ASSERT_TRUE(cacheFile.open(File::AccessMode::readWrite, File::OpenMode::createNewAllowOverwrite));
+        ASSERT_TRUE(cache->saveTo(cacheFile));
+    }
+    const std::string validFile = DummyLibraryFile::getTestEnv().otherFiles_["library.idx"];
+
+    const auto tryLoad = [&cache](const std::string& contents) {
+        DummyLibraryFile::getTestEnv().otherFiles_["library.idx"] = contents;
+        File cacheFile("library.idx");
+        EXPECT_TRUE(cacheFile.open(File::AccessMode::read, File::OpenMode::openIfExists));
+        const bool success = cache->loadFrom(cacheFile);
+        if (!success)
+        {
+            EXPECT_EQ(cache->getNumLinks(), 0u);
+        }
+        return success;
+    };
+    // the header is followed by the tag table, the name table and the names
+    constexpr size_t headerSize = 8 * sizeof(uint32_t);
+    constexpr size_t checksumOffset = headerSize - sizeof(uint32_t);
+    constexpr size_t tableSize = 16;
+    constexpr size_t nameTableOffset = headerSize + tableSize * 2 * sizeof(uint32_t);
+    // writes a valid checksum for the modified contents
+    const auto withChecksum = [](std::string contents) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = headerSize; i < contents.size(); i++)
+        {
+            hash ^= uint8_t(contents[i]);
+            hash *= 16777619u;
+        }
+        memcpy(&contents[checksumOffset], &hash, sizeof(hash));
+        return contents;
+    };
+
+    EXPECT_TRUE(tryLoad(validFile));
+    EXPECT_TRUE(tryLoad(withChecksum(validFile)));
+    EXPECT_STREQ(cache->findFolderFor(0x05060708), "Folder B");
+
+    // partially written
+    EXPECT_FALSE(tryLoad(validFile.substr(0, validFile.size() - 1)));
+    EXPECT_FALSE(tryLoad(validFile.substr(0, headerSize + 10)));
+    // a modified name
+    std::string contents = validFile;
+    contents[contents.size() - 3] = 'X';
+    EXPECT_FALSE(tryLoad(contents));
+
+    // these have a valid checksum, but invalid contents:
+    // the last name isn't terminated
+    contents = validFile;
+    contents.back() = 'X';
+    EXPECT_FALSE(tryLoad(withChecksum(contents)));
+    // a name offset past the names
+    size_t slot = 0;
+    while (contents.substr(nameTableOffset + slot * 4, 4) == std::string(4, char(0xFF)))
+        slot++;
+    contents = validFile;
+    contents[nameTableOffset + slot * 4] = char(100);
+    EXPECT_FALSE(tryLoad(withChecksum(contents)));
+    // no empty slot in the name table
+    contents = validFile;
+    for (size_t i = 0; i < tableSize; i++)
+        contents.replace(nameTableOffset + i * 4, 4, std::string(4, char(0)));
+    EXPECT_FALSE(tryLoad(withChecksum(contents)));
+
+    EXPECT_TRUE(tryLoad(validFile));
+    EXPECT_STREQ(cache->findFolderFor(0x01020304), "Folder A");
+}
+
+TEST_F(Library_Fixture, x_getNextUnlinked_resumesWhereItStopped)
+{
+    const auto makeFolder = [](const char* name) {
+        return DummyDirectoryIterator::Entry {
+            name,
+            DummyDirectoryIterator::Entry::Type::directory,
+            DummyDirectoryIterator::Entry::Hidden::no,
+            DummyDirectoryIterator::Entry::SystemFileOrDir::no,
+            DummyDirectoryIterator::Entry::Archived::no,
+            DummyDirectoryIterator::Entry::ReadOnly::no
+        };
+    };
+    auto& entries = DummyDirectoryIterator::getTestEnv().directoryEntries_;
+    entries = { makeFolder("A"), makeFolder("B"), makeFolder("C"), makeFolder("D") };
+    Library library;
+
+    // the same folder is returned until it's linked
+    Library::StringType path;
+    EXPECT_TRUE(library.getNextUnlinkedFolder(path));
+    EXPECT_STREQ(path, "A");
+    EXPECT_TRUE(library.getNextUnlinkedFolder(path));
+    EXPECT_STREQ(path, "A");
+    EXPECT_TRUE(library.storeLink(0x11111111, "A"));
+
+    // folders that were linked in the meantime are skipped
+    EXPECT_TRUE(library.storeLink(0x33333333, "C"));
+    EXPECT_TRUE(library.getNextUnlinkedFolder(path));
+    EXPECT_STREQ(path, "B");
+    EXPECT_TRUE(library.storeLink(0x22222222, "B"));
+    EXPECT_TRUE(library.getNextUnlinkedFolder(path));
+    EXPECT_STREQ(path, "D");
+
+    // linking all folders in sequence reads each directory entry only once
+    EXPECT_EQ(DummyDirectoryIterator::getTestEnv().numEntriesRead_, 4u);
+
+    // a folder that appeared before the current position is found by wrapping around
+    entries.insert(entries.begin(), makeFolder("0"));
+    EXPECT_TRUE(library.storeLink(0x44444444, "D"));
+    EXPECT_TRUE(library.getNextUnlinkedFolder(path));
+    EXPECT_STREQ(path, "0");
+    EXPECT_TRUE(library.storeLink(0x55555555, "0"));
+    EXPECT_FALSE(library.getNextUnlinkedFolder(path));
+    EXPECT_STREQ(path, "");
+    EXPECT_FALSE(library.getNextUnlinkedFolder(path));
+    EXPECT_STREQ(path, "");
+
+    commonEndOfTestChecks();
+}
+
+// ==============================================================
+// Benchmarks
+// ==============================================================
+
+namespace
+{
+    /** The lookup that was used before the library was cached. */
+    bool lineScanFolderFor(const RfidTagId& tag, Library::StringType& path)
+    {
+        File libFile("library.txt");
+        if (!libFile.open(File::AccessMode::read, File::OpenMode::openOrCreate))
+            return false;
+
+        FixedSizeStr<9> prefixStr = tag.asString();
+        prefixStr.append(':');
+        while (!libFile.isEndOfFile())
+        {
+            Library::StringType line;
+            if (!libFile.readLine(line))
+                return false;
+            if (line.startsWith(prefixStr))
+            {
+                line.removePrefix(9);
+                if (line.endsWith("\n"))
+                    line.removeSuffix(1);
+                path = line;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** The unlinked folder search that was used before the library was cached.
+     *  It restarts at the first directory entry and scans the library file
+     *  for every folder it visits.
+     */
+    bool legacyGetNextUnlinkedFolder(Library::StringType& path)
+    {
+        DirectoryIterator iterator("");
+        while (iterator.isValid())
+        {
+            path = iterator.getName();
+            if (iterator.isDirectory() && !iterator.isHidden() && (path[0] != '.'))
+            {
+                bool isLinked = false;
+                File libFile("library.txt");
+                if (!libFile.open(File::AccessMode::read, File::OpenMode::openOrCreate))
+                    return false;
+                while (!libFile.isEndOfFile() && !isLinked)
+                {
+                    Library::StringType line;
+                    if (!libFile.readLine(line))
+                        return false;
+                    line.removePrefix(9);
+                    if (line.endsWith("\n"))
+                        line.removeSuffix(1);
+                    isLinked = (line == path);
+                }
+                if (!isLinked)
+                    return true;
+            }
+            iterator.advance();
+        }
+        path = "";
+        return false;
+    }
+} // namespace
+
+TEST_F(Library_Fixture, y_benchmark_10kLinks)
+{
+    // Compares the lookups of the Library, configured like on the target, with
+    // the line scan that was used before, for a library with 10k links.
+    // The cache only holds the first links; lookups for all others still scan
+    // the library file.
+    constexpr size_t numLinks = 10000;
+    auto& testEnv = DummyLibraryFile::getTestEnv();
+    const auto getName = [](size_t i) { return "Audiobook collection, volume " + std::to_string(i); };
+
+    std::vector<uint32_t> tags;
+    std::string& contents = testEnv.fileContents_;
+    for (size_t i = 0; i < numLinks; i++)
+    {
+        // spread the tags randomly-ish across the entire ID range
+        const uint32_t tag = uint32_t(i * 2654435761u);
+        tags.push_back(tag);
+        contents += RfidTagId(tag).asString().c_str();
+        contents += ":" + getName(i) + "\n";
+    }
+    const std::string allLinks = contents;
+
+    // the number of links whose names fit into the cache
+    size_t numCachedLinks = 0;
+    size_t namesSize = 0;
+    while ((numCachedLinks < Library::maxNumCachedLinks_)
+           && (namesSize + getName(numCachedLinks).size() + 1 <= Library::cacheNameArenaSize_))
+        namesSize += getName(numCachedLinks++).size() + 1;
+
+    // the library file is read once on startup
+    testEnv.numOpenCalls_ = 0;
+    testEnv.numBytesRead_ = 0;
+    auto startupStart = std::chrono::steady_clock::now();
+    Library library;
+    const auto startupTimeUs = Benchmark::getMicrosecondsSince(startupStart);
+    EXPECT_TRUE(library.isLibraryFileValid());
+    EXPECT_EQ(testEnv.numBytesRead_, contents.size());
+
+    // the cached links are served from RAM
+    testEnv.numOpenCalls_ = 0;
+    testEnv.numBytesRead_ = 0;
+    Library::StringType folder;
+    auto cachedLookupStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numCachedLinks; i++)
+    {
+        ASSERT_TRUE(library.getFolderFor(tags[i], folder));
+        ASSERT_EQ(folder, getName(i).c_str());
+    }
+    const auto cachedLookupTimeUs = Benchmark::getMicrosecondsSince(cachedLookupStart) / double(numCachedLinks);
+    EXPECT_EQ(testEnv.numOpenCalls_, 0);
+    EXPECT_EQ(testEnv.numBytesRead_, 0u);
+
+    // All other links are looked up by scanning the library file, just like before.
+    // For these tags, that's more than half of the file.
+    constexpr size_t numLineScans = 20;
+    std::vector<size_t> uncachedIndices;
+    for (size_t i = 0; i < numLineScans; i++)
+        uncachedIndices.push_back(numLinks - 1 - i * ((numLinks - numCachedLinks) / numLineScans));
+    testEnv.numOpenCalls_ = 0;
+    testEnv.numBytesRead_ = 0;
+    auto uncachedLookupStart = std::chrono::steady_clock::now();
+    for (const auto i : uncachedIndices)
+    {
+        ASSERT_TRUE(library.getFolderFor(tags[i], folder));
+        ASSERT_EQ(folder, getName(i).c_str());
+    }
+    const auto uncachedLookupTimeUs = Benchmark::getMicrosecondsSince(uncachedLookupStart) / double(numLineScans);
+    EXPECT_EQ(testEnv.numOpenCalls_, int(numLineScans));
+    EXPECT_GT(testEnv.numBytesRead_ / numLineScans, contents.size() / 2);
+
+    auto lineScanStart = std::chrono::steady_clock::now();
+    for (const auto i : uncachedIndices)
+        ASSERT_TRUE(lineScanFolderFor(tags[i], folder));
+    const auto lineScanTimeUs = Benchmark::getMicrosecondsSince(lineScanStart) / double(numLineScans);
+
+    // Up to numCachedLinks links, the cache is complete and no lookup touches
+    // the card, not even for unknown tags. One link more and it does.
+    for (const size_t numLinksInFile : { numCachedLinks, numCachedLinks + 1 })
+    {
+        contents = allLinks.substr(0, allLinks.find(getName(numLinksInFile - 1) + "\n") + getName(numLinksInFile - 1).size() + 1);
+        testEnv.otherFiles_.clear();
+        Library smallLibrary;
+        testEnv.numOpenCalls_ = 0;
+        EXPECT_FALSE(smallLibrary.getFolderFor(0x00000001, folder));
+        EXPECT_EQ(testEnv.numOpenCalls_, (numLinksInFile > numCachedLinks) ? 1 : 0) << numLinksInFile << " links";
+    }
+    // with the names above, the name arena limits the cache
+    EXPECT_LT(numCachedLinks, Library::maxNumCachedLinks_);
+
+    if (Benchmark::isEnabled())
+        std::cout << "[ BENCH    ] " << numLinks << " links, the cache holds all links up to "
+                  << numCachedLinks << " links: "
+                  << "startup " << startupTimeUs << " us, "
+                  << "cached lookup " << cachedLookupTimeUs << " us/lookup, "
+                  << "uncached lookup " << uncachedLookupTimeUs << " us/lookup, "
+                  << "line scan before " << lineScanTimeUs << " us/lookup" << std::endl;
+}
+
+TEST_F(Library_Fixture, z_benchmark_2000Folders)
+{
+    // Compares the startup (library construction + first search for an unlinked
+    // folder) and a linking session with the old and new implementation for a
+    // memory card with 2000 folders in the root directory.
+    constexpr size_t numFolders = 2000;
+    constexpr size_t numLinkedFolders = 100; // the first folders are linked already
+    constexpr size_t numFoldersToLink = 10;
+    static_assert(numLinkedFolders + numFoldersToLink <= Library::maxNumCachedLinks_,
+                  "All links must fit into the cache");
+
+    auto& entries = DummyDirectoryIterator::getTestEnv().directoryEntries_;
+    std::string initialContents;
+    for (size_t i = 0; i < numFolders; i++)
+    {
+        const auto name = "Audiobook collection, volume " + std::to_string(i);
+        entries.push_back({ name,
+                            DummyDirectoryIterator::Entry::Type::directory,
+                            DummyDirectoryIterator::Entry::Hidden::no,
+                            DummyDirectoryIterator::Entry::SystemFileOrDir::no,
+                            DummyDirectoryIterator::Entry::Archived::no,
+                            DummyDirectoryIterator::Entry::ReadOnly::no });
+        if (i < numLinkedFolders)
+        {
+            initialContents += RfidTagId(uint32_t(0x10000000 + i)).asString().c_str();
+            initialContents += ":" + name + "\n";
+        }
+    }
+    auto& testEnv = DummyLibraryFile::getTestEnv();
+    std::string& contents = testEnv.fileContents_;
+
+    // old implementation
+    contents = initialContents;
+    auto legacyStart = std::chrono::steady_clock::now();
+    Library::StringType path;
+    ASSERT_TRUE(legacyGetNextUnlinkedFolder(path));
+    const auto legacyStartupTimeUs = Benchmark::getMicrosecondsSince(legacyStart);
+    const auto legacyStartupBytesRead = testEnv.numBytesRead_;
+    for (size_t i = 0; i < numFoldersToLink; i++)
+    {
+        ASSERT_TRUE(legacyGetNextUnlinkedFolder(path));
+        ASSERT_EQ(path, ("Audiobook collection, volume " + std::to_string(numLinkedFolders + i)).c_str());
+        contents += RfidTagId(uint32_t(0x20000000 + i)).asString().c_str();
+        contents += std::string(":") + path.c_str() + "\n";
+    }
+    const auto legacyTotalTimeUs = Benchmark::getMicrosecondsSince(legacyStart);
+    const auto legacyNumEntriesRead = DummyDirectoryIterator::getTestEnv().numEntriesRead_;
+    const auto legacyNumOpenCalls = testEnv.numOpenCalls_;
+    const auto legacyNumBytesRead = testEnv.numBytesRead_;
+
+    // new implementation
+    contents = initialContents;
+    testEnv.otherFiles_.clear();
+    testEnv.numOpenCalls_ = 0;
+    testEnv.numBytesRead_ = 0;
+    DummyDirectoryIterator::getTestEnv().numEntriesRead_ = 0;
+    auto start = std::chrono::steady_clock::now();
+    Library library;
+    ASSERT_TRUE(library.getNextUnlinkedFolder(path));
+    const auto startupTimeUs = Benchmark::getMicrosecondsSince(start);
+    const auto startupBytesRead = testEnv.numBytesRead_;
+    for (size_t i = 0; i < numFoldersToLink; i++)
+    {
+        ASSERT_TRUE(library.getNextUnlinkedFolder(path));
+        ASSERT_EQ(path, ("Audiobook collection, volume " + std::to_string(numLinkedFolders + i)).c_str());
+        ASSERT_TRUE(library.storeLink(uint32_t(0x20000000 + i), path));
+    }
+    const auto totalTimeUs = Benchmark::getMicrosecondsSince(start);
+    const auto numEntriesRead = DummyDirectoryIterator::getTestEnv().numEntriesRead_;
+
+    if (Benchmark::isEnabled())
+        std::cout << "[ BENCH    ] " << numFolders << " folders, " << numLinkedFolders << " links: "
+                  << "startup " << legacyStartupTimeUs << " us -> " << startupTimeUs << " us, "
+                  << "linking " << numFoldersToLink << " folders "
+                  << legacyTotalTimeUs << " us -> " << totalTimeUs << " us" << std::endl;
+
+    // The old implementation scans the library file for each folder it visits.
+    // The new one reads the library file once on startup and only looks at
+    // each folder once.
+    EXPECT_GT(legacyNumEntriesRead, (numFoldersToLink + 1) * numLinkedFolders);
+    EXPECT_EQ(numEntriesRead, numLinkedFolders + numFoldersToLink);
+    EXPECT_EQ(startupBytesRead, initialContents.size());
+    EXPECT_GT(legacyStartupBytesRead, numLinkedFolders * initialContents.size() / 2);
+    EXPECT_LT(testEnv.numOpenCalls_, legacyNumOpenCalls / 10);
+    EXPECT_LT(testEnv.numBytesRead_, legacyNumBytesRead / 10);
+}
@@ -1,5 +1,11 @@
 #include <gtest/gtest.h>
 #include "LockFreeFifo.h"
+#include "Benchmark.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
 
 class LockFreeFifo_Fixture : public ::testing::Test
 {
@@ -217,4 +223,167 @@ TEST_F(LockFreeFifo_Fixture, f_writeSingleReadSingle)
     EXPECT_TRUE(fifo_.writeSingle(0));
     EXPECT_FALSE(fifo_.writeSingle(1)); // is now full
     EXPECT_TRUE(fifo_.isFull());
-}
\ No newline at end of file
+}
+
+// ==============================================================
+// AtomicLockFreeFifo
+// ==============================================================
+
+class AtomicLockFreeFifo_Fixture : public ::testing::Test
+{
+protected:
+    static constexpr int fifoSize_ = 64;
+    AtomicLockFreeFifo<int, fifoSize_> fifo_;
+};
+
+TEST_F(AtomicLockFreeFifo_Fixture, a_emptyAfterInit)
+{
+    EXPECT_EQ(fifo_.getSize(), fifoSize_);
+    EXPECT_TRUE(fifo_.isEmpty());
+    EXPECT_FALSE(fifo_.isFull());
+    EXPECT_EQ(fifo_.getNumReady(), 0);
+    EXPECT_EQ(fifo_.getNumFree(), fifoSize_);
+}
+
+TEST_F(AtomicLockFreeFifo_Fixture, b_writeAndReadWrapping)
+{
+    int* block1 = nullptr;
+    int blockSize1 = 0;
+    int* block2 = nullptr;
+    int blockSize2 = 0;
+
+    // move the indices close to the end of the buffer
+    const int numToLeaveAtEndOfBuffer = 5;
+    fifo_.prepareWrite(fifoSize_ - numToLeaveAtEndOfBuffer, block1, blockSize1, block2, blockSize2);
+    fifo_.finishWrite(fifoSize_ - numToLeaveAtEndOfBuffer);
+    fifo_.prepareRead(fifoSize_ - numToLeaveAtEndOfBuffer, block1, blockSize1, block2, blockSize2);
+    fifo_.finishRead(fifoSize_ - numToLeaveAtEndOfBuffer);
+    EXPECT_TRUE(fifo_.isEmpty());
+
+    // all values of the buffer can be used
+    fifo_.prepareWrite(fifoSize_ + 10, block1, blockSize1, block2, blockSize2);
+    ASSERT_EQ(blockSize1, numToLeaveAtEndOfBuffer);
+    ASSERT_EQ(blockSize2, fifoSize_ - numToLeaveAtEndOfBuffer);
+    EXPECT_EQ(block2 + blockSize2, block1);
+    for (int i = 0; i < blockSize1; i++)
+        block1[i] = i;
+    for (int i = 0; i < blockSize2; i++)
+        block2[i] = blockSize1 + i;
+    fifo_.finishWrite(fifoSize_);
+    EXPECT_TRUE(fifo_.isFull());
+    EXPECT_FALSE(fifo_.writeSingle(0));
+
+    for (int i = 0; i < fifoSize_; i++)
+    {
+        int value = -1;
+        EXPECT_TRUE(fifo_.readSingle(value));
+        EXPECT_EQ(value, i);
+    }
+    int value = -1;
+    EXPECT_FALSE(fifo_.readSingle(value));
+    EXPECT_TRUE(fifo_.isEmpty());
+}
+
+TEST_F(AtomicLockFreeFifo_Fixture, c_writeBulkReadBulk)
+{
+    std::vector<int> values(fifoSize_ + 10);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = int(i);
+
+    // many times around the buffer, with sizes that don't line up with it
+    int numWritten = 0;
+    int numRead = 0;
+    std::vector<int> valuesRead(fifoSize_);
+    for (int i = 0; i < 100; i++)
+    {
+        const int numToWrite = 1 + (i * 7) % int(values.size());
+        const int expectedNumWritten = std::min(numToWrite, fifoSize_ - (numWritten - numRead));
+        EXPECT_EQ(fifo_.writeBulk(values.data(), numToWrite), expectedNumWritten);
+        numWritten += expectedNumWritten;
+
+        const int numToRead = 1 + (i * 11) % fifoSize_;
+        const int numReadNow = fifo_.readBulk(valuesRead.data(), numToRead);
+        EXPECT_EQ(numReadNow, std::min(numToRead, numWritten - numRead));
+        numRead += numReadNow;
+        EXPECT_EQ(fifo_.getNumReady(), numWritten - numRead);
+    }
+    EXPECT_GT(numRead, 10 * fifoSize_);
+
+    fifo_.clear();
+    EXPECT_EQ(fifo_.writeBulk(values.data(), 10), 10);
+    EXPECT_EQ(fifo_.readBulk(valuesRead.data(), 20), 10);
+    for (int i = 0; i < 10; i++)
+        EXPECT_EQ(valuesRead[i], i);
+}
+
+// A writer and a reader thread pass a sequence of numbers through the fifo.
+// Meant to be run under ThreadSanitizer, too: `make tsan`
+TEST(AtomicLockFreeFifo, d_twoThreadStressTest)
+{
+    static constexpr int fifoSize = 1024;
+    static constexpr uint32_t numValues = 1 << 22;
+    auto fifo = std::make_unique<AtomicLockFreeFifo<uint32_t, fifoSize>>();
+
+    const auto start = std::chrono::steady_clock::now();
+    std::thread writer([&fifo]() {
+        std::vector<uint32_t> values(fifoSize);
+        uint32_t nextValue = 0;
+        int chunkSize = 1;
+        while (nextValue < numValues)
+        {
+            // all ways of writing, with changing sizes
+            chunkSize = (chunkSize * 5 + 3) % fifoSize + 1;
+            const int numToWrite = int(std::min(uint32_t(chunkSize), numValues - nextValue));
+            if (numToWrite == 1)
+            {
+                if (fifo->writeSingle(nextValue))
+                    nextValue++;
+            }
+            else
+            {
+                for (int i = 0; i < numToWrite; i++)
+                    values[i] = nextValue + uint32_t(i);
+                nextValue += uint32_t(fifo->writeBulk(values.data(), numToWrite));
+            }
+            if (fifo->isFull())
+                std::this_thread::yield();
+        }
+    });
+
+    std::vector<uint32_t> values(fifoSize);
+    uint32_t expectedValue = 0;
+    uint32_t numErrors = 0;
+    int chunkSize = 1;
+    while (expectedValue < numValues)
+    {
+        chunkSize = (chunkSize * 3 + 1) % fifoSize + 1;
+        if (chunkSize % 2 == 0)
+        {
+            const int numRead = fifo->readBulk(values.data(), chunkSize);
+            for (int i = 0; i < numRead; i++)
+                numErrors += (values[i] != expectedValue++) ? 1 : 0;
+        }
+        else
+        {
+            uint32_t* block1 = nullptr;
+            int blockSize1 = 0;
+            uint32_t* block2 = nullptr;
+            int blockSize2 = 0;
+            fifo->prepareRead(chunkSize, block1, blockSize1, block2, blockSize2);
+            for (int i = 0; i < blockSize1; i++)
+                numErrors += (block1[i] != expectedValue++) ? 1 : 0;
+            for (int i = 0; i < blockSize2; i++)
+                numErrors += (block2[i] != expectedValue++) ? 1 : 0;
+            fifo->finishRead(blockSize1 + blockSize2);
+        }
+        if (fifo->isEmpty())
+            std::this_thread::yield();
+    }
+    writer.join();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    EXPECT_EQ(numErrors, 0u);
+    EXPECT_TRUE(fifo->isEmpty());
+    if (Benchmark::isEnabled())
+        std::cout << "[ BENCH    ] AtomicLockFreeFifo: " << int(numValues / seconds / 1000000) << " million values/s between two threads" << std::endl;
+}
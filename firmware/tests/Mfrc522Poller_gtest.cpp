@@ -0,0 +1,282 @@
+#include "Mfrc522Poller.h"
+#include <vector>
+#include <gtest/gtest.h>
+
+// ==============================================================
+// A simulated MFRC522 with a tag that may be on the reader
+// ==============================================================
+
+class SimulatedMfrc522
+{
+public:
+    using Poller = Mfrc522Poller<SimulatedMfrc522>;
+
+    void write(uint8_t reg, uint8_t value)
+    {
+        numAccesses_++;
+        switch (reg)
+        {
+            case Poller::command:
+                command_ = value;
+                break;
+            case Poller::comIrq:
+                // writing 0 to bit 7 clears the marked bits
+                if (!(value & 0x80))
+                    comIrq_ &= uint8_t(~value);
+                break;
+            case Poller::fifoLevel:
+                if (value & 0x80)
+                    fifo_.clear();
+                break;
+            case Poller::fifoData:
+                fifo_.push_back(value);
+                break;
+            case Poller::bitFraming:
+                bitFraming_ = value;
+                if ((value & 0x80) && (command_ == Poller::transceiveCommand))
+                    transceive();
+                break;
+            case Poller::txControl:
+                txControl_ = value;
+                numAntennaSwitches_++;
+                break;
+            default:
+                FAIL() << "unexpected register written: " << int(reg);
+        }
+    }
+
+    uint8_t read(uint8_t reg)
+    {
+        numAccesses_++;
+        switch (reg)
+        {
+            case Poller::comIrq:
+                // the answer arrives after a while
+                if (numComIrqReadsUntilDone_ > 0)
+                {
+                    numComIrqReadsUntilDone_--;
+                    return 0;
+                }
+                return comIrq_;
+            case Poller::error:
+                return error_;
+            case Poller::fifoLevel:
+                return uint8_t(fifo_.size());
+            case Poller::control:
+                return lastBits_;
+            case Poller::txControl:
+                return txControl_;
+            case Poller::fifoData:
+            {
+                if (fifo_.empty())
+                    return 0;
+                const uint8_t value = fifo_.front();
+                fifo_.erase(fifo_.begin());
+                return value;
+            }
+            default:
+                ADD_FAILURE() << "unexpected register read: " << int(reg);
+                return 0;
+        }
+    }
+
+    void writeFifo(const uint8_t* data, size_t numBytes)
+    {
+        numAccesses_++;
+        fifo_.insert(fifo_.end(), data, data + numBytes);
+    }
+
+    void readFifo(uint8_t* data, size_t numBytes)
+    {
+        numAccesses_++;
+        for (size_t i = 0; i < numBytes; i++)
+        {
+            data[i] = fifo_.empty() ? 0 : fifo_.front();
+            if (!fifo_.empty())
+                fifo_.erase(fifo_.begin());
+        }
+    }
+
+    bool isTagPresent_ = false;
+    uint8_t uid_[4] = { 0x12, 0x34, 0x56, 0x78 };
+    bool corruptChecksum_ = false;
+    bool isConnected_ = true;
+    int airTimeInReads_ = 3;
+
+    bool isAntennaOn() const { return (txControl_ & 0x03) == 0x03; }
+
+    int numAccesses_ = 0;
+    int numAntennaSwitches_ = 0;
+    std::vector<std::vector<uint8_t>> framesSent_;
+
+private:
+    void transceive()
+    {
+        const std::vector<uint8_t> frame = fifo_;
+        framesSent_.push_back(frame);
+        fifo_.clear();
+        error_ = 0;
+        lastBits_ = 0;
+        comIrq_ = 0;
+        if (!isConnected_)
+            return;
+        numComIrqReadsUntilDone_ = airTimeInReads_;
+
+        comIrq_ = Poller::txIrq;
+        if (!isTagPresent_ || !isAntennaOn())
+        {
+            comIrq_ |= Poller::timerIrq;
+            return;
+        }
+        if ((frame.size() == 1) && (frame[0] == 0x26) && ((bitFraming_ & 0x07) == 7))
+            fifo_ = { 0x04, 0x00 }; // ATQA
+        else if ((frame.size() == 2) && (frame[0] == 0x93) && (frame[1] == 0x20))
+        {
+            fifo_.assign(uid_, uid_ + 4);
+            fifo_.push_back(uint8_t(uid_[0] ^ uid_[1] ^ uid_[2] ^ uid_[3] ^ (corruptChecksum_ ? 1 : 0)));
+        }
+        else
+        {
+            comIrq_ |= Poller::timerIrq;
+            return;
+        }
+        comIrq_ |= Poller::rxIrq | Poller::idleIrq;
+    }
+
+    uint8_t command_ = 0;
+    uint8_t comIrq_ = 0;
+    uint8_t error_ = 0;
+    uint8_t bitFraming_ = 0;
+    uint8_t lastBits_ = 0;
+    uint8_t txControl_ = 0x80;
+    int numComIrqReadsUntilDone_ = 0;
+    std::vector<uint8_t> fifo_;
+};
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+class Mfrc522Poller_Fixture : public ::testing::Test
+{
+protected:
+    using Poller = SimulatedMfrc522::Poller;
+
+    /** Runs a poll to its end, calling step() once per ms */
+    Poller::Result poll()
+    {
+        poller_.startPoll(nowMs_);
+        numSteps_ = 0;
+        maxNumAccessesPerStep_ = 0;
+        while (true)
+        {
+            nowMs_++;
+            const int numAccessesBefore = reader_.numAccesses_;
+            const auto result = poller_.step(nowMs_);
+            numSteps_++;
+            maxNumAccessesPerStep_ = std::max(maxNumAccessesPerStep_, reader_.numAccesses_ - numAccessesBefore);
+            if (result != Poller::Result::busy)
+                return result;
+            if (numSteps_ > 1000)
+                return Poller::Result::busy;
+        }
+    }
+
+    SimulatedMfrc522 reader_;
+    Poller poller_ { reader_ };
+    uint32_t nowMs_ = 0;
+    int numSteps_ = 0;
+    int maxNumAccessesPerStep_ = 0;
+};
+
+TEST_F(Mfrc522Poller_Fixture, a_findsTag)
+{
+    EXPECT_TRUE(poller_.isIdle());
+    EXPECT_EQ(poller_.step(nowMs_), Poller::Result::idle);
+
+    reader_.isTagPresent_ = true;
+    EXPECT_EQ(poll(), Poller::Result::tagFound);
+    EXPECT_TRUE(poller_.isIdle());
+    // the same byte order as the id that was read into a uint32_t before
+    EXPECT_EQ(poller_.getTagId(), 0x78563412u);
+
+    // REQA, anticollision
+    ASSERT_EQ(reader_.framesSent_.size(), 2u);
+    EXPECT_EQ(reader_.framesSent_[0], (std::vector<uint8_t> { 0x26 }));
+    EXPECT_EQ(reader_.framesSent_[1], (std::vector<uint8_t> { 0x93, 0x20 }));
+
+    // the antenna was on only during the poll
+    EXPECT_FALSE(reader_.isAntennaOn());
+    EXPECT_EQ(reader_.numAntennaSwitches_, 2);
+
+    // again
+    reader_.uid_[0] = 0xAB;
+    EXPECT_EQ(poll(), Poller::Result::tagFound);
+    EXPECT_EQ(poller_.getTagId(), 0x785634ABu);
+}
+
+TEST_F(Mfrc522Poller_Fixture, b_noTag)
+{
+    EXPECT_EQ(poll(), Poller::Result::noTag);
+    // no need to send anything else than REQA
+    EXPECT_EQ(reader_.framesSent_.size(), 1u);
+    EXPECT_FALSE(reader_.isAntennaOn());
+}
+
+TEST_F(Mfrc522Poller_Fixture, c_neverWaitsForTheReader)
+{
+    // the reader takes a long time to answer
+    reader_.isTagPresent_ = true;
+    reader_.airTimeInReads_ = 10;
+    EXPECT_EQ(poll(), Poller::Result::tagFound);
+    // waiting for the antenna, then one step per register check,
+    // and only a few register accesses in each
+    EXPECT_EQ(numSteps_, int(Poller::antennaSettleTimeMs) + 1 + 2 * (10 + 1));
+    EXPECT_LE(maxNumAccessesPerStep_, 11);
+
+    // starting a poll is a few accesses as well
+    const int numAccessesBefore = reader_.numAccesses_;
+    poller_.startPoll(nowMs_);
+    EXPECT_EQ(reader_.numAccesses_ - numAccessesBefore, 2);
+
+    // starting again while running does nothing
+    poller_.startPoll(nowMs_);
+    EXPECT_EQ(reader_.numAccesses_ - numAccessesBefore, 2);
+}
+
+TEST_F(Mfrc522Poller_Fixture, f_waitsForTheTagToPowerUp)
+{
+    reader_.isTagPresent_ = true;
+    poller_.startPoll(nowMs_);
+    EXPECT_TRUE(reader_.isAntennaOn());
+    for (uint32_t i = 0; i <= Poller::antennaSettleTimeMs; i++)
+    {
+        const int numAccessesBefore = reader_.numAccesses_;
+        EXPECT_EQ(poller_.step(nowMs_ + i), Poller::Result::busy);
+        EXPECT_EQ(reader_.numAccesses_, numAccessesBefore);
+    }
+    EXPECT_EQ(reader_.framesSent_.size(), 0u);
+    EXPECT_EQ(poller_.step(nowMs_ + Poller::antennaSettleTimeMs + 1), Poller::Result::busy);
+    EXPECT_EQ(reader_.framesSent_.size(), 1u);
+}
+
+TEST_F(Mfrc522Poller_Fixture, d_invalidChecksum)
+{
+    reader_.isTagPresent_ = true;
+    reader_.corruptChecksum_ = true;
+    EXPECT_EQ(poll(), Poller::Result::noTag);
+    EXPECT_EQ(reader_.framesSent_.size(), 2u);
+}
+
+TEST_F(Mfrc522Poller_Fixture, e_readerNotResponding)
+{
+    reader_.isConnected_ = false;
+    EXPECT_EQ(poll(), Poller::Result::noTag);
+    EXPECT_EQ(uint32_t(numSteps_), Poller::antennaSettleTimeMs + 1 + Poller::commandTimeoutMs);
+    EXPECT_FALSE(reader_.isAntennaOn());
+
+    // works again afterwards
+    reader_.isConnected_ = true;
+    reader_.isTagPresent_ = true;
+    EXPECT_EQ(poll(), Poller::Result::tagFound);
+}
@@ -13,6 +13,7 @@ std::map<std::string, File::FactoryFunc> File::implFactories_;
 std::map<std::string, DirectoryIterator::FactoryFunc> DirectoryIterator::implFactories_;
 std::map<std::string, DummyLibraryFile::TestEnvironment> DummyLibraryFile::testEnvironments_;
 std::map<std::string, DummyDirectoryIterator::TestEnvironment> DummyDirectoryIterator::testEnvironments_;
+ProfilingStats Profiler::stats_[int(ProfilingZone::numZones)];
 
 // include various cpp files from the application directory
 #include "Library.cpp"
@@ -20,6 +21,10 @@ std::map<std::string, DummyDirectoryIterator::TestEnvironment> DummyDirectoryIte
 // specify some functions manually to make the linker happy
 // TODO: Include these int he Wunderkiste tests.
 void LED::setLed(LED::Pattern) {}
+void Power::setShutdownListener(ShutdownListener*) {}
 void Power::shutdownImmediately() {}
 void Power::enableOrResetAutoShutdownTimer() {}
 void Power::disableAutoShutdownTimer() {}
+bool Power::isAutoShutdownDue() { return false; }
+uint32_t Systick::getMsCounter() { return 0; }
+void Profiler::init() { Profiler::reset(); }
@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+#include "Mp3TestStream.h"
+#include "Benchmark.h"
+#include "mp3dec.h"
+#include "assembly.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+    struct DecodeResult
+    {
+        int numFramesDecoded = 0;
+        int numErrors = 0;
+        int sampleRate = 0;
+        int numChannels = 0;
+        /** Over all frames */
+        uint64_t numSamples = 0;
+        /** FNV-1a over all decoded samples */
+        uint32_t pcmChecksum = 2166136261u;
+        /** The time spent in MP3Decode() */
+        std::chrono::nanoseconds totalDecodeTime { 0 };
+        std::chrono::nanoseconds worstCaseDecodeTime { 0 };
+    };
+
+    DecodeResult decode(const std::vector<uint8_t>& stream)
+    {
+        DecodeResult result;
+        HMP3Decoder decoder = MP3InitDecoder();
+        EXPECT_NE(decoder, nullptr);
+        if (decoder == nullptr)
+            return result;
+
+        short pcm[MAX_NCHAN * MAX_NGRAN * MAX_NSAMP];
+        unsigned char* readPointer = const_cast<unsigned char*>(stream.data());
+        int numBytesLeft = int(stream.size());
+        while (numBytesLeft > 0)
+        {
+            const int offset = MP3FindSyncWord(readPointer, numBytesLeft);
+            if (offset < 0)
+                break;
+            readPointer += offset;
+            numBytesLeft -= offset;
+
+            const int numBytesLeftBefore = numBytesLeft;
+            const auto start = std::chrono::steady_clock::now();
+            const int err = MP3Decode(decoder, &readPointer, &numBytesLeft, pcm, 0);
+            const auto decodeTime = std::chrono::steady_clock::now() - start;
+            result.totalDecodeTime += decodeTime;
+            result.worstCaseDecodeTime = std::max(result.worstCaseDecodeTime, decodeTime);
+            if (err != ERR_MP3_NONE)
+            {
+                result.numErrors++;
+                // skip the frame or at least the sync word
+                if (numBytesLeft == numBytesLeftBefore)
+                {
+                    readPointer++;
+                    numBytesLeft--;
+                }
+                continue;
+            }
+
+            MP3FrameInfo frameInfo;
+            MP3GetLastFrameInfo(decoder, &frameInfo);
+            result.sampleRate = frameInfo.samprate;
+            result.numChannels = frameInfo.nChans;
+            result.numSamples += uint64_t(frameInfo.outputSamps);
+            for (int i = 0; i < frameInfo.outputSamps; i++)
+            {
+                result.pcmChecksum ^= uint8_t(pcm[i]);
+                result.pcmChecksum *= 16777619u;
+                result.pcmChecksum ^= uint8_t(uint16_t(pcm[i]) >> 8);
+                result.pcmChecksum *= 16777619u;
+            }
+            result.numFramesDecoded++;
+        }
+        MP3FreeDecoder(decoder);
+        return result;
+    }
+
+    /** A stream of the regression corpus and the checksum of its decoded PCM */
+    struct CorpusEntry
+    {
+        const char* name;
+        Mp3TestStream::Format format;
+        uint32_t pcmChecksum;
+    };
+
+    Mp3TestStream::Format makeFormat(Mp3TestStream::Version version,
+                                     int sampleRateIndex,
+                                     Mp3TestStream::ChannelMode channelMode,
+                                     int modeExtension,
+                                     int bitrateIndex,
+                                     bool isVbr = false,
+                                     int freeFormatBitrate = 0)
+    {
+        Mp3TestStream::Format format;
+        format.version = version;
+        format.sampleRateIndex = sampleRateIndex;
+        format.channelMode = channelMode;
+        format.modeExtension = modeExtension;
+        format.bitrateIndex = bitrateIndex;
+        format.isVbr = isVbr;
+        format.freeFormatBitrate = freeFormatBitrate;
+        format.numFrames = 100;
+        return format;
+    }
+
+    /** All versions, sample rates, channel modes and stereo tools, with constant,
+     *  variable and free format bitrates. The checksums were recorded with the
+     *  portable C arithmetic of this decoder, so they detect changes of its output,
+     *  but can't tell whether the output is correct: the streams aren't real encoded
+     *  audio and there's no reference decoder to compare with. */
+    std::vector<CorpusEntry> getCorpus()
+    {
+        using Version = Mp3TestStream::Version;
+        using Mode = Mp3TestStream::ChannelMode;
+        return {
+            { "MPEG-1 44.1kHz joint stereo (M/S) CBR 128kbps", makeFormat(Version::mpeg1, 0, Mode::jointStereo, 2, 9), 1397953166u },
+            { "MPEG-1 48kHz stereo CBR 320kbps", makeFormat(Version::mpeg1, 1, Mode::stereo, 0, 14), 3306885537u },
+            { "MPEG-1 32kHz mono CBR 64kbps", makeFormat(Version::mpeg1, 2, Mode::mono, 0, 5), 2091544285u },
+            { "MPEG-1 44.1kHz joint stereo (intensity) CBR 96kbps", makeFormat(Version::mpeg1, 0, Mode::jointStereo, 1, 7), 1488856364u },
+            { "MPEG-1 44.1kHz joint stereo (M/S + intensity) VBR", makeFormat(Version::mpeg1, 0, Mode::jointStereo, 3, 0, true), 238847242u },
+            { "MPEG-1 48kHz dual channel CBR 192kbps", makeFormat(Version::mpeg1, 1, Mode::dualChannel, 0, 11), 1689628041u },
+            { "MPEG-1 44.1kHz stereo free format 200kbps", makeFormat(Version::mpeg1, 0, Mode::stereo, 0, 0, false, 200), 1570266579u },
+            { "MPEG-2 22.05kHz mono CBR 64kbps", makeFormat(Version::mpeg2, 0, Mode::mono, 0, 8), 1061668518u },
+            { "MPEG-2 24kHz stereo CBR 96kbps", makeFormat(Version::mpeg2, 1, Mode::stereo, 0, 10), 739641225u },
+            { "MPEG-2 16kHz joint stereo (M/S + intensity) VBR", makeFormat(Version::mpeg2, 2, Mode::jointStereo, 3, 0, true), 4250907805u },
+            { "MPEG-2 22.05kHz joint stereo (intensity) CBR 48kbps", makeFormat(Version::mpeg2, 0, Mode::jointStereo, 1, 6), 775373955u },
+            { "MPEG-2.5 11.025kHz joint stereo (M/S) CBR 32kbps", makeFormat(Version::mpeg25, 0, Mode::jointStereo, 2, 4), 3439620426u },
+            { "MPEG-2.5 8kHz mono CBR 8kbps", makeFormat(Version::mpeg25, 2, Mode::mono, 0, 1), 1684116280u },
+            { "MPEG-2.5 12kHz stereo VBR", makeFormat(Version::mpeg25, 1, Mode::stereo, 0, 0, true), 2405263106u },
+        };
+    }
+
+    /** Edge cases and a few thousand pseudo random values for the arithmetic tests */
+    std::vector<int> getTestValues()
+    {
+        std::vector<int> values = { 0, 1, -1, 2, -2, 0x7FFF, -0x8000, 0x8000, -0x8001,
+                                    0x7FFFFFFF, int(0x80000000), 0x40000000, -0x40000000 };
+        uint32_t state = 12345;
+        for (int i = 0; i < 2000; i++)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            // random magnitudes: shift by 0..31
+            values.push_back(int32_t(state) >> (i % 32));
+        }
+        return values;
+    }
+} // namespace
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+// The arithmetic functions of the decoder that have a Cortex-M4 implementation in
+// assembly.h must return exactly the results of the 64 bit reference
+TEST(Mp3Decoder, a_arithmeticIsBitExact)
+{
+    const auto values = getTestValues();
+    for (const int x : values)
+    {
+        EXPECT_EQ(FASTABS(x), (x == int(0x80000000)) ? x : (x < 0 ? -x : x)) << x;
+
+        int expectedNumZeros = 0;
+        while ((expectedNumZeros < 32) && !((uint32_t(x) << expectedNumZeros) & 0x80000000u))
+            expectedNumZeros++;
+        EXPECT_EQ(CLZ(x), expectedNumZeros) << x;
+
+        for (size_t i = 0; i < values.size(); i += 97)
+        {
+            const int y = values[i];
+            const int64_t product = int64_t(x) * int64_t(y);
+            EXPECT_EQ(MULSHIFT32(x, y), int(product >> 32)) << x << " * " << y;
+
+            const int64_t sum = int64_t(uint64_t(int64_t(y) << 20) ^ uint64_t(x));
+            EXPECT_EQ(MADD64(sum, x, y), int64_t(uint64_t(sum) + uint64_t(product))) << x << " * " << y;
+            for (int n = 1; n < 32; n += 5)
+                EXPECT_EQ(SAR64(product, n), product / (int64_t(1) << n) - ((product % (int64_t(1) << n)) < 0 ? 1 : 0));
+        }
+    }
+}
+
+// Every stream of the corpus must decode to exactly the PCM that was recorded
+// with the portable C implementation of the decoder arithmetic
+TEST(Mp3Decoder, b_corpusMatchesRecordedChecksums)
+{
+    for (const auto& entry : getCorpus())
+    {
+        const auto& format = entry.format;
+        const auto result = decode(Mp3TestStream::generate(format));
+        EXPECT_EQ(result.numFramesDecoded + result.numErrors, format.numFrames) << entry.name;
+        // some frames of random data have invalid Huffman codes
+        EXPECT_GE(result.numFramesDecoded, format.numFrames * 8 / 10) << entry.name;
+        EXPECT_EQ(result.sampleRate, Mp3TestStream::getSampleRate(format.version, format.sampleRateIndex)) << entry.name;
+        EXPECT_EQ(result.numChannels, Mp3TestStream::getNumChannels(format)) << entry.name;
+        EXPECT_EQ(result.numSamples, uint64_t(result.numFramesDecoded) * uint64_t(Mp3TestStream::getNumSamplesPerFrame(format) * result.numChannels))
+            << entry.name;
+        EXPECT_EQ(result.pcmChecksum, entry.pcmChecksum) << entry.name;
+    }
+}
+
+TEST(Mp3Decoder, c_benchmark)
+{
+    // the default test run only checks that the whole corpus decodes
+    const int numRepetitions = Benchmark::isEnabled() ? 5 : 1;
+    for (const auto& entry : getCorpus())
+    {
+        const auto stream = Mp3TestStream::generate(entry.format);
+        std::chrono::nanoseconds totalDecodeTime { 0 };
+        std::chrono::nanoseconds worstCaseDecodeTime { 0 };
+        int numFrames = 0;
+        for (int i = 0; i < numRepetitions; i++)
+        {
+            const auto result = decode(stream);
+            totalDecodeTime += result.totalDecodeTime;
+            worstCaseDecodeTime = std::max(worstCaseDecodeTime, result.worstCaseDecodeTime);
+            numFrames += result.numFramesDecoded + result.numErrors;
+        }
+
+        const double seconds = std::chrono::duration<double>(totalDecodeTime).count();
+        // real time factor: how much faster than playback
+        const double playbackSeconds = double(numFrames) * Mp3TestStream::getNumSamplesPerFrame(entry.format)
+                                       / Mp3TestStream::getSampleRate(entry.format.version, entry.format.sampleRateIndex);
+        EXPECT_GT(numFrames, 0) << entry.name;
+        if (Benchmark::isEnabled())
+            std::cout << "[ BENCH    ] " << entry.name << ": "
+                      << int(numFrames / seconds) << " frames/s, "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(totalDecodeTime).count() / numFrames << " us per frame, worst case "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(worstCaseDecodeTime).count() << " us, "
+                      << int(playbackSeconds / seconds) << "x real time" << std::endl;
+    }
+}
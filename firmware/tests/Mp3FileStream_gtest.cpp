@@ -0,0 +1,153 @@
+#include "DummyLibraryFile.h"
+#include "AudioFileStream.h"
+#include "Mp3TestStream.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+// the ID3 tag parser of the Mp3FileStream
+#include "AudioFileStream.cpp"
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+class Mp3FileStream_Fixture : public ::testing::Test
+{
+protected:
+    Mp3FileStream_Fixture()
+    {
+        DummyLibraryFile::initTestEnv();
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        File::implFactories_[testName] = [](const char* filePath) {
+            return std::make_unique<DummyLibraryFile>(filePath);
+        };
+    }
+
+    ~Mp3FileStream_Fixture()
+    {
+        const auto testName = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        File::implFactories_.erase(testName);
+        DummyLibraryFile::deleteTestEnv();
+    }
+
+    void createFile(const Mp3TestStream::Format& format)
+    {
+        const auto stream = Mp3TestStream::generate(format);
+        DummyLibraryFile::getTestEnv().otherFiles_[filePath_] = std::string(stream.begin(), stream.end());
+    }
+
+    /** Plays the file to the end with calls to fillBuffer() of `chunkSize` samples.
+     *  Seeks to `seekPositionSeconds` first, if it's positive. */
+    static std::vector<AudioSampleType> play(int chunkSize, float seekPositionSeconds = 0.0f)
+    {
+        auto stream = std::make_unique<Mp3FileStream>();
+        EXPECT_TRUE(stream->restartWithFile(filePath_));
+        if (seekPositionSeconds > 0.0f)
+        {
+            EXPECT_TRUE(stream->seekToSeconds(seekPositionSeconds));
+        }
+
+        std::vector<AudioSampleType> samples;
+        while (true)
+        {
+            const size_t numSamplesBefore = samples.size();
+            samples.resize(numSamplesBefore + size_t(chunkSize));
+            const int numSamplesWritten = stream->fillBuffer(&samples[numSamplesBefore], chunkSize);
+            samples.resize(numSamplesBefore + size_t(numSamplesWritten));
+            if (numSamplesWritten < chunkSize)
+                break;
+        }
+        return samples;
+    }
+
+    /** Smaller than a frame: all frames are decoded to the internal buffer and copied */
+    static constexpr int smallChunkSize_ = 100;
+    /** The size of the AudioStreamPlayer fifo: most frames are decoded straight into it */
+    static constexpr int largeChunkSize_ = 0x3FFF;
+    static constexpr const char* filePath_ = "test.mp3";
+};
+
+TEST_F(Mp3FileStream_Fixture, a_decodesStraightIntoLargeBuffers)
+{
+    Mp3TestStream::Format format;
+    format.numFrames = 40;
+    createFile(format);
+
+    const auto copiedSamples = play(smallChunkSize_);
+    const auto samples = play(largeChunkSize_);
+    // frames of random data with invalid Huffman codes are played as silence
+    EXPECT_EQ(copiedSamples.size(), size_t(format.numFrames * 2304));
+    EXPECT_EQ(samples, copiedSamples);
+}
+
+TEST_F(Mp3FileStream_Fixture, b_trimsFramesDecodedIntoTheOutput)
+{
+    Mp3TestStream::Format format;
+    format.numFrames = 40;
+    createFile(format);
+
+    // after the seek, the start of the first frame is dropped
+    const auto copiedSamples = play(smallChunkSize_, 0.25f);
+    const auto samples = play(largeChunkSize_, 0.25f);
+    EXPECT_GT(copiedSamples.size(), 0u);
+    EXPECT_EQ(copiedSamples.size() % 2, 0u);
+    EXPECT_EQ(samples, copiedSamples);
+}
+
+TEST_F(Mp3FileStream_Fixture, c_duplicatesMonoInTheOutput)
+{
+    Mp3TestStream::Format format;
+    format.version = Mp3TestStream::Version::mpeg2;
+    format.channelMode = Mp3TestStream::ChannelMode::mono;
+    format.modeExtension = 0;
+    format.bitrateIndex = 8;
+    format.numFrames = 40;
+    createFile(format);
+
+    const auto copiedSamples = play(smallChunkSize_);
+    const auto samples = play(largeChunkSize_);
+    EXPECT_GT(copiedSamples.size(), 0u);
+    EXPECT_EQ(samples, copiedSamples);
+    for (size_t i = 0; i < samples.size(); i += 2)
+        ASSERT_EQ(samples[i], samples[i + 1]) << i;
+}
+
+TEST_F(Mp3FileStream_Fixture, d_countsFramesAfterAnEstimatedSeek)
+{
+    // VBR without a Xing header: the position of the seek is estimated from the bitrate of the first frame
+    Mp3TestStream::Format format;
+    format.isVbr = true;
+    format.numFrames = 600;
+    createFile(format);
+    const float seekPositionSeconds = 10.0f;
+
+    const auto samples = play(largeChunkSize_);
+    ASSERT_EQ(samples.size(), size_t(format.numFrames * 2304));
+    const float numSecondsInFile = float(samples.size() / 2) / 44100.0f;
+
+    auto stream = std::make_unique<Mp3FileStream>();
+    ASSERT_TRUE(stream->restartWithFile(filePath_));
+    ASSERT_TRUE(stream->seekToSeconds(seekPositionSeconds));
+    AudioSampleType buffer[smallChunkSize_];
+    size_t numSamplesAfterSeek = 0;
+    size_t numSamplesWithEstimate = 0;
+    int numSamplesWritten = 0;
+    do
+    {
+        numSamplesWritten = stream->fillBuffer(buffer, smallChunkSize_);
+        numSamplesAfterSeek += size_t(numSamplesWritten);
+        // the estimate is never reported as the position
+        if (stream->getNumSecondsPlayed() == seekPositionSeconds)
+            numSamplesWithEstimate = numSamplesAfterSeek;
+    } while (numSamplesWritten == smallChunkSize_);
+
+    // the frame headers were counted while a few frames were played...
+    EXPECT_GT(numSamplesWithEstimate, 2304u);
+    EXPECT_LT(numSamplesWithEstimate, 20u * 2304u);
+    // ... and the estimate was off, but the position is exact again
+    const auto numSamplesFromEstimate = samples.size() - size_t(2 * seekPositionSeconds * 44100.0f);
+    EXPECT_NE(numSamplesAfterSeek, numSamplesFromEstimate);
+    EXPECT_FLOAT_EQ(stream->getNumSecondsPlayed(), numSecondsInFile);
+}
@@ -0,0 +1,278 @@
+#include <gtest/gtest.h>
+#include "Mp3FrameHeader.h"
+#include "GaplessTrimmer.h"
+#include <vector>
+
+namespace
+{
+    // MPEG1 layer III, 128kbps, 44.1kHz, stereo, no CRC, no padding
+    const uint8_t mpeg1Header[4] = { 0xFF, 0xFB, 0x90, 0x00 };
+    // MPEG2 layer III, 64kbps, 22.05kHz, mono, no CRC, no padding
+    const uint8_t mpeg2MonoHeader[4] = { 0xFF, 0xF3, 0x80, 0xC0 };
+
+    void writeUint32(std::vector<uint8_t>& frame, size_t position, uint32_t value)
+    {
+        frame[position + 0] = uint8_t(value >> 24);
+        frame[position + 1] = uint8_t(value >> 16);
+        frame[position + 2] = uint8_t(value >> 8);
+        frame[position + 3] = uint8_t(value);
+    }
+
+    /** Builds a Xing/Info frame like LAME writes it. */
+    std::vector<uint8_t> makeXingFrame(const uint8_t* header,
+                                       const char* tag,
+                                       uint32_t numFrames,
+                                       bool withToc,
+                                       int encoderDelay,
+                                       int encoderPadding)
+    {
+        Mp3FrameHeader parsedHeader;
+        parsedHeader.parse(header, 4);
+        std::vector<uint8_t> frame(parsedHeader.frameSize, 0);
+        memcpy(frame.data(), header, 4);
+
+        size_t position = Mp3FrameHeader::headerSize + parsedHeader.getSideInfoSize();
+        memcpy(&frame[position], tag, 4);
+        writeUint32(frame, position + 4, 0x01 | 0x02 | (withToc ? 0x04 : 0) | 0x08);
+        position += 8;
+        writeUint32(frame, position, numFrames);
+        position += 4;
+        writeUint32(frame, position, numFrames * uint32_t(parsedHeader.frameSize));
+        position += 4;
+        if (withToc)
+        {
+            for (size_t i = 0; i < Mp3XingHeader::tocSize; i++)
+                frame[position + i] = uint8_t(i * 256 / Mp3XingHeader::tocSize);
+            position += Mp3XingHeader::tocSize;
+        }
+        position += 4; // quality
+
+        memcpy(&frame[position], "LAME3.100", 9);
+        frame[position + 21] = uint8_t(encoderDelay >> 4);
+        frame[position + 22] = uint8_t(((encoderDelay & 0x0F) << 4) | (encoderPadding >> 8));
+        frame[position + 23] = uint8_t(encoderPadding);
+        return frame;
+    }
+
+    /** Builds a VBRI frame like the Fraunhofer encoder writes it, with a seek table
+     *  of `entrySizes` (in bytes, one entry per `numFramesPerEntry` frames). */
+    std::vector<uint8_t> makeVbriFrame(const std::vector<uint32_t>& entrySizes, uint32_t numFramesPerEntry)
+    {
+        Mp3FrameHeader parsedHeader;
+        parsedHeader.parse(mpeg1Header, 4);
+        std::vector<uint8_t> frame(parsedHeader.frameSize, 0);
+        memcpy(frame.data(), mpeg1Header, 4);
+
+        const size_t position = 4 + 32;
+        memcpy(&frame[position], "VBRI", 4);
+        uint32_t numBytes = 0;
+        for (const auto size : entrySizes)
+            numBytes += size;
+        writeUint32(frame, position + 10, numBytes);
+        writeUint32(frame, position + 14, uint32_t(entrySizes.size()) * numFramesPerEntry);
+        frame[position + 19] = uint8_t(entrySizes.size());
+        frame[position + 21] = 2; // scale
+        frame[position + 23] = 2; // entry size
+        frame[position + 25] = uint8_t(numFramesPerEntry);
+        for (size_t i = 0; i < entrySizes.size(); i++)
+        {
+            frame[position + 26 + 2 * i] = uint8_t((entrySizes[i] / 2) >> 8);
+            frame[position + 27 + 2 * i] = uint8_t(entrySizes[i] / 2);
+        }
+        return frame;
+    }
+} // namespace
+
+TEST(Mp3FrameHeader, a_parse)
+{
+    Mp3FrameHeader header;
+    ASSERT_TRUE(header.parse(mpeg1Header, 4));
+    EXPECT_EQ(header.version, Mp3FrameHeader::Version::mpeg1);
+    EXPECT_FALSE(header.isMono);
+    EXPECT_FALSE(header.hasCrc);
+    EXPECT_EQ(header.bitrateKbps, 128);
+    EXPECT_EQ(header.sampleRate, 44100);
+    EXPECT_EQ(header.samplesPerFrame, 1152);
+    EXPECT_EQ(header.frameSize, 417u);
+    EXPECT_EQ(header.getSideInfoSize(), 32u);
+
+    // the padding bit adds a byte
+    const uint8_t paddedHeader[4] = { 0xFF, 0xFB, 0x92, 0x00 };
+    ASSERT_TRUE(header.parse(paddedHeader, 4));
+    EXPECT_EQ(header.frameSize, 418u);
+
+    ASSERT_TRUE(header.parse(mpeg2MonoHeader, 4));
+    EXPECT_EQ(header.version, Mp3FrameHeader::Version::mpeg2);
+    EXPECT_TRUE(header.isMono);
+    EXPECT_EQ(header.bitrateKbps, 64);
+    EXPECT_EQ(header.sampleRate, 22050);
+    EXPECT_EQ(header.samplesPerFrame, 576);
+    EXPECT_EQ(header.frameSize, 208u);
+    EXPECT_EQ(header.getSideInfoSize(), 9u);
+
+    // invalid headers
+    const uint8_t noSync[4] = { 0xFF, 0x1B, 0x90, 0x00 };
+    const uint8_t layer2[4] = { 0xFF, 0xFD, 0x90, 0x00 };
+    const uint8_t freeFormat[4] = { 0xFF, 0xFB, 0x00, 0x00 };
+    const uint8_t badSampleRate[4] = { 0xFF, 0xFB, 0x9C, 0x00 };
+    EXPECT_FALSE(header.parse(noSync, 4));
+    EXPECT_FALSE(header.parse(layer2, 4));
+    EXPECT_FALSE(header.parse(freeFormat, 4));
+    EXPECT_FALSE(header.parse(badSampleRate, 4));
+    EXPECT_FALSE(header.parse(mpeg1Header, 3));
+}
+
+TEST(Mp3XingHeader, a_parseLameTag)
+{
+    for (const char* tag : { "Xing", "Info" })
+    {
+        const auto frame = makeXingFrame(mpeg1Header, tag, 1234, true, 576, 1260);
+        Mp3FrameHeader header;
+        ASSERT_TRUE(header.parse(frame.data(), frame.size()));
+        Mp3XingHeader xingHeader;
+        ASSERT_TRUE(xingHeader.parse(header, frame.data(), frame.size()));
+        EXPECT_EQ(xingHeader.numFrames, 1234u);
+        EXPECT_EQ(xingHeader.numBytes, 1234u * 417u);
+        EXPECT_TRUE(xingHeader.hasToc);
+        EXPECT_EQ(xingHeader.toc[50], 128);
+        EXPECT_TRUE(xingHeader.hasEncoderDelayAndPadding);
+        EXPECT_EQ(xingHeader.encoderDelay, 576);
+        EXPECT_EQ(xingHeader.encoderPadding, 1260);
+    }
+
+    // mono MPEG2 has a shorter side info; no TOC
+    const auto frame = makeXingFrame(mpeg2MonoHeader, "Xing", 99, false, 0xABC, 0x123);
+    Mp3FrameHeader header;
+    ASSERT_TRUE(header.parse(frame.data(), frame.size()));
+    Mp3XingHeader xingHeader;
+    ASSERT_TRUE(xingHeader.parse(header, frame.data(), frame.size()));
+    EXPECT_EQ(xingHeader.numFrames, 99u);
+    EXPECT_FALSE(xingHeader.hasToc);
+    EXPECT_EQ(xingHeader.encoderDelay, 0xABC);
+    EXPECT_EQ(xingHeader.encoderPadding, 0x123);
+}
+
+TEST(Mp3XingHeader, b_noXingOrLameTag)
+{
+    Mp3FrameHeader header;
+    ASSERT_TRUE(header.parse(mpeg1Header, 4));
+
+    // a regular audio frame
+    std::vector<uint8_t> frame(header.frameSize, 0x55);
+    memcpy(frame.data(), mpeg1Header, 4);
+    Mp3XingHeader xingHeader;
+    EXPECT_FALSE(xingHeader.parse(header, frame.data(), frame.size()));
+
+    // Xing header written by another encoder: no LAME extension
+    frame = makeXingFrame(mpeg1Header, "Xing", 10, false, 576, 1260);
+    const size_t lameTagPosition = 4 + 32 + 8 + 4 + 4 + 4;
+    memcpy(&frame[lameTagPosition], "ABCD", 4);
+    ASSERT_TRUE(xingHeader.parse(header, frame.data(), frame.size()));
+    EXPECT_EQ(xingHeader.numFrames, 10u);
+    EXPECT_FALSE(xingHeader.hasEncoderDelayAndPadding);
+
+    // truncated frame
+    EXPECT_FALSE(xingHeader.parse(header, frame.data(), 4 + 32 + 4));
+}
+
+TEST(Mp3FrameHeader, b_isFrameOfSameStream)
+{
+    Mp3FrameHeader header;
+    ASSERT_TRUE(header.parse(mpeg1Header, 4));
+
+    // two frames in a row
+    std::vector<uint8_t> data(2 * header.frameSize, 0x55);
+    memcpy(&data[0], mpeg1Header, 4);
+    memcpy(&data[header.frameSize], mpeg1Header, 4);
+    EXPECT_TRUE(header.isFrameOfSameStream(data.data(), data.size()));
+    // the last frame of the stream
+    EXPECT_TRUE(header.isFrameOfSameStream(data.data(), header.frameSize));
+
+    // a sync word in the audio data isn't followed by another frame
+    memcpy(&data[100], mpeg1Header, 4);
+    EXPECT_FALSE(header.isFrameOfSameStream(&data[100], data.size() - 100));
+    // a frame of another stream
+    EXPECT_FALSE(header.isFrameOfSameStream(mpeg2MonoHeader, 4));
+}
+
+TEST(Mp3VbriHeader, a_parse)
+{
+    // 10 entries of 4 frames each, 100 bytes per frame in the first half and
+    // 300 bytes in the second half
+    std::vector<uint32_t> entrySizes(10, 400);
+    for (size_t i = 5; i < 10; i++)
+        entrySizes[i] = 1200;
+    const auto frame = makeVbriFrame(entrySizes, 4);
+    Mp3FrameHeader header;
+    ASSERT_TRUE(header.parse(frame.data(), frame.size()));
+
+    // not a Xing frame, but a VBRI frame
+    Mp3XingHeader xingHeader;
+    EXPECT_FALSE(xingHeader.parse(header, frame.data(), frame.size()));
+    Mp3VbriHeader vbriHeader;
+    ASSERT_TRUE(vbriHeader.parse(header, frame.data(), frame.size()));
+    EXPECT_EQ(vbriHeader.numFrames, 40u);
+    EXPECT_EQ(vbriHeader.numBytes, 8000u);
+    ASSERT_TRUE(vbriHeader.hasToc);
+
+    // the TOC has the same meaning as the Xing TOC
+    EXPECT_EQ(vbriHeader.toc[0], 0);
+    EXPECT_EQ(vbriHeader.toc[25], 1000 * 256 / 8000); // frame 10
+    EXPECT_EQ(vbriHeader.toc[50], 2000 * 256 / 8000); // frame 20
+    EXPECT_EQ(vbriHeader.toc[75], 5000 * 256 / 8000); // frame 30
+    EXPECT_EQ(vbriHeader.toc[99], 7700 * 256 / 8000); // frame 39
+    for (size_t i = 1; i < Mp3VbriHeader::tocSize; i++)
+        EXPECT_GE(vbriHeader.toc[i], vbriHeader.toc[i - 1]);
+
+    // a regular audio frame
+    std::vector<uint8_t> audioFrame(header.frameSize, 0x55);
+    memcpy(audioFrame.data(), mpeg1Header, 4);
+    EXPECT_FALSE(vbriHeader.parse(header, audioFrame.data(), audioFrame.size()));
+    // the seek table doesn't fit into the frame
+    EXPECT_TRUE(vbriHeader.parse(header, frame.data(), 4 + 32 + 26 + 4));
+    EXPECT_EQ(vbriHeader.numFrames, 40u);
+    EXPECT_FALSE(vbriHeader.hasToc);
+}
+
+TEST(GaplessTrimmer, a_trim)
+{
+    GaplessTrimmer trimmer;
+    int first = -1;
+    int num = -1;
+
+    // passes through everything after reset()
+    trimmer.trim(100, first, num);
+    EXPECT_EQ(first, 0);
+    EXPECT_EQ(num, 100);
+    EXPECT_FALSE(trimmer.isEndReached());
+
+    // skip 250, play 120 out of blocks of 100
+    trimmer.reset(250, 120);
+    std::vector<std::pair<int, int>> results;
+    for (int i = 0; i < 5; i++)
+    {
+        trimmer.trim(100, first, num);
+        results.emplace_back(first, num);
+    }
+    const std::vector<std::pair<int, int>> expected = { { 100, 0 }, { 100, 0 }, { 50, 50 }, { 0, 70 }, { 0, 0 } };
+    EXPECT_EQ(results, expected);
+    EXPECT_TRUE(trimmer.isEndReached());
+}
+
+TEST(GaplessTrimmer, b_skipWithoutEnd)
+{
+    // after a seek into a file without gapless information
+    GaplessTrimmer trimmer;
+    trimmer.reset(150);
+    int firstSampleToPlay = 0;
+    int numSamplesToPlay = 0;
+    trimmer.trim(100, firstSampleToPlay, numSamplesToPlay);
+    EXPECT_EQ(numSamplesToPlay, 0);
+    trimmer.trim(100, firstSampleToPlay, numSamplesToPlay);
+    EXPECT_EQ(firstSampleToPlay, 50);
+    EXPECT_EQ(numSamplesToPlay, 50);
+    trimmer.trim(100, firstSampleToPlay, numSamplesToPlay);
+    EXPECT_EQ(firstSampleToPlay, 0);
+    EXPECT_EQ(numSamplesToPlay, 100);
+    EXPECT_FALSE(trimmer.isEndReached());
+}
@@ -0,0 +1,361 @@
+#include <gtest/gtest.h>
+#include "Mp3SeekIndex.h"
+#include "Benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+    /** An MPEG1 layer III stream (44.1kHz, stereo) with random audio data, optionally
+     *  with a Xing or VBRI frame in front of the audio frames. */
+    class SyntheticStream
+    {
+    public:
+        enum class InfoFrame
+        {
+            none,
+            xing,
+            vbri
+        };
+
+        SyntheticStream(uint32_t numFrames, bool isVbr, InfoFrame infoFrame)
+        {
+            std::mt19937 random(numFrames);
+            if (infoFrame != InfoFrame::none)
+            {
+                Mp3FrameHeader header;
+                makeHeader(cbrBitrateIndex_, false, header);
+                data_.resize(header.frameSize, 0);
+            }
+            firstFramePosition_ = uint32_t(data_.size());
+
+            int bitrateIndex = cbrBitrateIndex_;
+            double paddingRemainder = 0.0;
+            for (uint32_t i = 0; i < numFrames; i++)
+            {
+                // VBR: the bitrate changes every now and then, like with music and speech
+                if (isVbr && (i % 300 == 0))
+                    bitrateIndex = 1 + int(random() % 14);
+
+                // pad like LAME: so that the average frame size is exact
+                Mp3FrameHeader header;
+                makeHeader(bitrateIndex, false, header);
+                const double exactFrameSize = 144000.0 * header.bitrateKbps / 44100.0;
+                paddingRemainder += exactFrameSize - double(header.frameSize);
+                const bool isPadded = paddingRemainder >= 1.0;
+                if (isPadded)
+                    paddingRemainder -= 1.0;
+
+                const uint8_t* headerBytes = makeHeader(bitrateIndex, isPadded, header);
+                framePositions_.push_back(uint32_t(data_.size()));
+                data_.insert(data_.end(), headerBytes, headerBytes + 4);
+                for (size_t j = 4; j < header.frameSize; j++)
+                    data_.push_back(uint8_t(random()));
+                // a sync word in the audio data, to be told apart from a frame header. Only
+                // in every other frame, so that it's never followed by another one.
+                if (i % 2 == 0)
+                {
+                    const size_t fakeHeaderPosition = 4 + random() % (header.frameSize - 8);
+                    std::copy(headerBytes, headerBytes + 4, &data_[framePositions_.back() + fakeHeaderPosition]);
+                }
+            }
+
+            if (infoFrame == InfoFrame::xing)
+                writeXingFrame();
+            else if (infoFrame == InfoFrame::vbri)
+                writeVbriFrame();
+            firstFrameHeader_.parse(&data_[firstFramePosition_], 4);
+            headerFrameHeader_.parse(data_.data(), 4);
+        }
+
+        /** Looks for the first frame header at or after `position`, like the
+         *  Mp3FileStream after a seek, and returns the index of that frame. */
+        uint32_t resync(uint32_t position, uint32_t& numBytesSkipped) const
+        {
+            numBytesSkipped = 0;
+            while ((position < data_.size())
+                   && !firstFrameHeader_.isFrameOfSameStream(&data_[position], data_.size() - position))
+            {
+                position++;
+                numBytesSkipped++;
+            }
+            if (position >= data_.size())
+                return getNumFrames();
+            const auto it = std::lower_bound(framePositions_.begin(), framePositions_.end(), position);
+            EXPECT_TRUE((it != framePositions_.end()) && (*it == position)) << "resynced to " << position;
+            return uint32_t(it - framePositions_.begin());
+        }
+
+        /** Sets up `index` like the Mp3FileStream does after opening the file. */
+        void setupIndex(Mp3SeekIndex& index) const
+        {
+            const Mp3FrameHeader& header = (firstFramePosition_ > 0) ? headerFrameHeader_ : firstFrameHeader_;
+            index.reset(header, firstFramePosition_, uint32_t(data_.size()));
+            if (xingNumBytes_ > 0)
+                index.setSeekTable(getNumFrames(), xingNumBytes_, toc_, 0);
+            else if (vbriHeader_.hasToc)
+                index.setSeekTable(vbriHeader_.numFrames, vbriHeader_.numBytes, vbriHeader_.toc, firstFramePosition_);
+        }
+
+        uint32_t getNumFrames() const { return uint32_t(framePositions_.size()); }
+        uint32_t getFramePosition(uint32_t frameIndex) const { return framePositions_[frameIndex]; }
+        const Mp3VbriHeader& getVbriHeader() const { return vbriHeader_; }
+
+    private:
+        static constexpr int cbrBitrateIndex_ = 9; // 128kbps
+
+        const uint8_t* makeHeader(int bitrateIndex, bool isPadded, Mp3FrameHeader& header)
+        {
+            headerBytes_[0] = 0xFF;
+            headerBytes_[1] = 0xFB;
+            headerBytes_[2] = uint8_t((bitrateIndex << 4) | (isPadded ? 0x02 : 0x00));
+            headerBytes_[3] = 0x00;
+            header.parse(headerBytes_, 4);
+            return headerBytes_;
+        }
+
+        void writeUint32(size_t position, uint32_t value)
+        {
+            for (int i = 0; i < 4; i++)
+                data_[position + size_t(i)] = uint8_t(value >> (24 - 8 * i));
+        }
+
+        /** A Xing frame like LAME writes it: the TOC is relative to the Xing frame */
+        void writeXingFrame()
+        {
+            Mp3FrameHeader header;
+            const uint8_t* headerBytes = makeHeader(cbrBitrateIndex_, false, header);
+            std::copy(headerBytes, headerBytes + 4, data_.begin());
+            xingNumBytes_ = uint32_t(data_.size());
+            for (size_t i = 0; i < Mp3XingHeader::tocSize; i++)
+            {
+                const uint32_t frameIndex = uint32_t(uint64_t(getNumFrames()) * i / Mp3XingHeader::tocSize);
+                toc_[i] = uint8_t(uint64_t(framePositions_[frameIndex]) * 256 / xingNumBytes_);
+            }
+            const size_t position = 4 + 32;
+            std::copy_n("Xing", 4, &data_[position]);
+            writeUint32(position + 4, 0x07);
+            writeUint32(position + 8, getNumFrames());
+            writeUint32(position + 12, xingNumBytes_);
+            std::copy(toc_, toc_ + Mp3XingHeader::tocSize, &data_[position + 16]);
+
+            Mp3XingHeader xingHeader;
+            EXPECT_TRUE(xingHeader.parse(header, data_.data(), data_.size()));
+            EXPECT_TRUE(xingHeader.hasToc);
+        }
+
+        /** A VBRI frame: the table holds the size of every few frames */
+        void writeVbriFrame()
+        {
+            Mp3FrameHeader header;
+            const uint8_t* headerBytes = makeHeader(cbrBitrateIndex_, false, header);
+            std::copy(headerBytes, headerBytes + 4, data_.begin());
+            const uint32_t numEntries = 80;
+            const uint32_t numFramesPerEntry = (getNumFrames() + numEntries - 1) / numEntries;
+            const size_t position = 4 + 32;
+            std::copy_n("VBRI", 4, &data_[position]);
+            writeUint32(position + 10, uint32_t(data_.size()) - firstFramePosition_);
+            writeUint32(position + 14, getNumFrames());
+            data_[position + 19] = uint8_t(numEntries);
+            data_[position + 21] = 1; // scale
+            data_[position + 23] = 4; // entry size
+            data_[position + 25] = uint8_t(numFramesPerEntry);
+            for (uint32_t i = 0; i < numEntries; i++)
+            {
+                const uint32_t first = std::min(i * numFramesPerEntry, getNumFrames());
+                const uint32_t last = std::min((i + 1) * numFramesPerEntry, getNumFrames());
+                const uint32_t firstPosition = framePositions_[first];
+                const uint32_t lastPosition = (last < getNumFrames()) ? framePositions_[last] : uint32_t(data_.size());
+                writeUint32(position + 26 + 4 * i, lastPosition - firstPosition);
+            }
+
+            EXPECT_TRUE(vbriHeader_.parse(header, data_.data(), data_.size()));
+            EXPECT_TRUE(vbriHeader_.hasToc);
+        }
+
+        std::vector<uint8_t> data_;
+        std::vector<uint32_t> framePositions_;
+        uint32_t firstFramePosition_ = 0;
+        Mp3FrameHeader firstFrameHeader_;
+        Mp3FrameHeader headerFrameHeader_;
+        uint8_t headerBytes_[4];
+        uint32_t xingNumBytes_ = 0;
+        uint8_t toc_[Mp3XingHeader::tocSize];
+        Mp3VbriHeader vbriHeader_;
+    };
+
+    struct SeekResult
+    {
+        uint32_t maxFrameError = 0;
+        uint32_t maxNumBytesSkipped = 0;
+        double averageFrameError = 0.0;
+    };
+
+    /** Seeks to random frames, resyncs and compares the frame found with the target. */
+    SeekResult seekToRandomFrames(const SyntheticStream& stream,
+                                  const Mp3SeekIndex& index,
+                                  uint32_t firstFrame,
+                                  uint32_t lastFrame)
+    {
+        std::mt19937 random(firstFrame + lastFrame);
+        SeekResult result;
+        const int numSeeks = 200;
+        for (int i = 0; i < numSeeks; i++)
+        {
+            const uint32_t frameIndex = firstFrame + uint32_t(random() % (lastFrame - firstFrame));
+            bool isExact = false;
+            const uint32_t position = index.getFramePosition(frameIndex, isExact);
+            uint32_t numBytesSkipped = 0;
+            const uint32_t foundFrameIndex = stream.resync(position, numBytesSkipped);
+            if (isExact)
+            {
+                EXPECT_EQ(foundFrameIndex, frameIndex);
+                EXPECT_EQ(numBytesSkipped, 0u);
+            }
+            const uint32_t frameError = uint32_t(std::abs(int(foundFrameIndex) - int(frameIndex)));
+            result.maxFrameError = std::max(result.maxFrameError, frameError);
+            result.maxNumBytesSkipped = std::max(result.maxNumBytesSkipped, numBytesSkipped);
+            result.averageFrameError += double(frameError) / numSeeks;
+        }
+        return result;
+    }
+
+    /** One frame is 1152 samples at 44.1kHz */
+    double toMs(double numFrames) { return numFrames * 1152.0 / 44.1; }
+} // namespace
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+TEST(Mp3SeekIndex, a_cbrWithoutInfoFrame)
+{
+    // one hour at 128kbps
+    const SyntheticStream stream(137800, false, SyntheticStream::InfoFrame::none);
+    Mp3SeekIndex index;
+    stream.setupIndex(index);
+
+    // the average frame size is exact, the padding is compensated
+    const auto result = seekToRandomFrames(stream, index, 0, stream.getNumFrames());
+    EXPECT_EQ(result.maxFrameError, 0u);
+    EXPECT_LE(result.maxNumBytesSkipped, 4u);
+
+    bool isExact = false;
+    EXPECT_EQ(index.getFramePosition(0, isExact), stream.getFramePosition(0));
+    EXPECT_TRUE(isExact);
+}
+
+TEST(Mp3SeekIndex, b_vbrWithXingToc)
+{
+    const SyntheticStream stream(20000, true, SyntheticStream::InfoFrame::xing);
+    Mp3SeekIndex index;
+    stream.setupIndex(index);
+    EXPECT_EQ(index.getNumFrames(), 20000u);
+
+    // the TOC has a resolution of 1% of the duration and 1/256 of the file size; the
+    // bitrate may change anywhere in between
+    const auto result = seekToRandomFrames(stream, index, 0, stream.getNumFrames());
+    EXPECT_LE(result.maxFrameError, stream.getNumFrames() / 50);
+    EXPECT_LE(result.maxNumBytesSkipped, 1441u);
+
+    // the first audio frame follows the Xing frame
+    bool isExact = false;
+    EXPECT_EQ(index.getFramePosition(0, isExact), stream.getFramePosition(0));
+    EXPECT_GT(stream.getFramePosition(0), 0u);
+}
+
+TEST(Mp3SeekIndex, c_vbrWithVbriToc)
+{
+    const SyntheticStream stream(20000, true, SyntheticStream::InfoFrame::vbri);
+    EXPECT_EQ(stream.getVbriHeader().numFrames, 20000u);
+    Mp3SeekIndex index;
+    stream.setupIndex(index);
+
+    const auto result = seekToRandomFrames(stream, index, 0, stream.getNumFrames());
+    EXPECT_LE(result.maxFrameError, stream.getNumFrames() / 50);
+    EXPECT_LE(result.maxNumBytesSkipped, 1441u);
+}
+
+TEST(Mp3SeekIndex, d_vbrRecordedWhilePlaying)
+{
+    // no seek table at all: the first frame header doesn't tell the average bitrate
+    const SyntheticStream stream(20000, true, SyntheticStream::InfoFrame::none);
+    Mp3SeekIndex index;
+    stream.setupIndex(index);
+
+    // play the first three quarters
+    const uint32_t numFramesPlayed = 15000;
+    for (uint32_t i = 0; i < numFramesPlayed; i++)
+        index.addFrame(i, stream.getFramePosition(i));
+    // frames out of order aren't recorded
+    index.addFrame(numFramesPlayed + 10, 0);
+
+    // the memory is bounded
+    const uint32_t numFramesPerEntry = index.getNumFramesPerEntry();
+    EXPECT_GE(numFramesPerEntry * Mp3SeekIndex::maxNumEntries, numFramesPlayed);
+    EXPECT_LT(numFramesPerEntry * Mp3SeekIndex::maxNumEntries / 2, numFramesPlayed);
+
+    // recorded frames are exact
+    bool isExact = false;
+    EXPECT_EQ(index.getFramePosition(numFramesPerEntry * 10, isExact), stream.getFramePosition(numFramesPerEntry * 10));
+    EXPECT_TRUE(isExact);
+    EXPECT_EQ(index.getFramePosition(numFramesPlayed - 1, isExact), stream.getFramePosition(numFramesPlayed - 1));
+    EXPECT_TRUE(isExact);
+
+    // interpolated between recorded frames
+    const auto played = seekToRandomFrames(stream, index, 0, numFramesPlayed);
+    EXPECT_LE(played.maxFrameError, numFramesPerEntry / 2);
+
+    // extrapolated with the average frame size so far: only a guess for VBR files
+    const auto notPlayed = seekToRandomFrames(stream, index, numFramesPlayed, stream.getNumFrames());
+    EXPECT_LE(notPlayed.maxFrameError, stream.getNumFrames() / 10);
+}
+
+TEST(Mp3SeekIndex, e_benchmark_seekAccuracy)
+{
+    struct Case
+    {
+        const char* name;
+        bool isVbr;
+        SyntheticStream::InfoFrame infoFrame;
+        uint32_t numFramesPlayed;
+    };
+    const Case cases[] = {
+        { "CBR", false, SyntheticStream::InfoFrame::none, 0 },
+        { "VBR, Xing TOC", true, SyntheticStream::InfoFrame::xing, 0 },
+        { "VBR, VBRI TOC", true, SyntheticStream::InfoFrame::vbri, 0 },
+        { "VBR, no TOC, half played", true, SyntheticStream::InfoFrame::none, 10000 },
+        { "VBR, no TOC, nothing played", true, SyntheticStream::InfoFrame::none, 0 },
+    };
+    for (const auto& c : cases)
+    {
+        const SyntheticStream stream(20000, c.isVbr, c.infoFrame);
+        Mp3SeekIndex index;
+        stream.setupIndex(index);
+        for (uint32_t i = 0; i < c.numFramesPlayed; i++)
+            index.addFrame(i, stream.getFramePosition(i));
+
+        // the work done by Mp3FileStream::seekToSeconds() before it returns
+        const int numLookups = 100000;
+        bool isExact = false;
+        uint64_t checksum = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < numLookups; i++)
+            checksum += index.getFramePosition(uint32_t(i) % stream.getNumFrames(), isExact);
+        const auto duration = std::chrono::steady_clock::now() - start;
+        const double nsPerLookup = double(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()) / numLookups;
+
+        const auto result = seekToRandomFrames(stream, index, 0, stream.getNumFrames());
+        if (Benchmark::isEnabled())
+            std::cout << "[ BENCH    ] " << c.name << ": " << nsPerLookup << " ns per lookup, "
+                      << "error avg " << toMs(result.averageFrameError) << " ms, max " << toMs(result.maxFrameError)
+                      << " ms, max " << result.maxNumBytesSkipped << " bytes to the next frame" << std::endl;
+        EXPECT_GT(checksum, 0u);
+        // the search for the next frame header needs at most one frame
+        EXPECT_LE(result.maxNumBytesSkipped, 1441u);
+    }
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/** Generates MPEG audio layer III streams for testing the decoder on the host.
+ *
+ *  The frame headers and the side information are valid and describe a wide mix
+ *  of block types, Huffman tables and gains. The main data is pseudo random, so
+ *  the decoder runs through scale factor decoding, Huffman decoding, dequantization,
+ *  stereo processing, IMDCT and the polyphase filter with "noisy" data that also
+ *  clips. The output isn't meant to sound like anything - it only has to be exactly
+ *  the same for every implementation of the decoder arithmetic.
+ *
+ *  Every frame has main_data_begin = 0, so frames never depend on the bit reservoir
+ *  of previous frames.
+ */
+class Mp3TestStream
+{
+public:
+    enum class Version
+    {
+        mpeg1,
+        mpeg2,
+        mpeg25
+    };
+
+    enum class ChannelMode
+    {
+        stereo = 0,
+        jointStereo = 1,
+        dualChannel = 2,
+        mono = 3
+    };
+
+    struct Format
+    {
+        Version version = Version::mpeg1;
+        /** 0..2, e.g. 44.1kHz, 48kHz, 32kHz for MPEG-1 */
+        int sampleRateIndex = 0;
+        ChannelMode channelMode = ChannelMode::jointStereo;
+        /** For jointStereo: bit 1 = mid/side stereo, bit 0 = intensity stereo */
+        int modeExtension = 2;
+        /** 1..14, or 0 for free format */
+        int bitrateIndex = 9;
+        /** For free format (bitrateIndex = 0): the bitrate in kbps that isn't in the table */
+        int freeFormatBitrate = 0;
+        /** Variable bitrate: a random bitrateIndex for each frame */
+        bool isVbr = false;
+        int numFrames = 50;
+        uint32_t seed = 1;
+    };
+
+    /** Returns the stream with all frames of the format */
+    static std::vector<uint8_t> generate(const Format& format)
+    {
+        Random random(format.seed);
+        std::vector<uint8_t> stream;
+        for (int i = 0; i < format.numFrames; i++)
+        {
+            const int bitrateIndex = format.isVbr ? random.next(1, 14) : format.bitrateIndex;
+            appendFrame(stream, format, bitrateIndex, random);
+        }
+        return stream;
+    }
+
+    /** Returns the bitrate in kbps */
+    static int getBitrate(Version version, int bitrateIndex)
+    {
+        static const int mpeg1Bitrates[15] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+        static const int mpeg2Bitrates[15] = { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 };
+        return (version == Version::mpeg1) ? mpeg1Bitrates[bitrateIndex] : mpeg2Bitrates[bitrateIndex];
+    }
+
+    static int getSampleRate(Version version, int sampleRateIndex)
+    {
+        static const int mpeg1SampleRates[3] = { 44100, 48000, 32000 };
+        const int divider = (version == Version::mpeg1) ? 1 : ((version == Version::mpeg2) ? 2 : 4);
+        return mpeg1SampleRates[sampleRateIndex] / divider;
+    }
+
+    static int getNumChannels(const Format& format) { return (format.channelMode == ChannelMode::mono) ? 1 : 2; }
+    static int getNumGranules(const Format& format) { return (format.version == Version::mpeg1) ? 2 : 1; }
+    static int getNumSamplesPerFrame(const Format& format) { return 576 * getNumGranules(format); }
+
+private:
+    /** A small, portable xorshift generator, so that streams are the same everywhere */
+    class Random
+    {
+    public:
+        Random(uint32_t seed) :
+            state_(seed * 2654435761u + 1) {}
+
+        uint32_t next()
+        {
+            state_ ^= state_ << 13;
+            state_ ^= state_ >> 17;
+            state_ ^= state_ << 5;
+            return state_;
+        }
+
+        /** Returns a number in [min, max] */
+        int next(int min, int max) { return min + int(next() % uint32_t(max - min + 1)); }
+
+    private:
+        uint32_t state_;
+    };
+
+    class BitWriter
+    {
+    public:
+        BitWriter(std::vector<uint8_t>& data, size_t startPosition) :
+            data_(data),
+            position_(startPosition * 8) {}
+
+        void write(uint32_t value, int numBits)
+        {
+            for (int bit = numBits - 1; bit >= 0; bit--)
+            {
+                const size_t byte = position_ / 8;
+                const int shift = 7 - int(position_ % 8);
+                data_[byte] = uint8_t((data_[byte] & ~(1 << shift)) | (((value >> bit) & 1) << shift));
+                position_++;
+            }
+        }
+
+    private:
+        std::vector<uint8_t>& data_;
+        size_t position_;
+    };
+
+    static int getSideInfoSize(const Format& format)
+    {
+        const bool isMono = getNumChannels(format) == 1;
+        if (format.version == Version::mpeg1)
+            return isMono ? 17 : 32;
+        return isMono ? 9 : 17;
+    }
+
+    static int getFrameSize(const Format& format, int bitrateKbps, int isPadded)
+    {
+        const int samplesPerFrameBy8 = getNumSamplesPerFrame(format) / 8;
+        return samplesPerFrameBy8 * bitrateKbps * 1000 / getSampleRate(format.version, format.sampleRateIndex) + isPadded;
+    }
+
+    static void appendFrame(std::vector<uint8_t>& stream, const Format& format, int bitrateIndex, Random& random)
+    {
+        const int isPadded = random.next(0, 1);
+        const int bitrate = (bitrateIndex == 0) ? format.freeFormatBitrate : getBitrate(format.version, bitrateIndex);
+        const int frameSize = getFrameSize(format, bitrate, isPadded);
+        const size_t frameStart = stream.size();
+        stream.resize(frameStart + size_t(frameSize));
+
+        // pseudo random main data
+        const int mainDataStart = 4 + getSideInfoSize(format);
+        for (int i = mainDataStart; i < frameSize; i++)
+            stream[frameStart + size_t(i)] = uint8_t(random.next());
+
+        BitWriter writer(stream, frameStart);
+        writeHeader(writer, format, bitrateIndex, isPadded);
+        writeSideInfo(writer, format, (frameSize - mainDataStart) * 8, random);
+    }
+
+    static void writeHeader(BitWriter& writer, const Format& format, int bitrateIndex, int isPadded)
+    {
+        writer.write(0x7FF, 11); // sync
+        writer.write((format.version == Version::mpeg1) ? 3 : ((format.version == Version::mpeg2) ? 2 : 0), 2);
+        writer.write(1, 2); // layer III
+        writer.write(1, 1); // no CRC
+        writer.write(uint32_t(bitrateIndex), 4);
+        writer.write(uint32_t(format.sampleRateIndex), 2);
+        writer.write(uint32_t(isPadded), 1);
+        writer.write(0, 1); // private
+        writer.write(uint32_t(format.channelMode), 2);
+        writer.write(uint32_t(format.modeExtension), 2);
+        writer.write(0, 1); // copyright
+        writer.write(1, 1); // original
+        writer.write(0, 2); // emphasis
+    }
+
+    static void writeSideInfo(BitWriter& writer, const Format& format, int numMainDataBits, Random& random)
+    {
+        const bool isMpeg1 = format.version == Version::mpeg1;
+        const int numChannels = getNumChannels(format);
+        const int numGranules = getNumGranules(format);
+
+        writer.write(0, isMpeg1 ? 9 : 8); // main_data_begin
+        if (isMpeg1)
+        {
+            writer.write(0, (numChannels == 1) ? 5 : 3); // private bits
+            for (int ch = 0; ch < numChannels; ch++)
+                writer.write(uint32_t(random.next(0, 15)), 4); // scfsi
+        }
+        else
+            writer.write(0, numChannels); // private bits
+
+        // share the main data between all granules and channels
+        const int numBitsPerChannel = numMainDataBits / (numGranules * numChannels);
+        for (int gr = 0; gr < numGranules; gr++)
+        {
+            for (int ch = 0; ch < numChannels; ch++)
+            {
+                const int part23Length = std::min(4095, random.next(numBitsPerChannel / 2, numBitsPerChannel));
+                writer.write(uint32_t(part23Length), 12);
+                // about 10 bits per pair of values leaves enough bits for scale factors and count1
+                writer.write(uint32_t(random.next(0, std::min(288, part23Length / 10))), 9); // big_values
+                writer.write(uint32_t(random.next(105, 155)), 8); // global_gain: some samples clip, but nothing overflows in the decoder
+                writer.write(uint32_t(random.next(0, isMpeg1 ? 15 : 511)), isMpeg1 ? 4 : 9); // scalefac_compress
+                const bool isWindowSwitching = random.next(0, 3) == 0;
+                writer.write(isWindowSwitching ? 1 : 0, 1);
+                if (isWindowSwitching)
+                {
+                    writer.write(uint32_t(random.next(1, 3)), 2); // block_type
+                    writer.write(uint32_t(random.next(0, 1)), 1); // mixed_block_flag
+                    for (int region = 0; region < 2; region++)
+                        writer.write(uint32_t(getRandomTable(random)), 5);
+                    for (int window = 0; window < 3; window++)
+                        writer.write(uint32_t(random.next(0, 7)), 3); // subblock_gain
+                }
+                else
+                {
+                    for (int region = 0; region < 3; region++)
+                        writer.write(uint32_t(getRandomTable(random)), 5);
+                    // the regions must end within the 22 scale factor bands
+                    const int region0Count = random.next(0, 15);
+                    writer.write(uint32_t(region0Count), 4);
+                    writer.write(uint32_t(random.next(0, std::min(7, 20 - region0Count))), 3); // region1_count
+                }
+                if (isMpeg1)
+                    writer.write(uint32_t(random.next(0, 1)), 1); // preflag
+                writer.write(uint32_t(random.next(0, 1)), 1); // scalefac_scale
+                writer.write(uint32_t(random.next(0, 1)), 1); // count1table_select
+            }
+        }
+    }
+
+    /** Returns a valid Huffman table: tables 4 and 14 don't exist */
+    static int getRandomTable(Random& random)
+    {
+        int table;
+        do
+            table = random.next(0, 31);
+        while ((table == 4) || (table == 14));
+        return table;
+    }
+};
@@ -0,0 +1,252 @@
+#include <gtest/gtest.h>
+#include "PolyphaseResampler.h"
+#include "Benchmark.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace
+{
+    /** Provides interleaved stereo samples from a vector, like a StereoAudioSampleStream. */
+    class VectorSource
+    {
+    public:
+        VectorSource(const std::vector<int16_t>& samples) :
+            samples_(samples),
+            position_(0)
+        {
+        }
+
+        int fillBuffer(int16_t* buffer, int bufferSize)
+        {
+            int numWritten = 0;
+            while ((numWritten < bufferSize) && (position_ < samples_.size()))
+                buffer[numWritten++] = samples_[position_++];
+            return numWritten;
+        }
+
+    private:
+        const std::vector<int16_t>& samples_;
+        size_t position_;
+    };
+
+    std::vector<int16_t> makeSine(double frequency, int sampleRate, int numFrames, double amplitude)
+    {
+        std::vector<int16_t> samples(2 * size_t(numFrames));
+        for (int i = 0; i < numFrames; i++)
+        {
+            const double value = amplitude * std::sin(2.0 * M_PI * frequency * i / sampleRate);
+            samples[2 * i] = int16_t(std::lround(value));
+            samples[2 * i + 1] = int16_t(std::lround(-value));
+        }
+        return samples;
+    }
+
+    std::vector<int16_t> resampleAll(PolyphaseResampler& resampler, const std::vector<int16_t>& input, int bufferSize)
+    {
+        VectorSource source(input);
+        std::vector<int16_t> output;
+        std::vector<int16_t> buffer(size_t(bufferSize), 0);
+        while (true)
+        {
+            const int numWritten = resampler.process(source, buffer.data(), bufferSize);
+            output.insert(output.end(), buffer.begin(), buffer.begin() + numWritten);
+            if (numWritten < bufferSize)
+                break;
+        }
+        return output;
+    }
+
+    /** Fits a sine of the given frequency to the left channel (skipping the
+     *  filter's settling time) and returns the signal to noise ratio in dB. */
+    double measureSnr(const std::vector<int16_t>& samples, double frequency, int sampleRate)
+    {
+        const size_t firstFrame = 256;
+        const size_t numFrames = samples.size() / 2 - 2 * firstFrame;
+        double sumSinSin = 0, sumCosCos = 0, sumSinCos = 0, sumSinX = 0, sumCosX = 0;
+        for (size_t i = firstFrame; i < firstFrame + numFrames; i++)
+        {
+            const double phase = 2.0 * M_PI * frequency * double(i) / sampleRate;
+            const double s = std::sin(phase);
+            const double c = std::cos(phase);
+            const double x = samples[2 * i];
+            sumSinSin += s * s;
+            sumCosCos += c * c;
+            sumSinCos += s * c;
+            sumSinX += s * x;
+            sumCosX += c * x;
+        }
+        // least squares fit x = a * sin + b * cos
+        const double determinant = sumSinSin * sumCosCos - sumSinCos * sumSinCos;
+        const double a = (sumSinX * sumCosCos - sumCosX * sumSinCos) / determinant;
+        const double b = (sumCosX * sumSinSin - sumSinX * sumSinCos) / determinant;
+        double signalEnergy = 0, noiseEnergy = 0;
+        for (size_t i = firstFrame; i < firstFrame + numFrames; i++)
+        {
+            const double phase = 2.0 * M_PI * frequency * double(i) / sampleRate;
+            const double fitted = a * std::sin(phase) + b * std::cos(phase);
+            const double error = samples[2 * i] - fitted;
+            signalEnergy += fitted * fitted;
+            noiseEnergy += error * error;
+        }
+        return 10.0 * std::log10(signalEnergy / noiseEnergy);
+    }
+
+    uint64_t readCycleCounter()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch())
+                            .count());
+#endif
+    }
+
+    const char* getName(PolyphaseResampler::Quality quality)
+    {
+        switch (quality)
+        {
+            case PolyphaseResampler::Quality::low:
+                return "low";
+            case PolyphaseResampler::Quality::medium:
+                return "medium";
+            case PolyphaseResampler::Quality::high:
+            default:
+                return "high";
+        }
+    }
+
+    const PolyphaseResampler::Quality allQualities[] = { PolyphaseResampler::Quality::low,
+                                                         PolyphaseResampler::Quality::medium,
+                                                         PolyphaseResampler::Quality::high };
+} // namespace
+
+TEST(PolyphaseResampler, a_rateAndDcGain)
+{
+    for (const auto quality : allQualities)
+    {
+        for (const auto& rates : std::vector<std::pair<int, int>> { { 44100, 48000 }, { 48000, 44100 }, { 8000, 48000 }, { 96000, 44100 } })
+        {
+            PolyphaseResampler resampler;
+            resampler.setQuality(quality);
+            ASSERT_TRUE(resampler.setSampleRates(rates.first, rates.second));
+
+            // one second of a constant value on the left, a negative constant on the right
+            std::vector<int16_t> input(2 * size_t(rates.first));
+            for (size_t i = 0; i < input.size(); i += 2)
+            {
+                input[i] = 10000;
+                input[i + 1] = -20000;
+            }
+            const auto output = resampleAll(resampler, input, 512);
+
+            // one second of output, except for the filter delay
+            const int numOutputFrames = int(output.size() / 2);
+            EXPECT_NEAR(numOutputFrames, rates.second, 64) << getName(quality) << " " << rates.first << "->" << rates.second;
+
+            // unity gain (after the filter has settled)
+            const size_t numSettlingFrames = 32 * size_t(std::max(1, rates.second / rates.first));
+            for (size_t i = 2 * numSettlingFrames; i < output.size(); i += 2)
+            {
+                ASSERT_NEAR(output[i], 10000, 2) << "at " << i;
+                ASSERT_NEAR(output[i + 1], -20000, 3) << "at " << i;
+            }
+        }
+    }
+
+    // invalid samplerates
+    PolyphaseResampler resampler;
+    EXPECT_FALSE(resampler.setSampleRates(0, 48000));
+    EXPECT_FALSE(resampler.setSampleRates(44100, -1));
+}
+
+TEST(PolyphaseResampler, b_sineQuality)
+{
+    // minimum signal-to-noise ratio for a 1kHz sine, per quality. The 16 bit
+    // input and output limit the SNR to about 90dB for this signal.
+    const double minSnr[] = { 55.0, 75.0, 75.0 };
+    for (const auto& rates : std::vector<std::pair<int, int>> { { 44100, 48000 }, { 48000, 44100 }, { 22050, 44100 }, { 32000, 48000 } })
+    {
+        const auto input = makeSine(1000.0, rates.first, rates.first / 2, 16000.0);
+        for (size_t q = 0; q < 3; q++)
+        {
+            PolyphaseResampler resampler;
+            resampler.setQuality(allQualities[q]);
+            ASSERT_TRUE(resampler.setSampleRates(rates.first, rates.second));
+            const auto output = resampleAll(resampler, input, 256);
+            const double snr = measureSnr(output, 1000.0, rates.second);
+            EXPECT_GT(snr, minSnr[q]) << getName(allQualities[q]) << " " << rates.first << "->" << rates.second;
+        }
+    }
+}
+
+TEST(PolyphaseResampler, c_bufferSizesAndSourcesDontMatter)
+{
+    const auto input1 = makeSine(440.0, 44100, 5000, 12000.0);
+    const auto input2 = makeSine(880.0, 44100, 7000, 8000.0);
+    std::vector<int16_t> bothInputs = input1;
+    bothInputs.insert(bothInputs.end(), input2.begin(), input2.end());
+
+    PolyphaseResampler reference;
+    reference.setSampleRates(44100, 48000);
+    const auto expected = resampleAll(reference, bothInputs, 1024);
+
+    // random, also odd, buffer sizes and the input split across two sources.
+    PolyphaseResampler resampler;
+    resampler.setSampleRates(44100, 48000);
+    std::mt19937 randomGenerator(1234);
+    std::uniform_int_distribution<int> bufferSizeDistribution(1, 37);
+    std::vector<int16_t> output;
+    for (const auto* input : { &input1, &input2 })
+    {
+        VectorSource source(*input);
+        int16_t buffer[37];
+        while (true)
+        {
+            const int bufferSize = bufferSizeDistribution(randomGenerator);
+            const int numWritten = resampler.process(source, buffer, bufferSize);
+            output.insert(output.end(), buffer, buffer + numWritten);
+            if (numWritten < bufferSize)
+                break;
+        }
+    }
+
+    // the output is the same (except that the reference may have an extra
+    // frame at the very end, because it stops at the end of a buffer)
+    ASSERT_GE(output.size(), expected.size() - 2);
+    ASSERT_LE(output.size(), expected.size() + 2);
+    for (size_t i = 0; i < std::min(output.size(), expected.size()); i++)
+        ASSERT_EQ(output[i], expected[i]) << "at " << i;
+}
+
+TEST(PolyphaseResampler, d_benchmark)
+{
+    const auto input = makeSine(1000.0, 44100, 44100 * 5, 16000.0);
+    int previousNumMacsPerSample = 0;
+    for (const auto quality : allQualities)
+    {
+        PolyphaseResampler resampler;
+        resampler.setQuality(quality);
+        resampler.setSampleRates(44100, 48000);
+
+        const auto start = readCycleCounter();
+        const auto output = resampleAll(resampler, input, 4096);
+        const auto end = readCycleCounter();
+
+        const double cyclesPerSample = double(end - start) / double(output.size() / 2);
+        const int numMacsPerSample = resampler.getNumTaps() * ((quality == PolyphaseResampler::Quality::low) ? 1 : 2);
+        if (Benchmark::isEnabled())
+            std::cout << "[ BENCH    ] PolyphaseResampler 44.1k->48k, quality " << getName(quality)
+                      << ": " << cyclesPerSample << " host cycles per output sample, "
+                      << numMacsPerSample << " multiply-accumulates per sample and channel" << std::endl;
+        // the host cycles depend on the load of the machine, the work done per sample doesn't
+        EXPECT_GT(numMacsPerSample, previousNumMacsPerSample);
+        previousNumMacsPerSample = numMacsPerSample;
+    }
+}
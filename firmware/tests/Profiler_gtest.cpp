@@ -0,0 +1,94 @@
+#include "Profiler.h"
+#include <chrono>
+#include <string>
+#include <thread>
+#include <gtest/gtest.h>
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+namespace
+{
+    /** Collects what's written to it, like a File opened for writing */
+    struct StringFile
+    {
+        bool write(const char* string)
+        {
+            contents += string;
+            return true;
+        }
+        std::string contents;
+    };
+} // namespace
+
+TEST(Profiler, a_statistics)
+{
+    Profiler::init();
+    EXPECT_EQ(Profiler::getStats(ProfilingZone::mp3Decode).count, 0u);
+
+    Profiler::addSample(ProfilingZone::mp3Decode, 1000);
+    Profiler::addSample(ProfilingZone::mp3Decode, 100);
+    Profiler::addSample(ProfilingZone::mp3Decode, 100000);
+    Profiler::addSample(ProfilingZone::mp3Decode, 0x80000000);
+
+    const auto& stats = Profiler::getStats(ProfilingZone::mp3Decode);
+    EXPECT_EQ(stats.count, 4u);
+    EXPECT_EQ(stats.min, 100u);
+    EXPECT_EQ(stats.max, 0x80000000u);
+    EXPECT_EQ(stats.getMean(), (1000u + 100u + 100000u + 0x80000000u) / 4);
+
+    // logarithmic bins, starting at 2^8 ticks
+    EXPECT_EQ(stats.histogram[0], 1u); // 100: below the first bin
+    EXPECT_EQ(stats.histogram[1], 1u); // 1000: 2^9 ... 2^10
+    EXPECT_EQ(stats.histogram[8], 1u); // 100000: 2^16 ... 2^17
+    EXPECT_EQ(stats.histogram[ProfilingStats::numHistogramBins - 1], 1u); // above the last bin
+
+    // other zones are separate
+    EXPECT_EQ(Profiler::getStats(ProfilingZone::audioIsr).count, 0u);
+
+    Profiler::reset();
+    EXPECT_EQ(Profiler::getStats(ProfilingZone::mp3Decode).count, 0u);
+    EXPECT_EQ(Profiler::getStats(ProfilingZone::mp3Decode).histogram[1], 0u);
+}
+
+TEST(Profiler, b_zoneMeasuresItsScope)
+{
+    Profiler::reset();
+    for (int i = 0; i < 3; i++)
+    {
+        PROFILE_ZONE(rfidRead);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    // host ticks are nanoseconds
+    const auto& stats = Profiler::getStats(ProfilingZone::rfidRead);
+    EXPECT_EQ(Profiler::getTicksPerSecond(), 1000000000u);
+    EXPECT_EQ(stats.count, 3u);
+    EXPECT_GE(stats.min, 2000000u);
+    EXPECT_GE(Profiler::toUs(stats.min), 2000u);
+    EXPECT_LE(stats.min, stats.getMean());
+    EXPECT_LE(stats.getMean(), stats.max);
+}
+
+TEST(Profiler, c_dumpTo)
+{
+    Profiler::reset();
+    Profiler::addSample(ProfilingZone::audioIsr, 3000);
+    Profiler::addSample(ProfilingZone::audioIsr, 5000);
+
+    StringFile file;
+    EXPECT_TRUE(Profiler::dumpTo(file));
+
+    // a header and one line per zone
+    size_t numLines = 0;
+    for (const char c : file.contents)
+        numLines += (c == '\n') ? 1 : 0;
+    EXPECT_EQ(numLines, 1u + size_t(ProfilingZone::numZones));
+    EXPECT_EQ(file.contents.find("zone; count; min [us]; mean [us]; max [us]; histogram\n"), 0u);
+    // bins: 3000 and 5000 ticks are both in 2^11 ... 2^13
+    EXPECT_NE(file.contents.find("\nAudioStreamPlayer::isrCallback; 2; 3; 4; 5; 0; 0; 0; 1; 1; 0; 0; 0; 0; 0; 0; 0; 0; 0; 0; 0\n"),
+              std::string::npos)
+        << file.contents;
+    EXPECT_NE(file.contents.find("\nMP3Decode; 0; 0; 0; 0; 0;"), std::string::npos);
+}
@@ -0,0 +1,138 @@
+#include "RfidTagTracker.h"
+#include <vector>
+#include <gtest/gtest.h>
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+class RfidTagTracker_Fixture : public ::testing::Test
+{
+protected:
+    /** Runs the tracker until `endMs`. Each poll takes pollDurationMs_ and finds `tagId`, if valid. */
+    void runUntil(uint32_t endMs, RfidTagId tag)
+    {
+        while (int32_t(endMs - nowMs_) > 0)
+        {
+            if (tracker_.isPollDue(nowMs_))
+            {
+                pollTimesMs_.push_back(nowMs_);
+                tracker_.pollStarted(nowMs_);
+                nowMs_ += pollDurationMs_;
+                tracker_.pollCompleted(nowMs_, tag.isValid(), uint32_t(tag), queue_);
+            }
+            else
+                nowMs_++;
+        }
+    }
+
+    std::vector<UiEvent> popEvents()
+    {
+        std::vector<UiEvent> events;
+        while (queue_.getNumEvents() > 0)
+            events.push_back(queue_.popEvent());
+        return events;
+    }
+
+    uint32_t nowMs_ = 1000;
+    uint32_t pollDurationMs_ = 8;
+    RfidTagTracker tracker_ { nowMs_ };
+    UiEventQueue queue_;
+    std::vector<uint32_t> pollTimesMs_;
+};
+
+TEST_F(RfidTagTracker_Fixture, a_tagAddedAndRemoved)
+{
+    // no tag: no events
+    runUntil(2000, RfidTagId::invalid());
+    EXPECT_EQ(queue_.getNumEvents(), 0u);
+    EXPECT_FALSE(tracker_.getCurrentTag().isValid());
+
+    // a tag is added once
+    runUntil(3000, 0x11223344);
+    auto events = popEvents();
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].type, UiEvent::Type::rfidTagAdded);
+    EXPECT_EQ(events[0].payload.asRfidTagId, 0x11223344u);
+    EXPECT_EQ(uint32_t(tracker_.getCurrentTag()), 0x11223344u);
+
+    // removed after the timeout
+    const uint32_t removedMs = nowMs_;
+    runUntil(removedMs + RfidTagTracker::tagRemovedTimeoutMs - 50, RfidTagId::invalid());
+    EXPECT_EQ(queue_.getNumEvents(), 0u);
+    runUntil(removedMs + RfidTagTracker::tagRemovedTimeoutMs + 100, RfidTagId::invalid());
+    events = popEvents();
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].type, UiEvent::Type::rfidTagRemoved);
+    EXPECT_FALSE(tracker_.getCurrentTag().isValid());
+}
+
+TEST_F(RfidTagTracker_Fixture, b_tagReplaced)
+{
+    runUntil(1500, 0x11223344);
+    popEvents();
+    runUntil(2000, 0x55667788);
+    const auto events = popEvents();
+    ASSERT_EQ(events.size(), 2u);
+    EXPECT_EQ(events[0].type, UiEvent::Type::rfidTagRemoved);
+    EXPECT_EQ(events[1].type, UiEvent::Type::rfidTagAdded);
+    EXPECT_EQ(events[1].payload.asRfidTagId, 0x55667788u);
+}
+
+TEST_F(RfidTagTracker_Fixture, c_shortDropoutsAreIgnored)
+{
+    runUntil(1500, 0x11223344);
+    popEvents();
+    // the tag isn't found for a while, but less than the timeout
+    runUntil(1800, RfidTagId::invalid());
+    runUntil(2500, 0x11223344);
+    EXPECT_EQ(queue_.getNumEvents(), 0u);
+}
+
+TEST_F(RfidTagTracker_Fixture, d_adaptivePollInterval)
+{
+    // searching: fast polls
+    runUntil(2000, RfidTagId::invalid());
+    EXPECT_EQ(tracker_.getPollIntervalMs(), RfidTagTracker::defaultSearchIntervalMs);
+    EXPECT_EQ(pollTimesMs_.size(), 1000 / RfidTagTracker::defaultSearchIntervalMs);
+
+    // a tag on the reader: slow polls
+    pollTimesMs_.clear();
+    runUntil(3000, 0x11223344);
+    EXPECT_EQ(tracker_.getPollIntervalMs(), RfidTagTracker::defaultPresenceCheckIntervalMs);
+    EXPECT_LE(pollTimesMs_.size(), 1000 / RfidTagTracker::defaultPresenceCheckIntervalMs + 1);
+    // still enough polls within the timeout to tolerate a failed one
+    EXPECT_GE(RfidTagTracker::tagRemovedTimeoutMs / RfidTagTracker::defaultPresenceCheckIntervalMs, 3u);
+
+    // the tag went missing: fast polls until it's found again or removed
+    runUntil(nowMs_ + RfidTagTracker::defaultPresenceCheckIntervalMs, RfidTagId::invalid());
+    EXPECT_EQ(tracker_.getPollIntervalMs(), RfidTagTracker::defaultSearchIntervalMs);
+    runUntil(nowMs_ + RfidTagTracker::defaultSearchIntervalMs, 0x11223344);
+    EXPECT_EQ(tracker_.getPollIntervalMs(), RfidTagTracker::defaultPresenceCheckIntervalMs);
+
+    // configurable
+    tracker_.setPollIntervalsMs(20, 200);
+    EXPECT_EQ(tracker_.getPollIntervalMs(), 200u);
+
+    // no new poll while one is running
+    tracker_.pollStarted(nowMs_);
+    EXPECT_FALSE(tracker_.isPollDue(nowMs_ + 1000));
+}
+
+TEST_F(RfidTagTracker_Fixture, e_stats)
+{
+    // 20 polls per second of 8ms each while searching
+    runUntil(3000, RfidTagId::invalid());
+    auto stats = tracker_.getStats();
+    EXPECT_NEAR(stats.numPollsPerSecond, 20u, 1u);
+    EXPECT_NEAR(stats.antennaOnPermille, 160u, 10u);
+    EXPECT_EQ(stats.estimatedCurrentUa,
+              RfidTagTracker::readerIdleCurrentUa
+                  + (RfidTagTracker::readerAntennaOnCurrentUa - RfidTagTracker::readerIdleCurrentUa) * stats.antennaOnPermille / 1000);
+
+    // fewer polls and less current with a tag on the reader
+    runUntil(6000, 0x11223344);
+    const auto statsWithTag = tracker_.getStats();
+    EXPECT_NEAR(statsWithTag.numPollsPerSecond, 7u, 1u);
+    EXPECT_LT(statsWithTag.estimatedCurrentUa, stats.estimatedCurrentUa);
+}
@@ -0,0 +1,187 @@
+#include "Scheduler.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+// ==============================================================
+// A virtual clock and tasks that log when they run
+// ==============================================================
+
+class Scheduler_Fixture : public ::testing::Test
+{
+protected:
+    using SchedulerType = CooperativeScheduler<4>;
+
+    /** A task that records its name and advances the clock by its duration */
+    struct TestTask
+    {
+        Scheduler_Fixture* fixture;
+        std::string name;
+        uint32_t durationMs;
+    };
+
+    static void runTestTask(void* context)
+    {
+        auto* task = (TestTask*) context;
+        task->fixture->log_.push_back(task->name);
+        task->fixture->runTimesMs_[task->name].push_back(task->fixture->nowMs_);
+        task->fixture->nowMs_ += task->durationMs;
+    }
+
+    SchedulerType::TaskId add(TestTask& task, int priority, uint32_t intervalMs)
+    {
+        task.fixture = this;
+        return scheduler_.addTask(runTestTask, &task, priority, intervalMs, nowMs_);
+    }
+
+    /** Runs the scheduler until `endMs`, advancing the clock by 1ms when nothing is due */
+    void runUntil(uint32_t endMs)
+    {
+        while (int32_t(endMs - nowMs_) > 0)
+        {
+            if (!scheduler_.runNextTask(nowMs_))
+                nowMs_++;
+        }
+    }
+
+    uint32_t nowMs_ = 1000;
+    SchedulerType scheduler_;
+    std::vector<std::string> log_;
+    std::map<std::string, std::vector<uint32_t>> runTimesMs_;
+};
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+TEST_F(Scheduler_Fixture, a_runsDueTasksByPriority)
+{
+    TestTask low { nullptr, "low", 0 };
+    TestTask high { nullptr, "high", 0 };
+    TestTask medium { nullptr, "medium", 0 };
+    add(low, 0, 10);
+    add(high, 2, 10);
+    add(medium, 1, 10);
+
+    // all are due at the start
+    EXPECT_EQ(scheduler_.getTimeUntilNextTaskMs(nowMs_), 0u);
+    EXPECT_TRUE(scheduler_.runNextTask(nowMs_));
+    EXPECT_TRUE(scheduler_.runNextTask(nowMs_));
+    EXPECT_TRUE(scheduler_.runNextTask(nowMs_));
+    EXPECT_FALSE(scheduler_.runNextTask(nowMs_));
+    EXPECT_EQ(log_, (std::vector<std::string> { "high", "medium", "low" }));
+    EXPECT_EQ(scheduler_.getTimeUntilNextTaskMs(nowMs_), 10u);
+}
+
+TEST_F(Scheduler_Fixture, b_intervals)
+{
+    TestTask rfid { nullptr, "rfid", 3 };
+    TestTask ui { nullptr, "ui", 1 };
+    add(rfid, 1, 50);
+    add(ui, 0, 10);
+
+    runUntil(nowMs_ + 1000);
+
+    // a steady rate, even though the tasks take time
+    ASSERT_EQ(runTimesMs_["rfid"].size(), 20u);
+    for (size_t i = 0; i < runTimesMs_["rfid"].size(); i++)
+        EXPECT_EQ(runTimesMs_["rfid"][i], 1000 + 50 * i);
+    ASSERT_EQ(runTimesMs_["ui"].size(), 100u);
+    // ui is delayed by rfid every 5th time, but doesn't drift
+    EXPECT_EQ(runTimesMs_["ui"][0], 1003u);
+    EXPECT_EQ(runTimesMs_["ui"][1], 1010u);
+    EXPECT_EQ(runTimesMs_["ui"][99], 1990u);
+}
+
+TEST_F(Scheduler_Fixture, c_fallingBehindDoesntCauseBursts)
+{
+    TestTask slow { nullptr, "slow", 35 };
+    TestTask fast { nullptr, "fast", 0 };
+    add(slow, 1, 100);
+    add(fast, 0, 10);
+
+    runUntil(nowMs_ + 100);
+
+    // fast was due 3 times while slow was running, but only runs once afterwards
+    ASSERT_GE(runTimesMs_["fast"].size(), 2u);
+    EXPECT_EQ(runTimesMs_["fast"][0], 1035u);
+    EXPECT_EQ(runTimesMs_["fast"][1], 1045u);
+}
+
+TEST_F(Scheduler_Fixture, d_wakeRunsTaskImmediately)
+{
+    TestTask audio { nullptr, "audio", 0 };
+    TestTask ui { nullptr, "ui", 0 };
+    const auto audioId = add(audio, 2, 0);
+    add(ui, 0, 10);
+
+    // tasks without an interval only run when woken
+    runUntil(nowMs_ + 25);
+    EXPECT_EQ(runTimesMs_["audio"].size(), 0u);
+    EXPECT_EQ(runTimesMs_["ui"].size(), 3u);
+
+    nowMs_ = 1030;
+    scheduler_.wake(audioId);
+    EXPECT_EQ(scheduler_.getTimeUntilNextTaskMs(nowMs_), 0u);
+    EXPECT_TRUE(scheduler_.runNextTask(nowMs_));
+    EXPECT_TRUE(scheduler_.runNextTask(nowMs_));
+    EXPECT_FALSE(scheduler_.runNextTask(nowMs_));
+    EXPECT_EQ(log_.back(), "ui");
+    EXPECT_EQ(log_[log_.size() - 2], "audio");
+
+    // invalid ids are ignored
+    scheduler_.wake(SchedulerType::invalidTaskId);
+    scheduler_.wake(3);
+    EXPECT_FALSE(scheduler_.runNextTask(nowMs_));
+}
+
+TEST_F(Scheduler_Fixture, e_slowRfidDoesntDelayAudioRefillByMoreThanOneTask)
+{
+    // The audio interrupt wakes the refill every 6ms. A slow RFID poll can't
+    // be interrupted, but the refill runs right after it, before the UI.
+    TestTask audio { nullptr, "audio", 1 };
+    TestTask rfid { nullptr, "rfid", 8 };
+    TestTask ui { nullptr, "ui", 2 };
+    const auto audioId = add(audio, 2, 0);
+    add(rfid, 1, 50);
+    add(ui, 0, 10);
+
+    uint32_t nextAudioInterruptMs = nowMs_;
+    std::vector<uint32_t> wakeTimesMs;
+    const uint32_t endMs = nowMs_ + 500;
+    while (int32_t(endMs - nowMs_) > 0)
+    {
+        while (int32_t(nowMs_ - nextAudioInterruptMs) >= 0)
+        {
+            scheduler_.wake(audioId);
+            wakeTimesMs.push_back(nextAudioInterruptMs);
+            nextAudioInterruptMs += 6;
+        }
+        if (!scheduler_.runNextTask(nowMs_))
+            nowMs_++;
+    }
+
+    // each wake-up was served, at most one rfid poll later
+    const auto& audioTimesMs = runTimesMs_["audio"];
+    ASSERT_GE(audioTimesMs.size(), 80u);
+    size_t audioRun = 0;
+    for (const auto wakeTimeMs : wakeTimesMs)
+    {
+        while ((audioRun < audioTimesMs.size()) && (audioTimesMs[audioRun] < wakeTimeMs))
+            audioRun++;
+        if (audioRun == audioTimesMs.size())
+            break;
+        EXPECT_LE(audioTimesMs[audioRun] - wakeTimeMs, rfid.durationMs) << "woken at " << wakeTimeMs;
+    }
+    EXPECT_EQ(runTimesMs_["rfid"].size(), 10u);
+    EXPECT_GE(runTimesMs_["ui"].size(), 45u);
+}
+
+TEST_F(Scheduler_Fixture, f_maxNumTasks)
+{
+    TestTask task { nullptr, "task", 0 };
+    for (int i = 0; i < 4; i++)
+        EXPECT_EQ(add(task, 0, 10), i);
+    EXPECT_EQ(add(task, 0, 10), SchedulerType::invalidTaskId);
+}
@@ -0,0 +1,401 @@
+#include "SimulatedSdCard.h"
+#include "Benchmark.h"
+#include "ff.h"
+#include "FixedSizeString.h"
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <gtest/gtest.h>
+
+// The FatFS based File class of the firmware. The other tests link the unit test
+// proxy of the same name, so this one is kept in its own namespace.
+namespace target
+{
+#include "File.h"
+}
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+/** FatFS, diskio.c and the SD card driver on a simulated card with a FAT32 volume */
+class SdCardFatFs_Fixture : public ::testing::Test
+{
+protected:
+    SdCardFatFs_Fixture() :
+        card_(numSectors)
+    {
+        card_.formatFat32(1);
+        card_.install();
+    }
+
+    ~SdCardFatFs_Fixture()
+    {
+        f_mount(nullptr, "", 0);
+    }
+
+    static uint8_t getFileByte(uint32_t position)
+    {
+        return uint8_t((position * 31) ^ (position >> 9));
+    }
+
+    /** Writes a file filled with getFileByte() in chunks of 4k */
+    void writeFile(const char* path, uint32_t size)
+    {
+        FIL file;
+        ASSERT_EQ(f_open(&file, path, FA_CREATE_ALWAYS | FA_WRITE), FR_OK);
+        std::vector<uint8_t> chunk(4096);
+        for (uint32_t position = 0; position < size; position += uint32_t(chunk.size()))
+        {
+            const UINT chunkSize = UINT(std::min<size_t>(chunk.size(), size - position));
+            for (UINT i = 0; i < chunkSize; i++)
+                chunk[i] = getFileByte(position + i);
+            UINT numBytesWritten = 0;
+            ASSERT_EQ(f_write(&file, chunk.data(), chunkSize, &numBytesWritten), FR_OK);
+            ASSERT_EQ(numBytesWritten, chunkSize);
+        }
+        ASSERT_EQ(f_close(&file), FR_OK);
+    }
+
+    /** Writes several files at once, alternating between them every
+     *  `fragmentSize` bytes, so that each file ends up in many fragments. */
+    void writeFragmentedFiles(const std::vector<const char*>& paths, uint32_t size, uint32_t fragmentSize)
+    {
+        std::vector<FIL> files(paths.size());
+        for (size_t i = 0; i < paths.size(); i++)
+            ASSERT_EQ(f_open(&files[i], paths[i], FA_CREATE_ALWAYS | FA_WRITE), FR_OK);
+        std::vector<uint8_t> chunk(fragmentSize);
+        for (uint32_t position = 0; position < size; position += fragmentSize)
+        {
+            for (UINT i = 0; i < fragmentSize; i++)
+                chunk[i] = getFileByte(position + i);
+            for (auto& file : files)
+            {
+                UINT numBytesWritten = 0;
+                ASSERT_EQ(f_write(&file, chunk.data(), fragmentSize, &numBytesWritten), FR_OK);
+            }
+        }
+        for (auto& file : files)
+            ASSERT_EQ(f_close(&file), FR_OK);
+    }
+
+    /** Reads an open file from its current position until the end and checks the contents */
+    bool readAndCheck(FIL& file, uint32_t chunkSize)
+    {
+        std::vector<uint8_t> chunk(chunkSize);
+        uint32_t position = uint32_t(f_tell(&file));
+        while (true)
+        {
+            UINT numBytesRead = 0;
+            if (f_read(&file, chunk.data(), chunkSize, &numBytesRead) != FR_OK)
+                return false;
+            for (UINT i = 0; i < numBytesRead; i++)
+                if (chunk[i] != getFileByte(position + i))
+                    return false;
+            position += numBytesRead;
+            if (numBytesRead < chunkSize)
+                return true;
+        }
+    }
+
+    // FAT32 needs at least 65526 clusters
+    static constexpr uint32_t numSectors = 66 * 1024;
+    static constexpr uint32_t fileSize = 1024 * 1024;
+    SimulatedSdCard card_;
+    FATFS fs_;
+};
+
+TEST_F(SdCardFatFs_Fixture, a_mountWriteAndRead)
+{
+    ASSERT_EQ(f_mount(&fs_, "", 1), FR_OK);
+    EXPECT_EQ(fs_.fs_type, FS_FAT32);
+
+    writeFile("test.mp3", 100000);
+    FIL file;
+    ASSERT_EQ(f_open(&file, "test.mp3", FA_READ), FR_OK);
+    EXPECT_EQ(f_size(&file), 100000u);
+    EXPECT_TRUE(readAndCheck(file, 1000));
+    EXPECT_EQ(f_close(&file), FR_OK);
+
+    DIR dir;
+    FILINFO info;
+    ASSERT_EQ(f_opendir(&dir, ""), FR_OK);
+    ASSERT_EQ(f_readdir(&dir, &info), FR_OK);
+    EXPECT_STREQ(info.fname, "test.mp3");
+    EXPECT_EQ(f_closedir(&dir), FR_OK);
+}
+
+TEST_F(SdCardFatFs_Fixture, b_diskImageFile)
+{
+    ASSERT_EQ(f_mount(&fs_, "", 1), FR_OK);
+    ASSERT_EQ(f_mkdir("01"), FR_OK);
+    writeFile("01/track.mp3", 20000);
+    ASSERT_EQ(f_mount(nullptr, "", 0), FR_OK);
+
+    // the card contents survive a round trip through an image file
+    const std::string imagePath = ::testing::TempDir() + "SdCardFatFs_b_diskImageFile.img";
+    ASSERT_TRUE(card_.saveImage(imagePath));
+
+    SimulatedSdCard otherCard(1024);
+    ASSERT_TRUE(otherCard.loadImage(imagePath));
+    std::remove(imagePath.c_str());
+    EXPECT_EQ(otherCard.getNumSectors(), numSectors);
+    otherCard.install();
+
+    ASSERT_EQ(f_mount(&fs_, "", 1), FR_OK);
+    FIL file;
+    ASSERT_EQ(f_open(&file, "01/track.mp3", FA_READ), FR_OK);
+    EXPECT_EQ(f_size(&file), 20000u);
+    EXPECT_TRUE(readAndCheck(file, 512));
+    EXPECT_EQ(f_close(&file), FR_OK);
+
+    EXPECT_FALSE(otherCard.loadImage(imagePath));
+}
+
+TEST_F(SdCardFatFs_Fixture, c_failureInjection)
+{
+    // no card
+    card_.isUnresponsive_ = true;
+    EXPECT_EQ(f_mount(&fs_, "", 1), FR_NOT_READY);
+    card_.isUnresponsive_ = false;
+
+    ASSERT_EQ(f_mount(&fs_, "", 1), FR_OK);
+    writeFile("test.mp3", 8192);
+
+    FIL file;
+    ASSERT_EQ(f_open(&file, "test.mp3", FA_READ), FR_OK);
+    const uint32_t firstSector = uint32_t(file.obj.fs->database
+                                          + (file.obj.sclust - 2) * file.obj.fs->csize);
+    EXPECT_EQ(card_.getSector(firstSector)[1], getFileByte(1));
+
+    // a sector that can't be read
+    card_.failingReadSector_ = firstSector + 3;
+    EXPECT_FALSE(readAndCheck(file, 1024));
+    EXPECT_EQ(file.err, FR_DISK_ERR);
+    EXPECT_EQ(f_close(&file), FR_OK);
+    card_.failingReadSector_ = -1;
+
+    // the card rejects all multi block reads
+    card_.shouldCommandFail_ = [](uint8_t command, uint32_t) { return command == 18; };
+    ASSERT_EQ(f_open(&file, "test.mp3", FA_READ), FR_DISK_ERR);
+    card_.shouldCommandFail_ = nullptr;
+
+    // after the errors, the volume is still readable
+    ASSERT_EQ(f_open(&file, "test.mp3", FA_READ), FR_OK);
+    EXPECT_TRUE(readAndCheck(file, 1024));
+    EXPECT_EQ(f_close(&file), FR_OK);
+}
+
+TEST_F(SdCardFatFs_Fixture, d_benchmark_sequentialRead)
+{
+    ASSERT_EQ(f_mount(&fs_, "", 1), FR_OK);
+    writeFile("test.mp3", fileSize);
+
+    // raw data rate of the bus, without any protocol overhead
+    const double busBytesPerUs = card_.fastClockHz_ / 8.0 / 1e6;
+
+    for (const uint32_t chunkSize : { 1024, 4096, 32768 })
+    {
+        FIL file;
+        ASSERT_EQ(f_open(&file, "test.mp3", FA_READ), FR_OK);
+        card_.resetStatistics();
+        const double startUs = card_.getTimeUs();
+        EXPECT_TRUE(readAndCheck(file, chunkSize));
+        const double durationUs = card_.getTimeUs() - startUs;
+        EXPECT_EQ(f_close(&file), FR_OK);
+
+        const double bytesPerUs = fileSize / durationUs;
+        if (Benchmark::isEnabled())
+            std::cout << "[ BENCH    ] 1MB in " << chunkSize / 1024 << "kB chunks: "
+                      << int(bytesPerUs * 1000.0) << " kB/s ("
+                      << int(100.0 * bytesPerUs / busBytesPerUs) << "% of the bus), "
+                      << card_.numBytesTransferred_ << " bytes on the bus, "
+                      << card_.commandCounts_[18] << " CMD18, "
+                      << card_.commandCounts_[12] << " CMD12" << std::endl;
+
+        // regression: the FAT lookups and restarted transfers may not eat up the bus
+        EXPECT_GT(bytesPerUs, 0.75 * busBytesPerUs);
+        EXPECT_LT(card_.numBytesTransferred_, uint64_t(1.1 * fileSize));
+    }
+}
+
+TEST_F(SdCardFatFs_Fixture, e_benchmark_seek)
+{
+    ASSERT_EQ(f_mount(&fs_, "", 1), FR_OK);
+    writeFile("test.mp3", fileSize);
+
+    FIL file;
+    ASSERT_EQ(f_open(&file, "test.mp3", FA_READ), FR_OK);
+
+    // without the fast seek feature, f_lseek() follows the cluster chain
+    // from the start of the file, so the cost grows with the offset
+    double previousDurationUs = 0.0;
+    for (const uint32_t offset : { fileSize / 8, fileSize / 4, fileSize / 2, fileSize - 1000 })
+    {
+        std::mt19937 random(offset);
+        const int numSeeks = 20;
+        card_.resetStatistics();
+        const double startUs = card_.getTimeUs();
+        for (int i = 0; i < numSeeks; i++)
+        {
+            // seek from the start of the file to a random position around the offset
+            ASSERT_EQ(f_lseek(&file, 0), FR_OK);
+            const uint32_t position = offset - uint32_t(random() % 1000);
+            ASSERT_EQ(f_lseek(&file, position), FR_OK);
+            uint8_t buffer[16];
+            UINT numBytesRead = 0;
+            ASSERT_EQ(f_read(&file, buffer, sizeof(buffer), &numBytesRead), FR_OK);
+            ASSERT_EQ(numBytesRead, sizeof(buffer));
+            EXPECT_EQ(buffer[0], getFileByte(position));
+        }
+        const double durationUs = (card_.getTimeUs() - startUs) / numSeeks;
+        if (Benchmark::isEnabled())
+            std::cout << "[ BENCH    ] seek to " << offset / 1024 << "kB: "
+                      << durationUs / 1000.0 << " ms, "
+                      << card_.numSectorsRead_ / numSeeks << " sectors read per seek" << std::endl;
+
+        EXPECT_GT(durationUs, previousDurationUs);
+        previousDurationUs = durationUs;
+    }
+    // regression: seeking to the end of a 1MB file (1 sector per cluster) stays
+    // below 100ms - in the player, it happens while the FIFO drains
+    EXPECT_LT(previousDurationUs, 100000.0);
+    EXPECT_EQ(f_close(&file), FR_OK);
+}
+
+TEST_F(SdCardFatFs_Fixture, f_fastSeek)
+{
+    ASSERT_EQ(f_mount(&fs_, "", 1), FR_OK);
+    // 64 fragments of 16k each
+    writeFragmentedFiles({ "a.mp3", "b.mp3", "c.mp3" }, fileSize, 16384);
+
+    char buffer[17];
+    uint32_t numBytesRead = 0;
+
+    // the map is too small: the file works without fast seek
+    uint32_t smallMap[64];
+    target::File file("b.mp3");
+    ASSERT_TRUE(file.open(target::File::AccessMode::read, target::File::OpenMode::openIfExists));
+    EXPECT_FALSE(file.enableFastSeek(smallMap, 64));
+    EXPECT_EQ(file.getLastError(), FR_NOT_ENOUGH_CORE);
+    EXPECT_EQ(smallMap[0], 2u + 2u * 64u);
+    ASSERT_TRUE(file.setCursorTo(fileSize - 20000));
+    ASSERT_TRUE(file.tryRead(buffer, 16, numBytesRead));
+    EXPECT_EQ(uint8_t(buffer[0]), getFileByte(fileSize - 20000));
+    EXPECT_TRUE(file.close());
+
+    // a large enough map
+    uint32_t map[2 + 2 * 64];
+    ASSERT_TRUE(file.open(target::File::AccessMode::read, target::File::OpenMode::openIfExists));
+    ASSERT_TRUE(file.enableFastSeek(map, 2 + 2 * 64));
+    EXPECT_EQ(map[1], 16384u / 512u); // length of the first fragment in clusters
+    std::mt19937 random(1234);
+    for (int i = 0; i < 50; i++)
+    {
+        const uint32_t position = uint32_t(random() % (fileSize - 16));
+        ASSERT_TRUE(file.setCursorTo(position));
+        ASSERT_TRUE(file.tryRead(buffer, 16, numBytesRead));
+        ASSERT_EQ(numBytesRead, 16u);
+        for (uint32_t j = 0; j < 16; j++)
+            ASSERT_EQ(uint8_t(buffer[j]), getFileByte(position + j));
+    }
+    EXPECT_FALSE(file.setCursorTo(fileSize + 1));
+
+    // reading across all fragments
+    ASSERT_TRUE(file.setCursorTo(0));
+    uint32_t position = 0;
+    while (!file.isEndOfFile())
+    {
+        ASSERT_TRUE(file.tryRead(buffer, 16, numBytesRead));
+        for (uint32_t j = 0; j < numBytesRead; j++)
+        {
+            ASSERT_EQ(uint8_t(buffer[j]), getFileByte(position + j));
+        }
+        position += numBytesRead;
+    }
+    EXPECT_EQ(position, fileSize);
+    EXPECT_TRUE(file.close());
+}
+
+TEST_F(SdCardFatFs_Fixture, g_benchmark_seekInFragmentedFile)
+{
+    ASSERT_EQ(f_mount(&fs_, "", 1), FR_OK);
+    // 64 fragments of 16k each, the cluster chain of a file spans 48 FAT sectors
+    writeFragmentedFiles({ "a.mp3", "b.mp3", "c.mp3" }, fileSize, 16384);
+
+    const auto measure = [&](bool useFastSeek, uint32_t offset, uint64_t& numSectorsRead) {
+        uint32_t map[2 + 2 * 64];
+        target::File file("c.mp3");
+        EXPECT_TRUE(file.open(target::File::AccessMode::read, target::File::OpenMode::openIfExists));
+        if (useFastSeek)
+        {
+            EXPECT_TRUE(file.enableFastSeek(map, 2 + 2 * 64));
+        }
+
+        std::mt19937 random(offset);
+        const int numSeeks = 20;
+        card_.resetStatistics();
+        const double startUs = card_.getTimeUs();
+        for (int i = 0; i < numSeeks; i++)
+        {
+            // seek back and forth: to the start, then close to the offset
+            EXPECT_TRUE(file.setCursorTo(0));
+            const uint32_t position = offset - uint32_t(random() % 1000);
+            EXPECT_TRUE(file.setCursorTo(position));
+            char buffer[17];
+            uint32_t numBytesRead = 0;
+            EXPECT_TRUE(file.tryRead(buffer, 16, numBytesRead));
+            EXPECT_EQ(uint8_t(buffer[0]), getFileByte(position));
+        }
+        numSectorsRead = card_.numSectorsRead_ / numSeeks;
+        return (card_.getTimeUs() - startUs) / numSeeks;
+    };
+
+    for (const uint32_t offset : { fileSize / 8, fileSize / 2, fileSize - 1000 })
+    {
+        uint64_t numSectorsWithChain = 0;
+        uint64_t numSectorsWithMap = 0;
+        const double durationWithChainUs = measure(false, offset, numSectorsWithChain);
+        const double durationWithMapUs = measure(true, offset, numSectorsWithMap);
+        if (Benchmark::isEnabled())
+            std::cout << "[ BENCH    ] fragmented file, seek to " << offset / 1024 << "kB: "
+                      << durationWithChainUs / 1000.0 << " ms (" << numSectorsWithChain
+                      << " sectors) following the FAT, "
+                      << durationWithMapUs / 1000.0 << " ms (" << numSectorsWithMap
+                      << " sectors) with the fast seek map" << std::endl;
+
+        // with the map, a seek costs the data sector only, no matter the offset
+        EXPECT_LE(numSectorsWithMap, 1u);
+        EXPECT_LT(durationWithMapUs, durationWithChainUs);
+    }
+
+    // sequential reading (1k chunks) doesn't need the FAT either
+    for (const bool useFastSeek : { false, true })
+    {
+        uint32_t map[2 + 2 * 64];
+        target::File file("c.mp3");
+        ASSERT_TRUE(file.open(target::File::AccessMode::read, target::File::OpenMode::openIfExists));
+        if (useFastSeek)
+        {
+            ASSERT_TRUE(file.enableFastSeek(map, 2 + 2 * 64));
+        }
+        card_.resetStatistics();
+        const double startUs = card_.getTimeUs();
+        char buffer[1025];
+        uint32_t numBytesRead = 0;
+        while (!file.isEndOfFile())
+            ASSERT_TRUE(file.tryRead(buffer, 1024, numBytesRead));
+        const double durationUs = card_.getTimeUs() - startUs;
+        if (Benchmark::isEnabled())
+            std::cout << "[ BENCH    ] fragmented file, 1MB in 1kB chunks "
+                      << (useFastSeek ? "with" : "without") << " the fast seek map: "
+                      << int(fileSize / durationUs * 1000.0) << " kB/s, "
+                      << card_.numSectorsRead_ << " sectors read" << std::endl;
+        // no FAT sectors: only the data, plus one block per fragment that the card
+        // already started to send before the driver stopped the transfer
+        if (useFastSeek)
+        {
+            EXPECT_EQ(card_.numSectorsRead_, int(fileSize / 512) + 64);
+        }
+    }
+}
@@ -0,0 +1,233 @@
+#include "SimulatedSdCard.h"
+#include "Benchmark.h"
+#include <iostream>
+#include <random>
+#include <gtest/gtest.h>
+
+// ==============================================================
+// Tests
+// ==============================================================
+
+class SdCardSpi_Fixture : public ::testing::Test
+{
+protected:
+    SdCardSpi_Fixture() :
+        card_(numSectors)
+    {
+        card_.install();
+        std::mt19937 random(1234);
+        for (auto& byte : card_.getData())
+            byte = uint8_t(random());
+    }
+
+    std::vector<uint8_t> getSectors(uint32_t sector, uint32_t count)
+    {
+        const auto* first = card_.getSector(sector);
+        return std::vector<uint8_t>(first, first + count * SimulatedSdCard::sectorSize);
+    }
+
+    std::vector<uint8_t> read(uint32_t sector, uint32_t count)
+    {
+        std::vector<uint8_t> buffer(count * SimulatedSdCard::sectorSize, 0);
+        EXPECT_EQ(SDSPI_disk_read(buffer.data(), sector, count), RES_OK);
+        return buffer;
+    }
+
+    static constexpr uint32_t numSectors = 4096;
+    SimulatedSdCard card_;
+};
+
+TEST_F(SdCardSpi_Fixture, a_initialize)
+{
+    EXPECT_EQ(SDSPI_disk_status(), STA_NOINIT);
+    BYTE buffer[512];
+    EXPECT_EQ(SDSPI_disk_read(buffer, 0, 1), RES_NOTRDY);
+
+    EXPECT_EQ(SDSPI_disk_initialize(), 0);
+    EXPECT_EQ(SDSPI_disk_status(), 0);
+    EXPECT_EQ(card_.commandCounts_[CMD0], 1);
+    EXPECT_EQ(card_.commandCounts_[CMD8], 1);
+    EXPECT_EQ(card_.commandCounts_[ACMD41 & 0x7F], card_.numInitAttempts_);
+    EXPECT_EQ(card_.commandCounts_[CMD58], 1);
+
+    DWORD numSectorsReported = 0;
+    EXPECT_EQ(SDSPI_disk_ioctl(GET_SECTOR_COUNT, &numSectorsReported), RES_OK);
+    EXPECT_EQ(numSectorsReported, numSectors);
+
+    // the card doesn't respond
+    SimulatedSdCard missingCard(numSectors);
+    missingCard.isUnresponsive_ = true;
+    missingCard.install();
+    EXPECT_EQ(SDSPI_disk_initialize(), STA_NOINIT);
+
+    // the card never leaves the idle state: times out after 1s
+    SimulatedSdCard stuckCard(numSectors);
+    stuckCard.numInitAttempts_ = 1000000;
+    stuckCard.install();
+    EXPECT_EQ(SDSPI_disk_initialize(), STA_NOINIT);
+    EXPECT_GT(stuckCard.commandCounts_[ACMD41 & 0x7F], 10);
+}
+
+TEST_F(SdCardSpi_Fixture, b_readAndWrite)
+{
+    ASSERT_EQ(SDSPI_disk_initialize(), 0);
+
+    EXPECT_EQ(read(0, 1), getSectors(0, 1));
+    EXPECT_EQ(read(100, 5), getSectors(100, 5));
+    EXPECT_EQ(read(numSectors - 1, 1), getSectors(numSectors - 1, 1));
+
+    std::vector<uint8_t> data(3 * SimulatedSdCard::sectorSize);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = uint8_t(i * 7);
+    EXPECT_EQ(SDSPI_disk_write(data.data(), 10, 1), RES_OK);
+    EXPECT_EQ(SDSPI_disk_write(data.data(), 20, 3), RES_OK);
+    EXPECT_EQ(SDSPI_disk_ioctl(CTRL_SYNC, nullptr), RES_OK);
+
+    const std::vector<uint8_t> firstSector(data.begin(), data.begin() + SimulatedSdCard::sectorSize);
+    EXPECT_EQ(getSectors(10, 1), firstSector);
+    EXPECT_EQ(getSectors(20, 3), data);
+    EXPECT_EQ(read(10, 1), firstSector);
+    EXPECT_EQ(read(20, 3), data);
+
+    // parameter errors
+    EXPECT_EQ(SDSPI_disk_read(data.data(), 0, 0), RES_PARERR);
+    EXPECT_EQ(SDSPI_disk_read(data.data(), numSectors, 1), RES_ERROR);
+    EXPECT_EQ(read(0, 1), getSectors(0, 1));
+}
+
+TEST_F(SdCardSpi_Fixture, c_sequentialReadsContinueTheOpenTransfer)
+{
+    ASSERT_EQ(SDSPI_disk_initialize(), 0);
+    card_.resetStatistics();
+
+    // like the FileReadAheadBuffer: 1k chunks from one file
+    for (uint32_t sector = 200; sector < 264; sector += 2)
+        EXPECT_EQ(read(sector, 2), getSectors(sector, 2));
+    EXPECT_EQ(card_.commandCounts_[CMD18], 1);
+    EXPECT_EQ(card_.commandCounts_[CMD17], 0);
+    EXPECT_EQ(card_.commandCounts_[CMD12], 0);
+    EXPECT_EQ(card_.numSectorsRead_, 64);
+    // CS stays asserted while the transfer is open
+    EXPECT_TRUE(card_.isSelected());
+
+    // a jump stops the transfer and starts a new one
+    EXPECT_EQ(read(10, 1), getSectors(10, 1));
+    EXPECT_EQ(read(11, 1), getSectors(11, 1));
+    EXPECT_EQ(card_.commandCounts_[CMD18], 2);
+    EXPECT_EQ(card_.commandCounts_[CMD12], 1);
+
+    // other commands stop the transfer as well
+    DWORD numSectorsReported = 0;
+    EXPECT_EQ(SDSPI_disk_ioctl(GET_SECTOR_COUNT, &numSectorsReported), RES_OK);
+    EXPECT_EQ(card_.commandCounts_[CMD12], 2);
+    EXPECT_FALSE(card_.isSelected());
+    EXPECT_EQ(read(12, 1), getSectors(12, 1));
+    EXPECT_EQ(card_.commandCounts_[CMD18], 3);
+
+    // a read error aborts the transfer, the next read starts over
+    card_.failingReadSector_ = 14;
+    std::vector<uint8_t> buffer(2 * SimulatedSdCard::sectorSize);
+    EXPECT_EQ(SDSPI_disk_read(buffer.data(), 13, 2), RES_ERROR);
+    card_.failingReadSector_ = -1;
+    EXPECT_EQ(read(15, 1), getSectors(15, 1));
+    EXPECT_EQ(read(16, 1), getSectors(16, 1));
+    EXPECT_EQ(card_.commandCounts_[CMD18], 4);
+}
+
+TEST_F(SdCardSpi_Fixture, d_sequentialWritesContinueTheOpenTransfer)
+{
+    ASSERT_EQ(SDSPI_disk_initialize(), 0);
+    card_.resetStatistics();
+
+    std::vector<uint8_t> data(16 * SimulatedSdCard::sectorSize);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = uint8_t(i * 13);
+
+    // a single sector is written (and programmed) right away
+    EXPECT_EQ(SDSPI_disk_write(data.data(), 300, 1), RES_OK);
+    EXPECT_EQ(card_.commandCounts_[CMD24], 1);
+    EXPECT_EQ(card_.commandCounts_[CMD25], 0);
+    EXPECT_FALSE(card_.isSelected());
+
+    // a multi block write stays open, also for following single sectors
+    EXPECT_EQ(SDSPI_disk_write(&data[0], 400, 2), RES_OK);
+    for (uint32_t i = 2; i < 16; i++)
+        EXPECT_EQ(SDSPI_disk_write(&data[i * SimulatedSdCard::sectorSize], 400 + i, 1), RES_OK);
+    EXPECT_EQ(card_.commandCounts_[CMD25], 1);
+    EXPECT_EQ(card_.commandCounts_[CMD24], 1);
+    EXPECT_EQ(card_.numStopTranTokens_, 0);
+    EXPECT_EQ(card_.numSectorsWritten_, 17);
+
+    // CTRL_SYNC ends the transfer
+    EXPECT_EQ(SDSPI_disk_ioctl(CTRL_SYNC, nullptr), RES_OK);
+    EXPECT_EQ(card_.numStopTranTokens_, 1);
+    EXPECT_EQ(getSectors(400, 16), data);
+
+    // reading ends the write transfer and vice versa
+    EXPECT_EQ(SDSPI_disk_write(&data[0], 500, 2), RES_OK);
+    EXPECT_EQ(read(400, 2), getSectors(400, 2));
+    EXPECT_EQ(card_.numStopTranTokens_, 2);
+    EXPECT_EQ(SDSPI_disk_write(&data[0], 502, 2), RES_OK);
+    EXPECT_EQ(card_.commandCounts_[CMD12], 1);
+    EXPECT_EQ(card_.commandCounts_[CMD25], 3);
+    EXPECT_EQ(SDSPI_disk_ioctl(CTRL_SYNC, nullptr), RES_OK);
+
+    // a rejected block aborts the transfer
+    card_.failingWriteSector_ = 601;
+    EXPECT_EQ(SDSPI_disk_write(&data[0], 600, 3), RES_ERROR);
+    card_.failingWriteSector_ = -1;
+    EXPECT_EQ(SDSPI_disk_write(&data[0], 602, 2), RES_OK);
+    EXPECT_EQ(SDSPI_disk_ioctl(CTRL_SYNC, nullptr), RES_OK);
+    EXPECT_EQ(getSectors(602, 2), std::vector<uint8_t>(data.begin(), data.begin() + 1024));
+}
+
+TEST_F(SdCardSpi_Fixture, e_byteAddressingCard)
+{
+    SimulatedSdCard sdscCard(numSectors, false);
+    sdscCard.install();
+    ASSERT_EQ(SDSPI_disk_initialize(), 0);
+
+    BYTE buffer[2 * 512];
+    EXPECT_EQ(SDSPI_disk_read(buffer, 3, 2), RES_OK);
+    EXPECT_EQ(SDSPI_disk_read(buffer, 5, 2), RES_OK);
+    EXPECT_EQ(sdscCard.numSectorsRead_, 4);
+    EXPECT_EQ(sdscCard.commandCounts_[CMD18], 1);
+
+    for (size_t i = 0; i < sizeof(buffer); i++)
+        buffer[i] = BYTE(i);
+    EXPECT_EQ(SDSPI_disk_write(buffer, 7, 2), RES_OK);
+    EXPECT_EQ(SDSPI_disk_ioctl(CTRL_SYNC, nullptr), RES_OK);
+    EXPECT_TRUE(std::equal(buffer, buffer + sizeof(buffer), sdscCard.getSector(7)));
+}
+
+TEST_F(SdCardSpi_Fixture, f_benchmark_busTrafficOfSequentialReads)
+{
+    ASSERT_EQ(SDSPI_disk_initialize(), 0);
+
+    // the bytes on the bus are what costs time (and CPU time without DMA)
+    const auto readFile = [&](uint32_t numSectorsPerRead, bool jumpBetweenReads) {
+        uint64_t numBytes = 0;
+        for (uint32_t i = 0; i < 256; i += numSectorsPerRead)
+        {
+            // a jump to another part of the card prevents continuing the open transfer
+            if (jumpBetweenReads)
+                read(numSectors - 1, 1);
+            const uint32_t sector = 1000 + i;
+            const auto numBytesBefore = card_.numBytesTransferred_;
+            EXPECT_EQ(read(sector, numSectorsPerRead), getSectors(sector, numSectorsPerRead));
+            numBytes += card_.numBytesTransferred_ - numBytesBefore;
+        }
+        return numBytes;
+    };
+
+    for (const uint32_t numSectorsPerRead : { 1, 2, 8 })
+    {
+        const auto numBytesWithRestarts = readFile(numSectorsPerRead, true);
+        const auto numBytesContinued = readFile(numSectorsPerRead, false);
+        if (Benchmark::isEnabled())
+            std::cout << "[ BENCH    ] 128kB in " << numSectorsPerRead << " sector reads: "
+                      << numBytesWithRestarts << " bytes on the bus with a command per read, "
+                      << numBytesContinued << " bytes when the transfer continues" << std::endl;
+        EXPECT_LT(numBytesContinued, numBytesWithRestarts);
+    }
+}
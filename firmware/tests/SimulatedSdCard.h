@@ -0,0 +1,546 @@
+#pragma once
+
+#include "sdcard_spi.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+/** A simulated SD card in SPI mode. It receives and sends bytes like a real card
+ *  and is used as the SPI transport of sdcard_spi.c, so that the driver and FatFS
+ *  run against it unmodified.
+ *
+ *  The card keeps a simulated time: each byte on the bus takes 8 SPI clock cycles
+ *  and the card answers with "no data yet" / "busy" bytes for as long as a command
+ *  takes. The time also drives the 1ms timer of the driver.
+ */
+class SimulatedSdCard
+{
+public:
+    static constexpr size_t sectorSize = 512;
+
+    /** @param numSectors       Capacity of the card, a multiple of 1024
+     *  @param isHighCapacity   true: SDHC card (sector addressing),
+     *                          false: SDSC v2 card (byte addressing)
+     */
+    SimulatedSdCard(uint32_t numSectors, bool isHighCapacity = true) :
+        data_(size_t(numSectors) * sectorSize, 0),
+        isHighCapacity_(isHighCapacity)
+    {
+        commandLatencyUs_.fill(0);
+        commandLatencyUs_[12] = 50;
+        commandLatencyUs_[17] = 500;
+        commandLatencyUs_[18] = 500;
+        commandLatencyUs_[24] = 500;
+        commandLatencyUs_[25] = 500;
+    }
+
+    ~SimulatedSdCard()
+    {
+        if (installedCard_ == this)
+            installedCard_ = nullptr;
+    }
+
+    /** Makes this card the one that sdcard_spi.c talks to and resets sdcard_spi.c */
+    void install()
+    {
+        installedCard_ = this;
+        static const SDSPI_Transport_t transport = {
+            []() { installedCard_->setChipSelect(true); },
+            []() { installedCard_->setChipSelect(false); },
+            []() { installedCard_->isFastClock_ = false; },
+            []() { installedCard_->isFastClock_ = true; },
+            [](BYTE dat) { return BYTE(installedCard_->transfer(dat)); },
+            [](BYTE* buff, UINT btr) {
+                for (UINT i = 0; i < btr; i++)
+                    buff[i] = installedCard_->transfer(0xFF);
+            },
+            [](const BYTE* buff, UINT btx) {
+                for (UINT i = 0; i < btx; i++)
+                    installedCard_->transfer(buff[i]);
+            },
+            []() { installedCard_->advanceTime(10.0); }
+        };
+        SDSPI_Init(&transport);
+    }
+
+    // ====================================================================
+    // contents
+    // ====================================================================
+
+    std::vector<uint8_t>& getData() { return data_; }
+    uint8_t* getSector(uint32_t sector) { return &data_[size_t(sector) * sectorSize]; }
+    uint32_t getNumSectors() const { return uint32_t(data_.size() / sectorSize); }
+
+    /** Replaces the contents of the card with a disk image file */
+    bool loadImage(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (image.empty() || (image.size() % (1024 * sectorSize) != 0))
+            return false;
+        data_ = std::move(image);
+        return true;
+    }
+
+    /** Writes the contents of the card to a disk image file */
+    bool saveImage(const std::string& path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data_.data()), std::streamsize(data_.size()));
+        return bool(file);
+    }
+
+    /** Formats the card with an empty FAT32 volume without a partition table.
+     *  FatFS decides the FAT type by the number of clusters, FAT32 needs at least
+     *  65526 clusters. */
+    void formatFat32(uint8_t sectorsPerCluster)
+    {
+        std::fill(data_.begin(), data_.end(), 0);
+        const uint32_t numReservedSectors = 32;
+        const uint32_t numSectors = getNumSectors();
+        uint32_t numFatSectors = 1;
+        while (true)
+        {
+            const uint32_t numClusters = (numSectors - numReservedSectors - 2 * numFatSectors) / sectorsPerCluster;
+            const uint32_t requiredNumFatSectors = uint32_t(((numClusters + 2) * 4 + sectorSize - 1) / sectorSize);
+            if (requiredNumFatSectors <= numFatSectors)
+                break;
+            numFatSectors = requiredNumFatSectors;
+        }
+
+        uint8_t* boot = getSector(0);
+        const uint8_t jump[] = { 0xEB, 0x58, 0x90 };
+        std::copy(jump, jump + 3, boot);
+        std::copy_n("MSWIN4.1", 8, boot + 3);
+        store16(boot + 11, sectorSize);
+        boot[13] = sectorsPerCluster;
+        store16(boot + 14, numReservedSectors);
+        boot[16] = 2; // number of FATs
+        boot[21] = 0xF8; // media
+        store16(boot + 24, 63); // sectors per track
+        store16(boot + 26, 255); // heads
+        store32(boot + 32, numSectors);
+        store32(boot + 36, numFatSectors);
+        store32(boot + 44, 2); // root directory cluster
+        store16(boot + 48, 1); // FSInfo sector
+        store16(boot + 50, 6); // backup boot sector
+        boot[64] = 0x80; // drive number
+        boot[66] = 0x29; // extended boot signature
+        store32(boot + 67, 0x12345678); // volume serial number
+        std::copy_n("NO NAME    ", 11, boot + 71);
+        std::copy_n("FAT32   ", 8, boot + 82);
+        store16(boot + 510, 0xAA55);
+        std::copy(boot, boot + sectorSize, getSector(6));
+
+        uint8_t* fsInfo = getSector(1);
+        store32(fsInfo, 0x41615252);
+        store32(fsInfo + 484, 0x61417272);
+        store32(fsInfo + 488, 0xFFFFFFFF); // free cluster count unknown
+        store32(fsInfo + 492, 0xFFFFFFFF); // next free cluster unknown
+        store32(fsInfo + 508, 0xAA550000);
+
+        for (uint32_t fat = 0; fat < 2; fat++)
+        {
+            uint8_t* entries = getSector(numReservedSectors + fat * numFatSectors);
+            store32(entries, 0x0FFFFFF8);
+            store32(entries + 4, 0x0FFFFFFF);
+            store32(entries + 8, 0x0FFFFFFF); // root directory
+        }
+    }
+
+    // ====================================================================
+    // timing
+    // ====================================================================
+
+    /** SPI clock for the initialization (FCLK_SLOW) and the data transfers (FCLK_FAST) */
+    double slowClockHz_ = 328125.0;
+    double fastClockHz_ = 1312500.0;
+    /** Ncr: bytes before the response of each command (1..8) */
+    uint32_t responseDelayBytes_ = 1;
+    /** How long the card needs to execute a command, by command index:
+     *  CMD17/18: before the first data token, CMD24/25: busy after each block
+     *  and after the stop token, others: busy after the response. */
+    std::array<double, 64> commandLatencyUs_;
+    /** How long the card needs for each following block of a CMD18 */
+    double nextBlockLatencyUs_ = 25.0;
+    /** Optional: additional latency of a command, e.g. to simulate latency spikes */
+    std::function<double(uint8_t command, uint32_t sector)> getExtraLatencyUs_;
+    /** Number of ACMD41 that are answered with "idle" before the card is ready */
+    int numInitAttempts_ = 3;
+
+    double getTimeUs() const { return timeUs_; }
+
+    /** Advances the simulated time, e.g. while the driver waits */
+    void advanceTime(double us)
+    {
+        timeUs_ += us;
+        // the 1ms timer of the driver
+        while (timeUs_ >= nextTimerTickUs_)
+        {
+            nextTimerTickUs_ += 1000.0;
+            SDSPI_TimerProc(1, 0);
+        }
+    }
+
+    // ====================================================================
+    // failure injection
+    // ====================================================================
+
+    /** The card doesn't answer at all (e.g. it's not inserted) */
+    bool isUnresponsive_ = false;
+    /** Reading this sector fails with an error token (-1: none) */
+    int64_t failingReadSector_ = -1;
+    /** Writing this sector is rejected with a write error data response (-1: none) */
+    int64_t failingWriteSector_ = -1;
+    /** Optional: returns true to make a command fail with an "illegal command" response */
+    std::function<bool(uint8_t command, uint32_t arg)> shouldCommandFail_;
+
+    // ====================================================================
+    // statistics
+    // ====================================================================
+
+    /** Number of commands received, by command index */
+    std::array<int, 64> commandCounts_ = {};
+    int numStopTranTokens_ = 0;
+    int numSectorsRead_ = 0;
+    int numSectorsWritten_ = 0;
+    /** All bytes clocked while the card was selected */
+    uint64_t numBytesTransferred_ = 0;
+
+    void resetStatistics()
+    {
+        commandCounts_ = {};
+        numStopTranTokens_ = 0;
+        numSectorsRead_ = 0;
+        numSectorsWritten_ = 0;
+        numBytesTransferred_ = 0;
+    }
+
+    // ====================================================================
+    // bus
+    // ====================================================================
+
+    void setChipSelect(bool isSelected) { isSelected_ = isSelected; }
+    bool isSelected() const { return isSelected_; }
+
+    /** Exchanges one byte on the bus: returns what the card sends while it receives `mosi` */
+    uint8_t transfer(uint8_t mosi)
+    {
+        advanceTime(8e6 / (isFastClock_ ? fastClockHz_ : slowClockHz_));
+
+        if (!isSelected_ || isUnresponsive_)
+            return 0xFF;
+        numBytesTransferred_++;
+
+        if (output_.empty() && (state_ == State::reading))
+            queueReadBlock(nextBlockLatencyUs_);
+        uint8_t miso = 0xFF;
+        if (!output_.empty())
+        {
+            miso = output_.front();
+            output_.pop_front();
+        }
+
+        receive(mosi);
+        return miso;
+    }
+
+private:
+    enum class State
+    {
+        idle,
+        reading, // CMD18 active
+        waitingForWriteToken, // CMD24 / CMD25 active
+        receivingWriteBlock,
+    };
+
+    void receive(uint8_t mosi)
+    {
+        switch (state_)
+        {
+            case State::waitingForWriteToken:
+                if (isBusy())
+                    return;
+                if (mosi == 0xFE || mosi == 0xFC)
+                {
+                    state_ = State::receivingWriteBlock;
+                    writeBlock_.clear();
+                }
+                else if (mosi == 0xFD && isMultiBlockWrite_)
+                {
+                    numStopTranTokens_++;
+                    // one byte delay before the card goes busy
+                    output_.push_back(0xFF);
+                    queueBusy(getLatencyUs(25, currentSector_));
+                    state_ = State::idle;
+                }
+                else if (mosi != 0xFF)
+                    receiveCommandByte(mosi);
+                return;
+            case State::receivingWriteBlock:
+                writeBlock_.push_back(mosi);
+                if (writeBlock_.size() == sectorSize + 2)
+                    finishWriteBlock();
+                return;
+            case State::idle:
+            case State::reading:
+                receiveCommandByte(mosi);
+                return;
+        }
+    }
+
+    void receiveCommandByte(uint8_t mosi)
+    {
+        if (command_.empty() && ((mosi & 0xC0) != 0x40))
+            return; // not a command start
+        command_.push_back(mosi);
+        if (command_.size() < 6)
+            return;
+        const uint8_t index = command_[0] & 0x3F;
+        const uint32_t arg = (uint32_t(command_[1]) << 24) | (uint32_t(command_[2]) << 16)
+                             | (uint32_t(command_[3]) << 8) | uint32_t(command_[4]);
+        const uint8_t crc = command_[5];
+        command_.clear();
+        executeCommand(index, arg, crc);
+    }
+
+    void executeCommand(uint8_t index, uint32_t arg, uint8_t crc)
+    {
+        commandCounts_[index]++;
+        const bool isAppCommand = isAppCommand_;
+        isAppCommand_ = false;
+
+        // a new command aborts whatever the card was sending
+        output_.clear();
+        if (index == 12) // STOP_TRANSMISSION
+        {
+            state_ = State::idle;
+            output_.push_back(0x5A); // stuff byte
+            queueR1(r1());
+            queueBusy(getLatencyUs(12, arg));
+            return;
+        }
+        if (state_ == State::reading)
+            state_ = State::idle;
+        // Ncr: bytes before the response
+        output_.insert(output_.end(), responseDelayBytes_, 0xFF);
+
+        if (shouldCommandFail_ && shouldCommandFail_(index, arg))
+        {
+            queueR1(r1IllegalCommand);
+            return;
+        }
+
+        switch (index)
+        {
+            case 0: // GO_IDLE_STATE
+                if (crc != 0x95)
+                {
+                    queueR1(r1CrcError);
+                    return;
+                }
+                isIdle_ = true;
+                numAcmd41Received_ = 0;
+                queueR1(r1());
+                return;
+            case 8: // SEND_IF_COND
+                if (crc != 0x87)
+                {
+                    queueR1(r1CrcError);
+                    return;
+                }
+                queueR1(r1());
+                output_.push_back(0x00);
+                output_.push_back(0x00);
+                output_.push_back(uint8_t((arg >> 8) & 0x0F));
+                output_.push_back(uint8_t(arg));
+                return;
+            case 55: // APP_CMD
+                isAppCommand_ = true;
+                queueR1(r1());
+                return;
+            case 41: // SEND_OP_COND
+                if (!isAppCommand)
+                    break;
+                if (++numAcmd41Received_ >= numInitAttempts_)
+                    isIdle_ = false;
+                queueR1(r1());
+                return;
+            case 58: // READ_OCR
+                queueR1(r1());
+                output_.push_back(isHighCapacity_ ? 0xC0 : 0x80);
+                output_.push_back(0xFF);
+                output_.push_back(0x80);
+                output_.push_back(0x00);
+                return;
+            case 9: // SEND_CSD
+                queueR1(r1());
+                queueCsd();
+                return;
+            case 16: // SET_BLOCKLEN
+                queueR1(arg == sectorSize ? r1() : r1ParameterError);
+                return;
+            case 23: // SET_WR_BLK_ERASE_COUNT
+                if (!isAppCommand)
+                    break;
+                queueR1(r1());
+                return;
+            case 17: // READ_SINGLE_BLOCK
+            case 18: // READ_MULTIPLE_BLOCK
+            case 24: // WRITE_BLOCK
+            case 25: // WRITE_MULTIPLE_BLOCK
+            {
+                if (isIdle_)
+                {
+                    queueR1(r1IllegalCommand);
+                    return;
+                }
+                if (!isHighCapacity_ && (arg % sectorSize != 0))
+                {
+                    queueR1(r1AddressError);
+                    return;
+                }
+                const uint32_t sector = isHighCapacity_ ? arg : arg / sectorSize;
+                if (sector >= getNumSectors())
+                {
+                    queueR1(r1ParameterError);
+                    return;
+                }
+                queueR1(r1());
+                currentSector_ = sector;
+                if (index == 17)
+                    queueReadBlock(getLatencyUs(17, sector));
+                else if (index == 18)
+                {
+                    queueReadBlock(getLatencyUs(18, sector));
+                    state_ = State::reading;
+                }
+                else
+                {
+                    isMultiBlockWrite_ = (index == 25);
+                    state_ = State::waitingForWriteToken;
+                }
+                return;
+            }
+            default:
+                break;
+        }
+        queueR1(r1IllegalCommand);
+    }
+
+    void queueReadBlock(double latencyUs)
+    {
+        output_.insert(output_.end(), toNumBytes(latencyUs), 0xFF);
+        if ((int64_t(currentSector_) == failingReadSector_) || (currentSector_ >= getNumSectors()))
+        {
+            output_.push_back(0x08); // error token: out of range / read error
+            state_ = State::idle;
+            return;
+        }
+        output_.push_back(0xFE);
+        const auto* sector = getSector(currentSector_);
+        output_.insert(output_.end(), sector, sector + sectorSize);
+        output_.push_back(0x12); // CRC, not checked
+        output_.push_back(0x34);
+        currentSector_++;
+        numSectorsRead_++;
+    }
+
+    void finishWriteBlock()
+    {
+        if (int64_t(currentSector_) == failingWriteSector_)
+        {
+            output_.push_back(0x0D); // data rejected, write error
+            state_ = State::idle;
+            return;
+        }
+        std::copy(writeBlock_.begin(), writeBlock_.begin() + sectorSize, getSector(currentSector_));
+        numSectorsWritten_++;
+        output_.push_back(0x05); // data accepted
+        queueBusy(getLatencyUs(isMultiBlockWrite_ ? 25 : 24, currentSector_));
+        currentSector_++;
+        if (!isMultiBlockWrite_ || currentSector_ >= getNumSectors())
+            state_ = State::idle;
+        else
+            state_ = State::waitingForWriteToken;
+    }
+
+    void queueCsd()
+    {
+        // CSD version 2.0: capacity = (C_SIZE + 1) * 512kB
+        std::array<uint8_t, 16> csd = {};
+        const uint32_t cSize = getNumSectors() / 1024 - 1;
+        csd[0] = 0x40;
+        csd[7] = uint8_t((cSize >> 16) & 0x3F);
+        csd[8] = uint8_t(cSize >> 8);
+        csd[9] = uint8_t(cSize);
+        output_.push_back(0xFF);
+        output_.push_back(0xFE);
+        output_.insert(output_.end(), csd.begin(), csd.end());
+        output_.push_back(0x00);
+        output_.push_back(0x00);
+    }
+
+    double getLatencyUs(uint8_t command, uint32_t sector) const
+    {
+        double latencyUs = commandLatencyUs_[command];
+        if (getExtraLatencyUs_)
+            latencyUs += getExtraLatencyUs_(command, sector);
+        return latencyUs;
+    }
+
+    size_t toNumBytes(double us) const
+    {
+        const double clockHz = isFastClock_ ? fastClockHz_ : slowClockHz_;
+        return size_t(std::ceil(us * clockHz / 8e6));
+    }
+
+    void queueR1(uint8_t r1) { output_.push_back(r1); }
+    void queueBusy(double us) { output_.insert(output_.end(), toNumBytes(us), 0x00); }
+    bool isBusy() const { return !output_.empty() && output_.front() == 0x00; }
+    uint8_t r1() const { return isIdle_ ? 0x01 : 0x00; }
+
+    static void store16(uint8_t* dest, uint16_t value)
+    {
+        dest[0] = uint8_t(value);
+        dest[1] = uint8_t(value >> 8);
+    }
+
+    static void store32(uint8_t* dest, uint32_t value)
+    {
+        store16(dest, uint16_t(value));
+        store16(dest + 2, uint16_t(value >> 16));
+    }
+
+    static constexpr uint8_t r1IllegalCommand = 0x04;
+    static constexpr uint8_t r1CrcError = 0x08;
+    static constexpr uint8_t r1AddressError = 0x20;
+    static constexpr uint8_t r1ParameterError = 0x40;
+
+    std::vector<uint8_t> data_;
+    const bool isHighCapacity_;
+
+    double timeUs_ = 0.0;
+    double nextTimerTickUs_ = 1000.0;
+    bool isFastClock_ = false;
+    bool isSelected_ = false;
+    State state_ = State::idle;
+    bool isIdle_ = true;
+    bool isAppCommand_ = false;
+    bool isMultiBlockWrite_ = false;
+    int numAcmd41Received_ = 0;
+    uint32_t currentSector_ = 0;
+    std::vector<uint8_t> command_;
+    std::vector<uint8_t> writeBlock_;
+    std::deque<uint8_t> output_;
+
+    static inline SimulatedSdCard* installedCard_ = nullptr;
+};
@@ -24,10 +24,29 @@ public:
     {
         currentFolderPlayed_ = directoryPath;
         currentTrackPlayed_ = 0;
+        currentPositionMs_ = 0;
         if (startPlayingDirectoryFunc_)
             startPlayingDirectoryFunc_(directoryPath);
     }
 
+    std::function<void(const char*, const PlaybackPosition&)> resumePlayingDirectoryFunc_;
+    void resumePlayingDirectory(const char* directoryPath, const PlaybackPosition& position) override
+    {
+        currentFolderPlayed_ = directoryPath;
+        currentTrackPlayed_ = position.trackIndex;
+        currentPositionMs_ = position.positionMs;
+        if (resumePlayingDirectoryFunc_)
+            resumePlayingDirectoryFunc_(directoryPath, position);
+    }
+
+    PlaybackPosition getPlaybackPosition() const override
+    {
+        PlaybackPosition position;
+        position.trackIndex = uint16_t(currentTrackPlayed_);
+        position.positionMs = currentPositionMs_;
+        return position;
+    }
+
     std::function<bool(void)> isPlayingFunc_;
     bool isPlaying() const override
     {
@@ -63,6 +82,7 @@ public:
 
     std::string currentFolderPlayed_;
     int currentTrackPlayed_ = 0;
+    uint32_t currentPositionMs_ = 0;
 };
 
 // ==============================================================
@@ -518,12 +538,11 @@ TEST_F(Wunderkiste_Fixture, g_playback)
     uiEventQueue_.pushEvent({ UiEvent::Type::rfidTagAdded, { 0x11223344 } });
     app_->handleEvents();
     EXPECT_EQ(app_->getState(), Wunderkiste::State::playing);
-    // player starts playing the folder again
+    // player continues playing the folder where the tag was removed
     EXPECT_STREQ(player_.currentFolderPlayed_.data(), "My Folder");
     EXPECT_EQ(player_.currentTrackPlayed_, 0);
     EXPECT_TRUE(player_.isPlaying()); // just to be sure...
-    EXPECT_TRUE(playbackWasRestarted);
-    playbackWasRestarted = false; // reset
+    EXPECT_FALSE(playbackWasRestarted);
 
     // When the player has finished playing, the "stoppedWaitingForTagRemove"
     // state must be entered
@@ -545,4 +564,83 @@ TEST_F(Wunderkiste_Fixture, g_playback)
     uiEventQueue_.pushEvent({ UiEvent::Type::rfidTagRemoved, { 0 } });
     app_->handleEvents();
     EXPECT_EQ(app_->getState(), Wunderkiste::State::waitingForTag);
-}
\ No newline at end of file
+}
+
+TEST_F(Wunderkiste_Fixture, h_playback_resumeWhereTheTagWasRemoved)
+{
+    DummyLibraryFile::getTestEnv().fileContents_ = "11223344:My Folder";
+    DummyDirectoryIterator::getTestEnv().directoryEntries_ = {
+        { "My Folder",
+          DummyDirectoryIterator::Entry::Type::directory,
+          DummyDirectoryIterator::Entry::Hidden::no,
+          DummyDirectoryIterator::Entry::SystemFileOrDir::no,
+          DummyDirectoryIterator::Entry::Archived::no,
+          DummyDirectoryIterator::Entry::ReadOnly::no }
+    };
+    const auto& bookmarkFile = DummyLibraryFile::getTestEnv().otherFiles_["bookmarks.bin"];
+    int numResumes = 0;
+    PlaybackPosition resumedFrom;
+    player_.resumePlayingDirectoryFunc_ = [&](const char*, const PlaybackPosition& position) {
+        numResumes++;
+        resumedFrom = position;
+    };
+
+    app_ = std::make_unique<Wunderkiste>(uiEventQueue_, player_);
+    app_->handleEvents();
+    EXPECT_EQ(app_->getState(), Wunderkiste::State::waitingForTag);
+
+    // no bookmark yet: starts at the beginning
+    uiEventQueue_.pushEvent({ UiEvent::Type::rfidTagAdded, { 0x11223344 } });
+    app_->handleEvents();
+    EXPECT_EQ(app_->getState(), Wunderkiste::State::playing);
+    EXPECT_EQ(numResumes, 0);
+    uiEventQueue_.pushEvent({ UiEvent::Type::nextBttnPressed, { 0 } });
+    app_->handleEvents();
+    player_.currentPositionMs_ = 12345;
+
+    // removing the tag stores the position in the file
+    uiEventQueue_.pushEvent({ UiEvent::Type::rfidTagRemoved, { 0 } });
+    app_->handleEvents();
+    EXPECT_EQ(app_->getState(), Wunderkiste::State::waitingForTag);
+    EXPECT_EQ(bookmarkFile.size(), BookmarkStore::numSlots * BookmarkStore::recordSize);
+
+    // placing it again continues there, without reading the file
+    const int numOpenCallsBefore = DummyLibraryFile::getTestEnv().numOpenCalls_;
+    uiEventQueue_.pushEvent({ UiEvent::Type::rfidTagAdded, { 0x11223344 } });
+    app_->handleEvents();
+    EXPECT_EQ(app_->getState(), Wunderkiste::State::playing);
+    EXPECT_EQ(numResumes, 1);
+    EXPECT_EQ(resumedFrom.trackIndex, 1);
+    EXPECT_EQ(resumedFrom.positionMs, 12345u);
+    EXPECT_EQ(player_.currentTrackPlayed_, 1);
+    EXPECT_EQ(DummyLibraryFile::getTestEnv().numOpenCalls_, numOpenCallsBefore);
+
+    // the position is stored when the power is cut during playback
+    player_.currentPositionMs_ = 23456;
+    app_->aboutToShutdown();
+
+    // ... and is there after the next start
+    app_ = std::make_unique<Wunderkiste>(uiEventQueue_, player_);
+    app_->handleEvents();
+    uiEventQueue_.pushEvent({ UiEvent::Type::rfidTagAdded, { 0x11223344 } });
+    app_->handleEvents();
+    EXPECT_EQ(numResumes, 2);
+    EXPECT_EQ(resumedFrom.trackIndex, 1);
+    EXPECT_EQ(resumedFrom.positionMs, 23456u);
+
+    // when all files were played, the next playback starts at the beginning
+    player_.isPlayingFunc_ = []() { return false; };
+    app_->handleEvents();
+    EXPECT_EQ(app_->getState(), Wunderkiste::State::stoppedWaitingForTagRemove);
+    uiEventQueue_.pushEvent({ UiEvent::Type::rfidTagRemoved, { 0 } });
+    app_->handleEvents();
+    player_.isPlayingFunc_ = nullptr;
+
+    app_ = std::make_unique<Wunderkiste>(uiEventQueue_, player_);
+    app_->handleEvents();
+    uiEventQueue_.pushEvent({ UiEvent::Type::rfidTagAdded, { 0x11223344 } });
+    app_->handleEvents();
+    EXPECT_EQ(app_->getState(), Wunderkiste::State::playing);
+    EXPECT_EQ(numResumes, 2);
+    EXPECT_EQ(player_.currentTrackPlayed_, 0);
+}